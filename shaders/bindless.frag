@@ -0,0 +1,28 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+struct Material {
+    vec4 baseColor;
+    uint textureIndex;
+};
+
+layout(set = 1, binding = 0) readonly buffer Materials {
+    Material materials[];
+};
+layout(set = 1, binding = 1) uniform sampler2D textures[];
+
+layout(push_constant) uniform DrawConstants {
+    mat4 mvp;
+    uint materialIndex;
+} draw;
+
+void main()
+{
+    Material material = materials[draw.materialIndex];
+    outColor = texture(textures[nonuniformEXT(material.textureIndex)], fragTexCoord) * material.baseColor * vec4(fragColor, 1.0);
+}
@@ -0,0 +1,18 @@
+#version 450
+
+// Depth pre-pass, positions only. Computes gl_Position exactly like
+// shader.vert so the main pass can test for equality.
+
+layout(push_constant) uniform DrawConstants {
+    mat4 mvp;
+    uint materialIndex;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = draw.mvp * vec4(inPosition, 1.0);
+}
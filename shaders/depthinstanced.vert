@@ -0,0 +1,19 @@
+#version 450
+
+// Depth pre-pass of instanced.vert, positions and instance matrices only.
+
+layout(push_constant) uniform DrawConstants {
+    mat4 mvp;
+    uint materialIndex;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+
+layout(location = 3) in mat4 instanceModel;
+
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = draw.mvp * instanceModel * vec4(inPosition, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 450
+
+layout(push_constant) uniform DrawConstants {
+    mat4 mvp;
+    uint materialIndex;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inColor;
+layout(location = 2) in vec2 inTexCoord;
+
+// Per-instance attributes, the matrix takes locations 3 to 6.
+layout(location = 3) in mat4 instanceModel;
+layout(location = 7) in vec4 instanceTint;
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragTexCoord;
+
+// Must match the depth pre-pass bit for bit for its EQUAL depth test.
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = draw.mvp * instanceModel * vec4(inPosition, 1.0);
+    fragColor = inColor * instanceTint.rgb;
+    fragTexCoord = inTexCoord;
+}
@@ -9,5 +9,5 @@ layout(binding = 1) uniform sampler2D texSampler;
 
 void main()
 {
-    outColor = texture(texSampler, fragTexCoord);
+    outColor = texture(texSampler, fragTexCoord) * vec4(fragColor, 1.0);
 }
@@ -1,10 +1,9 @@
 #version 450
 
-layout(binding = 0) uniform UniformObjectBuffer {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
-} ubo;
+layout(push_constant) uniform DrawConstants {
+    mat4 mvp;
+    uint materialIndex;
+} draw;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
@@ -13,9 +12,12 @@ layout(location = 2) in vec2 inTexCoord;
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
+// Must match the depth pre-pass bit for bit for its EQUAL depth test.
+invariant gl_Position;
+
 void main()
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    gl_Position = draw.mvp * vec4(inPosition, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
 }
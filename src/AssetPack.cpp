@@ -0,0 +1,264 @@
+#include "AssetPack.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "GeometryCodec.hpp"
+
+static const uint32_t PACK_MAGIC     = 0x4B415041;    // "APAK"
+static const uint32_t PACK_VERSION   = 1;
+static const uint64_t BLOB_ALIGNMENT = 64;
+
+struct PackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t nameBytes;
+};
+
+// A stored size below the size marks a compressed entry.
+struct PackEntry
+{
+	uint64_t offset;
+	uint64_t storedSize;
+	uint64_t size;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+};
+
+static const AssetPack *mountedPack = nullptr;
+
+static std::string_view entryName(const std::string &path)
+{
+	std::string_view name(path);
+	while (name.compare(0, 2, "./") == 0)
+	{
+		name.remove_prefix(2);
+	}
+	return name;
+}
+
+static uint64_t alignBlob(uint64_t offset)
+{
+	return (offset + BLOB_ALIGNMENT - 1) & ~(BLOB_ALIGNMENT - 1);
+}
+
+void AssetPack::write(const std::string &path, const std::vector<Input> &inputs, ThreadPool &pool)
+{
+	std::vector<Input> sorted(inputs);
+	std::sort(sorted.begin(), sorted.end(), [](const Input &a, const Input &b) { return entryName(a.name) < entryName(b.name); });
+	for (size_t i = 1; i < sorted.size(); ++i)
+	{
+		if (entryName(sorted[i - 1].name) == entryName(sorted[i].name))
+		{
+			throw std::runtime_error("Asset \"" + sorted[i].name + "\" is packed twice");
+		}
+	}
+
+	std::vector<MappedFile> files(sorted.size());
+	for (size_t i = 0; i < sorted.size(); ++i)
+	{
+		files[i].open(sorted[i].path);
+	}
+
+	// Entries that shrink by less than an eighth are stored as they are,
+	// reading them in place beats expanding them.
+	std::vector<std::vector<uint8_t>> compressed(sorted.size());
+	pool.run(static_cast<uint32_t>(sorted.size()), [&](uint32_t i) {
+		std::vector<uint8_t> lz = GeometryCodec::compressLz(files[i].data(), files[i].size());
+		if (lz.size() < files[i].size() - files[i].size() / 8)
+		{
+			compressed[i] = std::move(lz);
+		}
+	});
+
+	PackHeader header{};
+	header.magic      = PACK_MAGIC;
+	header.version    = PACK_VERSION;
+	header.entryCount = static_cast<uint32_t>(sorted.size());
+
+	std::string            names;
+	std::vector<PackEntry> table(sorted.size());
+	for (size_t i = 0; i < sorted.size(); ++i)
+	{
+		std::string_view name = entryName(sorted[i].name);
+		table[i].nameOffset   = static_cast<uint32_t>(names.size());
+		table[i].nameLength   = static_cast<uint32_t>(name.size());
+		table[i].size         = files[i].size();
+		table[i].storedSize   = compressed[i].empty() ? files[i].size() : compressed[i].size();
+		names.append(name);
+	}
+	header.nameBytes = static_cast<uint32_t>(names.size());
+
+	uint64_t offset = sizeof(header) + table.size() * sizeof(PackEntry) + names.size();
+	for (PackEntry &entry : table)
+	{
+		entry.offset = alignBlob(offset);
+		offset       = entry.offset + entry.storedSize;
+	}
+
+	std::ofstream output(path, std::ios::binary);
+	if (!output.is_open())
+	{
+		throw std::runtime_error("Failed to open a file \"" + path + "\"");
+	}
+	output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	output.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof(PackEntry));
+	output.write(names.data(), names.size());
+	const char padding[BLOB_ALIGNMENT] = {};
+	uint64_t   written                 = sizeof(header) + table.size() * sizeof(PackEntry) + names.size();
+	for (size_t i = 0; i < table.size(); ++i)
+	{
+		output.write(padding, table[i].offset - written);
+		const uint8_t *data = compressed[i].empty() ? files[i].data() : compressed[i].data();
+		output.write(reinterpret_cast<const char *>(data), table[i].storedSize);
+		written = table[i].offset + table[i].storedSize;
+	}
+	output.close();
+	if (!output)
+	{
+		throw std::runtime_error("Failed to write a file \"" + path + "\"");
+	}
+}
+
+void AssetPack::open(const std::string &path, ThreadPool &pool)
+{
+	close();
+	file.open(path);
+
+	auto malformed = [&path]() { return std::runtime_error("\"" + path + "\" is not a valid asset pack"); };
+
+	PackHeader header;
+	if (file.size() < sizeof(header))
+	{
+		throw malformed();
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	uint64_t tableEnd = sizeof(header) + static_cast<uint64_t>(header.entryCount) * sizeof(PackEntry);
+	if (header.magic != PACK_MAGIC || header.version != PACK_VERSION || tableEnd + header.nameBytes > file.size())
+	{
+		throw malformed();
+	}
+
+	const char            *names = reinterpret_cast<const char *>(file.data() + tableEnd);
+	std::vector<PackEntry> table(header.entryCount);
+	memcpy(table.data(), file.data() + sizeof(header), table.size() * sizeof(PackEntry));
+	entries.resize(table.size());
+	for (size_t i = 0; i < table.size(); ++i)
+	{
+		const PackEntry &entry = table[i];
+		if (static_cast<uint64_t>(entry.nameOffset) + entry.nameLength > header.nameBytes || entry.storedSize > entry.size ||
+		    entry.offset > file.size() || entry.storedSize > file.size() - entry.offset)
+		{
+			throw malformed();
+		}
+		entries[i].name = std::string_view(names + entry.nameOffset, entry.nameLength);
+		entries[i].view = {file.data() + entry.offset, static_cast<size_t>(entry.storedSize)};
+		if (i > 0 && !(entries[i - 1].name < entries[i].name))
+		{
+			throw malformed();
+		}
+	}
+
+	// Largest first, so one big entry doesn't finish last on its own.
+	std::vector<uint32_t> compressed;
+	for (uint32_t i = 0; i < table.size(); ++i)
+	{
+		if (table[i].storedSize < table[i].size)
+		{
+			compressed.push_back(i);
+		}
+	}
+	std::sort(compressed.begin(), compressed.end(), [&table](uint32_t a, uint32_t b) { return table[a].size > table[b].size; });
+
+	auto              start = std::chrono::steady_clock::now();
+	std::atomic<bool> failed{false};
+	expanded.assign(entries.size(), {});
+	pool.run(static_cast<uint32_t>(compressed.size()), [&](uint32_t task) {
+		uint32_t i = compressed[task];
+		try
+		{
+			expanded[i].resize(table[i].size);
+			GeometryCodec::decompressLz(entries[i].view.data, entries[i].view.size, expanded[i].data(), expanded[i].size());
+		}
+		catch (const std::exception &)
+		{
+			failed = true;
+		}
+	});
+	if (failed)
+	{
+		throw malformed();
+	}
+	for (uint32_t i : compressed)
+	{
+		entries[i].view = {expanded[i].data(), expanded[i].size()};
+	}
+
+	packStats              = Stats{};
+	packStats.entries      = header.entryCount;
+	packStats.compressed   = static_cast<uint32_t>(compressed.size());
+	packStats.fileBytes    = file.size();
+	packStats.decompressMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	for (const PackEntry &entry : table)
+	{
+		packStats.bytes += entry.size;
+	}
+}
+
+void AssetPack::close()
+{
+	entries.clear();
+	expanded.clear();
+	file.close();
+	packStats = Stats{};
+}
+
+bool AssetPack::isOpen() const
+{
+	return file.isOpen();
+}
+
+bool AssetPack::find(const std::string &name, AssetView &view) const
+{
+	std::string_view key   = entryName(name);
+	auto             entry = std::lower_bound(entries.begin(), entries.end(), key,
+	                                          [](const Entry &entry, std::string_view key) { return entry.name < key; });
+	if (entry == entries.end() || entry->name != key)
+	{
+		return false;
+	}
+	view = entry->view;
+	return true;
+}
+
+AssetPack::Stats AssetPack::stats() const
+{
+	return packStats;
+}
+
+void mountAssetPack(const AssetPack *pack)
+{
+	mountedPack = pack;
+}
+
+bool findAsset(const std::string &path, AssetView &view)
+{
+	return mountedPack != nullptr && mountedPack->find(path, view);
+}
+
+void AssetStream::Buffer::reset(char *begin, size_t size)
+{
+	setg(begin, begin, begin + size);
+}
+
+AssetStream::AssetStream(AssetView view) : std::istream(&buffer)
+{
+	// The stream only reads, the cast is for the streambuf interface.
+	buffer.reset(reinterpret_cast<char *>(const_cast<uint8_t *>(view.data)), view.size);
+}
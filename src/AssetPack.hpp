@@ -0,0 +1,89 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+
+// Shaders, textures and models in a single file: a table of contents sorted
+// by name, followed by the entries, each starting on a 64-byte boundary and
+// LZ compressed when that saves more than an eighth. Opening a pack maps
+// it once and expands the compressed entries in parallel, after which
+// every entry is a view into the mapping or into its expanded copy.
+
+struct AssetView
+{
+	const uint8_t *data = nullptr;
+	size_t         size = 0;
+};
+
+class AssetPack
+{
+  public:
+	struct Input
+	{
+		std::string name;    // as the app asks for it, e.g. "shaders/shader.vert.spv"
+		std::string path;
+	};
+
+	// Files are compressed on the pool's threads.
+	static void write(const std::string &path, const std::vector<Input> &inputs, ThreadPool &pool);
+
+	void open(const std::string &path, ThreadPool &pool);
+	void close();
+	bool isOpen() const;
+
+	// Names are relative to the working directory, a leading "./" is ignored.
+	// Views stay valid until the pack is closed.
+	bool find(const std::string &name, AssetView &view) const;
+
+	struct Stats
+	{
+		uint32_t entries      = 0;
+		uint32_t compressed   = 0;
+		uint64_t fileBytes    = 0;
+		uint64_t bytes        = 0;    // all entries expanded
+		double   decompressMs = 0.0;
+	};
+	Stats stats() const;
+
+  private:
+	struct Entry
+	{
+		std::string_view name;
+		AssetView        view;
+	};
+
+	MappedFile                        file;
+	std::vector<Entry>                entries;     // sorted by name
+	std::vector<std::vector<uint8_t>> expanded;    // compressed entries, by entry
+	Stats                             packStats;
+};
+
+// While a pack is mounted, loaders look files up in it before going to the
+// file system. Mount before any loader threads start and unmount after they
+// have stopped, lookups themselves are thread safe.
+void mountAssetPack(const AssetPack *pack);
+bool findAsset(const std::string &path, AssetView &view);
+
+// An entry as a std::istream, for parsers that only read streams.
+class AssetStream : public std::istream
+{
+  public:
+	explicit AssetStream(AssetView view);
+
+  private:
+	struct Buffer : std::streambuf
+	{
+		void reset(char *begin, size_t size);
+	};
+	Buffer buffer;
+};
+
+#endif
@@ -0,0 +1,926 @@
+#include "VulkanApp.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <thread>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <stb/stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+
+// VmHWM can be reset through clear_refs on Linux, so each phase gets its
+// own peak. Elsewhere the peak is reported as unavailable.
+static void resetPeakRss()
+{
+#ifdef __linux__
+	std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+static long peakRssMiB()
+{
+#ifdef __linux__
+	std::ifstream status("/proc/self/status");
+	std::string   line;
+	while (std::getline(status, line))
+	{
+		if (line.compare(0, 6, "VmHWM:") == 0)
+		{
+			return std::stol(line.substr(6)) / 1024;
+		}
+	}
+#endif
+	return -1;
+}
+
+void VulkanApp::runBenchmark()
+{
+	if (benchmark == "mipgen")
+	{
+		benchmarkMipGeneration();
+	}
+	else if (benchmark == "upload")
+	{
+		benchmarkTextureUpload();
+	}
+	else if (benchmark == "descriptors")
+	{
+		benchmarkDescriptorAllocation();
+	}
+	else if (benchmark == "instancing")
+	{
+		benchmarkInstancing();
+	}
+	else if (benchmark == "culling")
+	{
+		benchmarkCulling();
+	}
+	else if (benchmark == "prepass")
+	{
+		benchmarkDepthPrepass();
+	}
+	else if (benchmark == "transforms")
+	{
+		benchmarkTransforms();
+	}
+	else if (benchmark == "gltf")
+	{
+		benchmarkModelLoading();
+	}
+	else if (benchmark == "codec")
+	{
+		benchmarkGeometryCodec();
+	}
+	else
+	{
+		throw std::runtime_error("Unknown benchmark \"" + benchmark + "\"");
+	}
+}
+
+void VulkanApp::benchmarkMipGeneration()
+{
+	const uint32_t ITERATIONS = 10;
+	const VkFormat format     = VK_FORMAT_R8G8B8A8_SRGB;
+
+	QueueFamiliyIndices indices = findQueueFamilies(physicalDevice, surface);
+	uint32_t            queueFamilyCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+	if (queueFamilies[indices.graphicsFamily.value()].timestampValidBits == 0)
+	{
+		throw std::runtime_error("Graphics queue doesn't support timestamps!");
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	VkQueryPoolCreateInfo queryPoolInfo{};
+	queryPoolInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 2;
+	UniqueQueryPool queryPool;
+	VkResult        result = vkCreateQueryPool(logicalDevice, &queryPoolInfo, nullptr, queryPool.put(logicalDevice));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	bool computeSupported = mipGenerator.supports(format);
+	bool blitSupported    = supportsLinearBlit(physicalDevice, format);
+
+	for (uint32_t size : {4096u, 8192u})
+	{
+		uint32_t levels = static_cast<uint32_t>(std::floor(std::log2(size))) + 1;
+
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		if (computeSupported)
+		{
+			usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+		}
+		UniqueImage        image;
+		UniqueDeviceMemory imageMemory;
+		createImage(size, size, levels, VK_SAMPLE_COUNT_1_BIT, physicalDevice, logicalDevice,
+		            *image.put(logicalDevice), *imageMemory.put(logicalDevice), format, VK_IMAGE_TILING_OPTIMAL,
+		            usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, computeSupported ? MipGenerator::imageCreateFlags() : 0);
+
+		// Noise keeps framebuffer compression from flattering either path.
+		{
+			VkDeviceSize       imageSize = static_cast<VkDeviceSize>(size) * size * 4;
+			UniqueBuffer       stagingBuffer;
+			UniqueDeviceMemory stagingBufferMemory;
+			createMemoryBuffer(logicalDevice, physicalDevice, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			                   *stagingBuffer.put(logicalDevice), *stagingBufferMemory.put(logicalDevice));
+
+			void *data;
+			vkMapMemory(logicalDevice, stagingBufferMemory, 0, imageSize, 0, &data);
+			uint32_t *texels = static_cast<uint32_t *>(data);
+			uint32_t  state  = 0x12345678u;
+			for (VkDeviceSize i = 0; i < imageSize / 4; ++i)
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				texels[i] = state | 0xff000000u;
+			}
+			vkUnmapMemory(logicalDevice, stagingBufferMemory);
+
+			transitionImageLayout(logicalDevice, commandPool, graphicsQueue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, image, format, levels);
+			copyBufferToImage(logicalDevice, commandPool, graphicsQueue, stagingBuffer, image, size, size);
+			transitionImageLayout(logicalDevice, commandPool, graphicsQueue, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, image, format, levels);
+		}
+
+		for (int method = 0; method < 2; ++method)
+		{
+			bool        compute = method == 1;
+			const char *name    = compute ? "compute" : "blit";
+			if (compute ? !computeSupported : !blitSupported)
+			{
+				std::cout << size << "x" << size << " " << name << ": not supported" << std::endl;
+				continue;
+			}
+
+			double totalMs = 0.0;
+			for (uint32_t i = 0; i <= ITERATIONS; ++i)
+			{
+				VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool, logicalDevice);
+				vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+
+				VkImageMemoryBarrier barrier{};
+				barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.image                           = image;
+				barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+				barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+				barrier.subresourceRange.baseMipLevel   = 0;
+				barrier.subresourceRange.levelCount     = levels;
+				barrier.subresourceRange.baseArrayLayer = 0;
+				barrier.subresourceRange.layerCount     = 1;
+				barrier.oldLayout                       = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				barrier.newLayout                       = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.srcAccessMask                   = VK_ACCESS_SHADER_READ_BIT;
+				barrier.dstAccessMask                   = VK_ACCESS_TRANSFER_WRITE_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 0);
+				if (compute)
+				{
+					mipGenerator.record(commandBuffer, image, format, {size, size}, levels);
+				}
+				else
+				{
+					recordBlitMipmaps(commandBuffer, image, static_cast<int32_t>(size), static_cast<int32_t>(size), levels);
+				}
+				vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+
+				endSingleTimeCommands(logicalDevice, commandPool, commandBuffer, graphicsQueue);
+
+				uint64_t timestamps[2];
+				vkGetQueryPoolResults(logicalDevice, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+				                      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+				// The first run only warms up caches and pipelines.
+				if (i > 0)
+				{
+					totalMs += static_cast<double>(timestamps[1] - timestamps[0]) * properties.limits.timestampPeriod * 1e-6;
+				}
+			}
+
+			uint32_t dispatches = compute ? MipGenerator::dispatchCount(levels) : levels - 1;
+			uint32_t barriers   = compute ? dispatches + 1 : 2 * (levels - 1) + 1;
+			std::cout << size << "x" << size << " " << std::setw(7) << name << ": " << std::fixed << std::setprecision(3)
+			          << totalMs / ITERATIONS << " ms, " << dispatches << (compute ? " dispatches, " : " blits, ")
+			          << barriers << " barriers" << std::endl;
+		}
+	}
+}
+
+void VulkanApp::benchmarkTextureUpload()
+{
+	const uint32_t SIZE   = 8192;
+	const uint32_t COUNT  = 4;
+	const VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+
+	// Generated once and kept in the temp directory, writing 8K PNGs is slow.
+	std::vector<std::string> paths;
+	for (uint32_t i = 0; i < COUNT; ++i)
+	{
+		std::string path = (std::filesystem::temp_directory_path() / ("upload_benchmark_" + std::to_string(i) + ".png")).string();
+		if (!std::ifstream(path).good())
+		{
+			std::cout << "Writing " << path << std::endl;
+			std::vector<uint8_t> pixels(static_cast<size_t>(SIZE) * SIZE * 4);
+			for (uint32_t y = 0; y < SIZE; ++y)
+			{
+				for (uint32_t x = 0; x < SIZE; ++x)
+				{
+					uint8_t *texel = &pixels[(static_cast<size_t>(y) * SIZE + x) * 4];
+					texel[0]       = static_cast<uint8_t>(x ^ y);
+					texel[1]       = static_cast<uint8_t>((x * y) >> 8);
+					texel[2]       = static_cast<uint8_t>(i * 64 + (y >> 7));
+					texel[3]       = 255;
+				}
+			}
+			stbi_write_png_compression_level = 1;
+			if (!stbi_write_png(path.c_str(), SIZE, SIZE, 4, pixels.data(), SIZE * 4))
+			{
+				throw std::runtime_error("Couldn't write \"" + path + "\"");
+			}
+		}
+		paths.push_back(path);
+	}
+
+	std::vector<UniqueImage>        images(COUNT);
+	std::vector<UniqueDeviceMemory> imageMemory(COUNT);
+
+	auto createTarget = [&](uint32_t index, uint32_t width, uint32_t height) {
+		createImage(width, height, 1, VK_SAMPLE_COUNT_1_BIT, physicalDevice, logicalDevice,
+		            *images[index].put(logicalDevice), *imageMemory[index].put(logicalDevice), format, VK_IMAGE_TILING_OPTIMAL,
+		            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		transitionImageLayout(logicalDevice, commandPool, graphicsQueue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, images[index], format, 1);
+	};
+	auto report = [&](const char *name, std::chrono::steady_clock::time_point start) {
+		double ms      = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		long   peakRss = peakRssMiB();
+		std::cout << COUNT << "x " << SIZE << "x" << SIZE << " " << std::setw(16) << name << ": " << std::fixed
+		          << std::setprecision(1) << ms << " ms, peak RSS ";
+		if (peakRss < 0)
+		{
+			std::cout << "n/a" << std::endl;
+		}
+		else
+		{
+			std::cout << peakRss << " MiB" << std::endl;
+		}
+	};
+
+	// Previous path: heap decode, then a fresh staging buffer and a copy per texture.
+	{
+		resetPeakRss();
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < COUNT; ++i)
+		{
+			int      width, height, channels;
+			stbi_uc *pixels = stbi_load(paths[i].c_str(), &width, &height, &channels, STBI_rgb_alpha);
+			if (pixels == nullptr)
+			{
+				throw std::runtime_error("Couldn't load \"" + paths[i] + "\"");
+			}
+
+			VkDeviceSize       imageSize = static_cast<VkDeviceSize>(width) * height * 4;
+			UniqueBuffer       stagingBuffer;
+			UniqueDeviceMemory stagingBufferMemory;
+			createMemoryBuffer(logicalDevice, physicalDevice, imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			                   *stagingBuffer.put(logicalDevice), *stagingBufferMemory.put(logicalDevice));
+
+			void *data;
+			vkMapMemory(logicalDevice, stagingBufferMemory, 0, imageSize, 0, &data);
+			memcpy(data, pixels, static_cast<size_t>(imageSize));
+			vkUnmapMemory(logicalDevice, stagingBufferMemory);
+			stbi_image_free(pixels);
+
+			createTarget(i, width, height);
+			copyBufferToImage(logicalDevice, commandPool, graphicsQueue, stagingBuffer, images[i], width, height);
+		}
+		report("heap + memcpy", start);
+	}
+
+	// Parallel decode into one persistently mapped staging buffer: straight
+	// into write-combined memory, through a heap scratch, and into cached
+	// memory where the device has some.
+	const std::pair<TextureLoader::StagingMode, const char *> modes[] = {
+	    {TextureLoader::StagingMode::Direct, "mapped, direct"},
+	    {TextureLoader::StagingMode::Scratch, "mapped, scratch"},
+	    {TextureLoader::StagingMode::Automatic, "mapped, cached"},
+	};
+	for (const auto &[mode, name] : modes)
+	{
+		for (uint32_t i = 0; i < COUNT; ++i)
+		{
+			images[i].reset();
+			imageMemory[i].reset();
+		}
+
+		resetPeakRss();
+		auto          start = std::chrono::steady_clock::now();
+		TextureLoader loader;
+		loader.create(logicalDevice, physicalDevice, mode);
+
+		std::vector<DecodedTexture> textures = loader.decode(paths);
+		for (uint32_t i = 0; i < COUNT; ++i)
+		{
+			createTarget(i, textures[i].width, textures[i].height);
+			copyBufferToImage(logicalDevice, commandPool, graphicsQueue, loader.stagingBuffer(), images[i], {TextureLoader::copyRegion(textures[i])});
+		}
+		if (mode == TextureLoader::StagingMode::Automatic && !loader.stagingCached())
+		{
+			std::cout << COUNT << "x " << SIZE << "x" << SIZE << " " << std::setw(16) << name << ": no cached memory, ran as scratch" << std::endl;
+		}
+		report(name, start);
+		loader.destroy();
+	}
+
+	if (!canHostCopy(format))
+	{
+		std::cout << COUNT << "x " << SIZE << "x" << SIZE << " " << std::setw(16) << "host copy" << ": not supported" << std::endl;
+	}
+	else
+	{
+		for (uint32_t i = 0; i < COUNT; ++i)
+		{
+			images[i].reset();
+			imageMemory[i].reset();
+		}
+
+		// Parallel decode to the heap, then written without staging or submissions.
+		resetPeakRss();
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<std::thread> threads;
+		for (uint32_t i = 0; i < COUNT; ++i)
+		{
+			threads.emplace_back([&, i]() {
+				uint32_t             width, height;
+				std::vector<uint8_t> pixels = TextureLoader::decodeToHost(paths[i], width, height);
+				createImage(width, height, 1, VK_SAMPLE_COUNT_1_BIT, physicalDevice, logicalDevice,
+				            *images[i].put(logicalDevice), *imageMemory[i].put(logicalDevice), format, VK_IMAGE_TILING_OPTIMAL,
+				            VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+				hostCopyToImage(images[i], width, height, {pixels.data()});
+			});
+		}
+		for (std::thread &thread : threads)
+		{
+			thread.join();
+		}
+		report("host copy", start);
+	}
+
+	for (uint32_t i = 0; i < COUNT; ++i)
+	{
+		images[i].reset();
+		imageMemory[i].reset();
+	}
+}
+
+void VulkanApp::benchmarkDescriptorAllocation()
+{
+	const uint32_t FRAMES         = 100;
+	const uint32_t SETS_PER_FRAME = 10000;
+
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = uniformBuffers[0];
+	bufferInfo.offset = 0;
+	bufferInfo.range  = sizeof(UniformBufferObject);
+
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.sampler     = textureSampler;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView   = currentTextureView();
+
+	auto report = [&](const char *name, std::chrono::steady_clock::time_point start) {
+		double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		std::cout << std::setw(22) << name << ": " << std::fixed << std::setprecision(1)
+		          << ns / (static_cast<double>(FRAMES) * SETS_PER_FRAME) << " ns per set" << std::endl;
+	};
+
+	// One pool with a free list, sets allocated, written and freed one by one.
+	{
+		std::array<VkDescriptorPoolSize, 2> poolSizes{};
+		poolSizes[0].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		poolSizes[0].descriptorCount = SETS_PER_FRAME;
+		poolSizes[1].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[1].descriptorCount = SETS_PER_FRAME;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags         = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+		poolInfo.maxSets       = SETS_PER_FRAME;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes    = poolSizes.data();
+		UniqueDescriptorPool pool;
+		VkResult             result = vkCreateDescriptorPool(logicalDevice, &poolInfo, nullptr, pool.put(logicalDevice));
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(result));
+		}
+
+		std::vector<VkDescriptorSet> sets(SETS_PER_FRAME);
+		auto                         start = std::chrono::steady_clock::now();
+		for (uint32_t frame = 0; frame < FRAMES; ++frame)
+		{
+			for (VkDescriptorSet &set : sets)
+			{
+				VkDescriptorSetAllocateInfo allocInfo{};
+				allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+				allocInfo.descriptorPool     = pool;
+				allocInfo.descriptorSetCount = 1;
+				allocInfo.pSetLayouts        = &descriptorSetLayout;
+				result                       = vkAllocateDescriptorSets(logicalDevice, &allocInfo, &set);
+				if (result != VK_SUCCESS)
+				{
+					throw std::runtime_error(err2msg(result));
+				}
+
+				std::array<VkWriteDescriptorSet, 2> writes{};
+				writes[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[0].dstSet          = set;
+				writes[0].dstBinding      = 0;
+				writes[0].descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+				writes[0].descriptorCount = 1;
+				writes[0].pBufferInfo     = &bufferInfo;
+				writes[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[1].dstSet          = set;
+				writes[1].dstBinding      = 1;
+				writes[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				writes[1].descriptorCount = 1;
+				writes[1].pImageInfo      = &imageInfo;
+				vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+			}
+			vkFreeDescriptorSets(logicalDevice, pool, SETS_PER_FRAME, sets.data());
+		}
+		report("free list", start);
+	}
+
+	// Linear allocation from per-frame pools, batched writes, bulk reset.
+	{
+		std::vector<VkDescriptorPoolSize> sizesPerSet(2);
+		sizesPerSet[0].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		sizesPerSet[0].descriptorCount = 1;
+		sizesPerSet[1].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		sizesPerSet[1].descriptorCount = 1;
+
+		DescriptorAllocator allocator;
+		allocator.create(logicalDevice, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT), sizesPerSet);
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t frame = 0; frame < FRAMES; ++frame)
+		{
+			allocator.beginFrame(frame % MAX_FRAMES_IN_FLIGHT);
+			for (uint32_t i = 0; i < SETS_PER_FRAME; ++i)
+			{
+				VkDescriptorSet set = allocator.allocate(descriptorSetLayout);
+				allocator.writeBuffer(set, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfo);
+				allocator.writeImage(set, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfo);
+			}
+			allocator.flush();
+		}
+		report("linear, bulk reset", start);
+		std::cout << "  " << allocator.poolCount() << " pools created" << std::endl;
+		allocator.destroy();
+	}
+}
+
+void VulkanApp::benchmarkInstancing()
+{
+	const uint32_t                FRAMES          = 50;
+	const uint32_t                MOVED_INSTANCES = 1000;
+	const std::array<uint32_t, 6> COUNTS          = {1, 10, 100, 1000, 10000, 100000};
+
+	// Only the first triangle of the mesh is drawn, so the vertex work of a
+	// hundred thousand full models does not hide the per-draw CPU cost.
+	std::vector<uint32_t> meshIndices   = indices;
+	std::vector<Submesh>  meshSubmeshes = submeshes;
+	indices.resize(3);
+	submeshes = {{0, 3, meshSubmeshes[0].material, meshSubmeshes[0].center}};
+
+	// With --gpu-culling the indirect path runs as an extra mode, its
+	// commands take the triangle from a mesh entry of its own, with
+	// --occlusion-culling in two phases. With --cpu-culling the CPU culled
+	// draws do.
+	bool                      culling      = useGpuCulling;
+	bool                      occlusion    = useOcclusionCulling;
+	bool                      cpuCulling   = useCpuCulling;
+	uint32_t                  triangleMesh = 0;
+	std::vector<const char *> modes        = {"instanced", "per draw"};
+	if (culling)
+	{
+		GpuCuller::Mesh mesh;
+		mesh.sphere     = glm::vec4(modelCenter, modelRadius);
+		mesh.indexCount = 3;
+		triangleMesh    = gpuCuller.addMesh(mesh);
+		modes.push_back("indirect");
+	}
+	if (cpuCulling)
+	{
+		modes.push_back("cpu culled");
+	}
+
+	auto milliseconds = [](std::chrono::steady_clock::duration duration) {
+		return std::chrono::duration<double, std::milli>(duration).count();
+	};
+
+	std::cout << std::setw(9) << "instances" << std::setw(11) << "mode" << std::setw(9) << "draws" << std::setw(13)
+	          << "record ms" << std::setw(12) << "frame ms" << std::endl;
+	for (uint32_t count : COUNTS)
+	{
+		populateInstances(count);
+		for (InstanceId id = 0; culling && id < count; ++id)
+		{
+			InstanceManager::Instance instance = instanceManager.get(id);
+			instance.mesh                      = triangleMesh;
+			instanceManager.update(id, instance);
+		}
+
+		for (uint32_t mode = 0; mode < modes.size(); ++mode)
+		{
+			drawInstancesSeparately = mode == 1;
+			useGpuCulling           = strcmp(modes[mode], "indirect") == 0;
+			useOcclusionCulling     = useGpuCulling && occlusion;
+			useCpuCulling           = strcmp(modes[mode], "cpu culled") == 0;
+
+			// The first frame uploads every instance.
+			drawFrame();
+			vkDeviceWaitIdle(logicalDevice);
+
+			std::chrono::steady_clock::duration recordTime{};
+			auto                                start = std::chrono::steady_clock::now();
+			for (uint32_t frame = 0; frame < FRAMES; ++frame)
+			{
+				drawFrame();
+				recordTime += lastRecordTime;
+			}
+			vkDeviceWaitIdle(logicalDevice);
+			auto frameTime = std::chrono::steady_clock::now() - start;
+
+			uint32_t draws = drawInstancesSeparately ? count : 1u;
+			if (useCpuCulling)
+			{
+				draws = 0;
+				for (size_t i = 0; i < visibleInstances.size(); ++i)
+				{
+					draws += i == 0 || visibleInstances[i] != visibleInstances[i - 1] + 1;
+				}
+			}
+			std::cout << std::setw(9) << count << std::setw(11) << modes[mode] << std::setw(9) << draws << std::fixed
+			          << std::setprecision(3) << std::setw(13) << milliseconds(recordTime) / FRAMES << std::setw(12)
+			          << milliseconds(frameTime) / FRAMES << std::endl;
+		}
+	}
+	drawInstancesSeparately = false;
+	useGpuCulling           = culling;
+	useOcclusionCulling     = occlusion;
+	useCpuCulling           = cpuCulling;
+
+	// Moving a few instances uploads those instances, not the whole buffer.
+	uint32_t count = COUNTS.back();
+	drawFrame();
+	vkDeviceWaitIdle(logicalDevice);
+
+	std::chrono::steady_clock::duration updateTime{};
+	VkDeviceSize                        uploaded = 0;
+	for (uint32_t frame = 0; frame < FRAMES; ++frame)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < MOVED_INSTANCES; ++i)
+		{
+			InstanceId                id       = (frame * MOVED_INSTANCES + i * 97) % count;
+			InstanceManager::Instance instance = instanceManager.get(id);
+			instance.model                     = glm::translate(instance.model, glm::vec3(0.0f, 0.0f, 0.001f));
+			instanceManager.update(id, instance);
+			// Nothing was removed, so ids are still the slots.
+			objectStore.setTransform(id, instance.model);
+		}
+		updateTime += std::chrono::steady_clock::now() - start;
+
+		drawFrame();
+		updateTime += lastRecordTime;
+		uploaded   += instanceManager.lastUploadBytes();
+	}
+	vkDeviceWaitIdle(logicalDevice);
+
+	std::cout << "moving " << MOVED_INSTANCES << " of " << count << ": " << std::fixed << std::setprecision(3)
+	          << milliseconds(updateTime) / FRAMES << " ms CPU per frame, " << uploaded / FRAMES / 1024 << " of "
+	          << static_cast<VkDeviceSize>(count) * sizeof(InstanceManager::Instance) / 1024 << " KiB uploaded" << std::endl;
+
+	indices   = std::move(meshIndices);
+	submeshes = std::move(meshSubmeshes);
+}
+
+void VulkanApp::benchmarkCulling()
+{
+	const uint32_t OBJECTS    = 1000000;
+	const uint32_t ITERATIONS = 20;
+
+	// Unit boxes scattered through a cube the camera looks into from its
+	// center, so the frustum keeps a fraction of them.
+	ObjectStore                           store;
+	std::mt19937                          random(42);
+	std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+	for (uint32_t i = 0; i < OBJECTS; ++i)
+	{
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(position(random), position(random), position(random)));
+		transform           = glm::scale(transform, glm::vec3(scale(random)));
+		store.add(transform, glm::vec3(-0.5f), glm::vec3(0.5f), 0);
+	}
+
+	glm::mat4                view       = glm::lookAt(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::mat4                projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 150.0f);
+	std::array<glm::vec4, 6> planes     = frustumPlanes(projection * view);
+
+	std::vector<ObjectStore::Kernel> kernels = {ObjectStore::Kernel::Scalar};
+	if (ObjectStore::bestKernel() != ObjectStore::Kernel::Scalar)
+	{
+		kernels.push_back(ObjectStore::Kernel::Sse2);
+	}
+	if (ObjectStore::bestKernel() == ObjectStore::Kernel::Avx2)
+	{
+		kernels.push_back(ObjectStore::Kernel::Avx2);
+	}
+
+	std::vector<uint32_t> threadCounts;
+	uint32_t              hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (uint32_t threads = 1; threads < hardwareThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(hardwareThreads);
+
+	std::cout << std::setw(8) << "kernel" << std::setw(9) << "threads" << std::setw(10) << "ms" << std::setw(14)
+	          << "Mobjects/s" << std::setw(10) << "visible" << std::endl;
+	std::vector<uint32_t> visible;
+	for (ObjectStore::Kernel kernel : kernels)
+	{
+		store.setKernel(kernel);
+		for (uint32_t threads : threadCounts)
+		{
+			ThreadPool pool;
+			pool.create(threads);
+
+			// The first cull sizes the result vectors.
+			store.cull(planes, pool, visible);
+			auto start = std::chrono::steady_clock::now();
+			for (uint32_t iteration = 0; iteration < ITERATIONS; ++iteration)
+			{
+				store.cull(planes, pool, visible);
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+			pool.destroy();
+
+			std::cout << std::setw(8) << ObjectStore::kernelName(kernel) << std::setw(9) << threads << std::fixed
+			          << std::setprecision(3) << std::setw(10) << seconds * 1000.0 << std::setprecision(1) << std::setw(14)
+			          << OBJECTS / seconds / 1e6 << std::setw(10) << visible.size() << std::endl;
+		}
+	}
+}
+
+void VulkanApp::benchmarkDepthPrepass()
+{
+	const uint32_t                FRAMES = 50;
+	const std::array<uint32_t, 5> COUNTS = {1, 4, 16, 64, 256};
+
+	auto milliseconds = [](std::chrono::steady_clock::duration duration) {
+		return std::chrono::duration<double, std::milli>(duration).count();
+	};
+
+	// The pre-pass pays off when the fragment work it saves on covered
+	// samples outweighs drawing every vertex twice, which depends on the
+	// overdraw and the sample count of the scene.
+	bool prepass = useDepthPrepass;
+	std::cout << "MSAA " << msaaSamples << "x, " << indices.size() / 3 << " triangles per instance" << std::endl;
+	std::cout << std::setw(9) << "instances" << std::setw(14) << "without ms" << std::setw(11) << "with ms" << std::setw(10)
+	          << "speedup" << std::endl;
+	for (uint32_t count : COUNTS)
+	{
+		populateInstances(count);
+
+		std::array<double, 2> frameMs{};
+		for (int mode = 0; mode < 2; ++mode)
+		{
+			setDepthPrepass(mode == 1);
+
+			// The first frame uploads every instance.
+			drawFrame();
+			vkDeviceWaitIdle(logicalDevice);
+
+			auto start = std::chrono::steady_clock::now();
+			for (uint32_t frame = 0; frame < FRAMES; ++frame)
+			{
+				drawFrame();
+			}
+			vkDeviceWaitIdle(logicalDevice);
+			frameMs[mode] = milliseconds(std::chrono::steady_clock::now() - start) / FRAMES;
+		}
+		std::cout << std::setw(9) << count << std::fixed << std::setprecision(3) << std::setw(14) << frameMs[0] << std::setw(11)
+		          << frameMs[1] << std::setw(9) << std::setprecision(2) << frameMs[0] / frameMs[1] << "x" << std::endl;
+	}
+	setDepthPrepass(prepass);
+	populateInstances(std::max(instanceCount, 1u));
+}
+
+void VulkanApp::benchmarkTransforms()
+{
+	const uint32_t ITERATIONS = 50;
+
+	// 10 roots with 10 children each, 10 grandchildren under those and 100
+	// leaves under every grandchild: 101110 nodes on four levels.
+	TransformHierarchy         hierarchy;
+	std::vector<TransformNode> roots, leaves;
+	std::mt19937               random(42);
+	auto                       local = [&random]() {
+		std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+		glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(offset(random), offset(random), offset(random)));
+		return glm::rotate(transform, offset(random), glm::vec3(0.0f, 0.0f, 1.0f));
+	};
+	for (uint32_t root = 0; root < 10; ++root)
+	{
+		roots.push_back(hierarchy.add(TransformHierarchy::NO_PARENT, local()));
+		for (uint32_t child = 0; child < 10; ++child)
+		{
+			TransformNode childNode = hierarchy.add(roots.back(), local());
+			for (uint32_t grandchild = 0; grandchild < 10; ++grandchild)
+			{
+				TransformNode grandchildNode = hierarchy.add(childNode, local());
+				for (uint32_t leaf = 0; leaf < 100; ++leaf)
+				{
+					leaves.push_back(hierarchy.add(grandchildNode, local()));
+				}
+			}
+		}
+	}
+
+	std::vector<uint32_t> threadCounts;
+	uint32_t              hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (uint32_t threads = 1; threads < hardwareThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(hardwareThreads);
+
+	// Moving the roots recomputes every node, moving 1% of the leaves only those.
+	std::cout << hierarchy.size() << " nodes on " << hierarchy.levelCount() << " levels" << std::endl;
+	std::cout << std::setw(10) << "changed" << std::setw(9) << "threads" << std::setw(10) << "ms" << std::setw(12)
+	          << "Mnodes/s" << std::setw(10) << "updated" << std::endl;
+	for (bool allNodes : {true, false})
+	{
+		for (uint32_t threads : threadCounts)
+		{
+			ThreadPool pool;
+			pool.create(threads);
+			hierarchy.update(pool);
+
+			std::chrono::steady_clock::duration updateTime{};
+			uint32_t                            updated = 0;
+			for (uint32_t iteration = 0; iteration < ITERATIONS; ++iteration)
+			{
+				if (allNodes)
+				{
+					for (TransformNode root : roots)
+					{
+						hierarchy.setLocal(root, hierarchy.local(root));
+					}
+				}
+				else
+				{
+					for (size_t i = iteration; i < leaves.size(); i += 100)
+					{
+						hierarchy.setLocal(leaves[i], hierarchy.local(leaves[i]));
+					}
+				}
+				auto start = std::chrono::steady_clock::now();
+				updated    = hierarchy.update(pool);
+				updateTime += std::chrono::steady_clock::now() - start;
+			}
+			pool.destroy();
+
+			double seconds = std::chrono::duration<double>(updateTime).count() / ITERATIONS;
+			std::cout << std::setw(10) << (allNodes ? "roots" : "1% leaves") << std::setw(9) << threads << std::fixed
+			          << std::setprecision(3) << std::setw(10) << seconds * 1000.0 << std::setprecision(1) << std::setw(12)
+			          << updated / seconds / 1e6 << std::setw(10) << updated << std::endl;
+		}
+	}
+}
+
+void VulkanApp::benchmarkModelLoading()
+{
+	const uint32_t RUNS = 5;
+
+	// The OBJ model is written out as a GLB with the same vertices, indices
+	// and submeshes, so both loaders build the same buffers. Files stay in
+	// the page cache after the first run, so this compares parsing, not I/O.
+	std::string                  glbPath        = (std::filesystem::temp_directory_path() / "model_benchmark.glb").string();
+	std::vector<Vertex>          savedVertices  = std::move(vertices);
+	std::vector<uint32_t>        savedIndices   = std::move(indices);
+	std::vector<Submesh>         savedSubmeshes = std::move(submeshes);
+	std::vector<ModelMaterial>   savedMaterials = std::move(modelMaterials);
+	std::vector<MaterialTexture> savedTextures  = std::move(materialTextures);
+
+	auto measure = [&](const char *name, const std::string &path, void (VulkanApp::*load)(const std::string &)) {
+		double best = std::numeric_limits<double>::max(), total = 0.0;
+		for (uint32_t run = 0; run < RUNS; ++run)
+		{
+			vertices.clear();
+			indices.clear();
+			submeshes.clear();
+			modelMaterials.clear();
+			materialTextures.clear();
+			modelFiles.clear();
+
+			auto start = std::chrono::steady_clock::now();
+			(this->*load)(path);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			best      = std::min(best, ms);
+			total += ms;
+		}
+		double fileMiB = static_cast<double>(std::filesystem::file_size(path)) / (1024.0 * 1024.0);
+		std::cout << name << ": " << std::fixed << std::setprecision(3) << best << " ms best, " << total / RUNS << " ms mean, "
+		          << std::setprecision(1) << fileMiB << " MiB file, " << vertices.size() << " vertices, " << indices.size() / 3
+		          << " triangles, " << submeshes.size() << " submeshes" << std::endl;
+		return best;
+	};
+
+	double objMs = measure("obj", MODEL_OBJ_FILEPATH, &VulkanApp::loadObjModel);
+	writeGlb(glbPath, vertices, indices, submeshes, modelMaterials);
+	double glbMs = measure("glb", glbPath, &VulkanApp::loadGltfModel);
+	std::cout << "glb loads " << std::setprecision(1) << objMs / glbMs << "x faster" << std::endl;
+
+	modelFiles.clear();
+	vertices         = std::move(savedVertices);
+	indices          = std::move(savedIndices);
+	submeshes        = std::move(savedSubmeshes);
+	modelMaterials   = std::move(savedMaterials);
+	materialTextures = std::move(savedTextures);
+}
+
+void VulkanApp::benchmarkGeometryCodec()
+{
+	const uint32_t RUNS = 10;
+
+	struct Stream
+	{
+		const char *name;
+		const void *data;
+		uint32_t    count;
+		uint32_t    stride;
+	};
+	const Stream streams[] = {
+	    {"vertices", vertices.data(), static_cast<uint32_t>(vertices.size()), sizeof(Vertex)},
+	    {"indices", indices.data(), static_cast<uint32_t>(indices.size()), sizeof(uint32_t)},
+	};
+	std::vector<GeometryCodec::Kernel> kernels = {GeometryCodec::Kernel::Scalar};
+	if (GeometryCodec::bestKernel() != GeometryCodec::Kernel::Scalar)
+	{
+		kernels.push_back(GeometryCodec::Kernel::Sse2);
+	}
+
+	std::cout << std::fixed;
+	for (const Stream &stream : streams)
+	{
+		size_t               rawBytes = static_cast<size_t>(stream.count) * stream.stride;
+		std::vector<uint8_t> decoded(rawBytes);
+		for (bool lz : {false, true})
+		{
+			auto                 start   = std::chrono::steady_clock::now();
+			std::vector<uint8_t> encoded = GeometryCodec::encode(stream.data, stream.count, stream.stride, lz);
+			double encodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			std::cout << stream.name << (lz ? " with lz" : "") << ": " << std::setprecision(2) << rawBytes / (1024.0 * 1024.0)
+			          << " MiB -> " << encoded.size() / (1024.0 * 1024.0) << " MiB, "
+			          << static_cast<double>(rawBytes) / encoded.size() << ":1, encoded in " << encodeMs << " ms" << std::endl;
+
+			for (GeometryCodec::Kernel kernel : kernels)
+			{
+				double best = std::numeric_limits<double>::max();
+				for (uint32_t run = 0; run < RUNS; ++run)
+				{
+					start = std::chrono::steady_clock::now();
+					GeometryCodec::decode(encoded.data(), encoded.size(), decoded.data(), kernel);
+					best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+				}
+				if (memcmp(decoded.data(), stream.data, rawBytes) != 0)
+				{
+					throw std::runtime_error(std::string("Geometry codec round trip failed for ") + stream.name);
+				}
+				std::cout << "  " << std::setw(6) << GeometryCodec::kernelName(kernel) << ": " << std::setprecision(3) << best
+				          << " ms, " << std::setprecision(2) << rawBytes / (best * 1e6) << " GB/s" << std::endl;
+			}
+		}
+	}
+}
@@ -0,0 +1,208 @@
+#include "BindlessTable.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+#include "VulkanUtils.hpp"
+
+void BindlessTable::create(VkDevice device, VkPhysicalDevice physicalDevice, ObjectCache &objectCache, uint32_t frameCount)
+{
+	this->device = device;
+
+	VkPhysicalDeviceDescriptorIndexingProperties indexingProperties{};
+	indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &indexingProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+	capacity = std::min({MAX_TEXTURES,
+	                     indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+	                     indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+	                     indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+	                     indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers});
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+	bindings[0].binding         = 0;
+	bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[1].binding         = 1;
+	bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[1].descriptorCount = capacity;
+	bindings[1].stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	std::array<VkDescriptorBindingFlags, 2> bindingFlags = {
+	    0,
+	    VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+	        VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT};
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+	flagsInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	flagsInfo.bindingCount  = static_cast<uint32_t>(bindingFlags.size());
+	flagsInfo.pBindingFlags = bindingFlags.data();
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext        = &flagsInfo;
+	layoutInfo.flags        = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings    = bindings.data();
+	setLayout               = objectCache.descriptorSetLayout(layoutInfo);
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = 1;
+	poolSizes[1].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = capacity;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	poolInfo.maxSets       = 1;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes    = poolSizes.data();
+	VkResult result        = vkCreateDescriptorPool(device, &poolInfo, nullptr, descriptorPool.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	VkDescriptorSetVariableDescriptorCountAllocateInfo countInfo{};
+	countInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+	countInfo.descriptorSetCount = 1;
+	countInfo.pDescriptorCounts  = &capacity;
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.pNext              = &countInfo;
+	allocInfo.descriptorPool     = descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts        = &setLayout;
+	result                       = vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	VkDeviceSize bufferSize = static_cast<VkDeviceSize>(frameCount) * MAX_MATERIALS * sizeof(Material);
+	createMemoryBuffer(device, physicalDevice, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                   *materialBuffer.put(device), *materialMemory.put(device));
+	void *data;
+	result = vkMapMemory(device, materialMemory, 0, VK_WHOLE_SIZE, 0, &data);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	mappedMaterials = static_cast<Material *>(data);
+
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = materialBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range  = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet write{};
+	write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet          = descriptorSet;
+	write.dstBinding      = 0;
+	write.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	write.descriptorCount = 1;
+	write.pBufferInfo     = &bufferInfo;
+	vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+}
+
+void BindlessTable::destroy()
+{
+	mappedMaterials = nullptr;
+	materialBuffer.reset();
+	materialMemory.reset();
+	descriptorPool.reset();
+	descriptorSet = VK_NULL_HANDLE;
+	setLayout     = VK_NULL_HANDLE;
+	materials.clear();
+	freeTextures.clear();
+	textureCount = 0;
+}
+
+uint32_t BindlessTable::addTexture(VkImageView view, VkSampler sampler)
+{
+	uint32_t index;
+	if (!freeTextures.empty())
+	{
+		index = freeTextures.back();
+		freeTextures.pop_back();
+	}
+	else if (textureCount < capacity)
+	{
+		index = textureCount++;
+	}
+	else
+	{
+		throw std::runtime_error("Bindless texture array is full");
+	}
+
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.sampler     = sampler;
+	imageInfo.imageView   = view;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write{};
+	write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet          = descriptorSet;
+	write.dstBinding      = 1;
+	write.dstArrayElement = index;
+	write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.descriptorCount = 1;
+	write.pImageInfo      = &imageInfo;
+	vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	return index;
+}
+
+void BindlessTable::releaseTexture(uint32_t index)
+{
+	freeTextures.push_back(index);
+}
+
+uint32_t BindlessTable::addMaterial(const Material &material)
+{
+	if (materials.size() == MAX_MATERIALS)
+	{
+		throw std::runtime_error("Bindless material table is full");
+	}
+	materials.push_back(material);
+	return static_cast<uint32_t>(materials.size() - 1);
+}
+
+void BindlessTable::setMaterial(uint32_t index, const Material &material)
+{
+	materials[index] = material;
+}
+
+BindlessTable::Material BindlessTable::material(uint32_t index) const
+{
+	return materials[index];
+}
+
+uint32_t BindlessTable::beginFrame(uint32_t frame)
+{
+	uint32_t first = frame * MAX_MATERIALS;
+	memcpy(mappedMaterials + first, materials.data(), materials.size() * sizeof(Material));
+	return first;
+}
+
+VkDescriptorSetLayout BindlessTable::layout() const
+{
+	return setLayout;
+}
+
+VkDescriptorSet BindlessTable::set() const
+{
+	return descriptorSet;
+}
+
+uint32_t BindlessTable::textureCapacity() const
+{
+	return capacity;
+}
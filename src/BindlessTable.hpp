@@ -0,0 +1,66 @@
+#ifndef BINDLESSTABLE_H
+#define BINDLESSTABLE_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ObjectCache.hpp"
+#include "VulkanHandles.hpp"
+
+// One descriptor set holding every material and texture, bound once per
+// frame. Binding 0 is a storage buffer of materials, binding 1 a partially
+// bound, update-after-bind array of combined image samplers whose size is
+// chosen at allocation. Draws select their material with a push constant.
+//
+// Material data is copied into a separate slice of the buffer for each frame
+// in flight, so edits never touch what a pending frame reads. Texture slots
+// are only written while unused; the caller retires a slot after the frames
+// that may still sample it have completed.
+class BindlessTable
+{
+  public:
+	struct Material
+	{
+		glm::vec4 baseColor    = glm::vec4(1.0f);
+		uint32_t  textureIndex = 0;
+		uint32_t  padding[3]   = {};
+	};
+
+	static constexpr uint32_t MAX_MATERIALS = 256;
+	static constexpr uint32_t MAX_TEXTURES  = 1024;
+
+	void create(VkDevice device, VkPhysicalDevice physicalDevice, ObjectCache &objectCache, uint32_t frameCount);
+	void destroy();
+
+	uint32_t addTexture(VkImageView view, VkSampler sampler);
+	void     releaseTexture(uint32_t index);
+
+	uint32_t addMaterial(const Material &material);
+	void     setMaterial(uint32_t index, const Material &material);
+	Material material(uint32_t index) const;
+
+	// Copies the materials into the frame's slice. Returns the index of the
+	// frame's first material, to be added to the pushed material index.
+	uint32_t beginFrame(uint32_t frame);
+
+	VkDescriptorSetLayout layout() const;
+	VkDescriptorSet       set() const;
+	uint32_t              textureCapacity() const;
+
+  private:
+	VkDevice              device        = VK_NULL_HANDLE;
+	VkDescriptorSetLayout setLayout     = VK_NULL_HANDLE;
+	VkDescriptorSet       descriptorSet = VK_NULL_HANDLE;
+	uint32_t              capacity      = 0;
+	UniqueDescriptorPool  descriptorPool;
+	UniqueBuffer          materialBuffer;
+	UniqueDeviceMemory    materialMemory;
+	Material             *mappedMaterials = nullptr;
+
+	std::vector<Material> materials;
+	std::vector<uint32_t> freeTextures;
+	uint32_t              textureCount = 0;
+};
+
+#endif
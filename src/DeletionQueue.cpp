@@ -0,0 +1,35 @@
+#include "DeletionQueue.hpp"
+
+void DeletionQueue::setFrame(uint64_t frameNumber)
+{
+	currentFrame = frameNumber;
+}
+
+void DeletionQueue::collect(uint64_t completedFrames)
+{
+	// Entries are queued in frame order, so stop at the first one still in use.
+	while (!entries.empty() && entries.front().frame < completedFrames)
+	{
+		entries.front().deleter();
+		entries.pop_front();
+	}
+}
+
+void DeletionQueue::flush()
+{
+	for (auto &entry : entries)
+	{
+		entry.deleter();
+	}
+	entries.clear();
+}
+
+void DeletionQueue::push(std::function<void()> &&deleter)
+{
+	entries.push_back({currentFrame, std::move(deleter)});
+}
+
+size_t DeletionQueue::size() const
+{
+	return entries.size();
+}
@@ -0,0 +1,43 @@
+#ifndef DELETIONQUEUE_H
+#define DELETIONQUEUE_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+#include "VulkanHandles.hpp"
+
+// Keeps released Vulkan objects alive until every frame that could still
+// reference them has retired on the GPU.
+class DeletionQueue
+{
+  public:
+	void setFrame(uint64_t frameNumber);
+	void collect(uint64_t completedFrames);
+	void flush();
+	void push(std::function<void()> &&deleter);
+	size_t size() const;
+
+	template <typename UniqueT>
+	void defer(UniqueT &&object)
+	{
+		VkDevice device = object.getDevice();
+		auto     handle = object.release();
+		if (handle != VK_NULL_HANDLE)
+		{
+			push([device, handle]() { UniqueT::destroy(device, handle); });
+		}
+	}
+
+  private:
+	struct Entry
+	{
+		uint64_t              frame;
+		std::function<void()> deleter;
+	};
+
+	std::deque<Entry> entries;
+	uint64_t          currentFrame = 0;
+};
+
+#endif
@@ -0,0 +1,254 @@
+#include "DepthPyramid.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "VulkanUtils.hpp"
+
+static void createComputePipeline(VkDevice device, VkPipelineLayout pipelineLayout, const std::string &shaderPath, UniquePipeline &pipeline)
+{
+	UniqueShaderModule shaderModule(device, createShaderModule(device, loadSpirv(shaderPath)));
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName  = "main";
+	pipelineInfo.layout       = pipelineLayout;
+	VkResult result           = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, pipeline.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+}
+
+void DepthPyramid::create(VkDevice device, VkPhysicalDevice physicalDevice, ObjectCache &objectCache, const std::string &shaderPath,
+                          const std::string &multisampleShaderPath)
+{
+	this->device         = device;
+	this->physicalDevice = physicalDevice;
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+	bindings[0].binding         = 0;
+	bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding         = 1;
+	bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings    = bindings.data();
+	descriptorSetLayout     = objectCache.descriptorSetLayout(layoutInfo);
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset     = 0;
+	pushConstantRange.size       = sizeof(PushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount         = 1;
+	pipelineLayoutInfo.pSetLayouts            = &descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges    = &pushConstantRange;
+	pipelineLayout                            = objectCache.pipelineLayout(pipelineLayoutInfo);
+
+	createComputePipeline(device, pipelineLayout, shaderPath, pipeline);
+	createComputePipeline(device, pipelineLayout, multisampleShaderPath, multisamplePipeline);
+
+	// Only texelFetch reads through it, the filter does not matter.
+	VkSamplerCreateInfo samplerInfo{};
+	samplerInfo.sType        = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter    = VK_FILTER_NEAREST;
+	samplerInfo.minFilter    = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod       = VK_LOD_CLAMP_NONE;
+	nearestSampler           = objectCache.sampler(samplerInfo);
+}
+
+void DepthPyramid::destroy()
+{
+	levelSets.clear();
+	descriptorPool.reset();
+	levelViews.clear();
+	allLevels.reset();
+	image.reset();
+	memory.reset();
+	multisamplePipeline.reset();
+	pipeline.reset();
+	levels              = 0;
+	nearestSampler      = VK_NULL_HANDLE;
+	pipelineLayout      = VK_NULL_HANDLE;
+	descriptorSetLayout = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::resize(VkImageView depthView, VkExtent2D depthExtent, VkSampleCountFlagBits samples)
+{
+	this->extent  = depthExtent;
+	this->samples = samples;
+
+	VkExtent2D levelExtent = {std::max((extent.width + 1) / 2, 1u), std::max((extent.height + 1) / 2, 1u)};
+	levels                 = 1;
+	for (uint32_t size = std::max(levelExtent.width, levelExtent.height); size > 1; size = (size + 1) / 2)
+	{
+		++levels;
+	}
+
+	levelSets.clear();
+	descriptorPool.reset();
+	levelViews.clear();
+	allLevels.reset();
+	createImage(static_cast<int32_t>(levelExtent.width), static_cast<int32_t>(levelExtent.height), static_cast<int32_t>(levels),
+	            VK_SAMPLE_COUNT_1_BIT, physicalDevice, device, *image.put(device), *memory.put(device), VK_FORMAT_R32_SFLOAT,
+	            VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	allLevels = UniqueImageView(device, createImageView(device, image, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, levels));
+
+	for (uint32_t level = 0; level < levels; ++level)
+	{
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image                           = image;
+		viewInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format                          = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel   = level;
+		viewInfo.subresourceRange.levelCount     = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount     = 1;
+		levelViews.emplace_back();
+		VkResult result = vkCreateImageView(device, &viewInfo, nullptr, levelViews.back().put(device));
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(result));
+		}
+	}
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = levels;
+	poolSizes[1].type            = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = levels;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets       = levels;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes    = poolSizes.data();
+	VkResult result        = vkCreateDescriptorPool(device, &poolInfo, nullptr, descriptorPool.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	std::vector<VkDescriptorSetLayout> setLayouts(levels, descriptorSetLayout);
+	VkDescriptorSetAllocateInfo        allocInfo{};
+	allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool     = descriptorPool;
+	allocInfo.descriptorSetCount = levels;
+	allocInfo.pSetLayouts        = setLayouts.data();
+	levelSets.resize(levels);
+	result = vkAllocateDescriptorSets(device, &allocInfo, levelSets.data());
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	for (uint32_t level = 0; level < levels; ++level)
+	{
+		VkDescriptorImageInfo srcInfo = level == 0 ? VkDescriptorImageInfo{nearestSampler, depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL}
+		                                           : VkDescriptorImageInfo{nearestSampler, levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL};
+		VkDescriptorImageInfo dstInfo = {VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL};
+
+		std::array<VkWriteDescriptorSet, 2> writes{};
+		writes[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet          = levelSets[level];
+		writes[0].dstBinding      = 0;
+		writes[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[0].descriptorCount = 1;
+		writes[0].pImageInfo      = &srcInfo;
+		writes[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[1].dstSet          = levelSets[level];
+		writes[1].dstBinding      = 1;
+		writes[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[1].descriptorCount = 1;
+		writes[1].pImageInfo      = &dstInfo;
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void DepthPyramid::record(VkCommandBuffer commandBuffer)
+{
+	// Every level is rewritten, so the previous contents are discarded. The
+	// last frame's occlusion test may still be reading them.
+	VkImageMemoryBarrier barrier{};
+	barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image                           = image;
+	barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel   = 0;
+	barrier.subresourceRange.levelCount     = levels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount     = 1;
+	barrier.oldLayout                       = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout                       = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcAccessMask                   = 0;
+	barrier.dstAccessMask                   = VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	VkMemoryBarrier memoryBarrier{};
+	memoryBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	VkExtent2D srcExtent = extent;
+	for (uint32_t level = 0; level < levels; ++level)
+	{
+		PushConstants constants{};
+		constants.srcWidth  = static_cast<int32_t>(srcExtent.width);
+		constants.srcHeight = static_cast<int32_t>(srcExtent.height);
+		constants.samples   = level == 0 ? static_cast<int32_t>(samples) : 1;
+
+		bool multisampled = level == 0 && samples != VK_SAMPLE_COUNT_1_BIT;
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, multisampled ? multisamplePipeline : pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &levelSets[level], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+		VkExtent2D dstExtent = {std::max((srcExtent.width + 1) / 2, 1u), std::max((srcExtent.height + 1) / 2, 1u)};
+		vkCmdDispatch(commandBuffer, (dstExtent.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+		              (dstExtent.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+		// Each level is the source of the next one and, after the last, of the occlusion test.
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		srcExtent = dstExtent;
+	}
+}
+
+VkImageView DepthPyramid::view() const
+{
+	return allLevels;
+}
+
+VkSampler DepthPyramid::sampler() const
+{
+	return nearestSampler;
+}
+
+VkExtent2D DepthPyramid::depthExtent() const
+{
+	return extent;
+}
+
+uint32_t DepthPyramid::levelCount() const
+{
+	return levels;
+}
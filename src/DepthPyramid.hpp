@@ -0,0 +1,66 @@
+#ifndef DEPTHPYRAMID_H
+#define DEPTHPYRAMID_H
+
+#include <string>
+#include <vector>
+
+#include "ObjectCache.hpp"
+#include "VulkanHandles.hpp"
+
+// Hierarchical depth for occlusion tests. Every texel holds the farthest
+// depth of the 2x2 texels below it, level 0 reducing the depth image (all
+// of its samples with MSAA), so a box whose screen rectangle spans at most
+// 2x2 texels of a level is hidden if its nearest depth lies behind all of
+// them. Levels are rounded up in size so every source texel is covered.
+class DepthPyramid
+{
+  public:
+	// Layouts and the sampler come from the cache and are not destroyed here.
+	void create(VkDevice device, VkPhysicalDevice physicalDevice, ObjectCache &objectCache, const std::string &shaderPath,
+	            const std::string &multisampleShaderPath);
+	void destroy();
+
+	// Rebuilds the pyramid for a new depth image, which needs
+	// VK_IMAGE_USAGE_SAMPLED_BIT. Nothing may still use the old pyramid.
+	void resize(VkImageView depthView, VkExtent2D depthExtent, VkSampleCountFlagBits samples);
+
+	// Expects the depth image in DEPTH_STENCIL_READ_ONLY_OPTIMAL with its
+	// writes visible to compute shaders. Leaves every level in GENERAL,
+	// readable by compute shaders.
+	void record(VkCommandBuffer commandBuffer);
+
+	VkImageView view() const;
+	VkSampler   sampler() const;
+	VkExtent2D  depthExtent() const;
+	uint32_t    levelCount() const;
+
+  private:
+	static constexpr uint32_t WORKGROUP_SIZE = 8;
+
+	struct PushConstants
+	{
+		int32_t srcWidth;
+		int32_t srcHeight;
+		int32_t samples;
+	};
+
+	VkDevice              device              = VK_NULL_HANDLE;
+	VkPhysicalDevice      physicalDevice      = VK_NULL_HANDLE;
+	VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout      pipelineLayout      = VK_NULL_HANDLE;
+	VkSampler             nearestSampler      = VK_NULL_HANDLE;
+	UniquePipeline        pipeline;
+	UniquePipeline        multisamplePipeline;    // reads level 0 from an MSAA depth image
+
+	VkExtent2D                   extent  = {0, 0};
+	VkSampleCountFlagBits        samples = VK_SAMPLE_COUNT_1_BIT;
+	uint32_t                     levels  = 0;
+	UniqueImage                  image;
+	UniqueDeviceMemory           memory;
+	UniqueImageView              allLevels;
+	std::vector<UniqueImageView> levelViews;
+	UniqueDescriptorPool         descriptorPool;
+	std::vector<VkDescriptorSet> levelSets;    // level i reads level i - 1, level 0 the depth
+};
+
+#endif
@@ -0,0 +1,145 @@
+#include "DescriptorAllocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "VulkanUtils.hpp"
+
+void DescriptorAllocator::create(VkDevice device, uint32_t frameCount, const std::vector<VkDescriptorPoolSize> &sizesPerSet)
+{
+	this->device      = device;
+	this->sizesPerSet = sizesPerSet;
+	nextPoolSets      = INITIAL_POOL_SETS;
+	createdPools      = 0;
+	framePools.clear();
+	framePools.resize(frameCount);
+	currentFrame = 0;
+}
+
+void DescriptorAllocator::destroy()
+{
+	writes.clear();
+	bufferInfos.clear();
+	imageInfos.clear();
+	framePools.clear();
+	freePools.clear();
+	createdPools = 0;
+}
+
+void DescriptorAllocator::beginFrame(uint32_t frame)
+{
+	flush();
+	currentFrame = frame;
+	for (UniqueDescriptorPool &pool : framePools[frame])
+	{
+		vkResetDescriptorPool(device, pool, 0);
+		freePools.push_back(std::move(pool));
+	}
+	framePools[frame].clear();
+}
+
+void DescriptorAllocator::nextPool()
+{
+	if (!freePools.empty())
+	{
+		framePools[currentFrame].push_back(std::move(freePools.back()));
+		freePools.pop_back();
+		return;
+	}
+
+	std::vector<VkDescriptorPoolSize> poolSizes = sizesPerSet;
+	for (VkDescriptorPoolSize &size : poolSizes)
+	{
+		size.descriptorCount *= nextPoolSets;
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets       = nextPoolSets;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes    = poolSizes.data();
+
+	UniqueDescriptorPool pool;
+	VkResult             result = vkCreateDescriptorPool(device, &poolInfo, nullptr, pool.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	framePools[currentFrame].push_back(std::move(pool));
+	createdPools++;
+	nextPoolSets = std::min(nextPoolSets * 2, MAX_POOL_SETS);
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+	std::vector<UniqueDescriptorPool> &pools = framePools[currentFrame];
+	if (pools.empty())
+	{
+		nextPool();
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool     = pools.back();
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts        = &layout;
+
+	VkDescriptorSet set;
+	VkResult        result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		// Only the first attempt on a fresh pool can fail for real.
+		nextPool();
+		allocInfo.descriptorPool = pools.back();
+		result                   = vkAllocateDescriptorSets(device, &allocInfo, &set);
+	}
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	return set;
+}
+
+void DescriptorAllocator::writeBuffer(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo &info)
+{
+	bufferInfos.push_back(info);
+
+	VkWriteDescriptorSet write{};
+	write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet          = set;
+	write.dstBinding      = binding;
+	write.descriptorType  = type;
+	write.descriptorCount = 1;
+	write.pBufferInfo     = &bufferInfos.back();
+	writes.push_back(write);
+}
+
+void DescriptorAllocator::writeImage(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo &info)
+{
+	imageInfos.push_back(info);
+
+	VkWriteDescriptorSet write{};
+	write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet          = set;
+	write.dstBinding      = binding;
+	write.descriptorType  = type;
+	write.descriptorCount = 1;
+	write.pImageInfo      = &imageInfos.back();
+	writes.push_back(write);
+}
+
+void DescriptorAllocator::flush()
+{
+	if (!writes.empty())
+	{
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+	writes.clear();
+	bufferInfos.clear();
+	imageInfos.clear();
+}
+
+size_t DescriptorAllocator::poolCount() const
+{
+	return createdPools;
+}
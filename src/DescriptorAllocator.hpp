@@ -0,0 +1,55 @@
+#ifndef DESCRIPTORALLOCATOR_H
+#define DESCRIPTORALLOCATOR_H
+
+#include <deque>
+#include <vector>
+
+#include "VulkanHandles.hpp"
+
+// Linear descriptor set allocation per frame in flight. Sets come from
+// pools created without VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
+// and are never freed one by one: when a frame comes around again, every
+// pool it used is reset with vkResetDescriptorPool and returned to a shared
+// free list. A full pool is replaced by a free one, or by a new pool twice
+// the size of the last.
+class DescriptorAllocator
+{
+  public:
+	// Pool sizes are given for a single set and scaled by the sets per pool.
+	void create(VkDevice device, uint32_t frameCount, const std::vector<VkDescriptorPoolSize> &sizesPerSet);
+	void destroy();
+
+	// Recycles the pools of the frame, whose last submission must have retired.
+	void beginFrame(uint32_t frame);
+
+	VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+	// Writes are queued and applied with a single vkUpdateDescriptorSets.
+	void writeBuffer(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo &info);
+	void writeImage(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorImageInfo &info);
+	void flush();
+
+	size_t poolCount() const;
+
+  private:
+	void nextPool();
+
+	static constexpr uint32_t INITIAL_POOL_SETS = 64;
+	static constexpr uint32_t MAX_POOL_SETS     = 4096;
+
+	VkDevice                          device = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPoolSize> sizesPerSet;
+	uint32_t                          nextPoolSets = INITIAL_POOL_SETS;
+	size_t                            createdPools = 0;
+
+	std::vector<std::vector<UniqueDescriptorPool>> framePools;    // last one is being allocated from
+	std::vector<UniqueDescriptorPool>              freePools;
+	uint32_t                                       currentFrame = 0;
+
+	// Deques keep the info pointers stable while writes are queued.
+	std::vector<VkWriteDescriptorSet>  writes;
+	std::deque<VkDescriptorBufferInfo> bufferInfos;
+	std::deque<VkDescriptorImageInfo>  imageInfos;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "Downsample.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+static float srgbToLinear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value)
+{
+	return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+std::vector<uint8_t> downsampleRgba8(const uint8_t *pixels, uint32_t width, uint32_t height, bool srgb)
+{
+	static const std::array<float, 256> toLinear = []() {
+		std::array<float, 256> table;
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			table[i] = srgbToLinear(i / 255.0f);
+		}
+		return table;
+	}();
+
+	uint32_t             nextWidth  = std::max(width / 2, 1u);
+	uint32_t             nextHeight = std::max(height / 2, 1u);
+	std::vector<uint8_t> next(static_cast<size_t>(nextWidth) * nextHeight * 4);
+
+	for (uint32_t y = 0; y < nextHeight; ++y)
+	{
+		for (uint32_t x = 0; x < nextWidth; ++x)
+		{
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				bool  linearize = srgb && c < 3;
+				float sum       = 0.0f;
+				for (uint32_t dy = 0; dy < 2; ++dy)
+				{
+					for (uint32_t dx = 0; dx < 2; ++dx)
+					{
+						uint32_t sx    = std::min(x * 2 + dx, width - 1);
+						uint32_t sy    = std::min(y * 2 + dy, height - 1);
+						uint8_t  value = pixels[(static_cast<size_t>(sy) * width + sx) * 4 + c];
+						sum += linearize ? toLinear[value] : value / 255.0f;
+					}
+				}
+				float average = sum / 4.0f;
+				if (linearize)
+				{
+					average = linearToSrgb(average);
+				}
+				next[(static_cast<size_t>(y) * nextWidth + x) * 4 + c] = static_cast<uint8_t>(std::lround(std::clamp(average, 0.0f, 1.0f) * 255.0f));
+			}
+		}
+	}
+	return next;
+}
@@ -0,0 +1,11 @@
+#ifndef DOWNSAMPLE_H
+#define DOWNSAMPLE_H
+
+#include <cstdint>
+#include <vector>
+
+// Next mip level of an RGBA8 image with a 2x2 box filter. Color is averaged
+// in linear space for sRGB images, alpha always linearly. Odd edges clamp.
+std::vector<uint8_t> downsampleRgba8(const uint8_t *pixels, uint32_t width, uint32_t height, bool srgb);
+
+#endif
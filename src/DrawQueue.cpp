@@ -0,0 +1,96 @@
+#include "DrawQueue.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+DrawQueue::Stats &DrawQueue::Stats::operator+=(const Stats &other)
+{
+	submitted += other.submitted;
+	draws += other.draws;
+	pipelineChanges += other.pipelineChanges;
+	materialChanges += other.materialChanges;
+	meshChanges += other.meshChanges;
+	return *this;
+}
+
+uint64_t DrawQueue::makeKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+	// Ids wider than their field wrap around, which only costs sort quality.
+	uint64_t depthBits = static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>((1u << DEPTH_BITS) - 1));
+	uint64_t key       = pipeline & ((1u << PIPELINE_BITS) - 1);
+	key                = (key << MATERIAL_BITS) | (material & ((1u << MATERIAL_BITS) - 1));
+	key                = (key << MESH_BITS) | (mesh & ((1u << MESH_BITS) - 1));
+	key                = (key << DEPTH_BITS) | depthBits;
+	return key;
+}
+
+void DrawQueue::clear()
+{
+	queue.clear();
+	lastStats = Stats{};
+}
+
+void DrawQueue::push(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth, uint32_t firstIndex, uint32_t indexCount,
+                     uint32_t firstInstance, uint32_t instanceCount)
+{
+	queue.push_back({makeKey(pipeline, material, mesh, depth), pipeline, material, mesh, firstIndex, indexCount, firstInstance,
+	                 instanceCount});
+}
+
+void DrawQueue::sort(bool merge)
+{
+	// Ties keep instance order, so runs of one mesh stay mergeable.
+	std::sort(queue.begin(), queue.end(), [](const Draw &a, const Draw &b) {
+		return a.key != b.key ? a.key < b.key : a.firstInstance < b.firstInstance;
+	});
+
+	Stats stats;
+	stats.submitted = static_cast<uint32_t>(queue.size());
+	if (merge && !queue.empty())
+	{
+		size_t last = 0;
+		for (size_t i = 1; i < queue.size(); ++i)
+		{
+			Draw       &into          = queue[last];
+			const Draw &next          = queue[i];
+			bool        sameState     = into.pipeline == next.pipeline && into.material == next.material;
+			bool        moreInstances = into.firstIndex == next.firstIndex && into.indexCount == next.indexCount &&
+			                            into.firstInstance + into.instanceCount == next.firstInstance;
+			bool        moreIndices   = into.firstInstance == next.firstInstance && into.instanceCount == next.instanceCount &&
+			                            into.firstIndex + into.indexCount == next.firstIndex;
+			if (sameState && moreInstances)
+			{
+				into.instanceCount += next.instanceCount;
+			}
+			else if (sameState && moreIndices)
+			{
+				into.indexCount += next.indexCount;
+			}
+			else
+			{
+				queue[++last] = next;
+			}
+		}
+		queue.resize(last + 1);
+	}
+
+	for (size_t i = 0; i < queue.size(); ++i)
+	{
+		const Draw *previous = i > 0 ? &queue[i - 1] : nullptr;
+		stats.pipelineChanges += !previous || previous->pipeline != queue[i].pipeline;
+		stats.materialChanges += !previous || previous->material != queue[i].material;
+		stats.meshChanges += !previous || previous->mesh != queue[i].mesh;
+	}
+	stats.draws = static_cast<uint32_t>(queue.size());
+	lastStats   = stats;
+}
+
+const std::vector<DrawQueue::Draw> &DrawQueue::draws() const
+{
+	return queue;
+}
+
+const DrawQueue::Stats &DrawQueue::stats() const
+{
+	return lastStats;
+}
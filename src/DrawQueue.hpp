@@ -0,0 +1,63 @@
+#ifndef DRAWQUEUE_H
+#define DRAWQUEUE_H
+
+#include <cstdint>
+#include <vector>
+
+// Draws of one pass sorted by a 64-bit key of pipeline, material, mesh and
+// depth, most significant first, so draws sharing state follow each other
+// and the draws of one mesh go front to back. Neighbours with equal state
+// are merged when their instances or their index ranges continue each
+// other. Pipelines, materials and meshes are the caller's ids.
+class DrawQueue
+{
+  public:
+	struct Draw
+	{
+		uint64_t key;
+		uint32_t pipeline;
+		uint32_t material;
+		uint32_t mesh;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t firstInstance;
+		uint32_t instanceCount;
+	};
+
+	// What the sorted draws cost in state changes, counting the first bind.
+	struct Stats
+	{
+		uint32_t submitted       = 0;
+		uint32_t draws           = 0;
+		uint32_t pipelineChanges = 0;
+		uint32_t materialChanges = 0;
+		uint32_t meshChanges     = 0;
+
+		Stats &operator+=(const Stats &other);
+	};
+
+	static constexpr uint32_t PIPELINE_BITS = 4;
+	static constexpr uint32_t MATERIAL_BITS = 16;
+	static constexpr uint32_t MESH_BITS     = 20;
+	static constexpr uint32_t DEPTH_BITS    = 24;
+
+	// Depth is normalized, 0 the nearest.
+	static uint64_t makeKey(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+	void clear();
+	void push(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth, uint32_t firstIndex, uint32_t indexCount,
+	          uint32_t firstInstance, uint32_t instanceCount);
+
+	// Sorts the draws, merges them unless asked not to and counts the state
+	// changes of the result.
+	void sort(bool merge = true);
+
+	const std::vector<Draw> &draws() const;
+	const Stats             &stats() const;
+
+  private:
+	std::vector<Draw> queue;
+	Stats             lastStats;
+};
+
+#endif
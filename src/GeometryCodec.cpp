@@ -0,0 +1,523 @@
+#include "GeometryCodec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GEOMETRYCODEC_X86
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+const uint32_t MAGIC      = 0x43454F47;    // "GEOC"
+const uint32_t FLAG_LZ    = 1;
+const uint32_t BLOCK_SIZE = 256;
+const uint32_t MAX_STRIDE = 256;
+
+struct Header
+{
+	uint32_t magic;
+	uint32_t count;
+	uint32_t stride;
+	uint32_t flags;
+	uint32_t planeBytes;    // plane data before the LZ stage
+};
+
+const uint8_t zeroPlane[BLOCK_SIZE] = {};
+
+uint32_t zigzag(uint32_t value)
+{
+	return (value << 1) ^ (0u - (value >> 31));
+}
+
+uint32_t unzigzag(uint32_t value)
+{
+	return (value >> 1) ^ (0u - (value & 1));
+}
+
+[[noreturn]] void malformed()
+{
+	throw std::runtime_error("Malformed geometry stream");
+}
+
+uint32_t read32(const uint8_t *bytes)
+{
+	uint32_t value;
+	memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+// Plane p of a block holds byte p of every element's differences, for
+// planes whose bit is set in the block's mask. The others are zero.
+struct Block
+{
+	uint32_t       first;
+	uint32_t       count;
+	const uint8_t *planes[MAX_STRIDE];
+};
+
+// Reads the mask and plane pointers of the block starting at cursor.
+const uint8_t *readBlock(const uint8_t *cursor, const uint8_t *end, uint32_t stride, Block &block)
+{
+	size_t maskBytes = (stride + 7) / 8;
+	if (static_cast<size_t>(end - cursor) < maskBytes)
+	{
+		malformed();
+	}
+	const uint8_t *mask = cursor;
+	cursor += maskBytes;
+	for (uint32_t plane = 0; plane < stride; ++plane)
+	{
+		if ((mask[plane / 8] >> (plane % 8)) & 1)
+		{
+			if (static_cast<size_t>(end - cursor) < block.count)
+			{
+				malformed();
+			}
+			block.planes[plane] = cursor;
+			cursor += block.count;
+		}
+		else
+		{
+			block.planes[plane] = zeroPlane;
+		}
+	}
+	return cursor;
+}
+
+void decodeScalar(const Block &block, uint32_t begin, uint32_t stride, uint32_t *previous, uint8_t *output)
+{
+	uint32_t words = stride / 4;
+	for (uint32_t i = begin; i < block.count; ++i)
+	{
+		uint8_t *element = output + static_cast<size_t>(block.first + i) * stride;
+		for (uint32_t word = 0; word < words; ++word)
+		{
+			const uint8_t *const *planes = &block.planes[word * 4];
+			uint32_t              delta  = planes[0][i] | planes[1][i] << 8 | planes[2][i] << 16 | static_cast<uint32_t>(planes[3][i]) << 24;
+			previous[word] += unzigzag(delta);
+			memcpy(element + word * 4, &previous[word], 4);
+		}
+	}
+}
+
+#ifdef GEOMETRYCODEC_X86
+__attribute__((target("sse2"))) __m128i unzigzagSse2(__m128i value)
+{
+	__m128i sign = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(value, _mm_set1_epi32(1)));
+	return _mm_xor_si128(_mm_srli_epi32(value, 1), sign);
+}
+
+// Four rounds of interleaving row i with row i + 8 transpose a 16x16 byte
+// matrix.
+__attribute__((target("sse2"))) void transpose16x16(__m128i rows[16])
+{
+	for (int round = 0; round < 4; ++round)
+	{
+		__m128i shuffled[16];
+		for (int i = 0; i < 8; ++i)
+		{
+			shuffled[2 * i]     = _mm_unpacklo_epi8(rows[i], rows[i + 8]);
+			shuffled[2 * i + 1] = _mm_unpackhi_epi8(rows[i], rows[i + 8]);
+		}
+		std::copy(shuffled, shuffled + 16, rows);
+	}
+}
+
+// Elements a multiple of 16 bytes long: the planes of four words give one
+// register per element after the transpose, and the running sums are one
+// vector add per element.
+__attribute__((target("sse2"))) uint32_t decodeWideSse2(const Block &block, uint32_t stride, uint32_t *previous, uint8_t *output)
+{
+	uint32_t groups = stride / 16;
+	__m128i  sums[MAX_STRIDE / 16];
+	for (uint32_t group = 0; group < groups; ++group)
+	{
+		sums[group] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(previous + group * 4));
+	}
+
+	// All groups of a run are done together, so every output line is
+	// written once.
+	uint32_t i = 0;
+	for (; i + 16 <= block.count; i += 16)
+	{
+		uint8_t *elements = output + static_cast<size_t>(block.first + i) * stride;
+		for (uint32_t group = 0; group < groups; ++group)
+		{
+			__m128i rows[16];
+			for (int plane = 0; plane < 16; ++plane)
+			{
+				rows[plane] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block.planes[group * 16 + plane] + i));
+			}
+			transpose16x16(rows);
+
+			__m128i sum = sums[group];
+			for (int row = 0; row < 16; ++row)
+			{
+				sum = _mm_add_epi32(sum, unzigzagSse2(rows[row]));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(elements + static_cast<size_t>(row) * stride + group * 16), sum);
+			}
+			sums[group] = sum;
+		}
+	}
+
+	for (uint32_t group = 0; group < groups; ++group)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(previous + group * 4), sums[group]);
+	}
+	return i;
+}
+
+// Running sum of the four lanes, plus the last sum before them.
+__attribute__((target("sse2"))) __m128i prefixSumSse2(__m128i value, __m128i carry)
+{
+	value = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+	value = _mm_add_epi32(value, _mm_slli_si128(value, 8));
+	return _mm_add_epi32(value, carry);
+}
+
+// 4-byte elements: sixteen elements are four registers of the four planes
+// interleaved, and the running sum is a prefix sum across lanes.
+__attribute__((target("sse2"))) uint32_t decodeNarrowSse2(const Block &block, uint32_t *previous, uint8_t *output)
+{
+	__m128i   carry  = _mm_set1_epi32(static_cast<int>(previous[0]));
+	uint32_t *target = reinterpret_cast<uint32_t *>(output) + block.first;
+	uint32_t  i      = 0;
+	for (; i + 16 <= block.count; i += 16)
+	{
+		__m128i byte0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block.planes[0] + i));
+		__m128i byte1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block.planes[1] + i));
+		__m128i byte2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block.planes[2] + i));
+		__m128i byte3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block.planes[3] + i));
+		__m128i low0  = _mm_unpacklo_epi8(byte0, byte1);
+		__m128i low1  = _mm_unpackhi_epi8(byte0, byte1);
+		__m128i high0 = _mm_unpacklo_epi8(byte2, byte3);
+		__m128i high1 = _mm_unpackhi_epi8(byte2, byte3);
+
+		__m128i values[4] = {_mm_unpacklo_epi16(low0, high0), _mm_unpackhi_epi16(low0, high0), _mm_unpacklo_epi16(low1, high1),
+		                     _mm_unpackhi_epi16(low1, high1)};
+		for (int part = 0; part < 4; ++part)
+		{
+			__m128i sum = prefixSumSse2(unzigzagSse2(values[part]), carry);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(target + i + part * 4), sum);
+			carry = _mm_shuffle_epi32(sum, 0xFF);
+		}
+	}
+	previous[0] = static_cast<uint32_t>(_mm_cvtsi128_si32(carry));
+	return i;
+}
+#endif
+}        // namespace
+
+GeometryCodec::Kernel GeometryCodec::bestKernel()
+{
+#ifdef GEOMETRYCODEC_X86
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return Kernel::Sse2;
+	}
+#endif
+	return Kernel::Scalar;
+}
+
+const char *GeometryCodec::kernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+		case Kernel::Sse2:
+			return "sse2";
+		default:
+			return "scalar";
+	}
+}
+
+std::vector<uint8_t> GeometryCodec::encode(const void *elements, uint32_t count, uint32_t stride, bool lz)
+{
+	if (stride == 0 || stride % 4 != 0 || stride > MAX_STRIDE)
+	{
+		throw std::runtime_error("Geometry elements have to be a multiple of 4 bytes, up to 256");
+	}
+
+	const uint8_t        *source    = static_cast<const uint8_t *>(elements);
+	uint32_t              words     = stride / 4;
+	size_t                maskBytes = (stride + 7) / 8;
+	std::vector<uint8_t>  planes;
+	std::vector<uint8_t>  block(static_cast<size_t>(BLOCK_SIZE) * stride);
+	std::vector<uint32_t> previous(words, 0);
+	planes.reserve(static_cast<size_t>(count) * stride / 2);
+
+	for (uint32_t first = 0; first < count; first += BLOCK_SIZE)
+	{
+		uint32_t blockCount = std::min(BLOCK_SIZE, count - first);
+		for (uint32_t i = 0; i < blockCount; ++i)
+		{
+			const uint8_t *element = source + static_cast<size_t>(first + i) * stride;
+			for (uint32_t word = 0; word < words; ++word)
+			{
+				uint32_t value = read32(element + word * 4);
+				uint32_t delta = zigzag(value - previous[word]);
+				previous[word] = value;
+				for (uint32_t byte = 0; byte < 4; ++byte)
+				{
+					block[static_cast<size_t>(word * 4 + byte) * BLOCK_SIZE + i] = static_cast<uint8_t>(delta >> (byte * 8));
+				}
+			}
+		}
+
+		size_t maskOffset = planes.size();
+		planes.resize(planes.size() + maskBytes, 0);
+		for (uint32_t plane = 0; plane < stride; ++plane)
+		{
+			const uint8_t *bytes = &block[static_cast<size_t>(plane) * BLOCK_SIZE];
+			if (std::any_of(bytes, bytes + blockCount, [](uint8_t byte) { return byte != 0; }))
+			{
+				planes[maskOffset + plane / 8] |= static_cast<uint8_t>(1u << (plane % 8));
+				planes.insert(planes.end(), bytes, bytes + blockCount);
+			}
+		}
+	}
+
+	Header header{MAGIC, count, stride, 0, static_cast<uint32_t>(planes.size())};
+	if (lz)
+	{
+		std::vector<uint8_t> compressed = compressLz(planes.data(), planes.size());
+		if (compressed.size() < planes.size())
+		{
+			header.flags |= FLAG_LZ;
+			planes = std::move(compressed);
+		}
+	}
+
+	std::vector<uint8_t> encoded(sizeof(header) + planes.size());
+	memcpy(encoded.data(), &header, sizeof(header));
+	std::copy(planes.begin(), planes.end(), encoded.begin() + sizeof(header));
+	return encoded;
+}
+
+void GeometryCodec::readHeader(const uint8_t *encoded, size_t size, uint32_t &count, uint32_t &stride)
+{
+	Header header;
+	if (size < sizeof(header))
+	{
+		malformed();
+	}
+	memcpy(&header, encoded, sizeof(header));
+	if (header.magic != MAGIC || header.stride == 0 || header.stride % 4 != 0 || header.stride > MAX_STRIDE)
+	{
+		malformed();
+	}
+	count  = header.count;
+	stride = header.stride;
+}
+
+void GeometryCodec::decode(const uint8_t *encoded, size_t size, void *output, Kernel kernel)
+{
+	uint32_t count, stride;
+	readHeader(encoded, size, count, stride);
+	Header header;
+	memcpy(&header, encoded, sizeof(header));
+
+	// LZ output goes to a scratch buffer the planes are then read from.
+	const uint8_t       *cursor = encoded + sizeof(header);
+	const uint8_t       *end    = encoded + size;
+	std::vector<uint8_t> scratch;
+	if (header.flags & FLAG_LZ)
+	{
+		scratch.resize(header.planeBytes);
+		decompressLz(cursor, static_cast<size_t>(end - cursor), scratch.data(), scratch.size());
+		cursor = scratch.data();
+		end    = scratch.data() + scratch.size();
+	}
+
+	uint8_t              *target = static_cast<uint8_t *>(output);
+	std::vector<uint32_t> previous(stride / 4, 0);
+	Block                 block;
+	for (uint32_t first = 0; first < count; first += BLOCK_SIZE)
+	{
+		block.first = first;
+		block.count = std::min(BLOCK_SIZE, count - first);
+		cursor      = readBlock(cursor, end, stride, block);
+
+		// Kernels decode whole runs of sixteen, the rest of a block is scalar.
+		uint32_t decoded = 0;
+#ifdef GEOMETRYCODEC_X86
+		if (kernel == Kernel::Sse2 && stride == 4)
+		{
+			decoded = decodeNarrowSse2(block, previous.data(), target);
+		}
+		else if (kernel == Kernel::Sse2 && stride % 16 == 0)
+		{
+			decoded = decodeWideSse2(block, stride, previous.data(), target);
+		}
+#endif
+		decodeScalar(block, decoded, stride, previous.data(), target);
+	}
+	if (cursor != end)
+	{
+		malformed();
+	}
+}
+
+// LZ4 style sequences: a token with the literal count in the high and the
+// match length minus 4 in the low nibble, each extended by bytes of 255
+// when 15, then the literals and a 16-bit offset back into the output.
+// The last sequence has literals only.
+namespace
+{
+const size_t   MIN_MATCH  = 4;
+const uint32_t HASH_BITS  = 16;
+const size_t   MAX_OFFSET = 65535;
+
+void writeLength(std::vector<uint8_t> &out, size_t length)
+{
+	for (; length >= 255; length -= 255)
+	{
+		out.push_back(255);
+	}
+	out.push_back(static_cast<uint8_t>(length));
+}
+
+void writeSequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+	size_t matchCode = matchLength >= MIN_MATCH ? matchLength - MIN_MATCH : 0;
+	out.push_back(static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4 | std::min<size_t>(matchCode, 15)));
+	if (literalCount >= 15)
+	{
+		writeLength(out, literalCount - 15);
+	}
+	out.insert(out.end(), literals, literals + literalCount);
+	if (matchLength >= MIN_MATCH)
+	{
+		out.push_back(static_cast<uint8_t>(offset));
+		out.push_back(static_cast<uint8_t>(offset >> 8));
+		if (matchCode >= 15)
+		{
+			writeLength(out, matchCode - 15);
+		}
+	}
+}
+
+size_t readLength(const uint8_t *&cursor, const uint8_t *end, size_t length)
+{
+	if (length < 15)
+	{
+		return length;
+	}
+	uint8_t byte;
+	do
+	{
+		if (cursor == end)
+		{
+			malformed();
+		}
+		byte = *cursor++;
+		length += byte;
+	} while (byte == 255);
+	return length;
+}
+}        // namespace
+
+std::vector<uint8_t> GeometryCodec::compressLz(const uint8_t *data, size_t size)
+{
+	std::vector<uint8_t>  out;
+	std::vector<uint32_t> table(size_t(1) << HASH_BITS, UINT32_MAX);
+	out.reserve(size / 2 + 16);
+
+	size_t anchor = 0;
+	size_t i      = 0;
+	while (size >= MIN_MATCH && i + MIN_MATCH <= size)
+	{
+		uint32_t sequence  = read32(data + i);
+		uint32_t hash      = (sequence * 2654435761u) >> (32 - HASH_BITS);
+		uint32_t candidate = table[hash];
+		table[hash]        = static_cast<uint32_t>(i);
+		if (candidate == UINT32_MAX || i - candidate > MAX_OFFSET || read32(data + candidate) != sequence)
+		{
+			++i;
+			continue;
+		}
+
+		size_t length = MIN_MATCH;
+		while (i + length < size && data[candidate + length] == data[i + length])
+		{
+			++length;
+		}
+		writeSequence(out, data + anchor, i - anchor, i - candidate, length);
+		i += length;
+		anchor = i;
+	}
+	writeSequence(out, data + anchor, size - anchor, 0, 0);
+	return out;
+}
+
+void GeometryCodec::decompressLz(const uint8_t *compressed, size_t size, uint8_t *output, size_t outputSize)
+{
+	const uint8_t *cursor  = compressed;
+	const uint8_t *end     = compressed + size;
+	size_t         written = 0;
+	while (cursor != end)
+	{
+		uint8_t token    = *cursor++;
+		size_t  literals = readLength(cursor, end, token >> 4);
+		if (static_cast<size_t>(end - cursor) < literals || outputSize - written < literals)
+		{
+			malformed();
+		}
+		// Short copies move 16 bytes when there is room, one load and store.
+		if (literals <= 16 && end - cursor >= 16 && outputSize - written >= 16)
+		{
+			memcpy(output + written, cursor, 16);
+		}
+		else
+		{
+			memcpy(output + written, cursor, literals);
+		}
+		cursor += literals;
+		written += literals;
+		if (cursor == end)
+		{
+			break;
+		}
+
+		if (end - cursor < 2)
+		{
+			malformed();
+		}
+		size_t offset = cursor[0] | static_cast<size_t>(cursor[1]) << 8;
+		cursor += 2;
+		size_t length = readLength(cursor, end, token & 15) + MIN_MATCH;
+		if (offset == 0 || offset > written || outputSize - written < length)
+		{
+			malformed();
+		}
+
+		// Matches may overlap their own output, which repeats a pattern.
+		// From 16 bytes back chunks of 16 never read what they write.
+		const uint8_t *match = output + written - offset;
+		if (offset >= 16 && outputSize - written >= length + 15)
+		{
+			for (size_t j = 0; j < length; j += 16)
+			{
+				memcpy(output + written + j, match + j, 16);
+			}
+		}
+		else if (offset >= length)
+		{
+			memcpy(output + written, match, length);
+		}
+		else
+		{
+			for (size_t j = 0; j < length; ++j)
+			{
+				output[written + j] = match[j];
+			}
+		}
+		written += length;
+	}
+	if (written != outputSize)
+	{
+		malformed();
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef GEOMETRYCODEC_H
+#define GEOMETRYCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless compression of vertex and index streams. Every 32-bit word of
+// an element is stored as the zigzagged difference to the same word of the
+// previous element, and the differences of each block of elements are
+// split into byte planes, so the zero high bytes of small differences
+// drop out as whole planes. An optional LZ stage compresses what is left.
+// Decoding transposes the planes back sixteen elements at a time with
+// SSE2 for 4-byte elements and elements a multiple of 16 bytes long.
+class GeometryCodec
+{
+  public:
+	enum class Kernel
+	{
+		Scalar,
+		Sse2
+	};
+
+	static Kernel      bestKernel();
+	static const char *kernelName(Kernel kernel);
+
+	// Element sizes have to be a multiple of 4 bytes, up to 256. The LZ
+	// stage is dropped again when it doesn't make the stream smaller.
+	static std::vector<uint8_t> encode(const void *elements, uint32_t count, uint32_t stride, bool lz);
+
+	// Element count and size of an encoded stream.
+	static void readHeader(const uint8_t *encoded, size_t size, uint32_t &count, uint32_t &stride);
+
+	// Writes count * stride bytes to output. Throws on malformed streams.
+	static void decode(const uint8_t *encoded, size_t size, void *output, Kernel kernel = bestKernel());
+
+	// The LZ stage on its own, byte oriented and without entropy coding.
+	static std::vector<uint8_t> compressLz(const uint8_t *data, size_t size);
+	static void                 decompressLz(const uint8_t *compressed, size_t size, uint8_t *output, size_t outputSize);
+};
+
+#endif
@@ -0,0 +1,1053 @@
+#include "Gltf.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <glm/gtc/quaternion.hpp>
+
+namespace
+{
+const uint32_t GLB_MAGIC      = 0x46546C67;    // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+const uint32_t GLB_CHUNK_BIN  = 0x004E4942;
+
+const uint32_t COMPONENT_BYTE           = 5120;
+const uint32_t COMPONENT_UNSIGNED_BYTE  = 5121;
+const uint32_t COMPONENT_SHORT          = 5122;
+const uint32_t COMPONENT_UNSIGNED_SHORT = 5123;
+const uint32_t COMPONENT_UNSIGNED_INT   = 5125;
+const uint32_t COMPONENT_FLOAT          = 5126;
+
+const uint32_t MODE_TRIANGLES = 4;
+
+// Enough JSON for a glTF header, values are kept as a small tree.
+struct Json
+{
+	enum class Type
+	{
+		Null,
+		Boolean,
+		Number,
+		String,
+		Array,
+		Object
+	};
+
+	Type                                      type    = Type::Null;
+	bool                                      boolean = false;
+	double                                    number  = 0.0;
+	std::string                               string;
+	std::vector<Json>                         items;
+	std::vector<std::pair<std::string, Json>> members;
+
+	const Json *find(const char *key) const
+	{
+		for (const auto &member : members)
+		{
+			if (member.first == key)
+			{
+				return &member.second;
+			}
+		}
+		return nullptr;
+	}
+
+	size_t size() const
+	{
+		return items.size();
+	}
+
+	const Json &operator[](size_t index) const
+	{
+		return items[index];
+	}
+
+	double numberOr(const char *key, double fallback) const
+	{
+		const Json *value = find(key);
+		return value != nullptr && value->type == Type::Number ? value->number : fallback;
+	}
+
+	int64_t indexOr(const char *key, int64_t fallback) const
+	{
+		return static_cast<int64_t>(numberOr(key, static_cast<double>(fallback)));
+	}
+};
+
+class JsonParser
+{
+  public:
+	JsonParser(const char *begin, const char *end, const std::string &filename) :
+	    current(begin), end(end), filename(filename)
+	{
+	}
+
+	Json parse()
+	{
+		Json value = parseValue(0);
+		skipSpace();
+		if (current != end && *current != '\0')
+		{
+			fail();
+		}
+		return value;
+	}
+
+  private:
+	static const int MAX_DEPTH = 64;
+
+	[[noreturn]] void fail()
+	{
+		throw std::runtime_error("\"" + filename + "\" has malformed JSON");
+	}
+
+	void skipSpace()
+	{
+		while (current != end && (*current == ' ' || *current == '\t' || *current == '\n' || *current == '\r'))
+		{
+			++current;
+		}
+	}
+
+	void expect(char c)
+	{
+		skipSpace();
+		if (current == end || *current != c)
+		{
+			fail();
+		}
+		++current;
+	}
+
+	bool consume(const char *word)
+	{
+		size_t length = strlen(word);
+		if (static_cast<size_t>(end - current) >= length && memcmp(current, word, length) == 0)
+		{
+			current += length;
+			return true;
+		}
+		return false;
+	}
+
+	bool consumeSeparator()
+	{
+		skipSpace();
+		if (current != end && *current == ',')
+		{
+			++current;
+			return true;
+		}
+		return false;
+	}
+
+	Json parseValue(int depth)
+	{
+		if (depth > MAX_DEPTH)
+		{
+			fail();
+		}
+		skipSpace();
+		if (current == end)
+		{
+			fail();
+		}
+
+		Json value;
+		if (*current == '{')
+		{
+			value.type = Json::Type::Object;
+			++current;
+			skipSpace();
+			if (current != end && *current == '}')
+			{
+				++current;
+				return value;
+			}
+			while (true)
+			{
+				skipSpace();
+				std::string key = parseString();
+				expect(':');
+				value.members.emplace_back(std::move(key), parseValue(depth + 1));
+				if (!consumeSeparator())
+				{
+					break;
+				}
+			}
+			expect('}');
+		}
+		else if (*current == '[')
+		{
+			value.type = Json::Type::Array;
+			++current;
+			skipSpace();
+			if (current != end && *current == ']')
+			{
+				++current;
+				return value;
+			}
+			while (true)
+			{
+				value.items.push_back(parseValue(depth + 1));
+				if (!consumeSeparator())
+				{
+					break;
+				}
+			}
+			expect(']');
+		}
+		else if (*current == '"')
+		{
+			value.type   = Json::Type::String;
+			value.string = parseString();
+		}
+		else if (consume("true"))
+		{
+			value.type    = Json::Type::Boolean;
+			value.boolean = true;
+		}
+		else if (consume("false"))
+		{
+			value.type = Json::Type::Boolean;
+		}
+		else if (consume("null"))
+		{
+			value.type = Json::Type::Null;
+		}
+		else
+		{
+			value.type   = Json::Type::Number;
+			value.number = parseNumber();
+		}
+		return value;
+	}
+
+	std::string parseString()
+	{
+		if (current == end || *current != '"')
+		{
+			fail();
+		}
+		++current;
+
+		std::string result;
+		while (current != end && *current != '"')
+		{
+			char c = *current++;
+			if (c != '\\')
+			{
+				result += c;
+				continue;
+			}
+			if (current == end)
+			{
+				fail();
+			}
+			char escaped = *current++;
+			switch (escaped)
+			{
+				case '"':
+				case '\\':
+				case '/':
+					result += escaped;
+					break;
+				case 'b':
+					result += '\b';
+					break;
+				case 'f':
+					result += '\f';
+					break;
+				case 'n':
+					result += '\n';
+					break;
+				case 'r':
+					result += '\r';
+					break;
+				case 't':
+					result += '\t';
+					break;
+				case 'u':
+					appendUtf8(result, parseHex4());
+					break;
+				default:
+					fail();
+			}
+		}
+		if (current == end)
+		{
+			fail();
+		}
+		++current;
+		return result;
+	}
+
+	uint32_t parseHex4()
+	{
+		if (end - current < 4)
+		{
+			fail();
+		}
+		uint32_t code = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			char c = *current++;
+			code <<= 4;
+			if (c >= '0' && c <= '9')
+			{
+				code |= c - '0';
+			}
+			else if (c >= 'a' && c <= 'f')
+			{
+				code |= c - 'a' + 10;
+			}
+			else if (c >= 'A' && c <= 'F')
+			{
+				code |= c - 'A' + 10;
+			}
+			else
+			{
+				fail();
+			}
+		}
+		return code;
+	}
+
+	// Lone surrogates are kept as they are, names are only compared.
+	static void appendUtf8(std::string &out, uint32_t code)
+	{
+		if (code < 0x80)
+		{
+			out += static_cast<char>(code);
+		}
+		else if (code < 0x800)
+		{
+			out += static_cast<char>(0xC0 | (code >> 6));
+			out += static_cast<char>(0x80 | (code & 0x3F));
+		}
+		else
+		{
+			out += static_cast<char>(0xE0 | (code >> 12));
+			out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (code & 0x3F));
+		}
+	}
+
+	double parseNumber()
+	{
+		// The chunk is not null terminated, so the token is copied for strtod.
+		char   token[64];
+		size_t length = 0;
+		while (current != end && length + 1 < sizeof(token) && strchr("+-0123456789.eE", *current) != nullptr && *current != '\0')
+		{
+			token[length++] = *current++;
+		}
+		token[length] = '\0';
+
+		char  *parsed = nullptr;
+		double number = strtod(token, &parsed);
+		if (length == 0 || parsed != token + length)
+		{
+			fail();
+		}
+		return number;
+	}
+
+	const char        *current;
+	const char        *end;
+	const std::string &filename;
+};
+
+struct Buffer
+{
+	const uint8_t *data = nullptr;
+	size_t         size = 0;
+};
+
+struct Accessor
+{
+	const uint8_t *data          = nullptr;
+	size_t         count         = 0;
+	size_t         stride        = 0;
+	uint32_t       componentType = 0;
+	uint32_t       components    = 0;
+};
+
+uint32_t componentSize(uint32_t componentType)
+{
+	switch (componentType)
+	{
+		case COMPONENT_BYTE:
+		case COMPONENT_UNSIGNED_BYTE:
+			return 1;
+		case COMPONENT_SHORT:
+		case COMPONENT_UNSIGNED_SHORT:
+			return 2;
+		case COMPONENT_UNSIGNED_INT:
+		case COMPONENT_FLOAT:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+uint32_t componentCount(const std::string &type)
+{
+	if (type == "SCALAR")
+	{
+		return 1;
+	}
+	if (type == "VEC2")
+	{
+		return 2;
+	}
+	if (type == "VEC3")
+	{
+		return 3;
+	}
+	if (type == "VEC4" || type == "MAT2")
+	{
+		return 4;
+	}
+	if (type == "MAT3")
+	{
+		return 9;
+	}
+	if (type == "MAT4")
+	{
+		return 16;
+	}
+	return 0;
+}
+
+// Everything the loader needs from one file, the arrays of the document
+// checked once so lookups can't run past them.
+class Document
+{
+  public:
+	Document(const std::string &filename, Json root, std::vector<Buffer> buffers) :
+	    filename(filename), root(std::move(root)), buffers(std::move(buffers))
+	{
+	}
+
+	[[noreturn]] void fail(const std::string &what) const
+	{
+		throw std::runtime_error("\"" + filename + "\" " + what);
+	}
+
+	const Json &array(const char *name) const
+	{
+		static const Json empty;
+		const Json       *value = root.find(name);
+		if (value == nullptr)
+		{
+			return empty;
+		}
+		if (value->type != Json::Type::Array)
+		{
+			fail(std::string("has a malformed ") + name + " array");
+		}
+		return *value;
+	}
+
+	const Json &element(const char *name, int64_t index) const
+	{
+		const Json &values = array(name);
+		if (index < 0 || static_cast<size_t>(index) >= values.size() || values[index].type != Json::Type::Object)
+		{
+			fail(std::string("refers to a missing ") + name + " entry");
+		}
+		return values[index];
+	}
+
+	// Bytes of a buffer view, checked against its buffer.
+	Buffer view(int64_t index) const
+	{
+		const Json &view   = element("bufferViews", index);
+		int64_t     buffer = view.indexOr("buffer", -1);
+		if (buffer < 0 || static_cast<size_t>(buffer) >= buffers.size())
+		{
+			fail("refers to a missing buffer");
+		}
+		double offset = view.numberOr("byteOffset", 0);
+		double length = view.numberOr("byteLength", -1);
+		if (offset < 0 || length < 0 || offset + length > static_cast<double>(buffers[buffer].size))
+		{
+			fail("has a buffer view outside its buffer");
+		}
+		return {buffers[buffer].data + static_cast<size_t>(offset), static_cast<size_t>(length)};
+	}
+
+	Accessor accessor(int64_t index) const
+	{
+		const Json &json = element("accessors", index);
+		if (json.find("sparse") != nullptr)
+		{
+			fail("uses sparse accessors");
+		}
+
+		const Json *type = json.find("type");
+		Accessor    accessor;
+		accessor.count         = static_cast<size_t>(std::max(0.0, json.numberOr("count", 0)));
+		accessor.componentType = static_cast<uint32_t>(json.indexOr("componentType", 0));
+		accessor.components    = type != nullptr ? componentCount(type->string) : 0;
+		size_t elementSize     = static_cast<size_t>(componentSize(accessor.componentType)) * accessor.components;
+		if (elementSize == 0)
+		{
+			fail("has an accessor of unknown type");
+		}
+		if (accessor.count == 0)
+		{
+			return accessor;
+		}
+
+		// Accessors without a view are all zeros, which nothing drawable is.
+		if (json.find("bufferView") == nullptr)
+		{
+			fail("has an accessor without data");
+		}
+		Buffer bytes     = view(json.indexOr("bufferView", -1));
+		double stride    = element("bufferViews", json.indexOr("bufferView", -1)).numberOr("byteStride", 0);
+		double offset    = json.numberOr("byteOffset", 0);
+		accessor.stride  = stride > 0 ? static_cast<size_t>(stride) : elementSize;
+		double lastEnd   = offset + static_cast<double>(accessor.count - 1) * accessor.stride + elementSize;
+		if (offset < 0 || accessor.stride < elementSize || lastEnd > static_cast<double>(bytes.size))
+		{
+			fail("has an accessor outside its buffer view");
+		}
+		accessor.data = bytes.data + static_cast<size_t>(offset);
+		return accessor;
+	}
+
+	const std::string   filename;
+	const Json          root;
+	std::vector<Buffer> buffers;
+};
+
+glm::mat4 nodeMatrix(const Json &node)
+{
+	const Json *matrix = node.find("matrix");
+	if (matrix != nullptr && matrix->size() == 16)
+	{
+		glm::mat4 result;
+		for (int i = 0; i < 16; ++i)
+		{
+			result[i / 4][i % 4] = static_cast<float>((*matrix)[i].number);
+		}
+		return result;
+	}
+
+	glm::vec3   translation(0.0f);
+	glm::quat   rotation(1.0f, 0.0f, 0.0f, 0.0f);
+	glm::vec3   scale(1.0f);
+	const Json *value = node.find("translation");
+	if (value != nullptr && value->size() == 3)
+	{
+		translation = glm::vec3((*value)[0].number, (*value)[1].number, (*value)[2].number);
+	}
+	value = node.find("rotation");
+	if (value != nullptr && value->size() == 4)
+	{
+		rotation = glm::quat(static_cast<float>((*value)[3].number), static_cast<float>((*value)[0].number),
+		                     static_cast<float>((*value)[1].number), static_cast<float>((*value)[2].number));
+	}
+	value = node.find("scale");
+	if (value != nullptr && value->size() == 3)
+	{
+		scale = glm::vec3((*value)[0].number, (*value)[1].number, (*value)[2].number);
+	}
+
+	glm::mat4 result = glm::mat4_cast(rotation);
+	result[0] *= scale.x;
+	result[1] *= scale.y;
+	result[2] *= scale.z;
+	result[3] = glm::vec4(translation, 1.0f);
+	return result;
+}
+
+struct MeshInstance
+{
+	int64_t   mesh;
+	glm::mat4 world;
+};
+
+// Meshes of the default scene with their world matrices, or every mesh
+// once when the file has no scene.
+std::vector<MeshInstance> meshInstances(const Document &document)
+{
+	std::vector<MeshInstance> instances;
+	const Json               &scenes = document.array("scenes");
+	if (scenes.size() == 0)
+	{
+		for (size_t mesh = 0; mesh < document.array("meshes").size(); ++mesh)
+		{
+			instances.push_back({static_cast<int64_t>(mesh), glm::mat4(1.0f)});
+		}
+		return instances;
+	}
+
+	const Json &scene = document.element("scenes", document.root.indexOr("scene", 0));
+	const Json *roots = scene.find("nodes");
+
+	struct Entry
+	{
+		int64_t   node;
+		glm::mat4 parent;
+		size_t    depth;
+	};
+	std::vector<Entry> stack;
+	for (size_t i = 0; roots != nullptr && i < roots->size(); ++i)
+	{
+		stack.push_back({static_cast<int64_t>((*roots)[i].number), glm::mat4(1.0f), 0});
+	}
+
+	// Nodes form a forest, deeper chains than nodes mean a cycle.
+	size_t nodeCount = document.array("nodes").size();
+	while (!stack.empty())
+	{
+		Entry entry = stack.back();
+		stack.pop_back();
+		if (entry.depth > nodeCount)
+		{
+			document.fail("has a cycle in its node hierarchy");
+		}
+
+		const Json &node  = document.element("nodes", entry.node);
+		glm::mat4   world = entry.parent * nodeMatrix(node);
+		if (node.find("mesh") != nullptr)
+		{
+			instances.push_back({node.indexOr("mesh", -1), world});
+		}
+		const Json *children = node.find("children");
+		for (size_t i = 0; children != nullptr && i < children->size(); ++i)
+		{
+			stack.push_back({static_cast<int64_t>((*children)[i].number), world, entry.depth + 1});
+		}
+	}
+	return instances;
+}
+
+// Appends the vertices of one primitive in the Vertex layout. Positions
+// are copied as they are and only transformed when the node moves them.
+// glTF texture coordinates already start at the top left like Vulkan's.
+void copyVertices(std::vector<Vertex> &vertices, const Accessor &positions, const Accessor &texCoords, const glm::vec3 &color,
+                  const glm::mat4 &world, glm::vec3 &center)
+{
+	size_t    base     = vertices.size();
+	bool      identity = world == glm::mat4(1.0f);
+	glm::vec3 boundsMin(std::numeric_limits<float>::max());
+	glm::vec3 boundsMax(std::numeric_limits<float>::lowest());
+	vertices.resize(base + positions.count);
+	for (size_t i = 0; i < positions.count; ++i)
+	{
+		Vertex &vertex = vertices[base + i];
+		memcpy(&vertex.pos, positions.data + i * positions.stride, sizeof(vertex.pos));
+		if (!identity)
+		{
+			vertex.pos = glm::vec3(world * glm::vec4(vertex.pos, 1.0f));
+		}
+		vertex.color = color;
+
+		const uint8_t *texCoord = texCoords.data + i * texCoords.stride;
+		if (texCoords.componentType == COMPONENT_FLOAT)
+		{
+			memcpy(&vertex.texCoord, texCoord, sizeof(vertex.texCoord));
+		}
+		else if (texCoords.componentType == COMPONENT_UNSIGNED_SHORT)
+		{
+			uint16_t uv[2];
+			memcpy(uv, texCoord, sizeof(uv));
+			vertex.texCoord = glm::vec2(uv[0], uv[1]) / 65535.0f;
+		}
+		else if (texCoords.componentType == COMPONENT_UNSIGNED_BYTE)
+		{
+			vertex.texCoord = glm::vec2(texCoord[0], texCoord[1]) / 255.0f;
+		}
+		boundsMin = glm::min(boundsMin, vertex.pos);
+		boundsMax = glm::max(boundsMax, vertex.pos);
+	}
+	center = (boundsMin + boundsMax) * 0.5f;
+}
+
+std::string baseDirectory(const std::string &filename)
+{
+	return filename.substr(0, filename.find_last_of('/') + 1);
+}
+}        // namespace
+
+GltfModel loadGltf(const std::string &filename)
+{
+	GltfModel model;
+	model.files.emplace_back();
+	model.files[0].open(filename);
+	const uint8_t *file     = model.files[0].data();
+	size_t         fileSize = model.files[0].size();
+
+	// A .glb is a header, a JSON chunk and an optional binary chunk that
+	// is buffer 0. A .gltf is the JSON alone.
+	const char *jsonBegin = reinterpret_cast<const char *>(file);
+	const char *jsonEnd   = jsonBegin + fileSize;
+	Buffer      binary;
+	uint32_t    magic = 0;
+	if (fileSize >= 4)
+	{
+		memcpy(&magic, file, 4);
+	}
+	if (magic == GLB_MAGIC)
+	{
+		uint32_t header[5] = {};
+		if (fileSize < sizeof(header))
+		{
+			throw std::runtime_error("\"" + filename + "\" is truncated");
+		}
+		memcpy(header, file, sizeof(header));
+		if (header[1] != 2 || header[2] > fileSize || header[2] < sizeof(header) || header[4] != GLB_CHUNK_JSON || header[3] > header[2] - sizeof(header))
+		{
+			throw std::runtime_error("\"" + filename + "\" is not a glTF 2.0 binary");
+		}
+		jsonBegin = reinterpret_cast<const char *>(file + sizeof(header));
+		jsonEnd   = jsonBegin + header[3];
+
+		size_t binOffset = sizeof(header) + ((header[3] + 3) & ~3u);
+		if (binOffset + 8 <= header[2])
+		{
+			uint32_t chunk[2];
+			memcpy(chunk, file + binOffset, sizeof(chunk));
+			if (chunk[1] == GLB_CHUNK_BIN && chunk[0] <= header[2] - binOffset - 8)
+			{
+				binary = {file + binOffset + 8, chunk[0]};
+			}
+		}
+	}
+
+	Json root = JsonParser(jsonBegin, jsonEnd, filename).parse();
+	if (root.type != Json::Type::Object)
+	{
+		throw std::runtime_error("\"" + filename + "\" has malformed JSON");
+	}
+
+	// Buffers without a URI are the binary chunk, the others files next to
+	// the model, mapped like it.
+	std::string         baseDir = baseDirectory(filename);
+	std::vector<Buffer> buffers;
+	const Json *bufferArray = root.find("buffers");
+	for (size_t i = 0; bufferArray != nullptr && i < bufferArray->size(); ++i)
+	{
+		const Json &buffer = (*bufferArray)[i];
+		const Json *uri    = buffer.find("uri");
+		double      length = buffer.numberOr("byteLength", 0);
+		Buffer      bytes  = binary;
+		if (uri != nullptr)
+		{
+			if (uri->string.compare(0, 5, "data:") == 0)
+			{
+				throw std::runtime_error("\"" + filename + "\" embeds a buffer as a data URI, which is not supported");
+			}
+			model.files.emplace_back();
+			model.files.back().open(baseDir + uri->string);
+			bytes = {model.files.back().data(), model.files.back().size()};
+		}
+		// The chunk may be padded past the declared length.
+		if (length > static_cast<double>(bytes.size))
+		{
+			throw std::runtime_error("\"" + filename + "\" has a buffer larger than its data");
+		}
+		buffers.push_back({bytes.data, static_cast<size_t>(length)});
+	}
+	Document document(filename, std::move(root), std::move(buffers));
+
+	// Images are added in order of first use, so unused ones are never
+	// decoded. Untextured materials share a white image.
+	std::unordered_map<int64_t, uint32_t> imageSlots;
+	auto                                  imageSlot = [&](int64_t image) {
+		auto slot = imageSlots.find(image);
+		if (slot != imageSlots.end())
+		{
+			return slot->second;
+		}
+
+		GltfImage gltfImage;
+		if (image >= 0)
+		{
+			const Json &json = document.element("images", image);
+			const Json *uri  = json.find("uri");
+			if (json.find("bufferView") != nullptr)
+			{
+				Buffer bytes   = document.view(json.indexOr("bufferView", -1));
+				gltfImage.data = bytes.data;
+				gltfImage.size = bytes.size;
+			}
+			else if (uri != nullptr && uri->string.compare(0, 5, "data:") != 0)
+			{
+				gltfImage.path = baseDir + uri->string;
+			}
+			else
+			{
+				document.fail("embeds an image as a data URI, which is not supported");
+			}
+		}
+		uint32_t index = static_cast<uint32_t>(model.images.size());
+		model.images.push_back(gltfImage);
+		imageSlots.emplace(image, index);
+		return index;
+	};
+
+	const Json &materials = document.array("materials");
+	for (size_t i = 0; i < materials.size() + 1; ++i)
+	{
+		// The last one is the default material.
+		ModelMaterial material;
+		int64_t       image = -1;
+		if (i < materials.size())
+		{
+			const Json *pbr    = materials[i].find("pbrMetallicRoughness");
+			const Json *factor = pbr != nullptr ? pbr->find("baseColorFactor") : nullptr;
+			const Json *color  = pbr != nullptr ? pbr->find("baseColorTexture") : nullptr;
+			if (factor != nullptr && factor->size() == 4)
+			{
+				material.diffuse = glm::vec3((*factor)[0].number, (*factor)[1].number, (*factor)[2].number);
+			}
+			if (color != nullptr)
+			{
+				image = document.element("textures", color->indexOr("index", -1)).indexOr("source", -1);
+			}
+		}
+		material.texture = 1 + imageSlot(image);
+		model.materials.push_back(material);
+	}
+	uint32_t defaultMaterial = static_cast<uint32_t>(materials.size());
+
+	struct Draw
+	{
+		const Json *primitive;
+		glm::mat4   world;
+		uint32_t    material;
+	};
+	std::vector<Draw> draws;
+	for (const MeshInstance &instance : meshInstances(document))
+	{
+		const Json *primitives = document.element("meshes", instance.mesh).find("primitives");
+		for (size_t i = 0; primitives != nullptr && i < primitives->size(); ++i)
+		{
+			const Json &primitive = (*primitives)[i];
+			if (primitive.indexOr("mode", MODE_TRIANGLES) != MODE_TRIANGLES)
+			{
+				continue;
+			}
+			int64_t material = primitive.indexOr("material", -1);
+			if (material >= static_cast<int64_t>(materials.size()))
+			{
+				document.fail("refers to a missing materials entry");
+			}
+			draws.push_back({&primitive, instance.world, material < 0 ? defaultMaterial : static_cast<uint32_t>(material)});
+		}
+	}
+
+	// Primitives of one material laid out next to each other, so the draw
+	// queue can merge them.
+	std::stable_sort(draws.begin(), draws.end(), [](const Draw &a, const Draw &b) { return a.material < b.material; });
+
+	// Exporters often let the primitives of a mesh share one set of vertex
+	// attributes. Their vertices are copied once per color and transform.
+	struct VertexCopy
+	{
+		int64_t   positions;
+		int64_t   texCoords;
+		glm::vec3 color;
+		glm::mat4 world;
+		size_t    base;
+		glm::vec3 center;
+	};
+	std::vector<VertexCopy> copies;
+
+	for (const Draw &draw : draws)
+	{
+		const Json *attributes = draw.primitive->find("attributes");
+		if (attributes == nullptr || attributes->find("POSITION") == nullptr)
+		{
+			document.fail("has a primitive without positions");
+		}
+		int64_t  positionIndex = attributes->indexOr("POSITION", -1);
+		int64_t  texCoordIndex = attributes->find("TEXCOORD_0") != nullptr ? attributes->indexOr("TEXCOORD_0", -1) : -1;
+		Accessor positions     = document.accessor(positionIndex);
+		if (positions.componentType != COMPONENT_FLOAT || positions.components != 3)
+		{
+			document.fail("has positions that are not float vectors");
+		}
+
+		Accessor texCoords;
+		if (texCoordIndex >= 0)
+		{
+			texCoords       = document.accessor(texCoordIndex);
+			bool normalized = texCoords.componentType == COMPONENT_UNSIGNED_BYTE || texCoords.componentType == COMPONENT_UNSIGNED_SHORT;
+			if (texCoords.components != 2 || texCoords.count != positions.count ||
+			    (texCoords.componentType != COMPONENT_FLOAT && !normalized))
+			{
+				document.fail("has unsupported texture coordinates");
+			}
+		}
+
+		glm::vec3 color = model.materials[draw.material].diffuse;
+		auto      copy  = std::find_if(copies.begin(), copies.end(), [&](const VertexCopy &existing) {
+			return existing.positions == positionIndex && existing.texCoords == texCoordIndex && existing.color == color &&
+			       existing.world == draw.world;
+		});
+		if (copy == copies.end())
+		{
+			copy = copies.insert(copies.end(), {positionIndex, texCoordIndex, color, draw.world, model.vertices.size(), glm::vec3(0.0f)});
+			copyVertices(model.vertices, positions, texCoords, color, draw.world, copy->center);
+		}
+		size_t base = copy->base;
+
+		Submesh submesh{};
+		submesh.firstIndex = static_cast<uint32_t>(model.indices.size());
+		submesh.material   = draw.material;
+		submesh.center     = copy->center;
+
+		// 32-bit indices are copied as a block, narrower ones widened. Each
+		// is checked, an index past the primitive would read past its
+		// vertices on the GPU.
+		if (draw.primitive->find("indices") != nullptr)
+		{
+			Accessor source = document.accessor(draw.primitive->indexOr("indices", -1));
+			size_t   first  = model.indices.size();
+			model.indices.resize(first + source.count);
+			uint32_t *target = model.indices.data() + first;
+			if (source.components != 1)
+			{
+				document.fail("has indices that are not scalars");
+			}
+			else if (source.componentType == COMPONENT_UNSIGNED_INT && source.stride == 4)
+			{
+				memcpy(target, source.data, source.count * 4);
+			}
+			else
+			{
+				for (size_t i = 0; i < source.count; ++i)
+				{
+					const uint8_t *index = source.data + i * source.stride;
+					if (source.componentType == COMPONENT_UNSIGNED_INT)
+					{
+						memcpy(&target[i], index, 4);
+					}
+					else if (source.componentType == COMPONENT_UNSIGNED_SHORT)
+					{
+						uint16_t value;
+						memcpy(&value, index, 2);
+						target[i] = value;
+					}
+					else if (source.componentType == COMPONENT_UNSIGNED_BYTE)
+					{
+						target[i] = *index;
+					}
+					else
+					{
+						document.fail("has indices of an unsupported type");
+					}
+				}
+			}
+			for (size_t i = 0; i < source.count; ++i)
+			{
+				if (target[i] >= positions.count)
+				{
+					document.fail("has an index past its primitive's vertices");
+				}
+				target[i] += static_cast<uint32_t>(base);
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < positions.count; ++i)
+			{
+				model.indices.push_back(static_cast<uint32_t>(base + i));
+			}
+		}
+
+		// Trailing corners of an incomplete triangle are dropped.
+		model.indices.resize(submesh.firstIndex + (model.indices.size() - submesh.firstIndex) / 3 * 3);
+		submesh.indexCount = static_cast<uint32_t>(model.indices.size()) - submesh.firstIndex;
+		if (submesh.indexCount > 0)
+		{
+			model.submeshes.push_back(submesh);
+		}
+	}
+	return model;
+}
+
+void writeGlb(const std::string &filename, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices,
+              const std::vector<Submesh> &submeshes, const std::vector<ModelMaterial> &materials)
+{
+	// Binary chunk: positions, then texture coordinates, then indices.
+	size_t               count          = vertices.size();
+	size_t               texCoordOffset = count * sizeof(glm::vec3);
+	size_t               indexOffset    = texCoordOffset + count * sizeof(glm::vec2);
+	std::vector<uint8_t> binary(indexOffset + indices.size() * sizeof(uint32_t));
+	glm::vec3            positionMin(std::numeric_limits<float>::max());
+	glm::vec3            positionMax(std::numeric_limits<float>::lowest());
+	for (size_t i = 0; i < count; ++i)
+	{
+		memcpy(&binary[i * sizeof(glm::vec3)], &vertices[i].pos, sizeof(glm::vec3));
+		memcpy(&binary[texCoordOffset + i * sizeof(glm::vec2)], &vertices[i].texCoord, sizeof(glm::vec2));
+		positionMin = glm::min(positionMin, vertices[i].pos);
+		positionMax = glm::max(positionMax, vertices[i].pos);
+	}
+	if (!indices.empty())
+	{
+		memcpy(&binary[indexOffset], indices.data(), indices.size() * sizeof(uint32_t));
+	}
+	binary.resize((binary.size() + 3) & ~size_t(3), 0);
+
+	std::ostringstream json;
+	json.precision(9);
+	json << "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],";
+	json << "\"buffers\":[{\"byteLength\":" << binary.size() << "}],";
+	json << "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << texCoordOffset << "},"
+	     << "{\"buffer\":0,\"byteOffset\":" << texCoordOffset << ",\"byteLength\":" << indexOffset - texCoordOffset << "},"
+	     << "{\"buffer\":0,\"byteOffset\":" << indexOffset << ",\"byteLength\":" << indices.size() * sizeof(uint32_t) << "}],";
+	json << "\"accessors\":[{\"bufferView\":0,\"componentType\":" << COMPONENT_FLOAT << ",\"count\":" << count
+	     << ",\"type\":\"VEC3\",\"min\":[" << positionMin.x << "," << positionMin.y << "," << positionMin.z << "],\"max\":["
+	     << positionMax.x << "," << positionMax.y << "," << positionMax.z << "]},"
+	     << "{\"bufferView\":1,\"componentType\":" << COMPONENT_FLOAT << ",\"count\":" << count << ",\"type\":\"VEC2\"}";
+	for (const Submesh &submesh : submeshes)
+	{
+		json << ",{\"bufferView\":2,\"byteOffset\":" << submesh.firstIndex * sizeof(uint32_t) << ",\"componentType\":"
+		     << COMPONENT_UNSIGNED_INT << ",\"count\":" << submesh.indexCount << ",\"type\":\"SCALAR\"}";
+	}
+	json << "],\"materials\":[";
+	for (size_t i = 0; i < materials.size(); ++i)
+	{
+		const glm::vec3 &diffuse = materials[i].diffuse;
+		json << (i > 0 ? "," : "") << "{\"pbrMetallicRoughness\":{\"baseColorFactor\":[" << diffuse.r << "," << diffuse.g << ","
+		     << diffuse.b << ",1]}}";
+	}
+	json << "],\"meshes\":[{\"primitives\":[";
+	for (size_t i = 0; i < submeshes.size(); ++i)
+	{
+		json << (i > 0 ? "," : "") << "{\"attributes\":{\"POSITION\":0,\"TEXCOORD_0\":1},\"indices\":" << i + 2
+		     << ",\"material\":" << submeshes[i].material << "}";
+	}
+	json << "]}]}";
+
+	std::string text = json.str();
+	text.resize((text.size() + 3) & ~size_t(3), ' ');
+
+	uint32_t header[5] = {GLB_MAGIC, 2, static_cast<uint32_t>(12 + 8 + text.size() + 8 + binary.size()),
+	                      static_cast<uint32_t>(text.size()), GLB_CHUNK_JSON};
+	uint32_t binHeader[2] = {static_cast<uint32_t>(binary.size()), GLB_CHUNK_BIN};
+
+	std::ofstream file(filename, std::ios::binary);
+	file.write(reinterpret_cast<const char *>(header), sizeof(header));
+	file.write(text.data(), static_cast<std::streamsize>(text.size()));
+	file.write(reinterpret_cast<const char *>(binHeader), sizeof(binHeader));
+	file.write(reinterpret_cast<const char *>(binary.data()), static_cast<std::streamsize>(binary.size()));
+	if (!file)
+	{
+		throw std::runtime_error("Failed to write \"" + filename + "\"");
+	}
+}
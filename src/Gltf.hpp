@@ -0,0 +1,44 @@
+#ifndef GLTF_H
+#define GLTF_H
+
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "VulkanUtils.hpp"
+
+// Minimal glTF 2.0 support: binary .glb files and .gltf files with external
+// buffers, triangle primitives with float positions and texture
+// coordinates, base color factors and textures. Files are memory mapped and
+// accessors read in place, so no text is parsed beyond the JSON header.
+
+// An encoded image inside a mapped buffer, a file next to the model, or
+// neither for the plain white texture of untextured materials.
+struct GltfImage
+{
+	std::string    path;
+	const uint8_t *data = nullptr;
+	size_t         size = 0;
+};
+
+struct GltfModel
+{
+	std::vector<Vertex>        vertices;
+	std::vector<uint32_t>      indices;
+	std::vector<Submesh>       submeshes;    // one per drawn primitive, by material
+	std::vector<ModelMaterial> materials;    // textures are 1 + an image index
+	std::vector<GltfImage>     images;
+	std::vector<MappedFile>    files;        // hold the embedded images
+};
+
+// Meshes are placed by the nodes of the default scene, positions of nodes
+// other than the identity are transformed while copying. Primitives
+// without a material get a white one, appended after the file's.
+GltfModel loadGltf(const std::string &filename);
+
+// Positions, texture coordinates and indices with one primitive per
+// submesh. Material colors are kept, textures are not.
+void writeGlb(const std::string &filename, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices,
+              const std::vector<Submesh> &submeshes, const std::vector<ModelMaterial> &materials);
+
+#endif
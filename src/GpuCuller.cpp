@@ -0,0 +1,368 @@
+#include "GpuCuller.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+#include "InstanceManager.hpp"
+#include "VulkanUtils.hpp"
+
+void GpuCuller::create(VkDevice device, VkPhysicalDevice physicalDevice, ObjectCache &objectCache, uint32_t frameCount, const std::string &shaderPath,
+                       bool occlusion)
+{
+	this->device         = device;
+	this->physicalDevice = physicalDevice;
+	this->occlusion      = occlusion;
+
+	// Instances, meshes, draw commands, the counters and the visible
+	// instances, for occlusion also the visibility flags and the depth pyramid.
+	std::vector<VkDescriptorSetLayoutBinding> bindings(occlusion ? 7 : 5);
+	for (uint32_t i = 0; i < bindings.size(); ++i)
+	{
+		bindings[i].binding         = i;
+		bindings[i].descriptorType  = i == 6 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings    = bindings.data();
+	descriptorSetLayout     = objectCache.descriptorSetLayout(layoutInfo);
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset     = 0;
+	pushConstantRange.size       = occlusion ? sizeof(OcclusionConstants) : sizeof(PushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount         = 1;
+	pipelineLayoutInfo.pSetLayouts            = &descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges    = &pushConstantRange;
+	pipelineLayout                            = objectCache.pipelineLayout(pipelineLayoutInfo);
+
+	UniqueShaderModule shaderModule(device, createShaderModule(device, loadSpirv(shaderPath)));
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName  = "main";
+	pipelineInfo.layout       = pipelineLayout;
+	VkResult result           = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, pipeline.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[0].descriptorCount = frameCount * (occlusion ? 6 : 5);
+	poolSizes[1].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[1].descriptorCount = frameCount;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets       = frameCount;
+	poolInfo.poolSizeCount = occlusion ? 2 : 1;
+	poolInfo.pPoolSizes    = poolSizes.data();
+	result                 = vkCreateDescriptorPool(device, &poolInfo, nullptr, descriptorPool.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	std::vector<VkDescriptorSetLayout> setLayouts(frameCount, descriptorSetLayout);
+	VkDescriptorSetAllocateInfo        allocInfo{};
+	allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool     = descriptorPool;
+	allocInfo.descriptorSetCount = frameCount;
+	allocInfo.pSetLayouts        = setLayouts.data();
+	descriptorSets.resize(frameCount);
+	result = vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data());
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	createMemoryBuffer(device, physicalDevice, MAX_MESHES * sizeof(Mesh), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                   *meshBuffer.put(device), *meshMemory.put(device));
+	void *data;
+	result = vkMapMemory(device, meshMemory, 0, VK_WHOLE_SIZE, 0, &data);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	mappedMeshes = static_cast<Mesh *>(data);
+
+	createMemoryBuffer(device, physicalDevice, sizeof(Counters),
+	                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *drawCount.put(device), *drawCountMemory.put(device));
+
+	uint32_t     lists        = occlusion ? 2 : 1;
+	VkDeviceSize commandBytes = lists * MAX_MESHES * sizeof(VkDrawIndexedIndirectCommand);
+	createMemoryBuffer(device, physicalDevice, commandBytes,
+	                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *drawCommands.put(device), *drawCommandMemory.put(device));
+	createMemoryBuffer(device, physicalDevice, frameCount * commandBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                   *commandTemplates.put(device), *commandTemplateMemory.put(device));
+	result = vkMapMemory(device, commandTemplateMemory, 0, VK_WHOLE_SIZE, 0, &data);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	mappedTemplates = static_cast<VkDrawIndexedIndirectCommand *>(data);
+	allocateInstances(INITIAL_CAPACITY);
+
+	createMemoryBuffer(device, physicalDevice, frameCount * sizeof(Counters), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                   *statsBuffer.put(device), *statsMemory.put(device));
+	result = vkMapMemory(device, statsMemory, 0, VK_WHOLE_SIZE, 0, &data);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	mappedStats = static_cast<Counters *>(data);
+	memset(mappedStats, 0, frameCount * sizeof(Counters));
+}
+
+void GpuCuller::destroy()
+{
+	mappedStats = nullptr;
+	statsBuffer.reset();
+	statsMemory.reset();
+	visibility.reset();
+	visibilityMemory.reset();
+	pyramid = nullptr;
+	visibleInstanceBuffer.reset();
+	visibleInstanceMemory.reset();
+	instanceCapacity = 0;
+	mappedTemplates  = nullptr;
+	commandTemplates.reset();
+	commandTemplateMemory.reset();
+	drawCommands.reset();
+	drawCommandMemory.reset();
+	drawCount.reset();
+	drawCountMemory.reset();
+	mappedMeshes = nullptr;
+	meshBuffer.reset();
+	meshMemory.reset();
+	meshes.clear();
+	descriptorSets.clear();
+	descriptorPool.reset();
+	pipeline.reset();
+	pipelineLayout      = VK_NULL_HANDLE;
+	descriptorSetLayout = VK_NULL_HANDLE;
+}
+
+void GpuCuller::allocateInstances(uint32_t newCapacity)
+{
+	instanceCapacity = newCapacity;
+	createMemoryBuffer(device, physicalDevice, (occlusion ? 2 : 1) * static_cast<VkDeviceSize>(instanceCapacity) * sizeof(InstanceManager::Instance),
+	                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+	                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *visibleInstanceBuffer.put(device), *visibleInstanceMemory.put(device));
+	if (occlusion)
+	{
+		// Cleared before first use, every instance then goes to the late phase once.
+		createMemoryBuffer(device, physicalDevice, static_cast<VkDeviceSize>(instanceCapacity) * sizeof(uint32_t),
+		                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *visibility.put(device), *visibilityMemory.put(device));
+		visibilityCleared = false;
+	}
+}
+
+void GpuCuller::setDepthPyramid(const DepthPyramid *pyramid)
+{
+	this->pyramid = pyramid;
+}
+
+uint32_t GpuCuller::addMesh(const Mesh &mesh)
+{
+	if (meshes.size() == MAX_MESHES)
+	{
+		throw std::runtime_error("GPU culler mesh table is full");
+	}
+	mappedMeshes[meshes.size()] = mesh;
+	meshes.push_back(mesh);
+	return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+void GpuCuller::record(VkCommandBuffer commandBuffer, uint32_t frame, VkBuffer instances, uint32_t instanceCount,
+                       const std::vector<uint32_t> &meshInstanceCounts, const glm::mat4 &viewProjection, DeletionQueue &deletionQueue,
+                       Phase phase)
+{
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+	if (phase != Phase::Late)
+	{
+		if (instanceCount > instanceCapacity)
+		{
+			deletionQueue.defer(std::move(visibleInstanceBuffer));
+			deletionQueue.defer(std::move(visibleInstanceMemory));
+			if (occlusion)
+			{
+				deletionQueue.defer(std::move(visibility));
+				deletionQueue.defer(std::move(visibilityMemory));
+			}
+			allocateInstances(std::max(instanceCapacity * 2, instanceCount));
+		}
+
+		// Each mesh's draw starts with no instances at the start of its range,
+		// the ranges being as large as the mesh's instance count.
+		uint32_t                      lists     = occlusion ? 2 : 1;
+		VkDrawIndexedIndirectCommand *templates = mappedTemplates + frame * lists * MAX_MESHES;
+		drawMeshCount                           = static_cast<uint32_t>(meshes.size());
+		for (uint32_t list = 0; list < lists; ++list)
+		{
+			uint32_t first = list * instanceCapacity;
+			for (uint32_t mesh = 0; mesh < drawMeshCount; ++mesh)
+			{
+				templates[list * MAX_MESHES + mesh] = {meshes[mesh].indexCount, 0, meshes[mesh].firstIndex, meshes[mesh].vertexOffset, first};
+				first += mesh < meshInstanceCounts.size() ? meshInstanceCounts[mesh] : 0;
+			}
+		}
+
+		// Rewritten every frame since any buffer may have been replaced. The
+		// frame's previous submission, the last user of its set, has retired.
+		std::vector<VkDescriptorBufferInfo> bufferInfos = {{instances, 0, VK_WHOLE_SIZE},
+		                                                   {meshBuffer, 0, VK_WHOLE_SIZE},
+		                                                   {drawCommands, 0, VK_WHOLE_SIZE},
+		                                                   {drawCount, 0, VK_WHOLE_SIZE},
+		                                                   {visibleInstanceBuffer, 0, VK_WHOLE_SIZE}};
+		if (occlusion)
+		{
+			bufferInfos.push_back({visibility, 0, VK_WHOLE_SIZE});
+		}
+		std::vector<VkWriteDescriptorSet> writes(bufferInfos.size());
+		for (uint32_t i = 0; i < writes.size(); ++i)
+		{
+			writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet          = descriptorSets[frame];
+			writes[i].dstBinding      = i;
+			writes[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].descriptorCount = 1;
+			writes[i].pBufferInfo     = &bufferInfos[i];
+		}
+		VkDescriptorImageInfo pyramidInfo{};
+		if (occlusion)
+		{
+			pyramidInfo = {pyramid->sampler(), pyramid->view(), VK_IMAGE_LAYOUT_GENERAL};
+
+			VkWriteDescriptorSet write{};
+			write.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write.dstSet          = descriptorSets[frame];
+			write.dstBinding      = 6;
+			write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			write.descriptorCount = 1;
+			write.pImageInfo      = &pyramidInfo;
+			writes.push_back(write);
+		}
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+		// The previous frame's draws may still be reading the commands, the
+		// visible instances and the counters, and its late phase wrote the
+		// visibility read below.
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+		                     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT |
+		                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		                     VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		vkCmdFillBuffer(commandBuffer, drawCount, 0, sizeof(Counters), 0);
+		VkBufferCopy templateRegion{frame * lists * MAX_MESHES * sizeof(VkDrawIndexedIndirectCommand), 0,
+		                            lists * MAX_MESHES * sizeof(VkDrawIndexedIndirectCommand)};
+		vkCmdCopyBuffer(commandBuffer, commandTemplates, drawCommands, 1, &templateRegion);
+		if (occlusion && !visibilityCleared)
+		{
+			vkCmdFillBuffer(commandBuffer, visibility, 0, VK_WHOLE_SIZE, 0);
+			visibilityCleared = true;
+		}
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+	else
+	{
+		// The early phase read the flags rewritten here.
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+	lastPhase = phase;
+
+	if (instanceCount > 0)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[frame], 0, nullptr);
+		if (occlusion)
+		{
+			OcclusionConstants constants{};
+			constants.viewProjection = viewProjection;
+			constants.depthSize      = glm::vec2(pyramid->depthExtent().width, pyramid->depthExtent().height);
+			constants.instanceCount  = instanceCount;
+			constants.phase          = phase == Phase::Late ? 1 : 0;
+			constants.lateOffset     = MAX_MESHES;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		}
+		else
+		{
+			PushConstants                  constants{};
+			const std::array<glm::vec4, 6> planes = frustumPlanes(viewProjection);
+			std::copy(planes.begin(), planes.end(), constants.planes);
+			constants.instanceCount = instanceCount;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		}
+		vkCmdDispatch(commandBuffer, (instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier,
+	                     0, nullptr, 0, nullptr);
+
+	if (phase != Phase::Early)
+	{
+		// The counters are final after the frame's last phase.
+		VkBufferCopy region{0, frame * sizeof(Counters), sizeof(Counters)};
+		vkCmdCopyBuffer(commandBuffer, drawCount, statsBuffer, 1, &region);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+}
+
+void GpuCuller::draw(VkCommandBuffer commandBuffer) const
+{
+	VkDeviceSize commandOffset = lastPhase == Phase::Late ? MAX_MESHES * sizeof(VkDrawIndexedIndirectCommand) : 0;
+	if (drawMeshCount > 0)
+	{
+		vkCmdDrawIndexedIndirect(commandBuffer, drawCommands, commandOffset, drawMeshCount, sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
+VkBuffer GpuCuller::visibleInstances() const
+{
+	return visibleInstanceBuffer;
+}
+
+GpuCuller::Stats GpuCuller::stats(uint32_t frame) const
+{
+	const Counters &counters = mappedStats[frame];
+
+	Stats stats;
+	stats.drawn         = counters.drawCounts[0] + counters.drawCounts[1];
+	stats.frustumCulled = counters.frustumCulled;
+	stats.occluded      = counters.occluded;
+	return stats;
+}
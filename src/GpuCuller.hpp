@@ -0,0 +1,165 @@
+#ifndef GPUCULLER_H
+#define GPUCULLER_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "DeletionQueue.hpp"
+#include "DepthPyramid.hpp"
+#include "ObjectCache.hpp"
+#include "VulkanHandles.hpp"
+
+// Frustum culling in a compute pass. Every instance of the InstanceManager
+// buffer is tested against the bounding sphere of its mesh; visible ones are
+// copied into their mesh's range of a visible instance buffer, which the
+// draws bind as the instance vertex buffer in place of the InstanceManager
+// one. Each mesh has one VkDrawIndexedIndirectCommand whose instanceCount
+// the pass bumps, and one vkCmdDrawIndexedIndirect draws them all.
+// Recording costs the same few commands whatever the number of instances.
+//
+// With occlusion culling the instances are split over two phases. The
+// early one draws what was visible last frame, the late one tests the rest
+// against a depth pyramid of what the early draws left and draws what it
+// does not hide, so instances coming into view appear in the same frame.
+//
+// Needs multiDrawIndirect and drawIndirectFirstInstance, since each
+// command finds its mesh's range through firstInstance.
+class GpuCuller
+{
+  public:
+	// Matches the std430 layout in cull.comp.
+	struct Mesh
+	{
+		glm::vec4 sphere       = glm::vec4(0.0f);    // model space center and radius
+		uint32_t  firstIndex   = 0;
+		uint32_t  indexCount   = 0;
+		int32_t   vertexOffset = 0;
+		uint32_t  padding      = 0;
+	};
+
+	enum class Phase
+	{
+		All,
+		Early,
+		Late
+	};
+
+	struct Stats
+	{
+		uint32_t drawn         = 0;
+		uint32_t frustumCulled = 0;
+		uint32_t occluded      = 0;
+	};
+
+	static constexpr uint32_t MAX_MESHES = 256;
+
+	// Layouts come from the cache and are not destroyed here. With occlusion
+	// the shader runs the two phases and reads the pyramid given to
+	// setDepthPyramid().
+	void create(VkDevice device, VkPhysicalDevice physicalDevice, ObjectCache &objectCache, uint32_t frameCount, const std::string &shaderPath,
+	            bool occlusion = false);
+	void destroy();
+	void setDepthPyramid(const DepthPyramid *pyramid);
+
+	// Meshes are only appended, so frames in flight never see an entry change.
+	uint32_t addMesh(const Mesh &mesh);
+
+	// Records the culling pass outside of any render pass. The instance
+	// buffer must already hold this frame's instances, meshInstanceCounts
+	// how many of them use each mesh. Phase::All culls against the frustum
+	// only; with occlusion every frame records the early phase and, once the
+	// pyramid has been built from its depth, the late one.
+	void record(VkCommandBuffer commandBuffer, uint32_t frame, VkBuffer instances, uint32_t instanceCount,
+	            const std::vector<uint32_t> &meshInstanceCounts, const glm::mat4 &viewProjection, DeletionQueue &deletionQueue,
+	            Phase phase = Phase::All);
+
+	// Draws what the last recorded pass found visible, with visibleInstances()
+	// bound as the instance vertex buffer.
+	void     draw(VkCommandBuffer commandBuffer) const;
+	VkBuffer visibleInstances() const;
+
+	// What the frame's last submission culled, valid once its fence has
+	// signalled.
+	Stats stats(uint32_t frame) const;
+
+  private:
+	static constexpr uint32_t WORKGROUP_SIZE   = 64;
+	static constexpr uint32_t INITIAL_CAPACITY = 1024;
+
+	struct PushConstants
+	{
+		glm::vec4 planes[6];
+		uint32_t  instanceCount;
+	};
+
+	// The occlusion shader needs the matrix to project bounds, which leaves
+	// no room for the planes, so it derives them itself.
+	struct OcclusionConstants
+	{
+		glm::mat4 viewProjection;
+		glm::vec2 depthSize;
+		uint32_t  instanceCount;
+		uint32_t  phase;
+		uint32_t  lateOffset;
+	};
+
+	// Matches the Counters block of both shaders.
+	struct Counters
+	{
+		uint32_t drawCounts[2];    // early or only phase, late phase
+		uint32_t frustumCulled;
+		uint32_t occluded;
+	};
+
+	void allocateInstances(uint32_t newCapacity);
+
+	VkDevice                     device              = VK_NULL_HANDLE;
+	VkPhysicalDevice             physicalDevice      = VK_NULL_HANDLE;
+	VkDescriptorSetLayout        descriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout             pipelineLayout      = VK_NULL_HANDLE;
+	UniquePipeline               pipeline;
+	UniqueDescriptorPool         descriptorPool;
+	std::vector<VkDescriptorSet> descriptorSets;    // one per frame in flight
+
+	UniqueBuffer       meshBuffer;
+	UniqueDeviceMemory meshMemory;
+	Mesh              *mappedMeshes = nullptr;
+	std::vector<Mesh>  meshes;
+
+	// One indirect command per mesh and phase, copied from the frame's slice
+	// of the templates and counted up by the pass. With occlusion the late
+	// phase's commands follow the early ones, MAX_MESHES apart.
+	UniqueBuffer                  drawCommands;
+	UniqueDeviceMemory            drawCommandMemory;
+	UniqueBuffer                  commandTemplates;
+	UniqueDeviceMemory            commandTemplateMemory;
+	VkDrawIndexedIndirectCommand *mappedTemplates = nullptr;
+	uint32_t                      drawMeshCount   = 0;
+	Phase                         lastPhase       = Phase::All;
+
+	// Visible instances grouped by mesh, the late phase's after the early
+	// phase's, instanceCapacity apart.
+	UniqueBuffer       visibleInstanceBuffer;
+	UniqueDeviceMemory visibleInstanceMemory;
+	uint32_t           instanceCapacity = 0;
+
+	// Counters for the stats
+	UniqueBuffer       drawCount;
+	UniqueDeviceMemory drawCountMemory;
+
+	// Occlusion only, one flag per instance slot whether it was visible last frame
+	bool                occlusion = false;
+	const DepthPyramid *pyramid   = nullptr;
+	UniqueBuffer        visibility;
+	UniqueDeviceMemory  visibilityMemory;
+	bool                visibilityCleared = false;
+
+	// Per frame copies of the counters
+	UniqueBuffer       statsBuffer;
+	UniqueDeviceMemory statsMemory;
+	Counters          *mappedStats = nullptr;
+};
+
+#endif
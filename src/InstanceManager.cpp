@@ -0,0 +1,271 @@
+#include "InstanceManager.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#include "VulkanUtils.hpp"
+
+void InstanceManager::create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount)
+{
+	this->device         = device;
+	this->physicalDevice = physicalDevice;
+	this->frameCount     = frameCount;
+	allocate(INITIAL_CAPACITY);
+}
+
+void InstanceManager::destroy()
+{
+	mappedStaging = nullptr;
+	stagingBuffer.reset();
+	stagingMemory.reset();
+	instanceBuffer.reset();
+	instanceMemory.reset();
+	capacity = 0;
+	clear();
+}
+
+void InstanceManager::allocate(uint32_t newCapacity)
+{
+	capacity = newCapacity;
+
+	createMemoryBuffer(device, physicalDevice, static_cast<VkDeviceSize>(capacity) * sizeof(Instance),
+	                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *instanceBuffer.put(device), *instanceMemory.put(device));
+	createMemoryBuffer(device, physicalDevice, static_cast<VkDeviceSize>(frameCount) * capacity * sizeof(Instance),
+	                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                   *stagingBuffer.put(device), *stagingMemory.put(device));
+
+	void    *data;
+	VkResult result = vkMapMemory(device, stagingMemory, 0, VK_WHOLE_SIZE, 0, &data);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	mappedStaging = static_cast<Instance *>(data);
+	allDirty      = true;
+}
+
+InstanceId InstanceManager::add(const Instance &instance)
+{
+	InstanceId id;
+	if (!freeIds.empty())
+	{
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	else
+	{
+		id = static_cast<InstanceId>(idSlots.size());
+		idSlots.push_back(NO_SLOT);
+	}
+
+	if (instance.mesh >= meshCounts.size())
+	{
+		meshCounts.resize(instance.mesh + 1, 0);
+	}
+	meshCounts[instance.mesh]++;
+
+	uint32_t slot = static_cast<uint32_t>(instances.size());
+	idSlots[id]   = slot;
+	instances.push_back(instance);
+	slotIds.push_back(id);
+	dirty.push_back(0);
+	markDirty(slot);
+	return id;
+}
+
+void InstanceManager::remove(InstanceId id)
+{
+	uint32_t slot = idSlots[id];
+	uint32_t last = static_cast<uint32_t>(instances.size() - 1);
+	meshCounts[instances[slot].mesh]--;
+	if (slot != last)
+	{
+		instances[slot]        = instances[last];
+		slotIds[slot]          = slotIds[last];
+		idSlots[slotIds[slot]] = slot;
+		markDirty(slot);
+	}
+	instances.pop_back();
+	slotIds.pop_back();
+	dirty.pop_back();
+	idSlots[id] = NO_SLOT;
+	freeIds.push_back(id);
+}
+
+void InstanceManager::update(InstanceId id, const Instance &instance)
+{
+	uint32_t slot = idSlots[id];
+	if (instance.mesh >= meshCounts.size())
+	{
+		meshCounts.resize(instance.mesh + 1, 0);
+	}
+	meshCounts[instances[slot].mesh]--;
+	meshCounts[instance.mesh]++;
+	instances[slot] = instance;
+	markDirty(slot);
+}
+
+const InstanceManager::Instance &InstanceManager::get(InstanceId id) const
+{
+	return instances[idSlots[id]];
+}
+
+void InstanceManager::clear()
+{
+	instances.clear();
+	slotIds.clear();
+	idSlots.clear();
+	freeIds.clear();
+	dirty.clear();
+	dirtySlots.clear();
+	meshCounts.clear();
+}
+
+uint32_t InstanceManager::count() const
+{
+	return static_cast<uint32_t>(instances.size());
+}
+
+const std::vector<uint32_t> &InstanceManager::meshInstanceCounts() const
+{
+	return meshCounts;
+}
+
+void InstanceManager::markDirty(uint32_t slot)
+{
+	if (!dirty[slot])
+	{
+		dirty[slot] = 1;
+		dirtySlots.push_back(slot);
+	}
+}
+
+void InstanceManager::record(VkCommandBuffer commandBuffer, uint32_t frame, DeletionQueue &deletionQueue)
+{
+	lastUpload = 0;
+	if (instances.size() > capacity)
+	{
+		// Pending frames keep drawing from the old buffer until they retire.
+		deletionQueue.defer(std::move(instanceBuffer));
+		deletionQueue.defer(std::move(instanceMemory));
+		deletionQueue.defer(std::move(stagingBuffer));
+		deletionQueue.defer(std::move(stagingMemory));
+		allocate(std::max(capacity * 2, static_cast<uint32_t>(instances.size())));
+	}
+
+	std::vector<VkBufferCopy> regions;
+	uint32_t                  instanceCount = count();
+	if (allDirty)
+	{
+		if (instanceCount > 0)
+		{
+			regions.push_back({0, 0, instanceCount});
+		}
+	}
+	else
+	{
+		// Removals can leave slots past the end in the list, and re-added
+		// slots appear twice.
+		std::sort(dirtySlots.begin(), dirtySlots.end());
+		for (uint32_t slot : dirtySlots)
+		{
+			if (slot >= instanceCount)
+			{
+				break;
+			}
+			if (!regions.empty() && regions.back().srcOffset + regions.back().size >= slot)
+			{
+				regions.back().size = slot + 1 - regions.back().srcOffset;
+			}
+			else
+			{
+				regions.push_back({slot, slot, 1});
+			}
+		}
+	}
+	for (uint32_t slot : dirtySlots)
+	{
+		if (slot < instanceCount)
+		{
+			dirty[slot] = 0;
+		}
+	}
+	dirtySlots.clear();
+	allDirty = false;
+	if (regions.empty())
+	{
+		return;
+	}
+
+	// Regions are built in instances and turned into bytes while staging.
+	VkDeviceSize sliceOffset = static_cast<VkDeviceSize>(frame) * capacity;
+	for (VkBufferCopy &region : regions)
+	{
+		memcpy(mappedStaging + sliceOffset + region.srcOffset, instances.data() + region.srcOffset, region.size * sizeof(Instance));
+		region.srcOffset  = (sliceOffset + region.srcOffset) * sizeof(Instance);
+		region.dstOffset *= sizeof(Instance);
+		region.size      *= sizeof(Instance);
+		lastUpload       += region.size;
+	}
+
+	// Earlier frames may still be reading the instances being overwritten.
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask       = 0;
+	barrier.dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer              = instanceBuffer;
+	barrier.offset              = 0;
+	barrier.size                = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	                     VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer, instanceBuffer, static_cast<uint32_t>(regions.size()), regions.data());
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+	                     VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+VkBuffer InstanceManager::buffer() const
+{
+	return instanceBuffer;
+}
+
+VkDeviceSize InstanceManager::lastUploadBytes() const
+{
+	return lastUpload;
+}
+
+VkVertexInputBindingDescription InstanceManager::getBindingDescription()
+{
+	VkVertexInputBindingDescription description{};
+	description.binding   = BINDING;
+	description.stride    = sizeof(Instance);
+	description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+	return description;
+}
+
+// The model matrix takes one location per column, the tint follows.
+std::array<VkVertexInputAttributeDescription, 5> InstanceManager::getAttributeDescriptions()
+{
+	std::array<VkVertexInputAttributeDescription, 5> description{};
+	for (uint32_t column = 0; column < 4; ++column)
+	{
+		description[column].binding  = BINDING;
+		description[column].location = FIRST_LOCATION + column;
+		description[column].format   = VK_FORMAT_R32G32B32A32_SFLOAT;
+		description[column].offset   = static_cast<uint32_t>(offsetof(Instance, model) + column * sizeof(glm::vec4));
+	}
+	description[4].binding  = BINDING;
+	description[4].location = FIRST_LOCATION + 4;
+	description[4].format   = VK_FORMAT_R32G32B32A32_SFLOAT;
+	description[4].offset   = offsetof(Instance, tint);
+	return description;
+}
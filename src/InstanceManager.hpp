@@ -0,0 +1,90 @@
+#ifndef INSTANCEMANAGER_H
+#define INSTANCEMANAGER_H
+
+#include <array>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "DeletionQueue.hpp"
+#include "VulkanHandles.hpp"
+
+using InstanceId = uint32_t;
+
+// Per-instance data for drawing one mesh many times with a single
+// vkCmdDrawIndexed. Instances live densely packed in a device local buffer
+// that is bound as a second vertex binding with VK_VERTEX_INPUT_RATE_INSTANCE.
+//
+// Ids stay valid across removals, which move the last instance into the freed
+// slot. Edits only mark slots dirty; record() copies the dirty runs through
+// the frame's slice of a mapped staging buffer, so a frame touching a handful
+// of instances uploads a handful of instances whatever the total count.
+class InstanceManager
+{
+  public:
+	// Laid out for std430 as well, the GPU culler reads the buffer as storage.
+	struct Instance
+	{
+		glm::mat4 model      = glm::mat4(1.0f);
+		glm::vec4 tint       = glm::vec4(1.0f);
+		uint32_t  mesh       = 0;
+		uint32_t  padding[3] = {};
+	};
+
+	static constexpr uint32_t BINDING        = 1;
+	static constexpr uint32_t FIRST_LOCATION = 3;
+
+	void create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t frameCount);
+	void destroy();
+
+	InstanceId      add(const Instance &instance);
+	void            remove(InstanceId id);
+	void            update(InstanceId id, const Instance &instance);
+	const Instance &get(InstanceId id) const;
+	void            clear();
+	uint32_t        count() const;
+
+	// How many instances use each mesh, indexed by Instance::mesh.
+	const std::vector<uint32_t> &meshInstanceCounts() const;
+
+	// Records the upload of the dirty slots, outside of any render pass. The
+	// result is visible to vertex input and compute shaders.
+	// Buffers outgrown since the last call are handed to the deletion queue.
+	void record(VkCommandBuffer commandBuffer, uint32_t frame, DeletionQueue &deletionQueue);
+
+	VkBuffer     buffer() const;
+	VkDeviceSize lastUploadBytes() const;
+
+	static VkVertexInputBindingDescription                  getBindingDescription();
+	static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions();
+
+  private:
+	static constexpr uint32_t INITIAL_CAPACITY = 1024;
+	static constexpr uint32_t NO_SLOT          = UINT32_MAX;
+
+	void markDirty(uint32_t slot);
+	void allocate(uint32_t newCapacity);
+
+	VkDevice         device         = VK_NULL_HANDLE;
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	uint32_t         frameCount     = 0;
+	uint32_t         capacity       = 0;
+
+	UniqueBuffer       instanceBuffer;
+	UniqueDeviceMemory instanceMemory;
+	UniqueBuffer       stagingBuffer;    // one slice of capacity instances per frame
+	UniqueDeviceMemory stagingMemory;
+	Instance          *mappedStaging   = nullptr;
+	VkDeviceSize       lastUpload      = 0;
+
+	std::vector<Instance>   instances;     // dense, by slot
+	std::vector<InstanceId> slotIds;
+	std::vector<uint32_t>   idSlots;       // NO_SLOT for freed ids
+	std::vector<InstanceId> freeIds;
+	std::vector<uint8_t>    dirty;         // by slot
+	std::vector<uint32_t>   dirtySlots;
+	bool                    allDirty = false;
+	std::vector<uint32_t>   meshCounts;
+};
+
+#endif
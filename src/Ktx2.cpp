@@ -0,0 +1,309 @@
+#include "Ktx2.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+static const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+struct Ktx2Header
+{
+	uint8_t  identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must be packed");
+
+struct Ktx2LevelIndex
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+// Texel block extent and size of the formats the runtime can upload.
+struct BlockShape
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t bytes;
+};
+
+static bool blockShape(VkFormat format, BlockShape &shape)
+{
+	switch (format)
+	{
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+			shape = {4, 4, 8};
+			return true;
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+		case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+		case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+			shape = {4, 4, 16};
+			return true;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			shape = {1, 1, 4};
+			return true;
+		default:
+			return false;
+	}
+}
+
+// Parses the header and level index at the start of the file. fileSize
+// bounds the level ranges. Every level has to hold exactly the blocks of
+// its extent and start on a block boundary, since uploads copy whole
+// levels straight from the file.
+static Ktx2Texture parseIndex(const std::string &filename, const char *data, size_t size, uint64_t fileSize)
+{
+	Ktx2Header header;
+	if (size < sizeof(header))
+	{
+		throw std::runtime_error("\"" + filename + "\" is not a KTX2 file");
+	}
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+	{
+		throw std::runtime_error("\"" + filename + "\" is not a KTX2 file");
+	}
+	if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.supercompressionScheme != 0)
+	{
+		throw std::runtime_error("\"" + filename + "\" uses unsupported KTX2 features");
+	}
+
+	BlockShape block;
+	if (!blockShape(static_cast<VkFormat>(header.vkFormat), block) || header.pixelWidth == 0 || header.pixelHeight == 0)
+	{
+		throw std::runtime_error("\"" + filename + "\" uses unsupported KTX2 features");
+	}
+
+	Ktx2Texture texture;
+	texture.format = static_cast<VkFormat>(header.vkFormat);
+	texture.width  = header.pixelWidth;
+	texture.height = header.pixelHeight;
+
+	// Levels past 1x1 would each clamp to a single block and pass the size
+	// checks below, so the count is capped at the full chain.
+	uint32_t levelCount = header.levelCount > 0 ? header.levelCount : 1;
+	uint32_t fullChain  = 1;
+	while ((static_cast<uint64_t>(std::max(header.pixelWidth, header.pixelHeight)) >> fullChain) > 0)
+	{
+		++fullChain;
+	}
+	if (levelCount > fullChain)
+	{
+		throw std::runtime_error("\"" + filename + "\" has more levels than its extent allows");
+	}
+	if (sizeof(header) + levelCount * sizeof(Ktx2LevelIndex) > size)
+	{
+		throw std::runtime_error("\"" + filename + "\" is truncated");
+	}
+	for (uint32_t i = 0; i < levelCount; ++i)
+	{
+		Ktx2LevelIndex index;
+		memcpy(&index, data + sizeof(header) + i * sizeof(index), sizeof(index));
+		if (index.byteOffset > fileSize || index.byteLength > fileSize - index.byteOffset)
+		{
+			throw std::runtime_error("\"" + filename + "\" is truncated");
+		}
+		uint64_t levelWidth  = std::max(header.pixelWidth >> std::min(i, 31u), 1u);
+		uint64_t levelHeight = std::max(header.pixelHeight >> std::min(i, 31u), 1u);
+		uint64_t levelBytes  = (levelWidth + block.width - 1) / block.width * ((levelHeight + block.height - 1) / block.height) * block.bytes;
+		if (index.byteLength != levelBytes || index.byteOffset % std::max(block.bytes, 4u) != 0)
+		{
+			throw std::runtime_error("\"" + filename + "\" has a malformed level " + std::to_string(i));
+		}
+		texture.levels.push_back({index.byteOffset, index.byteLength});
+	}
+	return texture;
+}
+
+Ktx2Texture loadKtx2(const std::string &filename)
+{
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open a file \"" + filename + "\"");
+	}
+
+	std::vector<char> data(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(data.data(), data.size());
+
+	Ktx2Texture texture = parseIndex(filename, data.data(), data.size(), data.size());
+	texture.data        = std::move(data);
+	return texture;
+}
+
+Ktx2Texture loadKtx2Index(const std::string &filename)
+{
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open a file \"" + filename + "\"");
+	}
+	uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+	file.seekg(0);
+
+	// Header plus the index of up to 32 levels, enough for any 2D image.
+	std::vector<char> data(static_cast<size_t>(std::min<uint64_t>(fileSize, sizeof(Ktx2Header) + 32 * sizeof(Ktx2LevelIndex))));
+	file.read(data.data(), data.size());
+	return parseIndex(filename, data.data(), data.size(), fileSize);
+}
+
+Ktx2Texture loadKtx2Index(const std::string &filename, const uint8_t *data, size_t size)
+{
+	return parseIndex(filename, reinterpret_cast<const char *>(data), size, size);
+}
+
+std::vector<uint8_t> readKtx2Level(const std::string &filename, const Ktx2Level &level)
+{
+	std::vector<uint8_t> data(static_cast<size_t>(level.size));
+	readKtx2Level(filename, level, data.data());
+	return data;
+}
+
+void readKtx2Level(const std::string &filename, const Ktx2Level &level, void *data)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open a file \"" + filename + "\"");
+	}
+	file.seekg(static_cast<std::streamoff>(level.offset));
+	file.read(static_cast<char *>(data), static_cast<std::streamsize>(level.size));
+	if (!file)
+	{
+		throw std::runtime_error("\"" + filename + "\" is truncated");
+	}
+}
+
+// Basic data format descriptor with a single sample covering the block.
+static std::vector<uint32_t> basicDescriptor(VkFormat format)
+{
+	uint32_t model, bytesPerBlock, transfer;
+	switch (format)
+	{
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+			model         = 128;    // KHR_DF_MODEL_BC1A
+			bytesPerBlock = 8;
+			break;
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			model         = 134;    // KHR_DF_MODEL_BC7
+			bytesPerBlock = 16;
+			break;
+		default:
+			throw std::runtime_error("Writing this format to KTX2 is not supported");
+	}
+	transfer = (format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK) ? 2 : 1;
+
+	const uint32_t blockSize = 24 + 16;
+	return {
+	    4 + blockSize,                                  // dfdTotalSize
+	    0,                                              // vendorId, descriptorType
+	    2 | (blockSize << 16),                          // versionNumber, descriptorBlockSize
+	    model | (1 << 8) | (transfer << 16),            // colorModel, BT.709 primaries, transfer, flags
+	    3 | (3 << 8),                                   // 4x4 texel block
+	    bytesPerBlock,                                  // bytesPlane0..3
+	    0,                                              // bytesPlane4..7
+	    ((bytesPerBlock * 8 - 1) << 16),                // bitOffset 0, bitLength, channel 0
+	    0,                                              // samplePosition
+	    0,                                              // sampleLower
+	    0xFFFFFFFFu};                                   // sampleUpper
+}
+
+void writeKtx2(const std::string &filename, VkFormat format, uint32_t width, uint32_t height,
+               const std::vector<std::vector<uint8_t>> &levels)
+{
+	std::vector<uint32_t> dfd = basicDescriptor(format);
+
+	Ktx2Header header{};
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vkFormat      = static_cast<uint32_t>(format);
+	header.typeSize      = 1;
+	header.pixelWidth    = width;
+	header.pixelHeight   = height;
+	header.faceCount     = 1;
+	header.levelCount    = static_cast<uint32_t>(levels.size());
+	header.dfdByteOffset = static_cast<uint32_t>(sizeof(header) + levels.size() * sizeof(Ktx2LevelIndex));
+	header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+	// Smallest level first, each aligned to the 16 byte block size.
+	std::vector<Ktx2LevelIndex> index(levels.size());
+	uint64_t                    offset = header.dfdByteOffset + header.dfdByteLength;
+	for (size_t i = levels.size(); i-- > 0;)
+	{
+		offset                          = (offset + 15) & ~uint64_t(15);
+		index[i].byteOffset             = offset;
+		index[i].byteLength             = levels[i].size();
+		index[i].uncompressedByteLength = levels[i].size();
+		offset += levels[i].size();
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open a file \"" + filename + "\"");
+	}
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(Ktx2LevelIndex));
+	file.write(reinterpret_cast<const char *>(dfd.data()), dfd.size() * sizeof(uint32_t));
+	for (size_t i = levels.size(); i-- > 0;)
+	{
+		static const char padding[16] = {};
+		file.write(padding, static_cast<std::streamsize>(index[i].byteOffset - static_cast<uint64_t>(file.tellp())));
+		file.write(reinterpret_cast<const char *>(levels[i].data()), levels[i].size());
+	}
+	if (!file)
+	{
+		throw std::runtime_error("Failed to write \"" + filename + "\"");
+	}
+}
+
+const char *ktx2FormatName(VkFormat format)
+{
+	switch (format)
+	{
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+			return "BC1";
+		case VK_FORMAT_BC7_UNORM_BLOCK:
+		case VK_FORMAT_BC7_SRGB_BLOCK:
+			return "BC7";
+		case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+		case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+			return "ASTC 4x4";
+		case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+		case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+			return "ETC2";
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			return "RGBA8";
+		default:
+			return "unknown";
+	}
+}
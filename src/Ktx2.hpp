@@ -0,0 +1,47 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Minimal KTX2 container support: single 2D image, no array layers, faces
+// or supercompression. Shared by the runtime loader and tools/texconv.
+
+struct Ktx2Level
+{
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct Ktx2Texture
+{
+	VkFormat               format = VK_FORMAT_UNDEFINED;
+	uint32_t               width  = 0;
+	uint32_t               height = 0;
+	std::vector<Ktx2Level> levels;    // levels[0] is the full resolution image
+	std::vector<char>      data;      // whole file, level offsets point into it
+};
+
+Ktx2Texture loadKtx2(const std::string &filename);
+
+// Header and level index only, data stays empty. Levels are then read one
+// at a time, which lets textures stream in without loading the whole file.
+Ktx2Texture          loadKtx2Index(const std::string &filename);
+std::vector<uint8_t> readKtx2Level(const std::string &filename, const Ktx2Level &level);
+void                 readKtx2Level(const std::string &filename, const Ktx2Level &level, void *data);    // level.size bytes
+
+// The index of a file already in memory, such as an asset pack entry. Level
+// offsets are relative to data, which isn't copied.
+Ktx2Texture loadKtx2Index(const std::string &filename, const uint8_t *data, size_t size);
+
+// Levels are passed largest first, already encoded in the given format.
+// Only BC1 and BC7 can be written.
+void writeKtx2(const std::string &filename, VkFormat format, uint32_t width, uint32_t height,
+               const std::vector<std::vector<uint8_t>> &levels);
+
+const char *ktx2FormatName(VkFormat format);
+
+#endif
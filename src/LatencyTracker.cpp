@@ -0,0 +1,69 @@
+#include "LatencyTracker.hpp"
+
+#include <algorithm>
+
+void LatencyTracker::inputReceived()
+{
+	// Later input before the next frame is picked up by the same frame.
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!inputPending)
+	{
+		inputTime    = Clock::now();
+		inputPending = true;
+	}
+}
+
+void LatencyTracker::frameStarted(uint64_t frameId)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (inputPending)
+	{
+		pending.push_back({frameId, inputTime});
+		inputPending = false;
+	}
+}
+
+void LatencyTracker::frameCompleted(uint64_t frameId)
+{
+	auto now = Clock::now();
+
+	// Completion is reported in order, anything older than frameId is done too.
+	std::lock_guard<std::mutex> lock(mutex);
+	while (!pending.empty() && pending.front().frameId <= frameId)
+	{
+		double latency = std::chrono::duration<double, std::milli>(now - pending.front().inputTime).count();
+		pending.pop_front();
+
+		minMs = samples == 0 ? latency : std::min(minMs, latency);
+		maxMs = samples == 0 ? latency : std::max(maxMs, latency);
+		sumMs += latency;
+		samples++;
+	}
+}
+
+void LatencyTracker::reset()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	pending.clear();
+	inputPending = false;
+}
+
+bool LatencyTracker::shouldReport()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return samples > 0 && Clock::now() - lastReport >= std::chrono::seconds(1);
+}
+
+void LatencyTracker::report(std::ostream &out, const char *method, const char *presentMode, uint32_t imageCount)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	out << "Latency [" << presentMode << ", " << imageCount << " images, " << method << "]: avg "
+	    << sumMs / samples << " ms, min " << minMs << " ms, max " << maxMs << " ms over "
+	    << samples << " frames\n";
+
+	lastReport = Clock::now();
+	sumMs      = 0.0;
+	minMs      = 0.0;
+	maxMs      = 0.0;
+	samples    = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef LATENCYTRACKER_H
+#define LATENCYTRACKER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+
+// Measures the time between the first input a frame picks up and that
+// frame reaching the display (VK_KHR_present_wait) or, without it, the GPU
+// finishing the frame's work (CPU-side estimate). Frames that start with no
+// new input are not sampled. Completion may be reported from another thread.
+class LatencyTracker
+{
+  public:
+	using Clock = std::chrono::steady_clock;
+
+	void inputReceived();
+	void frameStarted(uint64_t frameId);
+	void frameCompleted(uint64_t frameId);
+	void reset();
+
+	bool shouldReport();
+	void report(std::ostream &out, const char *method, const char *presentMode, uint32_t imageCount);
+
+  private:
+	struct PendingFrame
+	{
+		uint64_t          frameId;
+		Clock::time_point inputTime;
+	};
+
+	std::mutex               mutex;
+	Clock::time_point        inputTime;
+	bool                     inputPending = false;
+	std::deque<PendingFrame> pending;
+	Clock::time_point        lastReport = Clock::now();
+	double                   sumMs      = 0.0;
+	double                   minMs      = 0.0;
+	double                   maxMs      = 0.0;
+	uint32_t                 samples    = 0;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		mapped = std::exchange(other.mapped, nullptr);
+		length = std::exchange(other.length, 0);
+		opened = std::exchange(other.opened, false);
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+void MappedFile::open(const std::string &path)
+{
+	close();
+
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		throw std::runtime_error("Failed to open a file \"" + path + "\"");
+	}
+
+	struct stat status;
+	if (fstat(file, &status) != 0)
+	{
+		::close(file);
+		throw std::runtime_error("Failed to open a file \"" + path + "\"");
+	}
+
+	// The mapping keeps its own reference to the file.
+	length = static_cast<size_t>(status.st_size);
+	if (length > 0)
+	{
+		void *memory = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+		if (memory == MAP_FAILED)
+		{
+			::close(file);
+			length = 0;
+			throw std::runtime_error("Failed to map a file \"" + path + "\"");
+		}
+		mapped = static_cast<const uint8_t *>(memory);
+	}
+	::close(file);
+	opened = true;
+}
+
+void MappedFile::close()
+{
+	if (mapped != nullptr)
+	{
+		munmap(const_cast<uint8_t *>(mapped), length);
+	}
+	mapped = nullptr;
+	length = 0;
+	opened = false;
+}
+
+bool MappedFile::isOpen() const
+{
+	return opened;
+}
+
+const uint8_t *MappedFile::data() const
+{
+	return mapped;
+}
+
+size_t MappedFile::size() const
+{
+	return length;
+}
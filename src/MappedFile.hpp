@@ -0,0 +1,33 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped read-only, so its bytes are paged in on first touch
+// instead of being read into a heap copy. Empty files map to no data.
+class MappedFile
+{
+  public:
+	MappedFile() = default;
+	MappedFile(const MappedFile &)            = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	MappedFile(MappedFile &&other) noexcept;
+	MappedFile &operator=(MappedFile &&other) noexcept;
+	~MappedFile();
+
+	void open(const std::string &path);
+	void close();
+
+	bool           isOpen() const;
+	const uint8_t *data() const;
+	size_t         size() const;
+
+  private:
+	const uint8_t *mapped = nullptr;
+	size_t         length = 0;
+	bool           opened = false;
+};
+
+#endif
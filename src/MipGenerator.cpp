@@ -0,0 +1,250 @@
+#include "MipGenerator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "VulkanUtils.hpp"
+
+static bool getStorageFormat(VkFormat format, VkFormat &storageFormat, bool &srgb)
+{
+	switch (format)
+	{
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			storageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+			srgb          = true;
+			return true;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+			storageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+			srgb          = false;
+			return true;
+		default:
+			return false;
+	}
+}
+
+void MipGenerator::create(VkDevice device, VkPhysicalDevice physicalDevice, ObjectCache &objectCache, const std::string &shaderPath)
+{
+	this->device         = device;
+	this->physicalDevice = physicalDevice;
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+	bindings[0].binding         = 0;
+	bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding         = 1;
+	bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].descriptorCount = MIPS_PER_DISPATCH;
+	bindings[1].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings    = bindings.data();
+	descriptorSetLayout     = objectCache.descriptorSetLayout(layoutInfo);
+
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset     = 0;
+	pushConstantRange.size       = sizeof(PushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount         = 1;
+	pipelineLayoutInfo.pSetLayouts            = &descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges    = &pushConstantRange;
+	pipelineLayout                            = objectCache.pipelineLayout(pipelineLayoutInfo);
+
+	UniqueShaderModule shaderModule(device, createShaderModule(device, loadSpirv(shaderPath)));
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName  = "main";
+	pipelineInfo.layout       = pipelineLayout;
+	VkResult result           = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, pipeline.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+}
+
+void MipGenerator::destroy()
+{
+	levelViews.clear();
+	descriptorPool.reset();
+	pipeline.reset();
+	pipelineLayout      = VK_NULL_HANDLE;
+	descriptorSetLayout = VK_NULL_HANDLE;
+}
+
+bool MipGenerator::supports(VkFormat format) const
+{
+	VkFormat storageFormat;
+	bool     srgb;
+	if (pipeline.get() == VK_NULL_HANDLE || !getStorageFormat(format, storageFormat, srgb))
+	{
+		return false;
+	}
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, storageFormat, &formatProperties);
+	return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
+}
+
+VkImageCreateFlags MipGenerator::imageCreateFlags()
+{
+	// The sRGB format itself cannot be a storage image, only its UNORM view.
+	return VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+}
+
+uint32_t MipGenerator::dispatchCount(uint32_t mipLevels)
+{
+	return (mipLevels - 1 + MIPS_PER_DISPATCH - 1) / MIPS_PER_DISPATCH;
+}
+
+void MipGenerator::record(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, uint32_t mipLevels)
+{
+	VkFormat storageFormat;
+	bool     srgb;
+	if (!getStorageFormat(format, storageFormat, srgb))
+	{
+		throw std::runtime_error("Format not supported by the compute mip generator!");
+	}
+
+	levelViews.clear();
+	descriptorPool.reset();
+
+	uint32_t dispatches = dispatchCount(mipLevels);
+
+	VkImageMemoryBarrier barrier{};
+	barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image                           = image;
+	barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel   = 0;
+	barrier.subresourceRange.levelCount     = mipLevels;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount     = 1;
+	barrier.oldLayout                       = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout                       = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcAccessMask                   = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask                   = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	if (dispatches > 0)
+	{
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type            = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		poolSize.descriptorCount = dispatches * (1 + MIPS_PER_DISPATCH);
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.maxSets       = dispatches;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes    = &poolSize;
+		VkResult result        = vkCreateDescriptorPool(device, &poolInfo, nullptr, descriptorPool.put(device));
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(result));
+		}
+
+		std::vector<VkDescriptorSetLayout> setLayouts(dispatches, descriptorSetLayout);
+		std::vector<VkDescriptorSet>       descriptorSets(dispatches);
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool     = descriptorPool;
+		allocInfo.descriptorSetCount = dispatches;
+		allocInfo.pSetLayouts        = setLayouts.data();
+		result                       = vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data());
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(result));
+		}
+
+		for (uint32_t level = 0; level < mipLevels; ++level)
+		{
+			VkImageViewCreateInfo viewInfo{};
+			viewInfo.sType                           = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image                           = image;
+			viewInfo.viewType                        = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format                          = storageFormat;
+			viewInfo.subresourceRange.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+			viewInfo.subresourceRange.baseMipLevel   = level;
+			viewInfo.subresourceRange.levelCount     = 1;
+			viewInfo.subresourceRange.baseArrayLayer = 0;
+			viewInfo.subresourceRange.layerCount     = 1;
+			levelViews.emplace_back();
+			result = vkCreateImageView(device, &viewInfo, nullptr, levelViews.back().put(device));
+			if (result != VK_SUCCESS)
+			{
+				throw std::runtime_error(err2msg(result));
+			}
+		}
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+		for (uint32_t d = 0; d < dispatches; ++d)
+		{
+			uint32_t baseLevel = d * MIPS_PER_DISPATCH;
+			uint32_t levels    = std::min(MIPS_PER_DISPATCH, mipLevels - 1 - baseLevel);
+
+			// Unused destination slots repeat the last level, the shader skips them.
+			VkDescriptorImageInfo                                srcInfo{VK_NULL_HANDLE, levelViews[baseLevel], VK_IMAGE_LAYOUT_GENERAL};
+			std::array<VkDescriptorImageInfo, MIPS_PER_DISPATCH> dstInfos;
+			for (uint32_t i = 0; i < MIPS_PER_DISPATCH; ++i)
+			{
+				dstInfos[i] = {VK_NULL_HANDLE, levelViews[baseLevel + std::min(i + 1, levels)], VK_IMAGE_LAYOUT_GENERAL};
+			}
+
+			std::array<VkWriteDescriptorSet, 2> writes{};
+			writes[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[0].dstSet          = descriptorSets[d];
+			writes[0].dstBinding      = 0;
+			writes[0].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[0].descriptorCount = 1;
+			writes[0].pImageInfo      = &srcInfo;
+			writes[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[1].dstSet          = descriptorSets[d];
+			writes[1].dstBinding      = 1;
+			writes[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[1].descriptorCount = MIPS_PER_DISPATCH;
+			writes[1].pImageInfo      = dstInfos.data();
+			vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+			PushConstants constants{};
+			constants.srcWidth  = static_cast<int32_t>(std::max(extent.width >> baseLevel, 1u));
+			constants.srcHeight = static_cast<int32_t>(std::max(extent.height >> baseLevel, 1u));
+			constants.levels    = static_cast<int32_t>(levels);
+			constants.srgb      = srgb ? 1 : 0;
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[d], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+			uint32_t dstWidth  = std::max(static_cast<uint32_t>(constants.srcWidth) >> 1, 1u);
+			uint32_t dstHeight = std::max(static_cast<uint32_t>(constants.srcHeight) >> 1, 1u);
+			vkCmdDispatch(commandBuffer, (dstWidth + 15) / 16, (dstHeight + 15) / 16, 1);
+
+			if (d + 1 < dispatches)
+			{
+				// The last level written here is the source of the next dispatch.
+				VkMemoryBarrier memoryBarrier{};
+				memoryBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+			}
+		}
+	}
+
+	barrier.oldLayout     = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
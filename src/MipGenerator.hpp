@@ -0,0 +1,51 @@
+#ifndef MIPGENERATOR_H
+#define MIPGENERATOR_H
+
+#include <string>
+#include <vector>
+
+#include "ObjectCache.hpp"
+#include "VulkanHandles.hpp"
+
+// Fills the mip chain of an RGBA8 image with a compute shader that writes
+// several levels per dispatch. sRGB images are averaged in linear space
+// through UNORM storage views, so the image has to be created with
+// imageCreateFlags() and VK_IMAGE_USAGE_STORAGE_BIT.
+class MipGenerator
+{
+  public:
+	static constexpr uint32_t MIPS_PER_DISPATCH = 4;
+
+	// Layouts come from the cache and are not destroyed here.
+	void create(VkDevice device, VkPhysicalDevice physicalDevice, ObjectCache &objectCache, const std::string &shaderPath);
+	void destroy();
+
+	bool                      supports(VkFormat format) const;
+	static VkImageCreateFlags imageCreateFlags();
+	static uint32_t           dispatchCount(uint32_t mipLevels);
+
+	// Expects every level in TRANSFER_DST_OPTIMAL with level 0 filled and
+	// leaves every level in SHADER_READ_ONLY_OPTIMAL. The per-level views
+	// stay alive until the next call, so the commands must have finished
+	// before recording again.
+	void record(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkExtent2D extent, uint32_t mipLevels);
+
+  private:
+	struct PushConstants
+	{
+		int32_t srcWidth;
+		int32_t srcHeight;
+		int32_t levels;
+		int32_t srgb;
+	};
+
+	VkDevice                     device         = VK_NULL_HANDLE;
+	VkPhysicalDevice             physicalDevice = VK_NULL_HANDLE;
+	VkDescriptorSetLayout        descriptorSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout             pipelineLayout      = VK_NULL_HANDLE;
+	UniquePipeline               pipeline;
+	UniqueDescriptorPool         descriptorPool;
+	std::vector<UniqueImageView> levelViews;
+};
+
+#endif
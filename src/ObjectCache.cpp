@@ -0,0 +1,194 @@
+#include "ObjectCache.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "VulkanUtils.hpp"
+
+// Keys are the create info fields packed into bytes. Structs are appended
+// member by member where padding or pointers would make memcpy unreliable.
+template <typename T>
+static void append(std::string &key, const T &value)
+{
+	key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename UniqueT, typename Create>
+static auto lookup(std::unordered_map<std::string, UniqueT> &objects, uint64_t &hits, uint64_t &misses,
+                   const std::string &key, VkDevice device, Create create)
+{
+	auto found = objects.find(key);
+	if (found != objects.end())
+	{
+		hits++;
+		return found->second.get();
+	}
+	misses++;
+
+	UniqueT  object;
+	VkResult result = create(object.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	auto handle = object.get();
+	objects.emplace(key, std::move(object));
+	return handle;
+}
+
+template <typename UniqueT>
+ObjectCache::Stats ObjectCache::Cache<UniqueT>::stats() const
+{
+	Stats stats;
+	stats.hits   = hits;
+	stats.misses = misses;
+	stats.live   = objects.size();
+	return stats;
+}
+
+void ObjectCache::create(VkDevice device)
+{
+	this->device = device;
+}
+
+void ObjectCache::destroy()
+{
+	pipelineLayouts.objects.clear();
+	descriptorSetLayouts.objects.clear();
+	samplers.objects.clear();
+}
+
+VkSampler ObjectCache::sampler(const VkSamplerCreateInfo &info)
+{
+	std::string key;
+	append(key, info.flags);
+	append(key, info.magFilter);
+	append(key, info.minFilter);
+	append(key, info.mipmapMode);
+	append(key, info.addressModeU);
+	append(key, info.addressModeV);
+	append(key, info.addressModeW);
+	append(key, info.mipLodBias);
+	append(key, info.anisotropyEnable);
+	append(key, info.maxAnisotropy);
+	append(key, info.compareEnable);
+	append(key, info.compareOp);
+	append(key, info.minLod);
+	append(key, info.maxLod);
+	append(key, info.borderColor);
+	append(key, info.unnormalizedCoordinates);
+
+	for (auto next = static_cast<const VkBaseInStructure *>(info.pNext); next != nullptr; next = next->pNext)
+	{
+		if (next->sType != VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO)
+		{
+			throw std::runtime_error("Sampler create info has an unsupported pNext structure");
+		}
+		append(key, reinterpret_cast<const VkSamplerReductionModeCreateInfo *>(next)->reductionMode);
+	}
+
+	auto create = [&](VkSampler *sampler) {
+		return vkCreateSampler(device, &info, nullptr, sampler);
+	};
+	return lookup(samplers.objects, samplers.hits, samplers.misses, key, device, create);
+}
+
+VkDescriptorSetLayout ObjectCache::descriptorSetLayout(const VkDescriptorSetLayoutCreateInfo &info)
+{
+	const VkDescriptorBindingFlags *bindingFlags = nullptr;
+	for (auto next = static_cast<const VkBaseInStructure *>(info.pNext); next != nullptr; next = next->pNext)
+	{
+		if (next->sType != VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO)
+		{
+			throw std::runtime_error("Descriptor set layout create info has an unsupported pNext structure");
+		}
+		auto flagsInfo = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfo *>(next);
+		bindingFlags   = flagsInfo->bindingCount > 0 ? flagsInfo->pBindingFlags : nullptr;
+	}
+
+	// Bindings sorted by number, each with its flags.
+	std::vector<uint32_t> order(info.bindingCount);
+	for (uint32_t i = 0; i < info.bindingCount; ++i)
+	{
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return info.pBindings[a].binding < info.pBindings[b].binding; });
+
+	std::string key;
+	append(key, info.flags);
+	for (uint32_t i : order)
+	{
+		const VkDescriptorSetLayoutBinding &binding = info.pBindings[i];
+		append(key, binding.binding);
+		append(key, binding.descriptorType);
+		append(key, binding.descriptorCount);
+		append(key, binding.stageFlags);
+		append(key, bindingFlags != nullptr ? bindingFlags[i] : VkDescriptorBindingFlags(0));
+		if (binding.pImmutableSamplers != nullptr)
+		{
+			key.append(reinterpret_cast<const char *>(binding.pImmutableSamplers), binding.descriptorCount * sizeof(VkSampler));
+		}
+	}
+
+	auto create = [&](VkDescriptorSetLayout *layout) {
+		return vkCreateDescriptorSetLayout(device, &info, nullptr, layout);
+	};
+	return lookup(descriptorSetLayouts.objects, descriptorSetLayouts.hits, descriptorSetLayouts.misses, key, device, create);
+}
+
+VkPipelineLayout ObjectCache::pipelineLayout(const VkPipelineLayoutCreateInfo &info)
+{
+	if (info.pNext != nullptr)
+	{
+		throw std::runtime_error("Pipeline layout create info has an unsupported pNext structure");
+	}
+
+	// Set layouts come from this cache, so equal layouts have equal handles.
+	std::string key;
+	append(key, info.flags);
+	append(key, info.setLayoutCount);
+	key.append(reinterpret_cast<const char *>(info.pSetLayouts), info.setLayoutCount * sizeof(VkDescriptorSetLayout));
+	for (uint32_t i = 0; i < info.pushConstantRangeCount; ++i)
+	{
+		append(key, info.pPushConstantRanges[i].stageFlags);
+		append(key, info.pPushConstantRanges[i].offset);
+		append(key, info.pPushConstantRanges[i].size);
+	}
+
+	auto create = [&](VkPipelineLayout *layout) {
+		return vkCreatePipelineLayout(device, &info, nullptr, layout);
+	};
+	return lookup(pipelineLayouts.objects, pipelineLayouts.hits, pipelineLayouts.misses, key, device, create);
+}
+
+ObjectCache::Stats ObjectCache::samplerStats() const
+{
+	return samplers.stats();
+}
+
+ObjectCache::Stats ObjectCache::descriptorSetLayoutStats() const
+{
+	return descriptorSetLayouts.stats();
+}
+
+ObjectCache::Stats ObjectCache::pipelineLayoutStats() const
+{
+	return pipelineLayouts.stats();
+}
+
+void ObjectCache::printStats() const
+{
+	auto print = [](const char *name, const Stats &stats) {
+		uint64_t requests = stats.hits + stats.misses;
+		double   hitRate  = requests > 0 ? 100.0 * stats.hits / requests : 0.0;
+		std::cout << "  " << name << ": " << stats.live << " live, " << stats.hits << "/" << requests << " hits ("
+		          << hitRate << "%)\n";
+	};
+
+	std::cout << "Object cache\n";
+	print("samplers", samplerStats());
+	print("descriptor set layouts", descriptorSetLayoutStats());
+	print("pipeline layouts", pipelineLayoutStats());
+}
@@ -0,0 +1,55 @@
+#ifndef OBJECTCACHE_H
+#define OBJECTCACHE_H
+
+#include <string>
+#include <unordered_map>
+
+#include "VulkanHandles.hpp"
+
+// Hash-consed samplers, descriptor set layouts and pipeline layouts. Create
+// infos with the same contents return the same handle, which the cache owns
+// until destroy(). Descriptor set layouts are keyed independently of the
+// binding order, so equal layouts also produce equal pipeline layout keys.
+class ObjectCache
+{
+  public:
+	struct Stats
+	{
+		uint64_t hits   = 0;
+		uint64_t misses = 0;
+		size_t   live   = 0;
+	};
+
+	void create(VkDevice device);
+	void destroy();
+
+	// Supported pNext structures: VkSamplerReductionModeCreateInfo and
+	// VkDescriptorSetLayoutBindingFlagsCreateInfo. Anything else throws,
+	// since it would not be part of the key.
+	VkSampler             sampler(const VkSamplerCreateInfo &info);
+	VkDescriptorSetLayout descriptorSetLayout(const VkDescriptorSetLayoutCreateInfo &info);
+	VkPipelineLayout      pipelineLayout(const VkPipelineLayoutCreateInfo &info);
+
+	Stats samplerStats() const;
+	Stats descriptorSetLayoutStats() const;
+	Stats pipelineLayoutStats() const;
+	void  printStats() const;
+
+  private:
+	template <typename UniqueT>
+	struct Cache
+	{
+		std::unordered_map<std::string, UniqueT> objects;
+		uint64_t                                 hits   = 0;
+		uint64_t                                 misses = 0;
+
+		Stats stats() const;
+	};
+
+	VkDevice                         device = VK_NULL_HANDLE;
+	Cache<UniqueSampler>             samplers;
+	Cache<UniqueDescriptorSetLayout> descriptorSetLayouts;
+	Cache<UniquePipelineLayout>      pipelineLayouts;
+};
+
+#endif
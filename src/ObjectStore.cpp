@@ -0,0 +1,297 @@
+#include "ObjectStore.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OBJECTSTORE_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+struct BoundsView
+{
+	const float *centerX, *centerY, *centerZ, *radius;
+	const float *minX, *minY, *minZ, *maxX, *maxY, *maxZ;
+};
+
+// Per plane the box corner furthest along the normal, as one array per axis.
+struct CornerArrays
+{
+	const float *x[6], *y[6], *z[6];
+};
+
+CornerArrays cornerArrays(const BoundsView &bounds, const std::array<glm::vec4, 6> &planes)
+{
+	CornerArrays corners;
+	for (int p = 0; p < 6; ++p)
+	{
+		corners.x[p] = planes[p].x > 0.0f ? bounds.maxX : bounds.minX;
+		corners.y[p] = planes[p].y > 0.0f ? bounds.maxY : bounds.minY;
+		corners.z[p] = planes[p].z > 0.0f ? bounds.maxZ : bounds.minZ;
+	}
+	return corners;
+}
+
+void cullScalar(const BoundsView &bounds, const std::array<glm::vec4, 6> &planes, uint32_t begin, uint32_t end,
+                std::vector<uint32_t> &visible)
+{
+	CornerArrays corners = cornerArrays(bounds, planes);
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; ++p)
+		{
+			const glm::vec4 &plane  = planes[p];
+			float            sphere = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+			float            box    = plane.x * corners.x[p][i] + plane.y * corners.y[p][i] + plane.z * corners.z[p][i] + plane.w;
+			inside                  = sphere >= -bounds.radius[i] && box >= 0.0f;
+		}
+		if (inside)
+		{
+			visible.push_back(i);
+		}
+	}
+}
+
+#ifdef OBJECTSTORE_X86
+void appendMask(uint32_t mask, uint32_t base, std::vector<uint32_t> &visible)
+{
+	while (mask != 0)
+	{
+		visible.push_back(base + static_cast<uint32_t>(__builtin_ctz(mask)));
+		mask &= mask - 1;
+	}
+}
+
+__attribute__((target("sse2"))) void cullSse2(const BoundsView &bounds, const std::array<glm::vec4, 6> &planes, uint32_t begin,
+                                              uint32_t end, std::vector<uint32_t> &visible)
+{
+	CornerArrays corners = cornerArrays(bounds, planes);
+	__m128       a[6], b[6], c[6], d[6];
+	for (int p = 0; p < 6; ++p)
+	{
+		a[p] = _mm_set1_ps(planes[p].x);
+		b[p] = _mm_set1_ps(planes[p].y);
+		c[p] = _mm_set1_ps(planes[p].z);
+		d[p] = _mm_set1_ps(planes[p].w);
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	uint32_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 x      = _mm_loadu_ps(bounds.centerX + i);
+		__m128 y      = _mm_loadu_ps(bounds.centerY + i);
+		__m128 z      = _mm_loadu_ps(bounds.centerZ + i);
+		__m128 r      = _mm_sub_ps(zero, _mm_loadu_ps(bounds.radius + i));
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+		for (int p = 0; p < 6; ++p)
+		{
+			__m128 sphere = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], x), _mm_mul_ps(b[p], y)), _mm_add_ps(_mm_mul_ps(c[p], z), d[p]));
+			__m128 box    = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p], _mm_loadu_ps(corners.x[p] + i)), _mm_mul_ps(b[p], _mm_loadu_ps(corners.y[p] + i))),
+			                           _mm_add_ps(_mm_mul_ps(c[p], _mm_loadu_ps(corners.z[p] + i)), d[p]));
+			inside        = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(sphere, r), _mm_cmpge_ps(box, zero)));
+		}
+		appendMask(static_cast<uint32_t>(_mm_movemask_ps(inside)), i, visible);
+	}
+	cullScalar(bounds, planes, i, end, visible);
+}
+
+__attribute__((target("avx2,fma"))) void cullAvx2(const BoundsView &bounds, const std::array<glm::vec4, 6> &planes, uint32_t begin,
+                                                  uint32_t end, std::vector<uint32_t> &visible)
+{
+	CornerArrays corners = cornerArrays(bounds, planes);
+	__m256       a[6], b[6], c[6], d[6];
+	for (int p = 0; p < 6; ++p)
+	{
+		a[p] = _mm256_set1_ps(planes[p].x);
+		b[p] = _mm256_set1_ps(planes[p].y);
+		c[p] = _mm256_set1_ps(planes[p].z);
+		d[p] = _mm256_set1_ps(planes[p].w);
+	}
+	const __m256 zero = _mm256_setzero_ps();
+
+	uint32_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 x      = _mm256_loadu_ps(bounds.centerX + i);
+		__m256 y      = _mm256_loadu_ps(bounds.centerY + i);
+		__m256 z      = _mm256_loadu_ps(bounds.centerZ + i);
+		__m256 r      = _mm256_sub_ps(zero, _mm256_loadu_ps(bounds.radius + i));
+		__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+		for (int p = 0; p < 6; ++p)
+		{
+			__m256 sphere = _mm256_fmadd_ps(a[p], x, _mm256_fmadd_ps(b[p], y, _mm256_fmadd_ps(c[p], z, d[p])));
+			__m256 box    = _mm256_fmadd_ps(a[p], _mm256_loadu_ps(corners.x[p] + i),
+			                                _mm256_fmadd_ps(b[p], _mm256_loadu_ps(corners.y[p] + i),
+			                                                _mm256_fmadd_ps(c[p], _mm256_loadu_ps(corners.z[p] + i), d[p])));
+			inside        = _mm256_and_ps(inside, _mm256_and_ps(_mm256_cmp_ps(sphere, r, _CMP_GE_OQ), _mm256_cmp_ps(box, zero, _CMP_GE_OQ)));
+		}
+		appendMask(static_cast<uint32_t>(_mm256_movemask_ps(inside)), i, visible);
+	}
+	cullScalar(bounds, planes, i, end, visible);
+}
+#endif
+}        // namespace
+
+ObjectStore::Kernel ObjectStore::bestKernel()
+{
+#ifdef OBJECTSTORE_X86
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+	{
+		return Kernel::Avx2;
+	}
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return Kernel::Sse2;
+	}
+#endif
+	return Kernel::Scalar;
+}
+
+const char *ObjectStore::kernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+		case Kernel::Avx2:
+			return "avx2";
+		case Kernel::Sse2:
+			return "sse2";
+		default:
+			return "scalar";
+	}
+}
+
+void ObjectStore::setKernel(Kernel kernel)
+{
+	this->kernel = kernel;
+}
+
+uint32_t ObjectStore::add(const glm::mat4 &transform, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, uint32_t mesh)
+{
+	for (std::vector<float> *field : boundsFields())
+	{
+		field->push_back(0.0f);
+	}
+	transforms.push_back(transform);
+	localMin.push_back(boundsMin);
+	localMax.push_back(boundsMax);
+	meshes.push_back(mesh);
+
+	uint32_t slot = size() - 1;
+	updateBounds(slot);
+	return slot;
+}
+
+void ObjectStore::setTransform(uint32_t slot, const glm::mat4 &transform)
+{
+	transforms[slot] = transform;
+	updateBounds(slot);
+}
+
+void ObjectStore::remove(uint32_t slot)
+{
+	auto moveLast = [&](auto &field) {
+		field[slot] = field.back();
+		field.pop_back();
+	};
+	for (std::vector<float> *field : boundsFields())
+	{
+		moveLast(*field);
+	}
+	moveLast(transforms);
+	moveLast(localMin);
+	moveLast(localMax);
+	moveLast(meshes);
+}
+
+void ObjectStore::clear()
+{
+	for (std::vector<float> *field : boundsFields())
+	{
+		field->clear();
+	}
+	transforms.clear();
+	localMin.clear();
+	localMax.clear();
+	meshes.clear();
+}
+
+std::array<std::vector<float> *, 10> ObjectStore::boundsFields()
+{
+	return {&centerX, &centerY, &centerZ, &radius, &minX, &minY, &minZ, &maxX, &maxY, &maxZ};
+}
+
+uint32_t ObjectStore::size() const
+{
+	return static_cast<uint32_t>(transforms.size());
+}
+
+const glm::mat4 &ObjectStore::transform(uint32_t slot) const
+{
+	return transforms[slot];
+}
+
+uint32_t ObjectStore::mesh(uint32_t slot) const
+{
+	return meshes[slot];
+}
+
+void ObjectStore::updateBounds(uint32_t slot)
+{
+	// World box from the transformed center and the extents projected onto
+	// each world axis, sphere around the box.
+	const glm::mat4 &m       = transforms[slot];
+	glm::vec3        center  = glm::vec3(m * glm::vec4((localMin[slot] + localMax[slot]) * 0.5f, 1.0f));
+	glm::vec3        extents = (localMax[slot] - localMin[slot]) * 0.5f;
+	glm::mat3        axes(m);
+	glm::vec3        worldExtents = glm::abs(axes[0]) * extents.x + glm::abs(axes[1]) * extents.y + glm::abs(axes[2]) * extents.z;
+	float            scale        = std::max({glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2])});
+
+	centerX[slot] = center.x;
+	centerY[slot] = center.y;
+	centerZ[slot] = center.z;
+	radius[slot]  = glm::length(extents) * scale;
+	minX[slot]    = center.x - worldExtents.x;
+	minY[slot]    = center.y - worldExtents.y;
+	minZ[slot]    = center.z - worldExtents.z;
+	maxX[slot]    = center.x + worldExtents.x;
+	maxY[slot]    = center.y + worldExtents.y;
+	maxZ[slot]    = center.z + worldExtents.z;
+}
+
+void ObjectStore::cull(const std::array<glm::vec4, 6> &planes, ThreadPool &pool, std::vector<uint32_t> &visible)
+{
+	BoundsView bounds = {centerX.data(), centerY.data(), centerZ.data(), radius.data(), minX.data(),
+	                     minY.data(),    minZ.data(),    maxX.data(),    maxY.data(),   maxZ.data()};
+
+	auto cullRange = cullScalar;
+#ifdef OBJECTSTORE_X86
+	if (kernel == Kernel::Avx2)
+	{
+		cullRange = cullAvx2;
+	}
+	else if (kernel == Kernel::Sse2)
+	{
+		cullRange = cullSse2;
+	}
+#endif
+
+	uint32_t chunks = (size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	if (chunkVisible.size() < chunks)
+	{
+		chunkVisible.resize(chunks);
+	}
+	pool.run(chunks, [&](uint32_t chunk) {
+		uint32_t begin = chunk * CHUNK_SIZE;
+		chunkVisible[chunk].clear();
+		cullRange(bounds, planes, begin, std::min(begin + CHUNK_SIZE, size()), chunkVisible[chunk]);
+	});
+
+	visible.clear();
+	for (uint32_t chunk = 0; chunk < chunks; ++chunk)
+	{
+		visible.insert(visible.end(), chunkVisible[chunk].begin(), chunkVisible[chunk].end());
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef OBJECTSTORE_H
+#define OBJECTSTORE_H
+
+#include <array>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+
+// Scene objects kept as structure of arrays, one array per field, so the
+// culling loop streams just the world space bounds it tests, several
+// objects per SIMD register. Objects are addressed by dense slot; removal
+// moves the last object into the freed slot.
+class ObjectStore
+{
+  public:
+	enum class Kernel
+	{
+		Scalar,
+		Sse2,
+		Avx2
+	};
+
+	// The best kernel the CPU runs is picked by default.
+	static Kernel      bestKernel();
+	static const char *kernelName(Kernel kernel);
+	void               setKernel(Kernel kernel);
+
+	// Bounds are the model space box of the object's mesh.
+	uint32_t         add(const glm::mat4 &transform, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, uint32_t mesh);
+	void             setTransform(uint32_t slot, const glm::mat4 &transform);
+	void             remove(uint32_t slot);
+	void             clear();
+	uint32_t         size() const;
+	const glm::mat4 &transform(uint32_t slot) const;
+	uint32_t         mesh(uint32_t slot) const;
+
+	// Replaces visible with the ascending slots of the objects whose world
+	// sphere and box both reach inside every plane. Chunks of objects are
+	// culled as tasks on the pool.
+	void cull(const std::array<glm::vec4, 6> &planes, ThreadPool &pool, std::vector<uint32_t> &visible);
+
+  private:
+	static constexpr uint32_t CHUNK_SIZE = 16384;
+
+	void                                 updateBounds(uint32_t slot);
+	std::array<std::vector<float> *, 10> boundsFields();
+
+	Kernel kernel = bestKernel();
+
+	// Hot: read by every cull
+	std::vector<float> centerX, centerY, centerZ, radius;
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+	// Cold: only read when an object moves or is drawn
+	std::vector<glm::mat4> transforms;
+	std::vector<glm::vec3> localMin, localMax;
+	std::vector<uint32_t>  meshes;
+
+	std::vector<std::vector<uint32_t>> chunkVisible;
+};
+
+#endif
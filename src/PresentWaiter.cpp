@@ -0,0 +1,71 @@
+#include "PresentWaiter.hpp"
+
+void PresentWaiter::start(VkDevice device, VkSwapchainKHR swapChain, PFN_vkWaitForPresentKHR waitForPresent, LatencyTracker &tracker)
+{
+	this->device         = device;
+	this->swapChain      = swapChain;
+	this->waitForPresent = waitForPresent;
+	this->tracker        = &tracker;
+	stopping             = false;
+	waiter               = std::thread(&PresentWaiter::waitLoop, this);
+}
+
+void PresentWaiter::stop()
+{
+	if (!waiter.joinable())
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	waiter.join();
+	presentIds.clear();
+}
+
+void PresentWaiter::presented(uint64_t presentId)
+{
+	if (!waiter.joinable())
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		presentIds.push_back(presentId);
+	}
+	wake.notify_one();
+}
+
+void PresentWaiter::waitLoop()
+{
+	// The timeout only bounds how long stop() may take.
+	const uint64_t timeout = 100'000'000;
+	while (true)
+	{
+		uint64_t presentId;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return stopping || !presentIds.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+			presentId = presentIds.front();
+		}
+
+		VkResult result = waitForPresent(device, swapChain, presentId, timeout);
+		if (result == VK_TIMEOUT)
+		{
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		presentIds.pop_front();
+		if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)
+		{
+			tracker->frameCompleted(presentId);
+		}
+	}
+}
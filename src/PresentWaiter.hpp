@@ -0,0 +1,42 @@
+#ifndef PRESENTWAITER_H
+#define PRESENTWAITER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <vulkan/vulkan.h>
+
+#include "LatencyTracker.hpp"
+
+// Waits for presents with VK_KHR_present_wait on a thread of its own and
+// reports each one to the tracker the moment the wait returns, rather than
+// whenever the render thread next looks. Bound to one swapchain, so it is
+// stopped before the swapchain is destroyed.
+class PresentWaiter
+{
+  public:
+	void start(VkDevice device, VkSwapchainKHR swapChain, PFN_vkWaitForPresentKHR waitForPresent, LatencyTracker &tracker);
+	void stop();
+
+	// Called after the present carrying presentId was queued.
+	void presented(uint64_t presentId);
+
+  private:
+	void waitLoop();
+
+	VkDevice                device         = VK_NULL_HANDLE;
+	VkSwapchainKHR          swapChain      = VK_NULL_HANDLE;
+	PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+	LatencyTracker         *tracker        = nullptr;
+	std::thread             waiter;
+
+	std::mutex              mutex;
+	std::condition_variable wake;
+	std::deque<uint64_t>    presentIds;
+	bool                    stopping = false;
+};
+
+#endif
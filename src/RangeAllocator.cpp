@@ -0,0 +1,75 @@
+#include "RangeAllocator.hpp"
+
+#include <iterator>
+
+void RangeAllocator::reset(uint64_t size)
+{
+	freeRanges.clear();
+	if (size > 0)
+	{
+		freeRanges[0] = size;
+	}
+	totalSize = size;
+	usedSize  = 0;
+}
+
+bool RangeAllocator::allocate(uint64_t size, uint64_t alignment, uint64_t &offset)
+{
+	for (auto range = freeRanges.begin(); range != freeRanges.end(); ++range)
+	{
+		uint64_t start   = range->first;
+		uint64_t end     = range->first + range->second;
+		uint64_t aligned = (start + alignment - 1) / alignment * alignment;
+		if (aligned > end || end - aligned < size)
+		{
+			continue;
+		}
+
+		// Whatever the allocation leaves on either side stays free.
+		freeRanges.erase(range);
+		if (aligned > start)
+		{
+			freeRanges[start] = aligned - start;
+		}
+		if (aligned + size < end)
+		{
+			freeRanges[aligned + size] = end - aligned - size;
+		}
+		offset = aligned;
+		usedSize += size;
+		return true;
+	}
+	return false;
+}
+
+void RangeAllocator::release(uint64_t offset, uint64_t size)
+{
+	usedSize -= size;
+	auto range = freeRanges.emplace(offset, size).first;
+
+	auto next = std::next(range);
+	if (next != freeRanges.end() && range->first + range->second == next->first)
+	{
+		range->second += next->second;
+		freeRanges.erase(next);
+	}
+	if (range != freeRanges.begin())
+	{
+		auto previous = std::prev(range);
+		if (previous->first + previous->second == range->first)
+		{
+			previous->second += range->second;
+			freeRanges.erase(range);
+		}
+	}
+}
+
+uint64_t RangeAllocator::capacity() const
+{
+	return totalSize;
+}
+
+bool RangeAllocator::empty() const
+{
+	return usedSize == 0;
+}
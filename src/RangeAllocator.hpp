@@ -0,0 +1,26 @@
+#ifndef RANGEALLOCATOR_H
+#define RANGEALLOCATOR_H
+
+#include <cstdint>
+#include <map>
+
+// First-fit suballocation of a fixed-size range, such as a buffer or a
+// block of device memory. Free ranges are kept by offset and merged with
+// their neighbours on release. Not thread safe.
+class RangeAllocator
+{
+  public:
+	void reset(uint64_t size);
+	bool allocate(uint64_t size, uint64_t alignment, uint64_t &offset);
+	void release(uint64_t offset, uint64_t size);
+
+	uint64_t capacity() const;
+	bool     empty() const;
+
+  private:
+	std::map<uint64_t, uint64_t> freeRanges;    // offset to size
+	uint64_t                     totalSize = 0;
+	uint64_t                     usedSize  = 0;
+};
+
+#endif
@@ -0,0 +1,547 @@
+#include "RenderGraph.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "VulkanUtils.hpp"
+
+namespace
+{
+struct UsageState
+{
+	VkImageLayout         layout;
+	VkPipelineStageFlags2 stage;
+	VkAccessFlags2        access;
+	bool                  write;
+};
+
+UsageState getUsageState(ResourceUsage usage)
+{
+	switch (usage)
+	{
+		case ResourceUsage::ColorAttachment:
+			return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+			        VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, true};
+		case ResourceUsage::DepthAttachment:
+			return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			        VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true};
+		case ResourceUsage::DepthRead:
+			return {VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+			        VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+			        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, false};
+		case ResourceUsage::SampledFragment:
+			return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+			        VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, false};
+		case ResourceUsage::SampledCompute:
+			return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			        VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, false};
+		case ResourceUsage::StorageCompute:
+			return {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+			        VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, true};
+		case ResourceUsage::TransferSrc:
+			return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, false};
+		case ResourceUsage::TransferDst:
+			return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, true};
+		case ResourceUsage::Present:
+			return {VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_2_NONE, 0, false};
+	}
+	throw std::runtime_error("Unknown resource usage!");
+}
+
+VkAccessFlags2 writeAccessMask(VkAccessFlags2 access)
+{
+	return access & (VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+	                 VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT);
+}
+
+const char *layoutName(VkImageLayout layout)
+{
+	switch (layout)
+	{
+		case VK_IMAGE_LAYOUT_UNDEFINED:
+			return "UNDEFINED";
+		case VK_IMAGE_LAYOUT_GENERAL:
+			return "GENERAL";
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+			return "COLOR_ATTACHMENT";
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+			return "DEPTH_STENCIL_ATTACHMENT";
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+			return "DEPTH_STENCIL_READ_ONLY";
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+			return "SHADER_READ_ONLY";
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+			return "TRANSFER_SRC";
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+			return "TRANSFER_DST";
+		case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+			return "PRESENT_SRC";
+		default:
+			return "OTHER";
+	}
+}
+}    // namespace
+
+RenderGraphResource RenderGraph::importImage(const std::string &name, VkImageAspectFlags aspect, VkImageLayout initialLayout,
+                                             VkPipelineStageFlags2 initialStage, VkAccessFlags2 initialAccess)
+{
+	Resource resource;
+	resource.name                = name;
+	resource.imported            = true;
+	resource.aspect              = aspect;
+	resource.initial.layout      = initialLayout;
+	resource.initial.writeStage  = initialStage;
+	resource.initial.writeAccess = initialAccess;
+	resources.push_back(std::move(resource));
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::createImage(const std::string &name, const TransientImageDesc &desc)
+{
+	Resource resource;
+	resource.name   = name;
+	resource.desc   = desc;
+	resource.aspect = desc.aspect;
+	if ((desc.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) && hasStencilComponent(desc.format))
+	{
+		resource.aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	resources.push_back(std::move(resource));
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+void RenderGraph::setImportedImage(RenderGraphResource resource, VkImage image, VkImageView view)
+{
+	resources[resource].image = image;
+	resources[resource].view  = view;
+}
+
+void RenderGraph::addPass(const std::string &name, std::vector<ResourceUse> uses, PassCallback callback)
+{
+	Pass pass;
+	pass.name     = name;
+	pass.uses     = std::move(uses);
+	pass.callback = std::move(callback);
+	passes.push_back(std::move(pass));
+}
+
+void RenderGraph::setOutput(RenderGraphResource resource, ResourceUsage finalUsage)
+{
+	outputs.emplace_back(resource, finalUsage);
+}
+
+void RenderGraph::compile(VkDevice device, VkPhysicalDevice physicalDevice)
+{
+	stats        = {};
+	stats.passes = static_cast<uint32_t>(passes.size());
+
+	cullPasses();
+	assignMemory(device, physicalDevice);
+	scheduleBarriers();
+}
+
+void RenderGraph::cullPasses()
+{
+	// Walk backwards from the outputs: a pass survives only if it writes
+	// something a later surviving pass or an output still needs.
+	std::vector<bool> needed(resources.size(), false);
+	for (const auto &output : outputs)
+	{
+		needed[output.first] = true;
+	}
+	for (auto pass = passes.rbegin(); pass != passes.rend(); ++pass)
+	{
+		pass->culled = true;
+		for (const auto &use : pass->uses)
+		{
+			if (getUsageState(use.usage).write && needed[use.resource])
+			{
+				pass->culled = false;
+			}
+		}
+		if (pass->culled)
+		{
+			stats.culledPasses++;
+			continue;
+		}
+		for (const auto &use : pass->uses)
+		{
+			needed[use.resource] = true;
+		}
+	}
+
+	int order = 0;
+	for (const auto &pass : passes)
+	{
+		if (pass.culled)
+		{
+			continue;
+		}
+		for (const auto &use : pass.uses)
+		{
+			Resource &resource = resources[use.resource];
+			if (resource.firstPass < 0)
+			{
+				resource.firstPass = order;
+			}
+			resource.lastPass = order;
+		}
+		order++;
+	}
+}
+
+void RenderGraph::assignMemory(VkDevice device, VkPhysicalDevice physicalDevice)
+{
+	std::vector<RenderGraphResource> transients;
+	for (RenderGraphResource i = 0; i < resources.size(); ++i)
+	{
+		Resource &resource = resources[i];
+		if (resource.imported || resource.firstPass < 0)
+		{
+			continue;
+		}
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+		imageInfo.extent.width  = resource.desc.extent.width;
+		imageInfo.extent.height = resource.desc.extent.height;
+		imageInfo.extent.depth  = 1;
+		imageInfo.mipLevels     = resource.desc.mipLevels;
+		imageInfo.arrayLayers   = 1;
+		imageInfo.format        = resource.desc.format;
+		imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage         = resource.desc.usage;
+		imageInfo.samples       = resource.desc.samples;
+		imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+		VkResult result         = vkCreateImage(device, &imageInfo, nullptr, resource.ownedImage.put(device));
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(result));
+		}
+		resource.image = resource.ownedImage;
+		vkGetImageMemoryRequirements(device, resource.image, &resource.requirements);
+		stats.transientBytes += resource.requirements.size;
+		transients.push_back(i);
+	}
+
+	// Largest first, each image goes into the first block whose occupants
+	// are all dead before it is born or born after it dies.
+	std::sort(transients.begin(), transients.end(), [this](RenderGraphResource a, RenderGraphResource b) {
+		return resources[a].requirements.size > resources[b].requirements.size;
+	});
+	for (RenderGraphResource index : transients)
+	{
+		Resource &resource = resources[index];
+		bool      lazy     = (resource.desc.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+		for (size_t b = 0; b < memoryBlocks.size() && resource.memoryBlock < 0; ++b)
+		{
+			MemoryBlock &block = memoryBlocks[b];
+			if ((block.typeBits & resource.requirements.memoryTypeBits) == 0 || block.transient != lazy)
+			{
+				continue;
+			}
+			bool overlaps = false;
+			for (RenderGraphResource other : block.resources)
+			{
+				overlaps |= resources[other].firstPass <= resource.lastPass && resource.firstPass <= resources[other].lastPass;
+			}
+			if (!overlaps)
+			{
+				resource.memoryBlock = static_cast<int>(b);
+			}
+		}
+		if (resource.memoryBlock < 0)
+		{
+			resource.memoryBlock = static_cast<int>(memoryBlocks.size());
+			memoryBlocks.emplace_back();
+			memoryBlocks.back().transient = lazy;
+		}
+		MemoryBlock &block = memoryBlocks[resource.memoryBlock];
+		block.size         = std::max(block.size, resource.requirements.size);
+		block.typeBits &= resource.requirements.memoryTypeBits;
+		block.resources.push_back(index);
+	}
+
+	for (auto &block : memoryBlocks)
+	{
+		uint32_t memoryType;
+		try
+		{
+			memoryType = findMemoryType(physicalDevice, block.typeBits,
+			                            block.transient ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+			                                            : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		}
+		catch (const std::runtime_error &)
+		{
+			memoryType = findMemoryType(physicalDevice, block.typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		}
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize  = block.size;
+		allocInfo.memoryTypeIndex = memoryType;
+		VkResult result           = vkAllocateMemory(device, &allocInfo, nullptr, block.memory.put(device));
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(result));
+		}
+		stats.allocatedBytes += block.size;
+
+		for (RenderGraphResource index : block.resources)
+		{
+			Resource &resource = resources[index];
+			vkBindImageMemory(device, resource.image, block.memory, 0);
+			*resource.ownedView.put(device) = createImageView(device, resource.image, resource.desc.format, resource.desc.aspect, resource.desc.mipLevels);
+			resource.view                   = resource.ownedView;
+		}
+		std::sort(block.resources.begin(), block.resources.end(), [this](RenderGraphResource a, RenderGraphResource b) {
+			return resources[a].firstPass < resources[b].firstPass;
+		});
+	}
+}
+
+void RenderGraph::addTransition(std::vector<Barrier> &barriers, RenderGraphResource resource, SyncState &state, ResourceUsage usage)
+{
+	UsageState target       = getUsageState(usage);
+	bool       layoutChange = state.layout != target.layout;
+
+	Barrier barrier{};
+	barrier.resource  = resource;
+	barrier.oldLayout = state.layout;
+	barrier.newLayout = target.layout;
+	barrier.dstStage  = target.stage;
+	barrier.dstAccess = target.access;
+
+	bool needed;
+	if (target.write)
+	{
+		// Write after write or after read, or a layout change.
+		needed            = layoutChange || state.writeStage != VK_PIPELINE_STAGE_2_NONE || state.readStages != VK_PIPELINE_STAGE_2_NONE;
+		barrier.srcStage   = state.writeStage | state.readStages;
+		barrier.srcAccess  = state.writeAccess;
+		state.writeStage   = target.stage;
+		state.writeAccess  = writeAccessMask(target.access);
+		state.readStages   = VK_PIPELINE_STAGE_2_NONE;
+		state.syncedStages = VK_PIPELINE_STAGE_2_NONE;
+	}
+	else
+	{
+		// Reads only wait once per stage for the last write.
+		needed            = layoutChange || (state.writeStage != VK_PIPELINE_STAGE_2_NONE && (target.stage & ~state.syncedStages) != 0);
+		barrier.srcStage  = layoutChange ? state.writeStage | state.readStages : state.writeStage;
+		barrier.srcAccess = state.writeAccess;
+		if (layoutChange)
+		{
+			state.readStages   = VK_PIPELINE_STAGE_2_NONE;
+			state.syncedStages = VK_PIPELINE_STAGE_2_NONE;
+		}
+		state.readStages |= target.stage;
+		state.syncedStages |= target.stage;
+	}
+	state.layout = target.layout;
+
+	if (needed)
+	{
+		barriers.push_back(barrier);
+	}
+}
+
+void RenderGraph::scheduleBarriers()
+{
+	std::vector<SyncState> states(resources.size());
+	for (RenderGraphResource i = 0; i < resources.size(); ++i)
+	{
+		const Resource &resource = resources[i];
+		states[i]                = resource.initial;
+		if (!resource.imported && resource.memoryBlock >= 0)
+		{
+			// The previous frame may still be using this memory through any
+			// image that aliases it.
+			for (RenderGraphResource other : memoryBlocks[resource.memoryBlock].resources)
+			{
+				for (const auto &pass : passes)
+				{
+					for (const auto &use : pass.uses)
+					{
+						if (!pass.culled && use.resource == other)
+						{
+							UsageState usage = getUsageState(use.usage);
+							states[i].writeStage |= usage.stage;
+							states[i].writeAccess |= writeAccessMask(usage.access);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	int order = 0;
+	for (auto &pass : passes)
+	{
+		pass.barriers.clear();
+		if (pass.culled)
+		{
+			continue;
+		}
+		for (const auto &use : pass.uses)
+		{
+			Resource &resource = resources[use.resource];
+			if (!resource.imported && resource.firstPass == order && resource.memoryBlock >= 0)
+			{
+				// Hand the memory over from the image that held it before.
+				for (RenderGraphResource other : memoryBlocks[resource.memoryBlock].resources)
+				{
+					if (other != use.resource && resources[other].lastPass < order)
+					{
+						Barrier alias{};
+						alias.resource  = use.resource;
+						alias.srcStage  = states[other].writeStage | states[other].readStages;
+						alias.srcAccess = states[other].writeAccess;
+						alias.dstStage  = getUsageState(use.usage).stage;
+						alias.dstAccess = getUsageState(use.usage).access;
+						alias.aliasing  = true;
+						pass.barriers.push_back(alias);
+					}
+				}
+			}
+			addTransition(pass.barriers, use.resource, states[use.resource], use.usage);
+		}
+		stats.barriers += static_cast<uint32_t>(pass.barriers.size());
+		stats.barrierBatches += pass.barriers.empty() ? 0 : 1;
+		order++;
+	}
+
+	finalBarriers.clear();
+	for (const auto &output : outputs)
+	{
+		addTransition(finalBarriers, output.first, states[output.first], output.second);
+	}
+	stats.barriers += static_cast<uint32_t>(finalBarriers.size());
+	stats.barrierBatches += finalBarriers.empty() ? 0 : 1;
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier> &barriers) const
+{
+	if (barriers.empty())
+	{
+		return;
+	}
+
+	std::vector<VkMemoryBarrier2>      memoryBarriers;
+	std::vector<VkImageMemoryBarrier2> imageBarriers;
+	for (const auto &barrier : barriers)
+	{
+		if (barrier.aliasing)
+		{
+			VkMemoryBarrier2 memoryBarrier{};
+			memoryBarrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+			memoryBarrier.srcStageMask  = barrier.srcStage;
+			memoryBarrier.srcAccessMask = barrier.srcAccess;
+			memoryBarrier.dstStageMask  = barrier.dstStage;
+			memoryBarrier.dstAccessMask = barrier.dstAccess;
+			memoryBarriers.push_back(memoryBarrier);
+		}
+		else
+		{
+			const Resource &resource = resources[barrier.resource];
+			imageBarriers.push_back(imageBarrier2(resource.image, resource.aspect, barrier.oldLayout, barrier.newLayout,
+			                                      barrier.srcStage, barrier.srcAccess, barrier.dstStage, barrier.dstAccess));
+		}
+	}
+
+	VkDependencyInfo dependencyInfo{};
+	dependencyInfo.sType                   = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependencyInfo.memoryBarrierCount      = static_cast<uint32_t>(memoryBarriers.size());
+	dependencyInfo.pMemoryBarriers         = memoryBarriers.data();
+	dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(imageBarriers.size());
+	dependencyInfo.pImageMemoryBarriers    = imageBarriers.data();
+	vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) const
+{
+	for (const auto &pass : passes)
+	{
+		if (pass.culled)
+		{
+			continue;
+		}
+		recordBarriers(commandBuffer, pass.barriers);
+		pass.callback(commandBuffer);
+	}
+	recordBarriers(commandBuffer, finalBarriers);
+}
+
+void RenderGraph::reset()
+{
+	resources.clear();
+	passes.clear();
+	outputs.clear();
+	finalBarriers.clear();
+	memoryBlocks.clear();
+	stats = {};
+}
+
+VkImage RenderGraph::getImage(RenderGraphResource resource) const
+{
+	return resources[resource].image;
+}
+
+VkImageView RenderGraph::getView(RenderGraphResource resource) const
+{
+	return resources[resource].view;
+}
+
+const RenderGraph::Stats &RenderGraph::getStats() const
+{
+	return stats;
+}
+
+void RenderGraph::printSchedule(std::ostream &out) const
+{
+	auto printBarriers = [this, &out](const std::vector<Barrier> &barriers) {
+		for (const auto &barrier : barriers)
+		{
+			if (barrier.aliasing)
+			{
+				out << "    alias    " << resources[barrier.resource].name << "\n";
+			}
+			else
+			{
+				out << "    barrier  " << resources[barrier.resource].name << " " << layoutName(barrier.oldLayout)
+				    << " -> " << layoutName(barrier.newLayout) << "\n";
+			}
+		}
+	};
+
+	out << "Render graph: " << stats.passes - stats.culledPasses << "/" << stats.passes << " passes, "
+	    << stats.barriers << " barriers in " << stats.barrierBatches << " batches, transient memory "
+	    << stats.transientBytes / 1024 << " KiB -> " << stats.allocatedBytes / 1024 << " KiB\n";
+	for (const auto &pass : passes)
+	{
+		if (pass.culled)
+		{
+			out << "  culled " << pass.name << "\n";
+			continue;
+		}
+		out << "  pass " << pass.name << "\n";
+		printBarriers(pass.barriers);
+	}
+	if (!finalBarriers.empty())
+	{
+		out << "  end of frame\n";
+		printBarriers(finalBarriers);
+	}
+	for (size_t b = 0; b < memoryBlocks.size(); ++b)
+	{
+		out << "  memory block " << b << " (" << memoryBlocks[b].size / 1024 << " KiB):";
+		for (RenderGraphResource index : memoryBlocks[b].resources)
+		{
+			out << " " << resources[index].name;
+		}
+		out << "\n";
+	}
+}
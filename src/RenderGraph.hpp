@@ -0,0 +1,149 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "VulkanHandles.hpp"
+
+using RenderGraphResource = uint32_t;
+
+// How a pass touches an image, which fixes its layout, stages and access.
+enum class ResourceUsage
+{
+	ColorAttachment,
+	DepthAttachment,
+	DepthRead,
+	SampledFragment,
+	SampledCompute,
+	StorageCompute,
+	TransferSrc,
+	TransferDst,
+	Present
+};
+
+struct ResourceUse
+{
+	RenderGraphResource resource;
+	ResourceUsage       usage;
+};
+
+struct TransientImageDesc
+{
+	VkFormat              format;
+	VkExtent2D            extent;
+	VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+	VkImageUsageFlags     usage;
+	VkImageAspectFlags    aspect    = VK_IMAGE_ASPECT_COLOR_BIT;
+	uint32_t              mipLevels = 1;
+};
+
+// Frame graph in which passes declare the images they read and write. On
+// compile it culls passes that do not contribute to an output, batches the
+// barriers in front of each pass and lets transient images whose lifetimes
+// do not overlap share memory.
+class RenderGraph
+{
+  public:
+	using PassCallback = std::function<void(VkCommandBuffer)>;
+
+	struct Stats
+	{
+		uint32_t     passes         = 0;
+		uint32_t     culledPasses   = 0;
+		uint32_t     barriers       = 0;
+		uint32_t     barrierBatches = 0;
+		VkDeviceSize transientBytes = 0;
+		VkDeviceSize allocatedBytes = 0;
+	};
+
+	RenderGraphResource importImage(const std::string &name, VkImageAspectFlags aspect, VkImageLayout initialLayout,
+	                                VkPipelineStageFlags2 initialStage, VkAccessFlags2 initialAccess);
+	RenderGraphResource createImage(const std::string &name, const TransientImageDesc &desc);
+	void                setImportedImage(RenderGraphResource resource, VkImage image, VkImageView view);
+	void                addPass(const std::string &name, std::vector<ResourceUse> uses, PassCallback callback);
+	void                setOutput(RenderGraphResource resource, ResourceUsage finalUsage);
+
+	void compile(VkDevice device, VkPhysicalDevice physicalDevice);
+	void execute(VkCommandBuffer commandBuffer) const;
+	void reset();
+
+	VkImage      getImage(RenderGraphResource resource) const;
+	VkImageView  getView(RenderGraphResource resource) const;
+	const Stats &getStats() const;
+	void         printSchedule(std::ostream &out) const;
+
+  private:
+	struct SyncState
+	{
+		VkImageLayout         layout       = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags2 writeStage   = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2        writeAccess  = 0;
+		VkPipelineStageFlags2 readStages   = VK_PIPELINE_STAGE_2_NONE;
+		VkPipelineStageFlags2 syncedStages = VK_PIPELINE_STAGE_2_NONE;
+	};
+
+	struct Resource
+	{
+		std::string          name;
+		bool                 imported = false;
+		TransientImageDesc   desc{};
+		VkImageAspectFlags   aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		SyncState            initial;
+		VkImage              image = VK_NULL_HANDLE;
+		VkImageView          view  = VK_NULL_HANDLE;
+		UniqueImage          ownedImage;
+		UniqueImageView      ownedView;
+		VkMemoryRequirements requirements{};
+		int                  firstPass   = -1;
+		int                  lastPass    = -1;
+		int                  memoryBlock = -1;
+	};
+
+	struct Barrier
+	{
+		RenderGraphResource   resource;
+		VkImageLayout         oldLayout;
+		VkImageLayout         newLayout;
+		VkPipelineStageFlags2 srcStage;
+		VkAccessFlags2        srcAccess;
+		VkPipelineStageFlags2 dstStage;
+		VkAccessFlags2        dstAccess;
+		bool                  aliasing = false;
+	};
+
+	struct Pass
+	{
+		std::string              name;
+		std::vector<ResourceUse> uses;
+		PassCallback             callback;
+		bool                     culled = false;
+		std::vector<Barrier>     barriers;
+	};
+
+	struct MemoryBlock
+	{
+		UniqueDeviceMemory               memory;
+		VkDeviceSize                     size      = 0;
+		uint32_t                         typeBits  = ~0u;
+		bool                             transient = true;
+		std::vector<RenderGraphResource> resources;
+	};
+
+	void cullPasses();
+	void assignMemory(VkDevice device, VkPhysicalDevice physicalDevice);
+	void scheduleBarriers();
+	void addTransition(std::vector<Barrier> &barriers, RenderGraphResource resource, SyncState &state, ResourceUsage usage);
+	void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier> &barriers) const;
+
+	std::vector<Resource>                                      resources;
+	std::vector<Pass>                                          passes;
+	std::vector<std::pair<RenderGraphResource, ResourceUsage>> outputs;
+	std::vector<Barrier>                                       finalBarriers;
+	std::vector<MemoryBlock>                                   memoryBlocks;
+	Stats                                                      stats;
+};
+
+#endif
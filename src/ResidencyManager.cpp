@@ -0,0 +1,799 @@
+#include "ResidencyManager.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "AssetPack.hpp"
+#include "Downsample.hpp"
+#include "TextureLoader.hpp"
+#include "VulkanUtils.hpp"
+
+static Ktx2Texture readKtx2Index(const std::string &path)
+{
+	AssetView asset;
+	return findAsset(path, asset) ? loadKtx2Index(path, asset.data, asset.size) : loadKtx2Index(path);
+}
+
+static uint32_t levelExtent(uint32_t extent, uint32_t level)
+{
+	return std::max(extent >> level, 1u);
+}
+
+void ResidencyManager::create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, VkQueue queue,
+                              bool memoryBudgetSupported, VkDeviceSize budgetOverride)
+{
+	this->device                = device;
+	this->physicalDevice        = physicalDevice;
+	this->queue                 = queue;
+	this->memoryBudgetSupported = memoryBudgetSupported;
+	this->budgetOverride        = budgetOverride;
+
+	VkCommandPoolCreateInfo poolInfo{};
+	poolInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = queueFamily;
+	VkResult result           = vkCreateCommandPool(device, &poolInfo, nullptr, commandPool.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	// Mid grey keeps the first frames from flashing black or white.
+	const VkFormat     placeholderFormat = VK_FORMAT_R8G8B8A8_SRGB;
+	const uint32_t     grey              = 0xff808080u;
+	UniqueBuffer       stagingBuffer;
+	UniqueDeviceMemory stagingMemory;
+	createMemoryBuffer(device, physicalDevice, sizeof(grey), VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                   *stagingBuffer.put(device), *stagingMemory.put(device));
+	void *data;
+	vkMapMemory(device, stagingMemory, 0, sizeof(grey), 0, &data);
+	memcpy(data, &grey, sizeof(grey));
+	vkUnmapMemory(device, stagingMemory);
+
+	createImage(1, 1, 1, VK_SAMPLE_COUNT_1_BIT, physicalDevice, device, *placeholderImage.put(device), *placeholderMemory.put(device),
+	            placeholderFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	transitionImageLayout(device, commandPool, queue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, placeholderImage, placeholderFormat, 1);
+	copyBufferToImage(device, commandPool, queue, stagingBuffer, placeholderImage, 1, 1);
+	transitionImageLayout(device, commandPool, queue, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, placeholderImage, placeholderFormat, 1);
+	placeholderView = UniqueImageView(device, createImageView(device, placeholderImage, placeholderFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1));
+
+	refreshBudget();
+
+	// Workers write levels straight into this, the render thread only copies.
+	createMemoryBuffer(device, physicalDevice, STAGING_BYTES, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                   *this->stagingBuffer.put(device), *this->stagingMemory.put(device));
+	void *stagingMapped;
+	vkMapMemory(device, this->stagingMemory, 0, STAGING_BYTES, 0, &stagingMapped);
+	stagingData = static_cast<uint8_t *>(stagingMapped);
+	stagingRanges.reset(STAGING_BYTES);
+
+	stopping = false;
+	for (uint32_t i = 0; i < WORKER_COUNT; ++i)
+	{
+		workers.emplace_back(&ResidencyManager::workerLoop, this);
+	}
+}
+
+void ResidencyManager::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		jobs.clear();
+	}
+	jobAvailable.notify_all();
+	stagingFreed.notify_all();
+	for (std::thread &worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+
+	for (Upload &upload : uploads)
+	{
+		VkFence fence = upload.fence;
+		vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+		vkFreeCommandBuffers(device, commandPool, 1, &upload.commandBuffer);
+	}
+	uploads.clear();
+	readyResults.clear();
+	results.clear();
+	textures.clear();
+	blocks.clear();
+	stagingData = nullptr;
+	stagingBuffer.reset();
+	stagingMemory.reset();
+	placeholderView.reset();
+	placeholderImage.reset();
+	placeholderMemory.reset();
+	commandPool.reset();
+}
+
+StreamedTexture ResidencyManager::add(const std::string &path)
+{
+	Texture texture;
+	texture.source       = std::make_shared<Source>();
+	texture.source->path = path;
+	texture.source->ktx2 = path.size() >= 5 && path.compare(path.size() - 5, 5, ".ktx2") == 0;
+
+	if (texture.source->ktx2)
+	{
+		Ktx2Texture index          = readKtx2Index(path);
+		texture.format             = index.format;
+		texture.width              = index.width;
+		texture.height             = index.height;
+		texture.levelCount         = static_cast<uint32_t>(index.levels.size());
+		texture.source->ktx2Levels = index.levels;
+		for (const Ktx2Level &level : index.levels)
+		{
+			texture.levelBytes.push_back(level.size);
+		}
+	}
+	else
+	{
+		TextureLoader::readExtent(path, texture.width, texture.height);
+		texture.format     = VK_FORMAT_R8G8B8A8_SRGB;
+		texture.levelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(texture.width, texture.height)))) + 1;
+		for (uint32_t level = 0; level < texture.levelCount; ++level)
+		{
+			texture.levelBytes.push_back(static_cast<VkDeviceSize>(levelExtent(texture.width, level)) * levelExtent(texture.height, level) * 4);
+		}
+	}
+
+	texture.tailLevel = 0;
+	while (texture.tailLevel + 1 < texture.levelCount &&
+	       std::max(levelExtent(texture.width, texture.tailLevel), levelExtent(texture.height, texture.tailLevel)) > TAIL_SIZE)
+	{
+		++texture.tailLevel;
+	}
+	texture.residentLevel = texture.levelCount;
+	texture.desiredLevel  = texture.tailLevel;
+	texture.lastRequested = updateCount;
+
+	textures.push_back(std::move(texture));
+	return static_cast<StreamedTexture>(textures.size() - 1);
+}
+
+void ResidencyManager::reload(StreamedTexture index)
+{
+	Texture                &texture = textures[index];
+	std::shared_ptr<Source> source  = std::make_shared<Source>();
+	source->path                    = texture.source->path;
+	source->ktx2                    = texture.source->ktx2;
+	if (source->ktx2)
+	{
+		source->ktx2Levels = readKtx2Index(source->path).levels;
+	}
+
+	// Results still in flight belong to the old data. The current image is
+	// shown until the reloaded levels replace it, starting with the tail.
+	texture.source = source;
+	texture.generation++;
+	texture.residentLevel = texture.levelCount;
+	texture.budgetLevel   = 0;
+	texture.loading       = false;
+	texture.failed        = false;
+}
+
+void ResidencyManager::request(StreamedTexture index, float screenPixels)
+{
+	Texture &texture = textures[index];
+	float    ratio   = texture.width / std::max(screenPixels, 1.0f);
+	int      level   = ratio > 1.0f ? static_cast<int>(std::floor(std::log2(ratio))) : 0;
+
+	texture.desiredLevel  = std::min(static_cast<uint32_t>(level), texture.levelCount - 1);
+	texture.lastRequested = updateCount;
+}
+
+bool ResidencyManager::busy() const
+{
+	if (!readyResults.empty() || !uploads.empty())
+	{
+		return true;
+	}
+	for (const Texture &texture : textures)
+	{
+		if (texture.loading)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+VkImageView ResidencyManager::view(StreamedTexture index) const
+{
+	const Texture &texture = textures[index];
+	return texture.view.get() != VK_NULL_HANDLE ? texture.view.get() : placeholderView.get();
+}
+
+ResidencyManager::Stats ResidencyManager::stats() const
+{
+	Stats stats;
+	stats.budget         = budget;
+	stats.pendingUploads = static_cast<uint32_t>(uploads.size());
+	stats.evictions      = evictions;
+	stats.uploads        = completedUploads;
+	stats.failures       = failures;
+	stats.lastError      = lastError;
+	for (const Texture &texture : textures)
+	{
+		stats.residentBytes += texture.residentBytes;
+		stats.pendingLoads += texture.loading ? 1 : 0;
+	}
+	return stats;
+}
+
+// Writes levels firstLevel and up at the given offsets of data.
+void ResidencyManager::writeLevels(const LoadJob &job, const std::vector<VkDeviceSize> &offsets, uint8_t *data)
+{
+	Source  &source     = *job.source;
+	uint32_t levelCount = static_cast<uint32_t>(job.levelBytes.size());
+	if (source.ktx2)
+	{
+		// Packed files are mapped, so a level is a copy instead of a read.
+		AssetView asset;
+		bool      packed = findAsset(source.path, asset);
+		for (uint32_t level = job.firstLevel; level < levelCount; ++level)
+		{
+			const Ktx2Level &range = source.ktx2Levels[level];
+			uint8_t         *dst   = data + offsets[level - job.firstLevel];
+			if (packed)
+			{
+				memcpy(dst, asset.data + range.offset, range.size);
+			}
+			else
+			{
+				readKtx2Level(source.path, range, dst);
+			}
+		}
+		return;
+	}
+
+	// Nothing is kept between loads, so a texture held at a coarser level
+	// doesn't pin its full chain in host memory. Only two levels are alive
+	// at a time while the chain is filtered down.
+	uint32_t             width, height;
+	std::vector<uint8_t> pixels = TextureLoader::decodeToHost(source.path, width, height);
+	if (pixels.size() != job.levelBytes[0])
+	{
+		throw std::runtime_error("\"" + source.path + "\" changed size");
+	}
+	for (uint32_t level = 0;; ++level)
+	{
+		if (level >= job.firstLevel)
+		{
+			memcpy(data + offsets[level - job.firstLevel], pixels.data(), pixels.size());
+		}
+		if (level + 1 == levelCount)
+		{
+			break;
+		}
+		pixels = downsampleRgba8(pixels.data(), width, height, true);
+		width  = std::max(width / 2, 1u);
+		height = std::max(height / 2, 1u);
+	}
+}
+
+void ResidencyManager::workerLoop()
+{
+	while (true)
+	{
+		LoadJob job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping)
+			{
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		LoadResult result;
+		result.texture    = job.texture;
+		result.firstLevel = job.firstLevel;
+		result.generation = job.generation;
+		try
+		{
+			load(job, result);
+		}
+		catch (const std::exception &e)
+		{
+			result.error = e.what();
+			releaseStaging(result.staging);
+			result.image.reset();
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		results.push_back(std::move(result));
+	}
+}
+
+// Runs on a worker. Everything but binding memory and recording the copy
+// happens here, the render thread never touches the level data.
+void ResidencyManager::load(const LoadJob &job, LoadResult &result)
+{
+	uint32_t     levelCount  = static_cast<uint32_t>(job.levelBytes.size()) - job.firstLevel;
+	VkDeviceSize stagingSize = 0;
+	for (uint32_t level = job.firstLevel; level < job.levelBytes.size(); ++level)
+	{
+		result.levelOffsets.push_back(stagingSize);
+		stagingSize = (stagingSize + job.levelBytes[level] + 15) & ~VkDeviceSize(15);
+	}
+	writeLevels(job, result.levelOffsets, reserveStaging(stagingSize, result.staging));
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+	imageInfo.extent        = {levelExtent(job.width, job.firstLevel), levelExtent(job.height, job.firstLevel), 1};
+	imageInfo.mipLevels     = levelCount;
+	imageInfo.arrayLayers   = 1;
+	imageInfo.format        = job.format;
+	imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.usage         = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+	VkResult vkResult       = vkCreateImage(device, &imageInfo, nullptr, result.image.put(device));
+	if (vkResult != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(vkResult));
+	}
+	vkGetImageMemoryRequirements(device, result.image, &result.requirements);
+}
+
+// Waits for room in the shared staging buffer, which frees up as uploads
+// retire. Chains larger than the whole buffer get one of their own.
+uint8_t *ResidencyManager::reserveStaging(VkDeviceSize size, Staging &staging)
+{
+	if (size > STAGING_BYTES)
+	{
+		createMemoryBuffer(device, physicalDevice, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		                   *staging.buffer.put(device), *staging.memory.put(device));
+		void *data;
+		vkMapMemory(device, staging.memory, 0, size, 0, &data);
+		staging.size = size;
+		return static_cast<uint8_t *>(data);
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	stagingFreed.wait(lock, [&]() { return stopping || stagingRanges.allocate(size, 16, staging.offset); });
+	if (stopping)
+	{
+		throw std::runtime_error("Streaming stopped");
+	}
+	staging.size = size;
+	return stagingData + staging.offset;
+}
+
+void ResidencyManager::releaseStaging(Staging &staging)
+{
+	if (staging.size > 0 && staging.buffer.get() == VK_NULL_HANDLE)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stagingRanges.release(staging.offset, staging.size);
+		}
+		stagingFreed.notify_all();
+	}
+	staging.size = 0;
+	staging.buffer.reset();
+	staging.memory.reset();
+}
+
+ResidencyManager::Allocation ResidencyManager::allocateImageMemory(const VkMemoryRequirements &requirements)
+{
+	uint32_t   memoryType = findMemoryType(physicalDevice, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	Allocation allocation;
+	allocation.size = requirements.size;
+	for (uint32_t i = 0; i < blocks.size(); ++i)
+	{
+		MemoryBlock &block = blocks[i];
+		if (block.memory.get() != VK_NULL_HANDLE && block.memoryType == memoryType &&
+		    block.ranges.allocate(requirements.size, requirements.alignment, allocation.offset))
+		{
+			allocation.block = i;
+			return allocation;
+		}
+	}
+
+	// An image larger than a block gets one of its own.
+	VkDeviceSize blockBytes = std::min(BLOCK_BYTES, std::max(budget, VkDeviceSize(1) << 20));
+	MemoryBlock  block;
+	block.memoryType = memoryType;
+	block.ranges.reset(std::max(blockBytes, requirements.size));
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize  = block.ranges.capacity();
+	allocInfo.memoryTypeIndex = memoryType;
+	VkResult result           = vkAllocateMemory(device, &allocInfo, nullptr, block.memory.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	block.ranges.allocate(requirements.size, requirements.alignment, allocation.offset);
+
+	auto unused = std::find_if(blocks.begin(), blocks.end(), [](const MemoryBlock &candidate) { return candidate.memory.get() == VK_NULL_HANDLE; });
+	if (unused != blocks.end())
+	{
+		*unused = std::move(block);
+	}
+	else
+	{
+		unused = blocks.insert(blocks.end(), std::move(block));
+	}
+	allocation.block = static_cast<uint32_t>(unused - blocks.begin());
+	return allocation;
+}
+
+void ResidencyManager::freeImageMemory(const Allocation &allocation)
+{
+	if (allocation.block >= blocks.size())
+	{
+		return;
+	}
+	MemoryBlock &block = blocks[allocation.block];
+	block.ranges.release(allocation.offset, allocation.size);
+	if (block.ranges.empty())
+	{
+		block.memory.reset();
+	}
+}
+
+// The range goes back to the pool once the frames using it have retired.
+void ResidencyManager::deferFree(const Allocation &allocation, DeletionQueue &deletionQueue)
+{
+	if (allocation.block != UINT32_MAX)
+	{
+		deletionQueue.push([this, allocation]() { freeImageMemory(allocation); });
+	}
+}
+
+void ResidencyManager::refreshBudget()
+{
+	VkDeviceSize previousBudget = budget;
+	if (budgetOverride > 0)
+	{
+		budget = budgetOverride;
+		return;
+	}
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT memoryBudget{};
+	memoryBudget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+	VkPhysicalDeviceMemoryProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	properties.pNext = memoryBudgetSupported ? &memoryBudget : nullptr;
+	vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+	uint32_t heap = 0;
+	for (uint32_t i = 0; i < properties.memoryProperties.memoryHeapCount; ++i)
+	{
+		const VkMemoryHeap &candidate = properties.memoryProperties.memoryHeaps[i];
+		if ((candidate.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && candidate.size > properties.memoryProperties.memoryHeaps[heap].size)
+		{
+			heap = i;
+		}
+	}
+
+	if (memoryBudgetSupported)
+	{
+		// The reported usage includes our own textures, which stay available to us.
+		VkDeviceSize ours   = committedBytes();
+		VkDeviceSize others = memoryBudget.heapUsage[heap] > ours ? memoryBudget.heapUsage[heap] - ours : 0;
+		budget              = memoryBudget.heapBudget[heap] > others ? (memoryBudget.heapBudget[heap] - others) / 2 : 0;
+	}
+	else
+	{
+		budget = properties.memoryProperties.memoryHeaps[heap].size / 4;
+	}
+
+	// Textures held back by the old budget may fit now.
+	if (budget > previousBudget)
+	{
+		for (Texture &texture : textures)
+		{
+			texture.budgetLevel = 0;
+		}
+	}
+}
+
+VkDeviceSize ResidencyManager::committedBytes() const
+{
+	VkDeviceSize bytes = 0;
+	for (const Texture &texture : textures)
+	{
+		bytes += texture.residentBytes;
+	}
+	for (const Upload &upload : uploads)
+	{
+		bytes += upload.memory.size;
+	}
+	return bytes;
+}
+
+bool ResidencyManager::makeRoom(StreamedTexture index, VkDeviceSize bytes, DeletionQueue &deletionQueue)
+{
+	// The replaced image is released when the new one is swapped in, so
+	// both count until then.
+	while (committedBytes() + bytes > budget)
+	{
+		StreamedTexture victim = static_cast<StreamedTexture>(textures.size());
+		for (StreamedTexture i = 0; i < textures.size(); ++i)
+		{
+			const Texture &candidate = textures[i];
+			if (i != index && candidate.residentBytes > 0 && candidate.lastRequested < updateCount &&
+			    (victim == textures.size() || candidate.lastRequested < textures[victim].lastRequested))
+			{
+				victim = i;
+			}
+		}
+		if (victim == textures.size())
+		{
+			return false;
+		}
+		evict(victim, deletionQueue);
+	}
+	return true;
+}
+
+void ResidencyManager::evict(StreamedTexture index, DeletionQueue &deletionQueue)
+{
+	Texture &texture = textures[index];
+	deletionQueue.defer(std::move(texture.view));
+	deletionQueue.defer(std::move(texture.image));
+	deferFree(texture.memory, deletionQueue);
+	texture.memory        = {};
+	texture.residentLevel = texture.levelCount;
+	texture.residentBytes = 0;
+	texture.generation++;
+	texture.loading = false;
+	evictions++;
+}
+
+void ResidencyManager::startUpload(LoadResult &result)
+{
+	Texture &texture    = textures[result.texture];
+	uint32_t levelCount = texture.levelCount - result.firstLevel;
+	uint32_t width      = levelExtent(texture.width, result.firstLevel);
+	uint32_t height     = levelExtent(texture.height, result.firstLevel);
+
+	Upload upload;
+	upload.texture    = result.texture;
+	upload.firstLevel = result.firstLevel;
+	upload.generation = result.generation;
+	upload.image      = std::move(result.image);
+	upload.staging    = std::move(result.staging);
+
+	try
+	{
+		// The worker made the image and filled staging, what is left is cheap.
+		upload.memory     = allocateImageMemory(result.requirements);
+		VkResult vkResult = vkBindImageMemory(device, upload.image, blocks[upload.memory.block].memory, upload.memory.offset);
+		if (vkResult != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(vkResult));
+		}
+		upload.view = UniqueImageView(device, createImageView(device, upload.image, texture.format, VK_IMAGE_ASPECT_COLOR_BIT, levelCount));
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool        = commandPool;
+		allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+		vkResult                     = vkAllocateCommandBuffers(device, &allocInfo, &upload.commandBuffer);
+		if (vkResult != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(vkResult));
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(upload.commandBuffer, &beginInfo);
+
+		VkImageMemoryBarrier barrier{};
+		barrier.sType                       = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.image                       = upload.image;
+		barrier.srcQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex         = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = levelCount;
+		barrier.subresourceRange.layerCount = 1;
+		barrier.oldLayout                   = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout                   = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask               = 0;
+		barrier.dstAccessMask               = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(upload.commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		std::vector<VkBufferImageCopy> regions(levelCount);
+		for (uint32_t level = 0; level < levelCount; ++level)
+		{
+			regions[level].bufferOffset                = upload.staging.offset + result.levelOffsets[level];
+			regions[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			regions[level].imageSubresource.mipLevel   = level;
+			regions[level].imageSubresource.layerCount = 1;
+			regions[level].imageExtent                 = {levelExtent(width, level), levelExtent(height, level), 1};
+		}
+		VkBuffer source = upload.staging.buffer.get() != VK_NULL_HANDLE ? upload.staging.buffer.get() : stagingBuffer.get();
+		vkCmdCopyBufferToImage(upload.commandBuffer, source, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		                       levelCount, regions.data());
+
+		// Frames submitted after this one sample the image, the barrier orders them.
+		barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(upload.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		vkEndCommandBuffer(upload.commandBuffer);
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		vkResult        = vkCreateFence(device, &fenceInfo, nullptr, upload.fence.put(device));
+		if (vkResult != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(vkResult));
+		}
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers    = &upload.commandBuffer;
+		vkResult                      = vkQueueSubmit(queue, 1, &submitInfo, upload.fence);
+		if (vkResult != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(vkResult));
+		}
+	}
+	catch (...)
+	{
+		// Nothing was submitted, so everything can go back right away.
+		if (upload.commandBuffer != VK_NULL_HANDLE)
+		{
+			vkFreeCommandBuffers(device, commandPool, 1, &upload.commandBuffer);
+		}
+		upload.view.reset();
+		upload.image.reset();
+		freeImageMemory(upload.memory);
+		releaseStaging(upload.staging);
+		throw;
+	}
+	uploads.push_back(std::move(upload));
+}
+
+bool ResidencyManager::retireUploads(DeletionQueue &deletionQueue)
+{
+	bool changed = false;
+	for (size_t i = 0; i < uploads.size();)
+	{
+		Upload &upload = uploads[i];
+		if (vkGetFenceStatus(device, upload.fence) != VK_SUCCESS)
+		{
+			++i;
+			continue;
+		}
+		vkFreeCommandBuffers(device, commandPool, 1, &upload.commandBuffer);
+		releaseStaging(upload.staging);
+
+		Texture &texture = textures[upload.texture];
+		if (upload.generation == texture.generation)
+		{
+			deletionQueue.defer(std::move(texture.view));
+			deletionQueue.defer(std::move(texture.image));
+			deferFree(texture.memory, deletionQueue);
+			texture.view          = std::move(upload.view);
+			texture.image         = std::move(upload.image);
+			texture.memory        = upload.memory;
+			texture.residentLevel = upload.firstLevel;
+			texture.residentBytes = upload.memory.size;
+			texture.loading       = false;
+			changed               = true;
+			completedUploads++;
+		}
+		else
+		{
+			// Never sampled, the fence covers the only use of the memory.
+			upload.view.reset();
+			upload.image.reset();
+			freeImageMemory(upload.memory);
+		}
+		uploads.erase(uploads.begin() + i);
+	}
+	return changed;
+}
+
+bool ResidencyManager::update(DeletionQueue &deletionQueue)
+{
+	if (updateCount % BUDGET_REFRESH_UPDATES == 0)
+	{
+		refreshBudget();
+	}
+
+	uint32_t evictionsBefore = evictions;
+	bool     changed         = retireUploads(deletionQueue);
+
+	// Staging goes back under the lock, so results are taken out first.
+	std::vector<LoadResult> finished;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.swap(results);
+	}
+	for (LoadResult &result : finished)
+	{
+		Texture &texture = textures[result.texture];
+		if (result.generation != texture.generation)
+		{
+			releaseStaging(result.staging);
+			continue;
+		}
+		if (!result.error.empty())
+		{
+			lastError = std::move(result.error);
+			failures++;
+			texture.failed  = true;
+			texture.loading = false;
+			continue;
+		}
+		readyResults.push_back(std::move(result));
+	}
+
+	// Bounded per update so a burst of finished loads doesn't stall a frame.
+	VkDeviceSize uploadedBytes = 0;
+	while (!readyResults.empty() && uploadedBytes < UPLOAD_BYTES_PER_FRAME)
+	{
+		LoadResult result = std::move(readyResults.front());
+		readyResults.pop_front();
+
+		Texture &texture = textures[result.texture];
+		if (result.generation != texture.generation)
+		{
+			releaseStaging(result.staging);
+			continue;
+		}
+		if (!makeRoom(result.texture, result.requirements.size, deletionQueue))
+		{
+			// Settle for one level less until the budget grows again.
+			texture.budgetLevel = result.firstLevel + 1;
+			texture.loading     = false;
+			releaseStaging(result.staging);
+			continue;
+		}
+		uploadedBytes += result.staging.size;
+		startUpload(result);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (StreamedTexture i = 0; i < textures.size(); ++i)
+	{
+		Texture &texture = textures[i];
+		if (texture.loading || texture.failed || texture.lastRequested < updateCount)
+		{
+			continue;
+		}
+		// The mip tail comes first, then the levels the screen coverage asks for.
+		uint32_t target = std::max(texture.desiredLevel, texture.budgetLevel);
+		if (texture.residentLevel == texture.levelCount)
+		{
+			target = std::max(target, texture.tailLevel);
+		}
+		if (target >= texture.residentLevel)
+		{
+			continue;
+		}
+		texture.loading = true;
+		jobs.push_back({i, target, texture.generation, texture.source, texture.format, texture.width, texture.height, texture.levelBytes});
+		jobAvailable.notify_one();
+	}
+
+	// Requests made before the next update count for it.
+	++updateCount;
+	return changed || evictions != evictionsBefore;
+}
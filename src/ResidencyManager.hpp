@@ -0,0 +1,226 @@
+#ifndef RESIDENCYMANAGER_H
+#define RESIDENCYMANAGER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "DeletionQueue.hpp"
+#include "Ktx2.hpp"
+#include "RangeAllocator.hpp"
+#include "VulkanHandles.hpp"
+
+using StreamedTexture = uint32_t;
+
+// Keeps textures resident within a device memory budget. A texture holds a
+// contiguous part of its mip chain, from the finest wanted level down to
+// 1x1, in an image that is replaced whenever that range changes. Worker
+// threads create the image and read its levels straight into a shared
+// staging buffer, the render thread binds memory from a pool of device
+// local blocks and records the copy without waiting. Images are swapped in
+// once the upload fence has signaled. Textures not requested recently are
+// evicted first when the budget runs out.
+class ResidencyManager
+{
+  public:
+	struct Stats
+	{
+		VkDeviceSize budget         = 0;
+		VkDeviceSize residentBytes  = 0;
+		uint32_t     pendingLoads   = 0;
+		uint32_t     pendingUploads = 0;
+		uint32_t     evictions      = 0;
+		uint32_t     uploads        = 0;    // swapped in since create
+		uint32_t     failures       = 0;
+		std::string  lastError;
+	};
+
+	// A budget of 0 takes half of what VK_EXT_memory_budget reports as
+	// available in the largest device local heap, or a quarter of the heap
+	// without the extension.
+	void create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, VkQueue queue,
+	            bool memoryBudgetSupported, VkDeviceSize budgetOverride);
+	void destroy();
+
+	// KTX2 files are read level by level, other images are decoded for each
+	// load and their mip chain is filtered on the CPU. The mip tail is requested
+	// right away so something is shown before the detail arrives.
+	StreamedTexture add(const std::string &path);
+	void            reload(StreamedTexture texture);
+
+	// Call every frame the texture is visible, with the number of pixels its
+	// full width covers on screen.
+	void request(StreamedTexture texture, float screenPixels);
+
+	// Retires finished uploads, evicts under budget pressure and starts new
+	// loads and uploads. Returns true when a view changed, so descriptors
+	// have to be rewritten.
+	bool update(DeletionQueue &deletionQueue);
+	bool busy() const;
+
+	// A 1x1 placeholder until the first levels are resident.
+	VkImageView view(StreamedTexture texture) const;
+	Stats       stats() const;
+
+  private:
+	// Where the levels come from, shared with the workers.
+	struct Source
+	{
+		std::string            path;
+		bool                   ktx2 = false;
+		std::vector<Ktx2Level> ktx2Levels;
+	};
+
+	// A range of a pooled memory block.
+	struct Allocation
+	{
+		uint32_t     block  = UINT32_MAX;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size   = 0;
+	};
+
+	// Freed as soon as its last range is released.
+	struct MemoryBlock
+	{
+		UniqueDeviceMemory memory;
+		uint32_t           memoryType = 0;
+		RangeAllocator     ranges;
+	};
+
+	// A range of the shared staging buffer, or a buffer of its own for
+	// chains that don't fit in it.
+	struct Staging
+	{
+		VkDeviceSize       offset = 0;
+		VkDeviceSize       size   = 0;
+		UniqueBuffer       buffer;
+		UniqueDeviceMemory memory;
+	};
+
+	struct Texture
+	{
+		std::shared_ptr<Source>   source;
+		VkFormat                  format;
+		uint32_t                  width;
+		uint32_t                  height;
+		uint32_t                  levelCount;
+		uint32_t                  tailLevel;
+		std::vector<VkDeviceSize> levelBytes;
+
+		UniqueImage     image;
+		Allocation      memory;
+		UniqueImageView view;
+		uint32_t        residentLevel;    // levelCount when nothing is resident
+		VkDeviceSize    residentBytes = 0;
+
+		uint32_t desiredLevel;
+		uint32_t budgetLevel   = 0;    // finest level that fit the budget
+		uint64_t lastRequested = 0;
+		uint32_t generation    = 0;    // bumped to drop results still in flight
+		bool     loading       = false;
+		bool     failed        = false;
+	};
+
+	struct LoadJob
+	{
+		StreamedTexture           texture;
+		uint32_t                  firstLevel;
+		uint32_t                  generation;
+		std::shared_ptr<Source>   source;
+		VkFormat                  format;
+		uint32_t                  width;
+		uint32_t                  height;
+		std::vector<VkDeviceSize> levelBytes;    // every level of the texture
+	};
+
+	struct LoadResult
+	{
+		StreamedTexture           texture;
+		uint32_t                  firstLevel;
+		uint32_t                  generation;
+		UniqueImage               image;    // created, no memory bound yet
+		VkMemoryRequirements      requirements{};
+		Staging                   staging;
+		std::vector<VkDeviceSize> levelOffsets;    // relative to the staging range
+		std::string               error;
+	};
+
+	struct Upload
+	{
+		StreamedTexture texture;
+		uint32_t        firstLevel;
+		uint32_t        generation;
+		UniqueImage     image;
+		Allocation      memory;
+		UniqueImageView view;
+		Staging         staging;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		UniqueFence     fence;
+	};
+
+	static void writeLevels(const LoadJob &job, const std::vector<VkDeviceSize> &offsets, uint8_t *data);
+
+	void         workerLoop();
+	void         load(const LoadJob &job, LoadResult &result);
+	uint8_t     *reserveStaging(VkDeviceSize size, Staging &staging);
+	void         releaseStaging(Staging &staging);
+	Allocation   allocateImageMemory(const VkMemoryRequirements &requirements);
+	void         freeImageMemory(const Allocation &allocation);
+	void         deferFree(const Allocation &allocation, DeletionQueue &deletionQueue);
+	void         refreshBudget();
+	VkDeviceSize committedBytes() const;
+	bool         makeRoom(StreamedTexture texture, VkDeviceSize bytes, DeletionQueue &deletionQueue);
+	void         evict(StreamedTexture texture, DeletionQueue &deletionQueue);
+	void         startUpload(LoadResult &result);
+	bool         retireUploads(DeletionQueue &deletionQueue);
+
+	static constexpr uint32_t     WORKER_COUNT           = 2;
+	static constexpr uint32_t     TAIL_SIZE              = 128;    // largest dimension loaded first
+	static constexpr VkDeviceSize UPLOAD_BYTES_PER_FRAME = 32ull << 20;
+	static constexpr VkDeviceSize STAGING_BYTES          = 2 * UPLOAD_BYTES_PER_FRAME;
+	static constexpr VkDeviceSize BLOCK_BYTES            = 64ull << 20;
+	static constexpr uint64_t     BUDGET_REFRESH_UPDATES = 120;
+
+	VkDevice          device                = VK_NULL_HANDLE;
+	VkPhysicalDevice  physicalDevice        = VK_NULL_HANDLE;
+	VkQueue           queue                 = VK_NULL_HANDLE;
+	bool              memoryBudgetSupported = false;
+	VkDeviceSize      budgetOverride        = 0;
+	VkDeviceSize      budget                = 0;
+	uint64_t          updateCount           = 0;
+	uint32_t          evictions             = 0;
+	uint32_t          completedUploads      = 0;
+	uint32_t          failures              = 0;
+	std::string       lastError;
+	UniqueCommandPool commandPool;
+
+	UniqueImage        placeholderImage;
+	UniqueDeviceMemory placeholderMemory;
+	UniqueImageView    placeholderView;
+
+	std::vector<Texture>     textures;
+	std::deque<LoadResult>   readyResults;
+	std::vector<Upload>      uploads;
+	std::vector<MemoryBlock> blocks;
+	std::vector<std::thread> workers;
+
+	// Persistently mapped, written by the workers
+	UniqueBuffer       stagingBuffer;
+	UniqueDeviceMemory stagingMemory;
+	uint8_t           *stagingData = nullptr;
+
+	// Shared with the workers
+	std::mutex              mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable stagingFreed;
+	std::deque<LoadJob>     jobs;
+	std::vector<LoadResult> results;
+	RangeAllocator          stagingRanges;
+	bool                    stopping = false;
+};
+
+#endif
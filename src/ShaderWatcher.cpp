@@ -0,0 +1,149 @@
+#include "ShaderWatcher.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+#ifdef __linux__
+#include <poll.h>
+#include <spawn.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static bool isWatchedShader(const std::string &name)
+{
+	auto endsWith = [&name](const char *suffix) {
+		std::string tail(suffix);
+		return name.size() > tail.size() && name.compare(name.size() - tail.size(), tail.size(), tail) == 0;
+	};
+	return endsWith(".vert") || endsWith(".frag");
+}
+
+void ShaderWatcher::start(const std::string &sourceDirectory, const std::string &outputDirectory, const std::string &compiler)
+{
+	this->sourceDirectory = sourceDirectory;
+	this->outputDirectory = outputDirectory;
+	this->compiler        = compiler;
+
+	// Editors either rewrite the file or rename a new one over it.
+	inotifyFd = inotify_init1(IN_CLOEXEC);
+	if (inotifyFd < 0 || inotify_add_watch(inotifyFd, sourceDirectory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		stop();
+		throw std::runtime_error("Failed to watch \"" + sourceDirectory + "\"");
+	}
+	if (pipe(stopPipe) != 0)
+	{
+		stop();
+		throw std::runtime_error("Failed to watch \"" + sourceDirectory + "\"");
+	}
+	watcher = std::thread(&ShaderWatcher::watchLoop, this);
+}
+
+void ShaderWatcher::stop()
+{
+	if (watcher.joinable())
+	{
+		char    wake    = 0;
+		ssize_t written = write(stopPipe[1], &wake, 1);
+		(void) written;
+		watcher.join();
+	}
+	for (int *fd : {&inotifyFd, &stopPipe[0], &stopPipe[1]})
+	{
+		if (*fd >= 0)
+		{
+			close(*fd);
+			*fd = -1;
+		}
+	}
+}
+
+void ShaderWatcher::watchLoop()
+{
+	alignas(inotify_event) char buffer[4096];
+	while (true)
+	{
+		pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+		if (poll(fds, 2, -1) < 0 || fds[1].revents != 0)
+		{
+			return;
+		}
+
+		// A save often raises several events, each file is compiled once.
+		std::set<std::string> changed;
+		ssize_t               length = read(inotifyFd, buffer, sizeof(buffer));
+		for (ssize_t offset = 0; offset < length;)
+		{
+			const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+			if (event->len > 0 && isWatchedShader(event->name))
+			{
+				changed.insert(event->name);
+			}
+			offset += sizeof(inotify_event) + event->len;
+		}
+
+		for (const std::string &name : changed)
+		{
+			std::string output = outputDirectory + "/" + name + ".spv";
+			if (compile(sourceDirectory + "/" + name, output))
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (std::find(compiled.begin(), compiled.end(), output) == compiled.end())
+				{
+					compiled.push_back(output);
+				}
+			}
+		}
+	}
+}
+
+bool ShaderWatcher::compile(const std::string &source, const std::string &output) const
+{
+	std::string temporary   = output + ".tmp";
+	std::string arguments[] = {compiler, "-V", source, "-o", temporary};
+	char       *argv[]      = {arguments[0].data(), arguments[1].data(), arguments[2].data(), arguments[3].data(),
+	                           arguments[4].data(), nullptr};
+
+	pid_t process;
+	int   status = 0;
+	if (posix_spawn(&process, compiler.c_str(), nullptr, nullptr, argv, environ) != 0 || waitpid(process, &status, 0) < 0 ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		std::cout << "Shader " << source << " failed to compile, keeping the previous module\n";
+		std::remove(temporary.c_str());
+		return false;
+	}
+	return std::rename(temporary.c_str(), output.c_str()) == 0;
+}
+#else
+void ShaderWatcher::start(const std::string &sourceDirectory, const std::string &, const std::string &)
+{
+	throw std::runtime_error("Watching \"" + sourceDirectory + "\" needs inotify");
+}
+
+void ShaderWatcher::stop()
+{
+}
+
+void ShaderWatcher::watchLoop()
+{
+}
+
+bool ShaderWatcher::compile(const std::string &, const std::string &) const
+{
+	return false;
+}
+#endif
+
+std::vector<std::string> ShaderWatcher::takeCompiled()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return std::exchange(compiled, {});
+}
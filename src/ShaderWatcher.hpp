@@ -0,0 +1,38 @@
+#ifndef SHADERWATCHER_H
+#define SHADERWATCHER_H
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Development aid: watches a directory of GLSL sources with inotify and
+// compiles every vertex or fragment shader saved there to SPIR-V on a
+// thread of its own. Modules are written next to a temporary name and
+// renamed into place, so loaders never see half a file. Compiler errors are
+// printed and leave the previous module in place. Linux only.
+class ShaderWatcher
+{
+  public:
+	void start(const std::string &sourceDirectory, const std::string &outputDirectory, const std::string &compiler);
+	void stop();
+
+	// Modules compiled since the last call, as "<output>/<source>.spv".
+	std::vector<std::string> takeCompiled();
+
+  private:
+	void watchLoop();
+	bool compile(const std::string &source, const std::string &output) const;
+
+	std::string sourceDirectory;
+	std::string outputDirectory;
+	std::string compiler;
+	int         inotifyFd   = -1;
+	int         stopPipe[2] = {-1, -1};
+	std::thread watcher;
+
+	std::mutex               mutex;
+	std::vector<std::string> compiled;
+};
+
+#endif
@@ -0,0 +1,317 @@
+#include "TextureLoader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "AssetPack.hpp"
+#include "VulkanUtils.hpp"
+
+// stb_image allocates its result with STBI_MALLOC. While a decode runs, the
+// allocation matching the final RGBA8 size is handed a slice of the staging
+// buffer instead of the heap. If the decoder takes another route the result
+// is simply copied, so the hooks never affect correctness.
+struct DecodeTarget
+{
+	uint8_t *memory   = nullptr;
+	size_t   size     = 0;
+	size_t   capacity = 0;
+	bool     claimed  = false;
+};
+
+static thread_local DecodeTarget decodeTarget;
+
+// Some decoders allocate a few bytes more than width * height * 4.
+static const size_t DECODE_SLACK = 16;
+
+static void *stagingMalloc(size_t size)
+{
+	if (decodeTarget.memory != nullptr && !decodeTarget.claimed && size >= decodeTarget.size && size <= decodeTarget.capacity)
+	{
+		decodeTarget.claimed = true;
+		return decodeTarget.memory;
+	}
+	return malloc(size);
+}
+
+static void *stagingRealloc(void *pointer, size_t size)
+{
+	if (pointer != nullptr && pointer == decodeTarget.memory)
+	{
+		// Never grow in place, the next slice belongs to another image.
+		void *moved = malloc(size);
+		if (moved != nullptr)
+		{
+			memcpy(moved, pointer, std::min(size, decodeTarget.capacity));
+		}
+		decodeTarget.claimed = false;
+		return moved;
+	}
+	return realloc(pointer, size);
+}
+
+static void stagingFree(void *pointer)
+{
+	if (pointer != nullptr && pointer == decodeTarget.memory)
+	{
+		decodeTarget.claimed = false;
+		return;
+	}
+	free(pointer);
+}
+
+#define STBI_MALLOC(size)           stagingMalloc(size)
+#define STBI_REALLOC(pointer, size) stagingRealloc(pointer, size)
+#define STBI_FREE(pointer)          stagingFree(pointer)
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+// Decodes to RGBA8 at memory, which has room for size + DECODE_SLACK bytes.
+// Returns an error message, empty on success.
+static std::string decodeInto(const std::string &path, uint8_t *memory, size_t size, uint32_t expectedWidth, uint32_t expectedHeight)
+{
+	decodeTarget.memory   = memory;
+	decodeTarget.size     = size;
+	decodeTarget.capacity = size + DECODE_SLACK;
+	decodeTarget.claimed  = false;
+
+	std::string error;
+	int         width, height, channels;
+	AssetView   asset;
+	stbi_uc    *pixels = findAsset(path, asset)
+	                         ? stbi_load_from_memory(asset.data, static_cast<int>(asset.size), &width, &height, &channels, STBI_rgb_alpha)
+	                         : stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (pixels == nullptr)
+	{
+		error = "Couldn't load texture \"" + path + "\"";
+	}
+	else if (static_cast<uint32_t>(width) != expectedWidth || static_cast<uint32_t>(height) != expectedHeight)
+	{
+		error = "Texture \"" + path + "\" changed while loading";
+	}
+	else if (pixels != memory)
+	{
+		memcpy(memory, pixels, size);
+	}
+	stbi_image_free(pixels);
+	decodeTarget = DecodeTarget{};
+	return error;
+}
+
+void TextureLoader::readExtent(const std::string &path, uint32_t &width, uint32_t &height)
+{
+	int       x, y, channels;
+	AssetView asset;
+	bool      known = findAsset(path, asset) ? stbi_info_from_memory(asset.data, static_cast<int>(asset.size), &x, &y, &channels)
+	                                         : stbi_info(path.c_str(), &x, &y, &channels);
+	if (!known)
+	{
+		throw std::runtime_error("Couldn't load texture \"" + path + "\"");
+	}
+	width  = static_cast<uint32_t>(x);
+	height = static_cast<uint32_t>(y);
+}
+
+void TextureLoader::create(VkDevice device, VkPhysicalDevice physicalDevice, StagingMode mode)
+{
+	this->device         = device;
+	this->physicalDevice = physicalDevice;
+	this->mode           = mode;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	alignment = std::max<VkDeviceSize>(16, properties.limits.optimalBufferCopyOffsetAlignment);
+}
+
+void TextureLoader::destroy()
+{
+	mapped = nullptr;
+	buffer.reset();
+	memory.reset();
+	capacity = 0;
+}
+
+void TextureLoader::reserve(VkDeviceSize size)
+{
+	if (size <= capacity)
+	{
+		return;
+	}
+	destroy();
+
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size        = size;
+	bufferInfo.usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	VkResult result        = vkCreateBuffer(device, &bufferInfo, nullptr, buffer.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+
+	VkPhysicalDeviceMemoryProperties properties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &properties);
+	const VkMemoryPropertyFlags cachedFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	uint32_t                    memoryType  = UINT32_MAX;
+	for (uint32_t i = 0; mode == StagingMode::Automatic && i < properties.memoryTypeCount && memoryType == UINT32_MAX; ++i)
+	{
+		if ((requirements.memoryTypeBits & (1u << i)) && (properties.memoryTypes[i].propertyFlags & cachedFlags) == cachedFlags)
+		{
+			memoryType = i;
+		}
+	}
+	if (memoryType == UINT32_MAX)
+	{
+		memoryType = findMemoryType(physicalDevice, requirements.memoryTypeBits,
+		                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+	cached   = (properties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0;
+	coherent = (properties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize  = requirements.size;
+	allocInfo.memoryTypeIndex = memoryType;
+	result                    = vkAllocateMemory(device, &allocInfo, nullptr, memory.put(device));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	vkBindBufferMemory(device, buffer, memory, 0);
+
+	void *data;
+	result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	mapped   = static_cast<uint8_t *>(data);
+	capacity = size;
+}
+
+std::vector<DecodedTexture> TextureLoader::decode(const std::vector<std::string> &paths)
+{
+	std::vector<DecodedTexture> textures(paths.size());
+	VkDeviceSize                offset = 0;
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		readExtent(paths[i], textures[i].width, textures[i].height);
+		textures[i].offset = offset;
+		textures[i].size   = static_cast<VkDeviceSize>(textures[i].width) * textures[i].height * 4;
+		offset             = (offset + textures[i].size + DECODE_SLACK + alignment - 1) / alignment * alignment;
+	}
+	reserve(offset);
+
+	std::vector<std::string> errors(paths.size());
+	std::atomic<size_t>      next{0};
+	bool                     direct = cached || mode == StagingMode::Direct;
+
+	auto worker = [&]() {
+		std::vector<uint8_t> scratch;
+		for (size_t i = next++; i < paths.size(); i = next++)
+		{
+			size_t   size   = static_cast<size_t>(textures[i].size);
+			uint8_t *memory = mapped + textures[i].offset;
+			if (direct)
+			{
+				errors[i] = decodeInto(paths[i], memory, size, textures[i].width, textures[i].height);
+				continue;
+			}
+			// Write-combined memory is only written, front to back.
+			scratch.resize(size + DECODE_SLACK);
+			errors[i] = decodeInto(paths[i], scratch.data(), size, textures[i].width, textures[i].height);
+			memcpy(memory, scratch.data(), size);
+		}
+	};
+
+	size_t                   threadCount = std::min<size_t>(paths.size(), std::max(1u, std::thread::hardware_concurrency()));
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < threadCount; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (std::thread &thread : threads)
+	{
+		thread.join();
+	}
+
+	if (!coherent)
+	{
+		VkMappedMemoryRange range{};
+		range.sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = memory;
+		range.size   = VK_WHOLE_SIZE;
+		vkFlushMappedMemoryRanges(device, 1, &range);
+	}
+
+	for (const std::string &error : errors)
+	{
+		if (!error.empty())
+		{
+			throw std::runtime_error(error);
+		}
+	}
+	return textures;
+}
+
+std::vector<uint8_t> TextureLoader::decodeToHost(const std::string &path, uint32_t &width, uint32_t &height)
+{
+	readExtent(path, width, height);
+	size_t               size = static_cast<size_t>(width) * height * 4;
+	std::vector<uint8_t> pixels(size + DECODE_SLACK);
+	std::string          error = decodeInto(path, pixels.data(), size, width, height);
+	if (!error.empty())
+	{
+		throw std::runtime_error(error);
+	}
+	pixels.resize(size);
+	return pixels;
+}
+
+std::vector<uint8_t> TextureLoader::decodeToHost(const uint8_t *encoded, size_t size, uint32_t &width, uint32_t &height)
+{
+	int      x, y, channels;
+	stbi_uc *pixels = stbi_load_from_memory(encoded, static_cast<int>(size), &x, &y, &channels, STBI_rgb_alpha);
+	if (pixels == nullptr)
+	{
+		throw std::runtime_error("Couldn't decode an embedded texture");
+	}
+	width  = static_cast<uint32_t>(x);
+	height = static_cast<uint32_t>(y);
+	std::vector<uint8_t> result(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	stbi_image_free(pixels);
+	return result;
+}
+
+VkBuffer TextureLoader::stagingBuffer() const
+{
+	return buffer;
+}
+
+VkDeviceSize TextureLoader::stagingCapacity() const
+{
+	return capacity;
+}
+
+bool TextureLoader::stagingCached() const
+{
+	return cached;
+}
+
+VkBufferImageCopy TextureLoader::copyRegion(const DecodedTexture &texture)
+{
+	VkBufferImageCopy region{};
+	region.bufferOffset                = texture.offset;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel   = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent                 = {texture.width, texture.height, 1};
+	return region;
+}
@@ -0,0 +1,70 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <string>
+#include <vector>
+
+#include "VulkanHandles.hpp"
+
+struct DecodedTexture
+{
+	uint32_t     width;
+	uint32_t     height;
+	VkDeviceSize offset;    // into the staging buffer
+	VkDeviceSize size;
+};
+
+// Decodes images to RGBA8 into a persistently mapped staging buffer, several
+// files in parallel. Extents are read from the file headers first, so the
+// buffer is sized once per batch and reused across batches. PNG unfiltering
+// reads back the previous row, which is slow from write-combined memory, so
+// the buffer uses host cached memory when the device has it. Otherwise each
+// image is decoded into cached scratch memory and copied over in one pass.
+class TextureLoader
+{
+  public:
+	enum class StagingMode
+	{
+		Automatic,    // cached memory if there is some, else Scratch
+		Direct,       // decode into the buffer whatever its memory is
+		Scratch,      // coherent memory, filled from a heap decode
+	};
+
+	void create(VkDevice device, VkPhysicalDevice physicalDevice, StagingMode mode = StagingMode::Automatic);
+	void destroy();
+
+	// Overwrites the staging buffer, so copies from a previous batch must
+	// have finished.
+	std::vector<DecodedTexture> decode(const std::vector<std::string> &paths);
+
+	// Extent from the file header, without decoding.
+	static void readExtent(const std::string &path, uint32_t &width, uint32_t &height);
+
+	// Same decode into heap memory, for uploads that don't need staging.
+	static std::vector<uint8_t> decodeToHost(const std::string &path, uint32_t &width, uint32_t &height);
+
+	// Decodes an image already in memory, e.g. embedded in a model file.
+	static std::vector<uint8_t> decodeToHost(const uint8_t *encoded, size_t size, uint32_t &width, uint32_t &height);
+
+	VkBuffer     stagingBuffer() const;
+	VkDeviceSize stagingCapacity() const;
+	bool         stagingCached() const;
+
+	static VkBufferImageCopy copyRegion(const DecodedTexture &texture);
+
+  private:
+	void reserve(VkDeviceSize size);
+
+	VkDevice           device         = VK_NULL_HANDLE;
+	VkPhysicalDevice   physicalDevice = VK_NULL_HANDLE;
+	VkDeviceSize       alignment      = 16;
+	VkDeviceSize       capacity       = 0;
+	StagingMode        mode           = StagingMode::Automatic;
+	bool               cached         = false;
+	bool               coherent       = true;
+	UniqueBuffer       buffer;
+	UniqueDeviceMemory memory;
+	uint8_t           *mapped = nullptr;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+void ThreadPool::create(uint32_t threadCount)
+{
+	if (threadCount == 0)
+	{
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	stopping = false;
+	for (uint32_t i = 1; i < threadCount; ++i)
+	{
+		workers.emplace_back(&ThreadPool::workerLoop, this, generation);
+	}
+}
+
+void ThreadPool::destroy()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread &worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+}
+
+void ThreadPool::run(uint32_t count, const std::function<void(uint32_t)> &task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->task = &task;
+		taskCount  = count;
+		nextTask   = 0;
+		busy       = static_cast<uint32_t>(workers.size());
+		generation++;
+	}
+	wake.notify_all();
+	drain();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [&]() { return busy == 0; });
+	this->task = nullptr;
+}
+
+uint32_t ThreadPool::threadCount() const
+{
+	return static_cast<uint32_t>(workers.size()) + 1;
+}
+
+void ThreadPool::drain()
+{
+	for (uint32_t i = nextTask++; i < taskCount; i = nextTask++)
+	{
+		(*task)(i);
+	}
+}
+
+void ThreadPool::workerLoop(uint64_t seen)
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&]() { return stopping || generation != seen; });
+			if (stopping)
+			{
+				return;
+			}
+			seen = generation;
+		}
+
+		drain();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--busy == 0)
+		{
+			finished.notify_one();
+		}
+	}
+}
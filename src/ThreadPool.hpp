@@ -0,0 +1,45 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent workers for splitting per-frame work into tasks. The calling
+// thread takes tasks as well, so a pool of one thread has no workers and
+// runs everything inline.
+class ThreadPool
+{
+  public:
+	// 0 threads means one per hardware thread.
+	void create(uint32_t threadCount = 0);
+	void destroy();
+
+	// Runs task(0) to task(count - 1) and returns once all have finished.
+	// Tasks are handed out in order, one at a time.
+	void run(uint32_t count, const std::function<void(uint32_t)> &task);
+
+	uint32_t threadCount() const;
+
+  private:
+	void workerLoop(uint64_t seen);
+	void drain();
+
+	std::vector<std::thread> workers;
+	std::mutex               mutex;
+	std::condition_variable  wake;
+	std::condition_variable  finished;
+	uint64_t                 generation = 0;
+	uint32_t                 busy       = 0;
+	bool                     stopping   = false;
+
+	// The current batch, published under the mutex with a new generation
+	const std::function<void(uint32_t)> *task      = nullptr;
+	uint32_t                             taskCount = 0;
+	std::atomic<uint32_t>                nextTask{0};
+};
+
+#endif
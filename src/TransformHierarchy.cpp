@@ -0,0 +1,209 @@
+#include "TransformHierarchy.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+// out = a * b, a column of out being the columns of a weighted by a column of b.
+void multiply(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out)
+{
+#if defined(__SSE__)
+	__m128 a0 = _mm_loadu_ps(&a[0][0]);
+	__m128 a1 = _mm_loadu_ps(&a[1][0]);
+	__m128 a2 = _mm_loadu_ps(&a[2][0]);
+	__m128 a3 = _mm_loadu_ps(&a[3][0]);
+	for (int column = 0; column < 4; ++column)
+	{
+		__m128 r = _mm_mul_ps(a0, _mm_set1_ps(b[column][0]));
+		r        = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(b[column][1])));
+		r        = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(b[column][2])));
+		r        = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(b[column][3])));
+		_mm_storeu_ps(&out[column][0], r);
+	}
+#elif defined(__ARM_NEON)
+	float32x4_t a0 = vld1q_f32(&a[0][0]);
+	float32x4_t a1 = vld1q_f32(&a[1][0]);
+	float32x4_t a2 = vld1q_f32(&a[2][0]);
+	float32x4_t a3 = vld1q_f32(&a[3][0]);
+	for (int column = 0; column < 4; ++column)
+	{
+		float32x4_t r = vmulq_n_f32(a0, b[column][0]);
+		r             = vmlaq_n_f32(r, a1, b[column][1]);
+		r             = vmlaq_n_f32(r, a2, b[column][2]);
+		r             = vmlaq_n_f32(r, a3, b[column][3]);
+		vst1q_f32(&out[column][0], r);
+	}
+#else
+	out = a * b;
+#endif
+}
+}        // namespace
+
+TransformNode TransformHierarchy::add(TransformNode parent, const glm::mat4 &local)
+{
+	TransformNode node  = static_cast<TransformNode>(slots.size());
+	uint32_t      slot  = static_cast<uint32_t>(locals.size());
+	uint32_t      depth = parent == NO_PARENT ? 0 : depths[parent] + 1;
+
+	// Appending keeps the order as long as no shallower node follows a deeper one.
+	if (slot > 0 && depth < depths[handles.back()])
+	{
+		sorted = false;
+	}
+
+	locals.push_back(local);
+	worlds.push_back(local);
+	parentSlots.push_back(parent == NO_PARENT ? NO_PARENT : slots[parent]);
+	dirty.push_back(1);
+	slots.push_back(slot);
+	depths.push_back(depth);
+	parents.push_back(parent);
+	handles.push_back(node);
+
+	if (sorted)
+	{
+		if (depth + 1 >= levelStarts.size())
+		{
+			levelStarts.resize(depth + 2, slot);
+		}
+		levelStarts.back() = slot + 1;
+	}
+	return node;
+}
+
+void TransformHierarchy::setLocal(TransformNode node, const glm::mat4 &local)
+{
+	uint32_t slot = slots[node];
+	locals[slot]  = local;
+	dirty[slot]   = 1;
+}
+
+const glm::mat4 &TransformHierarchy::local(TransformNode node) const
+{
+	return locals[slots[node]];
+}
+
+const glm::mat4 &TransformHierarchy::world(TransformNode node) const
+{
+	return worlds[slots[node]];
+}
+
+void TransformHierarchy::clear()
+{
+	locals.clear();
+	worlds.clear();
+	parentSlots.clear();
+	dirty.clear();
+	levelStarts.clear();
+	slots.clear();
+	depths.clear();
+	parents.clear();
+	handles.clear();
+	sorted = true;
+}
+
+uint32_t TransformHierarchy::size() const
+{
+	return static_cast<uint32_t>(locals.size());
+}
+
+uint32_t TransformHierarchy::levelCount()
+{
+	if (!sorted)
+	{
+		sortByDepth();
+	}
+	return levelStarts.empty() ? 0 : static_cast<uint32_t>(levelStarts.size()) - 1;
+}
+
+void TransformHierarchy::sortByDepth()
+{
+	// Counting sort by depth, stable so siblings added together stay together.
+	uint32_t levels = *std::max_element(depths.begin(), depths.end()) + 1;
+	levelStarts.assign(levels + 1, 0);
+	for (uint32_t depth : depths)
+	{
+		levelStarts[depth + 1]++;
+	}
+	for (uint32_t level = 0; level < levels; ++level)
+	{
+		levelStarts[level + 1] += levelStarts[level];
+	}
+
+	std::vector<uint32_t> next(levelStarts.begin(), levelStarts.end() - 1);
+	for (TransformNode node = 0; node < slots.size(); ++node)
+	{
+		slots[node] = next[depths[node]]++;
+	}
+
+	std::vector<glm::mat4> sortedLocals(locals.size());
+	std::vector<glm::mat4> sortedWorlds(worlds.size());
+	std::vector<uint8_t>   sortedDirty(dirty.size());
+	for (uint32_t slot = 0; slot < handles.size(); ++slot)
+	{
+		uint32_t target      = slots[handles[slot]];
+		sortedLocals[target] = locals[slot];
+		sortedWorlds[target] = worlds[slot];
+		sortedDirty[target]  = dirty[slot];
+	}
+	locals = std::move(sortedLocals);
+	worlds = std::move(sortedWorlds);
+	dirty  = std::move(sortedDirty);
+
+	for (TransformNode node = 0; node < slots.size(); ++node)
+	{
+		handles[slots[node]]     = node;
+		parentSlots[slots[node]] = parents[node] == NO_PARENT ? NO_PARENT : slots[parents[node]];
+	}
+	sorted = true;
+}
+
+uint32_t TransformHierarchy::update(ThreadPool &pool)
+{
+	if (!sorted)
+	{
+		sortByDepth();
+	}
+
+	// A node is recomputed when it or its parent is dirty and then stays
+	// dirty itself, so changes flow down one level at a time.
+	updatedCount = 0;
+	for (size_t level = 0; level + 1 < levelStarts.size(); ++level)
+	{
+		uint32_t levelBegin = levelStarts[level];
+		uint32_t levelEnd   = levelStarts[level + 1];
+		uint32_t chunks     = (levelEnd - levelBegin + CHUNK_SIZE - 1) / CHUNK_SIZE;
+		pool.run(chunks, [&](uint32_t chunk) {
+			uint32_t begin   = levelBegin + chunk * CHUNK_SIZE;
+			uint32_t end     = std::min(begin + CHUNK_SIZE, levelEnd);
+			uint32_t updated = 0;
+			for (uint32_t slot = begin; slot < end; ++slot)
+			{
+				uint32_t parent = parentSlots[slot];
+				if (parent == NO_PARENT)
+				{
+					if (dirty[slot])
+					{
+						worlds[slot] = locals[slot];
+						++updated;
+					}
+				}
+				else if (dirty[slot] || dirty[parent])
+				{
+					multiply(worlds[parent], locals[slot], worlds[slot]);
+					dirty[slot] = 1;
+					++updated;
+				}
+			}
+			updatedCount += updated;
+		});
+	}
+	std::fill(dirty.begin(), dirty.end(), 0);
+	return updatedCount;
+}
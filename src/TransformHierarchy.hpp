@@ -0,0 +1,59 @@
+#ifndef TRANSFORMHIERARCHY_H
+#define TRANSFORMHIERARCHY_H
+
+#include <atomic>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+
+using TransformNode = uint32_t;
+
+// Parented transforms kept in arrays sorted by depth, so all parents of a
+// level are final before it is computed and each level is one contiguous
+// range split into chunks across the pool. Nodes are addressed by stable
+// handles; adding nodes re-sorts the arrays on the next update.
+class TransformHierarchy
+{
+  public:
+	static constexpr TransformNode NO_PARENT = UINT32_MAX;
+
+	// Parents have to exist before their children.
+	TransformNode    add(TransformNode parent, const glm::mat4 &local);
+	void             setLocal(TransformNode node, const glm::mat4 &local);
+	const glm::mat4 &local(TransformNode node) const;
+	void             clear();
+	uint32_t         size() const;
+	uint32_t         levelCount();
+
+	// Parent world times local, as of the last update.
+	const glm::mat4 &world(TransformNode node) const;
+
+	// Recomputes the world matrix of every node whose local matrix or one of
+	// whose ancestors' changed since the last update. Returns their count.
+	uint32_t update(ThreadPool &pool);
+
+  private:
+	static constexpr uint32_t CHUNK_SIZE = 4096;
+
+	void sortByDepth();
+
+	// Hot, in slot order: read by every update
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<uint32_t>  parentSlots;    // NO_PARENT for roots
+	std::vector<uint8_t>   dirty;
+	std::vector<uint32_t>  levelStarts;    // first slot of every level, then the end
+
+	// Cold, by handle: only read when nodes are added
+	std::vector<uint32_t> slots;
+	std::vector<uint32_t> depths;
+	std::vector<uint32_t> parents;
+	std::vector<uint32_t> handles;    // by slot
+	bool                  sorted = true;
+
+	std::atomic<uint32_t> updatedCount{0};
+};
+
+#endif
@@ -1,7 +1,17 @@
 #include "VulkanApp.hpp"
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
 #include <set>
+#include <sstream>
 #include <unordered_map>
 
 #define GLM_FORCE_RADIANS
@@ -11,17 +21,29 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/hash.hpp>
 
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb/stb_image.h>
-
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tinyobjloader/tiny_obj_loader.h>
 
+// Set by the build, for --watch-shaders.
+#ifndef SHADER_SOURCE_DIR
+#define SHADER_SOURCE_DIR "../shaders"
+#endif
+#ifndef GLSL_VALIDATOR
+#define GLSL_VALIDATOR "/usr/bin/glslangValidator"
+#endif
+
 void VulkanApp::run()
 {
 	initWindow();
 	initVulkan();
-	mainLoop();
+	if (benchmark.empty())
+	{
+		mainLoop();
+	}
+	else
+	{
+		runBenchmark();
+	}
 	cleanup();
 }
 
@@ -36,17 +58,125 @@ void VulkanApp::initWindow()
 	}
 	glfwSetWindowUserPointer(window, this);
 	glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+	glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+	glfwSetKeyCallback(window, keyCallback);
+	glfwSetScrollCallback(window, scrollCallback);
 }
 
 static void framebufferResizeCallback(GLFWwindow *window, int width, int height)
 {
 	auto *app               = reinterpret_cast<VulkanApp *>(glfwGetWindowUserPointer(window));
 	app->framebufferResized = true;
+	app->markDirty(DIRTY_SWAPCHAIN);
+}
+
+static void windowRefreshCallback(GLFWwindow *window)
+{
+	auto *app = reinterpret_cast<VulkanApp *>(glfwGetWindowUserPointer(window));
+	app->markDirty(DIRTY_SWAPCHAIN);
+}
+
+static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+	auto *app = reinterpret_cast<VulkanApp *>(glfwGetWindowUserPointer(window));
+	app->handleKey(key, action);
+}
+
+static void scrollCallback(GLFWwindow *window, double xOffset, double yOffset)
+{
+	auto *app = reinterpret_cast<VulkanApp *>(glfwGetWindowUserPointer(window));
+	app->handleScroll(yOffset);
+}
+
+void VulkanApp::markDirty(uint32_t flags)
+{
+	dirtyFlags |= flags;
+}
+
+void VulkanApp::handleKey(int key, int action)
+{
+	if (action == GLFW_RELEASE)
+	{
+		return;
+	}
+	latencyTracker.inputReceived();
+
+	switch (key)
+	{
+		case GLFW_KEY_F5:
+			if (action == GLFW_PRESS)
+			{
+				reloadAssets();
+			}
+			break;
+		case GLFW_KEY_Z:
+			if (action == GLFW_PRESS)
+			{
+				setDepthPrepass(!useDepthPrepass);
+				std::cout << "Depth pre-pass " << (useDepthPrepass ? "on" : "off") << std::endl;
+			}
+			break;
+		case GLFW_KEY_SPACE:
+			if (action == GLFW_PRESS)
+			{
+				animationPaused = !animationPaused;
+				markDirty(DIRTY_UNIFORMS);
+			}
+			break;
+		case GLFW_KEY_LEFT:
+			cameraYaw -= glm::radians(5.0f);
+			markDirty(DIRTY_CAMERA);
+			break;
+		case GLFW_KEY_RIGHT:
+			cameraYaw += glm::radians(5.0f);
+			markDirty(DIRTY_CAMERA);
+			break;
+		case GLFW_KEY_UP:
+			cameraPitch = std::min(cameraPitch + glm::radians(5.0f), glm::radians(85.0f));
+			markDirty(DIRTY_CAMERA);
+			break;
+		case GLFW_KEY_DOWN:
+			cameraPitch = std::max(cameraPitch - glm::radians(5.0f), glm::radians(-85.0f));
+			markDirty(DIRTY_CAMERA);
+			break;
+	}
+}
+
+void VulkanApp::handleScroll(double yOffset)
+{
+	latencyTracker.inputReceived();
+	cameraDistance = std::clamp(cameraDistance * std::pow(0.9f, static_cast<float>(yOffset)), 0.2f, 5.0f);
+	markDirty(DIRTY_CAMERA);
+}
+
+bool VulkanApp::isRedrawNeeded() const
+{
+	return dirtyFlags != DIRTY_NONE || !animationPaused || (streamTextures && residencyManager.busy()) || !textureReloads.empty();
 }
 
 void VulkanApp::drawFrame()
 {
+	// Polled on both sides of the wait: a frame that finished earlier is seen
+	// before it, one still running the moment the wait returns.
+	pollFrameLatency();
 	vkWaitForFences(logicalDevice, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+	pollFrameLatency();
+	reportCulling();
+
+	// Frames up to frameNumber - MAX_FRAMES_IN_FLIGHT have retired with this fence.
+	deletionQueue.collect(frameNumber >= MAX_FRAMES_IN_FLIGHT ? frameNumber - MAX_FRAMES_IN_FLIGHT + 1 : 0);
+	retireTextureReloads(false);
+	if (streamTextures)
+	{
+		requestTextureDetail();
+		if (residencyManager.update(deletionQueue))
+		{
+			markDirty(DIRTY_SCENE);
+		}
+		reportStreaming();
+	}
+	writeFrameDescriptors(currentFrame);
+
 	uint32_t imageIndex = 0;
 	VkResult result     = vkAcquireNextImageKHR(logicalDevice, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
 
@@ -60,17 +190,39 @@ void VulkanApp::drawFrame()
 		throw std::runtime_error(err2msg(result));
 	}
 
+	// Everything changed so far is picked up by the frame recorded below.
+	dirtyFlags = DIRTY_NONE;
+
 	vkResetFences(logicalDevice, 1, &inFlightFences[currentFrame]);
 
+	presentId++;
+	if (reportLatency)
+	{
+		inFlightPresentIds[currentFrame] = presentId;
+		latencyTracker.frameStarted(presentId);
+	}
+
+	// Also computes the per-draw matrices pushed while recording.
+	updateUniformBuffer(currentFrame);
+	if (animateInstances && !animationPaused)
+	{
+		animateInstanceTransforms();
+	}
+	if (useCpuCulling && !useGpuCulling)
+	{
+		objectStore.cull(frustumPlanes(viewProjection * modelMatrix), threadPool, visibleInstances);
+	}
+
 	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+	auto recordStart = std::chrono::steady_clock::now();
 	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+	lastRecordTime = std::chrono::steady_clock::now() - recordStart;
+	reportDraws();
 
 	VkSemaphore          waitSemaphores[]   = {imageAvailableSemaphores[currentFrame]};
 	VkSemaphore          signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
 	VkPipelineStageFlags waitStages[]       = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
-	updateUniformBuffer(currentFrame);
-
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submitInfo.waitSemaphoreCount = 1;
@@ -86,6 +238,8 @@ void VulkanApp::drawFrame()
 	{
 		throw std::runtime_error(err2msg(result));
 	}
+	frameNumber++;
+	deletionQueue.setFrame(frameNumber);
 
 	VkPresentInfoKHR presentInfo{};
 	presentInfo.sType              = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -98,7 +252,20 @@ void VulkanApp::drawFrame()
 	presentInfo.pImageIndices   = &imageIndex;
 	presentInfo.pResults        = nullptr;
 
+	VkPresentIdKHR presentIdInfo{};
+	presentIdInfo.sType          = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+	presentIdInfo.swapchainCount = 1;
+	presentIdInfo.pPresentIds    = &presentId;
+	if (presentWaitSupported && reportLatency)
+	{
+		presentInfo.pNext = &presentIdInfo;
+	}
+
 	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	if (presentWaitSupported && reportLatency)
+	{
+		presentWaiter.presented(presentId);
+	}
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized)
 	{
@@ -115,31 +282,128 @@ void VulkanApp::drawFrame()
 
 void VulkanApp::initVulkan()
 {
+	// The instancing and pre-pass benchmarks fill the instance buffer themselves.
+	useGpuCulling = useGpuCulling || useOcclusionCulling;
+	useInstancing = instanceCount > 0 || useGpuCulling || useCpuCulling || animateInstances || benchmark == "instancing" || benchmark == "prepass";
+	if (useCpuCulling || animateInstances || !assetPackPath.empty())
+	{
+		threadPool.create();
+	}
+
+	if (watchShaders && !assetPackPath.empty())
+	{
+		std::cout << "Watching shaders needs the loose files, not using the asset pack.\n";
+		assetPackPath.clear();
+	}
+
+	// Everything after this reads through the pack.
+	if (!assetPackPath.empty())
+	{
+		assetPack.open(assetPackPath, threadPool);
+		mountAssetPack(&assetPack);
+		AssetPack::Stats stats = assetPack.stats();
+		std::cout << "Asset pack " << assetPackPath << ": " << stats.entries << " files, " << stats.compressed << " expanded on "
+		          << threadPool.threadCount() << " threads in " << stats.decompressMs << " ms\n";
+	}
+
 	createInstance();
 	setupDebugMessanger();
 	createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
+	objectCache.create(logicalDevice);
 	createSwapChain();
 	createImageViews();
-	createRenderPass();
+	if (!useDynamicRendering)
+	{
+		createRenderPass();
+	}
 	createDescriptorSetLayout();
+	if (useBindless)
+	{
+		bindlessTable.create(logicalDevice, physicalDevice, objectCache, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT));
+	}
 	createGraphicsPipeline();
 	createCommandPool();
-	createColorResources();
-	createDepthResources();
-	createFramebuffers();
-	createTextureImage();
-	createTextureImageView();
+	mipGenerator.create(logicalDevice, physicalDevice, objectCache, "shaders/mipgen.comp.spv");
+	if (useOcclusionCulling)
+	{
+		depthPyramid.create(logicalDevice, physicalDevice, objectCache, "shaders/depthreduce.comp.spv", "shaders/depthreducems.comp.spv");
+		gpuCuller.create(logicalDevice, physicalDevice, objectCache, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT), "shaders/occlusion.comp.spv", true);
+		gpuCuller.setDepthPyramid(&depthPyramid);
+	}
+	else if (useGpuCulling)
+	{
+		gpuCuller.create(logicalDevice, physicalDevice, objectCache, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT), "shaders/cull.comp.spv");
+	}
+	textureLoader.create(logicalDevice, physicalDevice);
+	if (useDynamicRendering)
+	{
+		buildRenderGraph();
+	}
+	else
+	{
+		createColorResources();
+		createDepthResources();
+		createFramebuffers();
+	}
+	if (streamTextures)
+	{
+		// Textures appear once their first levels are uploaded, no waiting here.
+		QueueFamiliyIndices indices = findQueueFamilies(physicalDevice, surface);
+		residencyManager.create(logicalDevice, physicalDevice, indices.graphicsFamily.value(), graphicsQueue,
+		                        memoryBudgetSupported, textureBudget);
+		modelTexture = residencyManager.add(findTextureFile());
+	}
+	else
+	{
+		createTextureImage();
+	}
 	createTextureSampler();
+	if (useBindless)
+	{
+		// The texture slot is filled in by writeFrameDescriptors().
+		modelMaterial = bindlessTable.addMaterial(BindlessTable::Material{});
+	}
 	loadModel();
+	createMaterialTextures();
+	if (useBindless)
+	{
+		bindlessMaterials.push_back(modelMaterial);
+		for (const MaterialTexture &texture : materialTextures)
+		{
+			BindlessTable::Material material;
+			material.textureIndex = bindlessTable.addTexture(texture.view, textureSampler);
+			bindlessMaterials.push_back(bindlessTable.addMaterial(material));
+		}
+	}
 	createVertexBuffer();
 	createIndexBuffer();
+	createPositionBuffer();
+	if (useInstancing)
+	{
+		instanceManager.create(logicalDevice, physicalDevice, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT));
+		populateInstances(std::max(instanceCount, 1u));
+	}
+	if (useGpuCulling)
+	{
+		GpuCuller::Mesh mesh;
+		mesh.sphere     = glm::vec4(modelCenter, modelRadius);
+		mesh.indexCount = static_cast<uint32_t>(indices.size());
+		gpuCuller.addMesh(mesh);
+	}
 	createUniformBuffers();
 	createDescriptorPool();
-	createDescriptorSets();
 	createCommandBuffers();
 	createSyncObjects();
+
+	// Modules are written where they are loaded from, shaders/ in the
+	// working directory.
+	if (watchShaders)
+	{
+		shaderWatcher.start(SHADER_SOURCE_DIR, "shaders", GLSL_VALIDATOR);
+		std::cout << "Watching " << SHADER_SOURCE_DIR << " for shader changes\n";
+	}
 }
 
 void VulkanApp::createInstance()
@@ -150,7 +414,7 @@ void VulkanApp::createInstance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 	appInfo.pEngineName        = ENGINE_NAME;
 	appInfo.engineVersion      = VK_MAKE_VERSION(1, 0, 0);
-	appInfo.apiVersion         = VK_API_VERSION_1_0;
+	appInfo.apiVersion         = VK_API_VERSION_1_3;
 
 	VkInstanceCreateInfo createInfo{};
 	createInfo.sType             = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -242,19 +506,27 @@ void VulkanApp::pickPhysicalDevice()
 
 	vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
+	// Prefer real GPUs, but accept software rasterizers such as lavapipe.
+	int bestRank = 0;
 	for (const VkPhysicalDevice &device : devices)
 	{
-		if (isDeviceSuitable(device, surface))
+		int rank = rankPhysicalDevice(device);
+		if (rank > bestRank && isDeviceSuitable(device, surface))
 		{
 			physicalDevice = device;
-			msaaSamples    = getMaxUsableSampleCount(physicalDevice);
-			break;
+			bestRank       = rank;
 		}
 	}
 	if (physicalDevice == VK_NULL_HANDLE)
 	{
 		throw std::runtime_error("No supported devices found!");
 	}
+	msaaSamples = getMaxUsableSampleCount(physicalDevice);
+	depthFormat = findSuitableFormat(
+	    physicalDevice,
+	    {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+	    VK_IMAGE_TILING_OPTIMAL,
+	    VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | (useOcclusionCulling ? VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT : 0));
 }
 
 void VulkanApp::createLogicalDevice()
@@ -275,15 +547,179 @@ void VulkanApp::createLogicalDevice()
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
-	VkPhysicalDeviceFeatures physicalDeviceFeatures{};
-	physicalDeviceFeatures.samplerAnisotropy = VK_TRUE;
-	VkDeviceCreateInfo       deviceCreateInfo{};
+	std::vector<const char *> enabledExtensions = deviceExtensions;
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	bool isVulkan13       = deviceProperties.apiVersion >= VK_API_VERSION_1_3;
+	bool hasPresentWait   = isDeviceExtensionSupported(physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+	                        isDeviceExtensionSupported(physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+	bool hasHostImageCopy = isVulkan13 && isDeviceExtensionSupported(physicalDevice, VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+	bool isVulkan12       = deviceProperties.apiVersion >= VK_API_VERSION_1_2;
+	bool hasIndexing      = isVulkan12 || (isDeviceExtensionSupported(physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+	                                       isDeviceExtensionSupported(physicalDevice, VK_KHR_MAINTENANCE_3_EXTENSION_NAME));
+
+	// Query optional features
+	VkPhysicalDevicePresentWaitFeaturesKHR supportedPresentWait{};
+	supportedPresentWait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	VkPhysicalDevicePresentIdFeaturesKHR supportedPresentId{};
+	supportedPresentId.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	VkPhysicalDeviceVulkan13Features supportedVulkan13{};
+	supportedVulkan13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	VkPhysicalDeviceHostImageCopyFeaturesEXT supportedHostImageCopy{};
+	supportedHostImageCopy.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+	VkPhysicalDeviceDescriptorIndexingFeatures supportedIndexing{};
+	supportedIndexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+
+	VkPhysicalDeviceFeatures2 supportedFeatures{};
+	supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	if (hasPresentWait)
+	{
+		chainFeature(supportedFeatures, supportedPresentId);
+		chainFeature(supportedFeatures, supportedPresentWait);
+	}
+	if (isVulkan13)
+	{
+		chainFeature(supportedFeatures, supportedVulkan13);
+	}
+	if (hasHostImageCopy)
+	{
+		chainFeature(supportedFeatures, supportedHostImageCopy);
+	}
+	if (hasIndexing)
+	{
+		chainFeature(supportedFeatures, supportedIndexing);
+	}
+	vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+
+	presentWaitSupported           = hasPresentWait && supportedPresentId.presentId && supportedPresentWait.presentWait;
+	bool dynamicRenderingSupported = isVulkan13 && supportedVulkan13.dynamicRendering && supportedVulkan13.synchronization2;
+	hostImageCopySupported         = hasHostImageCopy && supportedHostImageCopy.hostImageCopy && !disableHostImageCopy &&
+	                                 isHostCopyDstLayout(physicalDevice, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	bool bindlessSupported         = hasIndexing && supportedIndexing.runtimeDescriptorArray &&
+	                                 supportedIndexing.shaderSampledImageArrayNonUniformIndexing &&
+	                                 supportedIndexing.descriptorBindingPartiallyBound &&
+	                                 supportedIndexing.descriptorBindingVariableDescriptorCount &&
+	                                 supportedIndexing.descriptorBindingSampledImageUpdateAfterBind &&
+	                                 supportedIndexing.descriptorBindingUpdateUnusedWhilePending;
+	bool gpuCullingSupported       = supportedFeatures.features.multiDrawIndirect && supportedFeatures.features.drawIndirectFirstInstance;
+
+	// Enable only what is used
+	VkPhysicalDeviceFeatures2 physicalDeviceFeatures{};
+	physicalDeviceFeatures.sType                      = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	physicalDeviceFeatures.features.samplerAnisotropy = VK_TRUE;
+
+	// Block compressed textures are picked at load time from what is enabled here.
+	physicalDeviceFeatures.features.textureCompressionBC       = supportedFeatures.features.textureCompressionBC;
+	physicalDeviceFeatures.features.textureCompressionASTC_LDR = supportedFeatures.features.textureCompressionASTC_LDR;
+	physicalDeviceFeatures.features.textureCompressionETC2     = supportedFeatures.features.textureCompressionETC2;
+
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+	presentIdFeatures.sType     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	presentIdFeatures.presentId = VK_TRUE;
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+	presentWaitFeatures.sType       = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	presentWaitFeatures.presentWait = VK_TRUE;
+	if (presentWaitSupported)
+	{
+		chainFeature(physicalDeviceFeatures, presentIdFeatures);
+		chainFeature(physicalDeviceFeatures, presentWaitFeatures);
+		enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+		enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+	}
+
+	VkPhysicalDeviceVulkan13Features vulkan13Features{};
+	vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	if (useDynamicRendering && !dynamicRenderingSupported)
+	{
+		std::cout << "Dynamic rendering is not supported, using the render pass path.\n";
+		useDynamicRendering = false;
+	}
+	if (useDynamicRendering)
+	{
+		vulkan13Features.dynamicRendering = VK_TRUE;
+		vulkan13Features.synchronization2 = VK_TRUE;
+		chainFeature(physicalDeviceFeatures, vulkan13Features);
+	}
+
+	VkPhysicalDeviceHostImageCopyFeaturesEXT hostImageCopyFeatures{};
+	hostImageCopyFeatures.sType         = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+	hostImageCopyFeatures.hostImageCopy = VK_TRUE;
+	if (hostImageCopySupported)
+	{
+		chainFeature(physicalDeviceFeatures, hostImageCopyFeatures);
+		enabledExtensions.push_back(VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME);
+	}
+
+	// Heap budgets for texture streaming, a plain extension without features
+	memoryBudgetSupported = isDeviceExtensionSupported(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (memoryBudgetSupported)
+	{
+		enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	}
+
+	// On Vulkan 1.2 the indexing features go into the Vulkan 1.2 structure,
+	// which must not be chained next to the structures it subsumes.
+	VkPhysicalDeviceVulkan12Features vulkan12Features{};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	VkPhysicalDeviceDescriptorIndexingFeatures indexingFeatures{};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+	if (useBindless && !bindlessSupported)
+	{
+		std::cout << "Descriptor indexing is not supported, using one descriptor per texture.\n";
+		useBindless = false;
+	}
+	if (useBindless && isVulkan12)
+	{
+		vulkan12Features.runtimeDescriptorArray                       = VK_TRUE;
+		vulkan12Features.shaderSampledImageArrayNonUniformIndexing    = VK_TRUE;
+		vulkan12Features.descriptorBindingPartiallyBound              = VK_TRUE;
+		vulkan12Features.descriptorBindingVariableDescriptorCount     = VK_TRUE;
+		vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		vulkan12Features.descriptorBindingUpdateUnusedWhilePending    = VK_TRUE;
+	}
+	else if (useBindless)
+	{
+		indexingFeatures.runtimeDescriptorArray                       = VK_TRUE;
+		indexingFeatures.shaderSampledImageArrayNonUniformIndexing    = VK_TRUE;
+		indexingFeatures.descriptorBindingPartiallyBound              = VK_TRUE;
+		indexingFeatures.descriptorBindingVariableDescriptorCount     = VK_TRUE;
+		indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		indexingFeatures.descriptorBindingUpdateUnusedWhilePending    = VK_TRUE;
+		chainFeature(physicalDeviceFeatures, indexingFeatures);
+		enabledExtensions.push_back(VK_KHR_MAINTENANCE_3_EXTENSION_NAME);
+		enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+	}
+
+	if (useGpuCulling && !gpuCullingSupported)
+	{
+		std::cout << "Multi-draw indirect is not supported, drawing every instance.\n";
+		useGpuCulling       = false;
+		useOcclusionCulling = false;
+	}
+	if (useOcclusionCulling && useDynamicRendering)
+	{
+		std::cout << "Occlusion culling needs the render pass path, culling against the frustum only.\n";
+		useOcclusionCulling = false;
+	}
+	if (useGpuCulling)
+	{
+		physicalDeviceFeatures.features.multiDrawIndirect         = VK_TRUE;
+		physicalDeviceFeatures.features.drawIndirectFirstInstance = VK_TRUE;
+	}
+	if (isVulkan12 && useBindless)
+	{
+		chainFeature(physicalDeviceFeatures, vulkan12Features);
+	}
+
+	VkDeviceCreateInfo deviceCreateInfo{};
 	deviceCreateInfo.sType                   = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceCreateInfo.pNext                   = &physicalDeviceFeatures;
 	deviceCreateInfo.pQueueCreateInfos       = queueCreateInfos.data();
 	deviceCreateInfo.queueCreateInfoCount    = static_cast<uint32_t>(queueCreateInfos.size());
-	deviceCreateInfo.pEnabledFeatures        = &physicalDeviceFeatures;
-	deviceCreateInfo.enabledExtensionCount   = static_cast<uint32_t>(deviceExtensions.size());
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	deviceCreateInfo.pEnabledFeatures        = nullptr;
+	deviceCreateInfo.enabledExtensionCount   = static_cast<uint32_t>(enabledExtensions.size());
+	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 	if (enableValidationLayers)
 	{
@@ -303,6 +739,16 @@ void VulkanApp::createLogicalDevice()
 
 	vkGetDeviceQueue(logicalDevice, indices.graphicsFamily.value(), 0, &graphicsQueue);
 	vkGetDeviceQueue(logicalDevice, indices.presentFamily.value(), 0, &presentQueue);
+
+	if (presentWaitSupported)
+	{
+		pfnWaitForPresent = (PFN_vkWaitForPresentKHR) vkGetDeviceProcAddr(logicalDevice, "vkWaitForPresentKHR");
+	}
+	if (hostImageCopySupported)
+	{
+		pfnTransitionImageLayout = (PFN_vkTransitionImageLayoutEXT) vkGetDeviceProcAddr(logicalDevice, "vkTransitionImageLayoutEXT");
+		pfnCopyMemoryToImage     = (PFN_vkCopyMemoryToImageEXT) vkGetDeviceProcAddr(logicalDevice, "vkCopyMemoryToImageEXT");
+	}
 }
 
 void VulkanApp::recreateSwapChain()
@@ -314,51 +760,64 @@ void VulkanApp::recreateSwapChain()
 		glfwGetFramebufferSize(window, &width, &height);
 		glfwWaitEvents();
 	}
+	cancelPipelineRebuild();
 	vkDeviceWaitIdle(logicalDevice);
+	deletionQueue.flush();
+	latencyTracker.reset();
+	markDirty(DIRTY_SWAPCHAIN);
 
+	VkFormat previousFormat = swapChainImageFormat;
 	cleanupSwapChain();
 
 	createSwapChain();
 	createImageViews();
-	createRenderPass();
-	createGraphicsPipeline();
-	createColorResources();
-	createDepthResources();
-	createFramebuffers();
-	createUniformBuffers();
-	createDescriptorPool();
-	createDescriptorSets();
-	createCommandBuffers();
+	if (swapChainImageFormat != previousFormat)
+	{
+		// Viewport and scissor are dynamic, only the attachment format is baked in.
+		graphicsPipeline.reset();
+		depthPipeline.reset();
+		if (!useDynamicRendering)
+		{
+			vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+			vkDestroyRenderPass(logicalDevice, occlusionRenderPass, nullptr);
+			createRenderPass();
+		}
+		graphicsPipeline = buildGraphicsPipeline();
+		if (useDepthPrepass)
+		{
+			depthPipeline = buildGraphicsPipeline(true);
+		}
+	}
+	if (useDynamicRendering)
+	{
+		buildRenderGraph();
+	}
+	else
+	{
+		createColorResources();
+		createDepthResources();
+		createFramebuffers();
+	}
 }
 
 void VulkanApp::cleanupSwapChain()
 {
-	vkDestroyImageView(logicalDevice, colorImageView, nullptr);
-	vkDestroyImage(logicalDevice, colorImage, nullptr);
-	vkFreeMemory(logicalDevice, colorImageMemory, nullptr);
+	presentWaiter.stop();
 
-	vkDestroyImageView(logicalDevice, depthImageView, nullptr);
-	vkDestroyImage(logicalDevice, depthImage, nullptr);
-	vkFreeMemory(logicalDevice, depthImageMemory, nullptr);
+	colorImageView.reset();
+	colorImage.reset();
+	colorImageMemory.reset();
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
-	{
-		vkDestroyBuffer(logicalDevice, uniformBuffers[i], nullptr);
-		vkFreeMemory(logicalDevice, uniformBuffersMemory[i], nullptr);
-	}
+	depthImageView.reset();
+	depthImage.reset();
+	depthImageMemory.reset();
 
 	for (auto buffer : swapChainFramebuffers)
 	{
 		vkDestroyFramebuffer(logicalDevice, buffer, nullptr);
 	}
-	for (const auto &imageView : swapChainImageViews)
-	{
-		vkDestroyImageView(logicalDevice, imageView, nullptr);
-	}
-	vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
-	vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
-	vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+	swapChainFramebuffers.clear();
+	swapChainImageViews.clear();
 	vkDestroySwapchainKHR(logicalDevice, swapChain, nullptr);
 }
 
@@ -366,13 +825,9 @@ void VulkanApp::createSwapChain()
 {
 	SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice, surface);
 	VkSurfaceFormatKHR      surfaceFormat    = chooseSwapSurfaceFormat(swapChainSupport.formats);
-	VkPresentModeKHR        presentMode      = chooseSwapPresentMode(swapChainSupport.presentModes);
+	VkPresentModeKHR        presentMode      = chooseSwapPresentMode(swapChainSupport.presentModes, presentPolicy);
 	VkExtent2D              extent           = chooseSwapExtent(swapChainSupport.capabilities, window);
-	uint32_t                imageCount       = swapChainSupport.capabilities.minImageCount + 1;
-	if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount)
-	{
-		imageCount = swapChainSupport.capabilities.maxImageCount;
-	}
+	uint32_t                imageCount       = chooseSwapImageCount(swapChainSupport.capabilities, swapChainImageCount);
 	VkSwapchainCreateInfoKHR swapChainCreateInfo{};
 	swapChainCreateInfo.sType            = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 	swapChainCreateInfo.surface          = surface;
@@ -416,14 +871,22 @@ void VulkanApp::createSwapChain()
 	vkGetSwapchainImagesKHR(logicalDevice, swapChain, &swapChainImagesCount, swapChainImages.data());
 	swapChainImageFormat = surfaceFormat.format;
 	swapChainExtent      = extent;
+	swapChainPresentMode = presentMode;
+
+	std::cout << "Swap chain: " << presentModeName(presentMode) << ", " << swapChainImagesCount << " images\n";
+
+	if (presentWaitSupported && reportLatency)
+	{
+		presentWaiter.start(logicalDevice, swapChain, pfnWaitForPresent, latencyTracker);
+	}
 }
 
 void VulkanApp::createImageViews()
 {
-	swapChainImageViews.resize(swapChainImages.size());
+	swapChainImageViews.clear();
 	for (size_t i = 0; i < swapChainImages.size(); ++i)
 	{
-		swapChainImageViews[i] = createImageView(logicalDevice, swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+		swapChainImageViews.emplace_back(logicalDevice, createImageView(logicalDevice, swapChainImages[i], swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1));
 	}
 }
 
@@ -444,11 +907,7 @@ void VulkanApp::createRenderPass()
 	colorAttachmentRef.layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	VkAttachmentDescription depthAttachment{};
-	depthAttachment.format = findSuitableFormat(
-	    physicalDevice,
-	    {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-	    VK_IMAGE_TILING_OPTIMAL,
-	    VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	depthAttachment.format         = depthFormat;
 	depthAttachment.samples        = msaaSamples;
 	depthAttachment.loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
 	depthAttachment.storeOp        = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -456,6 +915,12 @@ void VulkanApp::createRenderPass()
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
 	depthAttachment.finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	if (useOcclusionCulling)
+	{
+		// Kept for the depth pyramid and the second pass.
+		depthAttachment.storeOp     = VK_ATTACHMENT_STORE_OP_STORE;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+	}
 
 	VkAttachmentReference depthAttachmentRef{};
 	depthAttachmentRef.attachment = 1;
@@ -482,6 +947,20 @@ void VulkanApp::createRenderPass()
 	subpass.pDepthStencilAttachment = &depthAttachmentRef;
 	subpass.pResolveAttachments     = &colorAttachmentResolveRef;
 
+	// The pre-pass writes all of the depth in subpass 0, the main subpass
+	// after it only tests against it.
+	VkSubpassDescription depthSubpass{};
+	depthSubpass.pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	depthSubpass.colorAttachmentCount    = 0;
+	depthSubpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+	std::vector<VkSubpassDescription> subpasses = {subpass};
+	if (useDepthPrepass)
+	{
+		subpasses.insert(subpasses.begin(), depthSubpass);
+	}
+	uint32_t mainSubpass = static_cast<uint32_t>(subpasses.size()) - 1;
+
 	VkSubpassDependency dependancy{};
 	dependancy.srcSubpass    = VK_SUBPASS_EXTERNAL;
 	dependancy.dstSubpass    = 0;
@@ -490,22 +969,88 @@ void VulkanApp::createRenderPass()
 	dependancy.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	dependancy.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
-	std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, colorAttachmentResolve};
+	// With the pre-pass, color is first written in the main subpass.
+	VkSubpassDependency colorDependancy = dependancy;
+	colorDependancy.dstSubpass          = mainSubpass;
+
+	VkSubpassDependency prepassDependancy{};
+	prepassDependancy.srcSubpass    = 0;
+	prepassDependancy.dstSubpass    = mainSubpass;
+	prepassDependancy.srcStageMask  = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	prepassDependancy.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	prepassDependancy.dstStageMask  = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	prepassDependancy.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+
+	// The depth pyramid is built from the depth written here, all of it in
+	// subpass 0 with or without the pre-pass.
+	VkSubpassDependency pyramidDependancy{};
+	pyramidDependancy.srcSubpass    = 0;
+	pyramidDependancy.dstSubpass    = VK_SUBPASS_EXTERNAL;
+	pyramidDependancy.srcStageMask  = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	pyramidDependancy.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	pyramidDependancy.dstStageMask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	pyramidDependancy.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	std::array<VkAttachmentDescription, 3> attachments  = {colorAttachment, depthAttachment, colorAttachmentResolve};
+	std::vector<VkSubpassDependency>       dependancies = {dependancy};
+	if (useDepthPrepass)
+	{
+		dependancies.push_back(colorDependancy);
+		dependancies.push_back(prepassDependancy);
+	}
+	if (useOcclusionCulling)
+	{
+		dependancies.push_back(pyramidDependancy);
+	}
 
 	VkRenderPassCreateInfo renderPassCreateInfo{};
 	renderPassCreateInfo.sType           = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 	renderPassCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
 	renderPassCreateInfo.pAttachments    = attachments.data();
-	renderPassCreateInfo.subpassCount    = 1;
-	renderPassCreateInfo.pSubpasses      = &subpass;
-	renderPassCreateInfo.dependencyCount = 1;
-	renderPassCreateInfo.pDependencies   = &dependancy;
+	renderPassCreateInfo.subpassCount    = static_cast<uint32_t>(subpasses.size());
+	renderPassCreateInfo.pSubpasses      = subpasses.data();
+	renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(dependancies.size());
+	renderPassCreateInfo.pDependencies   = dependancies.data();
 
 	VkResult result = vkCreateRenderPass(logicalDevice, &renderPassCreateInfo, nullptr, &renderPass);
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error(err2msg(result));
 	}
+
+	if (useOcclusionCulling)
+	{
+		// The second pass draws on top of the first, after the culler's late
+		// phase has read the depth. Both share the framebuffers.
+		attachments[0].loadOp        = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachments[1].loadOp        = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].storeOp       = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		attachments[1].finalLayout   = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		dependancy.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependancy.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependancy.dstStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependancy.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		                           VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		colorDependancy            = dependancy;
+		colorDependancy.dstSubpass = mainSubpass;
+		dependancies[0]            = dependancy;
+		if (useDepthPrepass)
+		{
+			dependancies[1] = colorDependancy;
+		}
+		dependancies.pop_back();    // the pyramid dependency, last in the list
+		renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(dependancies.size());
+		renderPassCreateInfo.pDependencies   = dependancies.data();
+
+		result = vkCreateRenderPass(logicalDevice, &renderPassCreateInfo, nullptr, &occlusionRenderPass);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error(err2msg(result));
+		}
+	}
 }
 
 void VulkanApp::createDescriptorSetLayout()
@@ -530,19 +1075,57 @@ void VulkanApp::createDescriptorSetLayout()
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 	layoutInfo.pBindings    = bindings.data();
 
-	VkResult result = vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &descriptorSetLayout);
-	if (result != VK_SUCCESS)
+	descriptorSetLayout = objectCache.descriptorSetLayout(layoutInfo);
+}
+
+void VulkanApp::createGraphicsPipeline()
+{
+	VkPushConstantRange drawConstantRange{};
+	drawConstantRange.stageFlags = DRAW_CONSTANT_STAGES;
+	drawConstantRange.offset     = 0;
+	drawConstantRange.size       = sizeof(DrawConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
+	pipelineLayoutCreateInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount         = 1;
+	pipelineLayoutCreateInfo.pSetLayouts            = &descriptorSetLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges    = &drawConstantRange;
+
+	// Bindless draws add the material table as set 1.
+	std::array<VkDescriptorSetLayout, 2> bindlessSetLayouts = {descriptorSetLayout, bindlessTable.layout()};
+	if (useBindless)
 	{
-		throw std::runtime_error(err2msg(result));
+		pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(bindlessSetLayouts.size());
+		pipelineLayoutCreateInfo.pSetLayouts    = bindlessSetLayouts.data();
+	}
+
+	pipelineLayout   = objectCache.pipelineLayout(pipelineLayoutCreateInfo);
+	graphicsPipeline = buildGraphicsPipeline();
+	if (useDepthPrepass)
+	{
+		depthPipeline = buildGraphicsPipeline(true);
 	}
 }
 
-void VulkanApp::createGraphicsPipeline()
+const char *VulkanApp::vertexShaderFile(bool depthOnly) const
 {
-	auto           vertShaderCode = readFile("shaders/shader.vert.spv");
-	auto           fragShaderCode = readFile("shaders/shader.frag.spv");
-	VkShaderModule vertShader     = createShaderModule(logicalDevice, vertShaderCode);
-	VkShaderModule fragShader     = createShaderModule(logicalDevice, fragShaderCode);
+	if (depthOnly)
+	{
+		return useInstancing ? "shaders/depthinstanced.vert.spv" : "shaders/depth.vert.spv";
+	}
+	return useInstancing ? "shaders/instanced.vert.spv" : "shaders/shader.vert.spv";
+}
+
+const char *VulkanApp::fragmentShaderFile() const
+{
+	return useBindless ? "shaders/bindless.frag.spv" : "shaders/shader.frag.spv";
+}
+
+UniquePipeline VulkanApp::buildGraphicsPipeline(bool depthOnly)
+{
+	UniqueShaderModule vertShader(logicalDevice, createShaderModule(logicalDevice, loadSpirv(vertexShaderFile(depthOnly))));
+	UniqueShaderModule fragShader(logicalDevice, createShaderModule(logicalDevice, loadSpirv(fragmentShaderFile())));
 
 	VkPipelineShaderStageCreateInfo vertShaderStageCreateInfo{};
 	vertShaderStageCreateInfo.sType               = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -560,39 +1143,40 @@ void VulkanApp::createGraphicsPipeline()
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageCreateInfo, fragShaderStageCreateInfo};
 
-	auto bindingDescription   = Vertex::getBindingDescription();
-	auto attributeDescription = Vertex::getAttributeDescriptions();
+	std::vector<VkVertexInputBindingDescription>   bindingDescriptions = {Vertex::getBindingDescription()};
+	auto                                           vertexAttributes    = Vertex::getAttributeDescriptions();
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions(vertexAttributes.begin(), vertexAttributes.end());
+	if (depthOnly)
+	{
+		bindingDescriptions   = {Vertex::getPositionBindingDescription()};
+		attributeDescriptions = {Vertex::getPositionAttributeDescription()};
+	}
+	if (useInstancing)
+	{
+		auto instanceAttributes = InstanceManager::getAttributeDescriptions();
+		bindingDescriptions.push_back(InstanceManager::getBindingDescription());
+		attributeDescriptions.insert(attributeDescriptions.end(), instanceAttributes.begin(), instanceAttributes.end());
+	}
 
 	VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo{};
 	vertexInputStateCreateInfo.sType                           = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputStateCreateInfo.vertexBindingDescriptionCount   = 1;
-	vertexInputStateCreateInfo.pVertexBindingDescriptions      = &bindingDescription;
-	vertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescription.size());
-	vertexInputStateCreateInfo.pVertexAttributeDescriptions    = attributeDescription.data();
+	vertexInputStateCreateInfo.vertexBindingDescriptionCount   = static_cast<uint32_t>(bindingDescriptions.size());
+	vertexInputStateCreateInfo.pVertexBindingDescriptions      = bindingDescriptions.data();
+	vertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
+	vertexInputStateCreateInfo.pVertexAttributeDescriptions    = attributeDescriptions.data();
 
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo{};
 	inputAssemblyStateCreateInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 	inputAssemblyStateCreateInfo.topology               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport{};
-	viewport.x        = 0.0f;
-	viewport.y        = 0.0f;
-	viewport.width    = swapChainExtent.width;
-	viewport.height   = swapChainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor{};
-	scissor.offset = {0, 0};
-	scissor.extent = swapChainExtent;
-
+	// Viewport and scissor are set at record time so resizes keep the pipeline.
 	VkPipelineViewportStateCreateInfo viewportState{};
 	viewportState.sType         = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports    = &viewport;
+	viewportState.pViewports    = nullptr;
 	viewportState.scissorCount  = 1;
-	viewportState.pScissors     = &scissor;
+	viewportState.pScissors     = nullptr;
 
 	VkPipelineRasterizationStateCreateInfo rasterizer{};
 	rasterizer.sType                = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -629,40 +1213,38 @@ void VulkanApp::createGraphicsPipeline()
 	colorBlendState.sType             = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 	colorBlendState.logicOpEnable     = VK_FALSE;
 	colorBlendState.logicOp           = VK_LOGIC_OP_COPY;
-	colorBlendState.attachmentCount   = 1;
+	colorBlendState.attachmentCount   = depthOnly ? 0 : 1;
 	colorBlendState.pAttachments      = &colorBlendAttachment;
 	colorBlendState.blendConstants[0] = 0.0f;
 	colorBlendState.blendConstants[1] = 0.0f;
 	colorBlendState.blendConstants[2] = 0.0f;
 	colorBlendState.blendConstants[3] = 0.0f;
 
-	//	std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
-	//	                                             VK_DYNAMIC_STATE_LINE_WIDTH};
-
-	//	VkPipelineDynamicStateCreateInfo dynamicState{};
-	//	dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	//	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-	//	dynamicState.pDynamicStates    = dynamicStates.data();
-
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
-	pipelineLayoutCreateInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutCreateInfo.setLayoutCount         = 1;
-	pipelineLayoutCreateInfo.pSetLayouts            = &descriptorSetLayout;
-	pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
-	pipelineLayoutCreateInfo.pPushConstantRanges    = nullptr;
+	std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
+	                                             VK_DYNAMIC_STATE_SCISSOR};
 
-	VkResult result = vkCreatePipelineLayout(logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout);
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates    = dynamicStates.data();
 
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error(err2msg(result));
-	}
+	VkPipelineRenderingCreateInfo renderingCreateInfo{};
+	renderingCreateInfo.sType                   = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	renderingCreateInfo.colorAttachmentCount    = depthOnly ? 0 : 1;
+	renderingCreateInfo.pColorAttachmentFormats = &swapChainImageFormat;
+	renderingCreateInfo.depthAttachmentFormat   = depthFormat;
 
 	VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo{};
 	depthStencilCreateInfo.sType                 = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 	depthStencilCreateInfo.depthTestEnable       = VK_TRUE;
 	depthStencilCreateInfo.depthWriteEnable      = VK_TRUE;
 	depthStencilCreateInfo.depthCompareOp        = VK_COMPARE_OP_LESS;
+	if (useDepthPrepass && !depthOnly)
+	{
+		// Only the nearest surface left by the pre-pass passes.
+		depthStencilCreateInfo.depthWriteEnable = VK_FALSE;
+		depthStencilCreateInfo.depthCompareOp   = VK_COMPARE_OP_EQUAL;
+	}
 	depthStencilCreateInfo.depthBoundsTestEnable = VK_FALSE;
 	depthStencilCreateInfo.minDepthBounds        = 0.0f;
 	depthStencilCreateInfo.maxDepthBounds        = 1.0f;
@@ -672,7 +1254,7 @@ void VulkanApp::createGraphicsPipeline()
 
 	VkGraphicsPipelineCreateInfo pipelineCreateInfo{};
 	pipelineCreateInfo.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineCreateInfo.stageCount          = 2;
+	pipelineCreateInfo.stageCount          = depthOnly ? 1 : 2;
 	pipelineCreateInfo.pStages             = shaderStages;
 	pipelineCreateInfo.pVertexInputState   = &vertexInputStateCreateInfo;
 	pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCreateInfo;
@@ -681,23 +1263,28 @@ void VulkanApp::createGraphicsPipeline()
 	pipelineCreateInfo.pMultisampleState   = &multisampling;
 	pipelineCreateInfo.pDepthStencilState  = nullptr;
 	pipelineCreateInfo.pColorBlendState    = &colorBlendState;
-	pipelineCreateInfo.pDynamicState       = nullptr;
+	pipelineCreateInfo.pDynamicState       = &dynamicState;
 
 	pipelineCreateInfo.layout             = pipelineLayout;
 	pipelineCreateInfo.renderPass         = renderPass;
-	pipelineCreateInfo.subpass            = 0;
+	if (useDynamicRendering)
+	{
+		pipelineCreateInfo.pNext      = &renderingCreateInfo;
+		pipelineCreateInfo.renderPass = VK_NULL_HANDLE;
+	}
+	pipelineCreateInfo.subpass            = useDepthPrepass && !depthOnly && !useDynamicRendering ? 1 : 0;
 	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
 	pipelineCreateInfo.basePipelineIndex  = -1;
 
 	pipelineCreateInfo.pDepthStencilState = &depthStencilCreateInfo;
 
-	result = vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &graphicsPipeline);
+	VkPipeline pipeline;
+	VkResult   result = vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline);
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error(err2msg(result));
 	}
-	vkDestroyShaderModule(logicalDevice, vertShader, nullptr);
-	vkDestroyShaderModule(logicalDevice, fragShader, nullptr);
+	return UniquePipeline(logicalDevice, pipeline);
 }
 
 void VulkanApp::createFramebuffers()
@@ -744,69 +1331,376 @@ void VulkanApp::createColorResources()
 {
 	VkFormat colorFormat = swapChainImageFormat;
 
-	createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, physicalDevice, logicalDevice, colorImage, colorImageMemory, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, physicalDevice, logicalDevice, *colorImage.put(logicalDevice), *colorImageMemory.put(logicalDevice), colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	colorImageView = createImageView(logicalDevice, colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	colorImageView = UniqueImageView(logicalDevice, createImageView(logicalDevice, colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1));
 }
 
 void VulkanApp::createDepthResources()
 {
-	VkFormat depthFormat = findSuitableFormat(
-	    physicalDevice,
-	    {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-	    VK_IMAGE_TILING_OPTIMAL,
-	    VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-
-	createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, physicalDevice, logicalDevice, depthImage, depthImageMemory, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	depthImageView = createImageView(logicalDevice, depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+	// The depth pyramid is reduced from the depth image.
+	VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (useOcclusionCulling ? VK_IMAGE_USAGE_SAMPLED_BIT : 0);
+	createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, physicalDevice, logicalDevice, *depthImage.put(logicalDevice), *depthImageMemory.put(logicalDevice), depthFormat, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	depthImageView = UniqueImageView(logicalDevice, createImageView(logicalDevice, depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1));
+	if (useOcclusionCulling)
+	{
+		depthPyramid.resize(depthImageView, swapChainExtent, msaaSamples);
+	}
 
 	transitionImageLayout(logicalDevice, commandPool, graphicsQueue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depthImage, depthFormat, 1);
 }
 
-void VulkanApp::createTextureImage()
+std::string VulkanApp::findTextureFile() const
 {
-	int      texWidth, texHeight, texChannels;
-	stbi_uc *pixels = stbi_load(MODEL_TEX_FILEPATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-	if (pixels == NULL)
+	// Offline encoded variants next to the PNG, best quality first. A variant
+	// is used only if the device can sample and filter its format.
+	const char *suffixes[] = {".bc7.ktx2", ".astc.ktx2", ".etc2.ktx2", ".bc1.ktx2"};
+	std::string base       = MODEL_TEX_FILEPATH.substr(0, MODEL_TEX_FILEPATH.rfind('.'));
+
+	for (const char *suffix : suffixes)
 	{
-		throw std::runtime_error("Couldn't load texture");
+		std::string path = base + suffix;
+		AssetView   asset;
+		if (findAsset(path, asset))
+		{
+			if (isSampledFormatSupported(physicalDevice, loadKtx2Index(path, asset.data, asset.size).format))
+			{
+				return path;
+			}
+		}
+		else if (std::ifstream(path).good() && isSampledFormatSupported(physicalDevice, loadKtx2Index(path).format))
+		{
+			return path;
+		}
 	}
+	return MODEL_TEX_FILEPATH;
+}
 
-	mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+bool VulkanApp::recordCompressedTextureUpload(VkCommandBuffer commandBuffer, const std::string &path, TextureUpload &upload)
+{
+	// Packed files are read in place.
+	Ktx2Texture texture;
+	AssetView   file;
+	if (findAsset(path, file))
+	{
+		texture = loadKtx2Index(path, file.data, file.size);
+	}
+	else
+	{
+		texture = loadKtx2(path);
+		file    = {reinterpret_cast<const uint8_t *>(texture.data.data()), texture.data.size()};
+	}
+
+	upload.mipLevels = static_cast<uint32_t>(texture.levels.size());
+	upload.format    = texture.format;
+
+	VkDeviceSize levelBytes = 0;
+	for (const Ktx2Level &level : texture.levels)
+	{
+		levelBytes += level.size;
+	}
+	std::cout << "Texture " << path << ": " << ktx2FormatName(upload.format) << ", " << upload.mipLevels << " levels, "
+	          << levelBytes / 1024 << " KiB\n";
+
+	if (canHostCopy(upload.format))
+	{
+		std::vector<const void *> levels;
+		for (const Ktx2Level &level : texture.levels)
+		{
+			levels.push_back(file.data + level.offset);
+		}
+		hostCopyTextureImage(upload, texture.width, texture.height, levels);
+		return false;
+	}
 
-	VkDeviceSize   imageSize = texHeight * texHeight * 4;
-	VkBuffer       stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createMemoryBuffer(logicalDevice, physicalDevice, imageSize,
+	// The staging buffer belongs to the upload and lives until its fence.
+	VkDeviceSize dataSize = file.size;
+	createMemoryBuffer(logicalDevice, physicalDevice, dataSize,
 	                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-	                   stagingBuffer, stagingBufferMemory);
+	                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                   *upload.stagingBuffer.put(logicalDevice), *upload.stagingMemory.put(logicalDevice));
 
 	void *data;
-	vkMapMemory(logicalDevice, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(logicalDevice, stagingBufferMemory);
-	stbi_image_free(pixels);
+	vkMapMemory(logicalDevice, upload.stagingMemory, 0, dataSize, 0, &data);
+	memcpy(data, file.data, static_cast<size_t>(dataSize));
+	vkUnmapMemory(logicalDevice, upload.stagingMemory);
 
-	createImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT, physicalDevice,
-	            logicalDevice, textureImage, textureImageMemory,
-	            VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
-	            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	createImage(texture.width, texture.height, upload.mipLevels, VK_SAMPLE_COUNT_1_BIT, physicalDevice,
+	            logicalDevice, *upload.image.put(logicalDevice), *upload.memory.put(logicalDevice),
+	            upload.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	transitionImageLayout(logicalDevice, commandPool, graphicsQueue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, textureImage, swapChainImageFormat, mipLevels);
+	// Every level comes precomputed, one region each.
+	std::vector<VkBufferImageCopy> regions(upload.mipLevels);
+	for (uint32_t level = 0; level < upload.mipLevels; ++level)
+	{
+		regions[level].bufferOffset                = texture.levels[level].offset;
+		regions[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[level].imageSubresource.mipLevel   = level;
+		regions[level].imageSubresource.layerCount = 1;
+		regions[level].imageExtent                 = {std::max(texture.width >> level, 1u), std::max(texture.height >> level, 1u), 1};
+	}
+
+	recordTransitionImageLayout(commandBuffer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, upload.image, upload.format, upload.mipLevels);
+	vkCmdCopyBufferToImage(commandBuffer, upload.stagingBuffer, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	                       static_cast<uint32_t>(regions.size()), regions.data());
+	recordTransitionImageLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, upload.image, upload.format, upload.mipLevels);
+	return true;
+}
+
+// Records the model texture's upload into commandBuffer and returns whether
+// anything was recorded. Host copies write the image right away and leave
+// the command buffer empty.
+bool VulkanApp::recordTextureUpload(VkCommandBuffer commandBuffer, TextureUpload &upload)
+{
+	std::string path = findTextureFile();
+	if (path != MODEL_TEX_FILEPATH)
+	{
+		return recordCompressedTextureUpload(commandBuffer, path, upload);
+	}
+
+	upload.format = VK_FORMAT_R8G8B8A8_SRGB;
+	if (canHostCopy(upload.format))
+	{
+		// No staging and no queue work: the mips are filtered on the CPU and
+		// every level is written from host memory.
+		uint32_t                          width, height;
+		std::vector<std::vector<uint8_t>> levels;
+		levels.push_back(TextureLoader::decodeToHost(MODEL_TEX_FILEPATH, width, height));
+		for (uint32_t levelWidth = width, levelHeight = height; levelWidth > 1 || levelHeight > 1;)
+		{
+			levels.push_back(downsampleRgba8(levels.back().data(), levelWidth, levelHeight, true));
+			levelWidth  = std::max(levelWidth / 2, 1u);
+			levelHeight = std::max(levelHeight / 2, 1u);
+		}
+
+		std::vector<const void *> levelData;
+		for (const std::vector<uint8_t> &level : levels)
+		{
+			levelData.push_back(level.data());
+		}
+		upload.mipLevels = static_cast<uint32_t>(levels.size());
+		hostCopyTextureImage(upload, width, height, levelData);
+		return false;
+	}
 
-	copyBufferToImage(logicalDevice, commandPool, graphicsQueue, stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+	// Decoded straight into the loader's mapped staging buffer, sized from
+	// the real extents of the file.
+	DecodedTexture texture   = textureLoader.decode({MODEL_TEX_FILEPATH})[0];
+	int32_t        texWidth  = static_cast<int32_t>(texture.width);
+	int32_t        texHeight = static_cast<int32_t>(texture.height);
 
-	generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels, commandPool, logicalDevice, graphicsQueue, physicalDevice);
+	upload.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
-	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+	// Compute mip generation needs storage views, otherwise fall back to blits.
+	bool              computeMips = mipGenerator.supports(upload.format);
+	VkImageUsageFlags usage       = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	if (computeMips)
+	{
+		usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+
+	if (!computeMips && !supportsLinearBlit(physicalDevice, upload.format))
+	{
+		throw std::runtime_error("texture format doesn't support linear blitting!");
+	}
+
+	createImage(texWidth, texHeight, upload.mipLevels, VK_SAMPLE_COUNT_1_BIT, physicalDevice,
+	            logicalDevice, *upload.image.put(logicalDevice), *upload.memory.put(logicalDevice),
+	            upload.format, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+	            computeMips ? MipGenerator::imageCreateFlags() : 0);
+
+	VkBufferImageCopy region = TextureLoader::copyRegion(texture);
+	recordTransitionImageLayout(commandBuffer, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, upload.image, upload.format, upload.mipLevels);
+	vkCmdCopyBufferToImage(commandBuffer, textureLoader.stagingBuffer(), upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	if (computeMips)
+	{
+		mipGenerator.record(commandBuffer, upload.image, upload.format, {static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight)}, upload.mipLevels);
+	}
+	else
+	{
+		recordBlitMipmaps(commandBuffer, upload.image, texWidth, texHeight, upload.mipLevels);
+	}
+	return true;
+}
+
+void VulkanApp::createTextureImage()
+{
+	// Startup submits the whole upload once and waits for it.
+	TextureUpload   upload;
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool, logicalDevice);
+	recordTextureUpload(commandBuffer, upload);
+	endSingleTimeCommands(logicalDevice, commandPool, commandBuffer, graphicsQueue);
+	useTexture(upload);
 }
 
-void VulkanApp::createTextureImageView()
+void VulkanApp::useTexture(TextureUpload &upload)
 {
-	textureImageView = createImageView(logicalDevice, textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+	deletionQueue.defer(std::move(textureImageView));
+	deletionQueue.defer(std::move(textureImage));
+	deletionQueue.defer(std::move(textureImageMemory));
+	textureFormat      = upload.format;
+	mipLevels          = upload.mipLevels;
+	textureImage       = std::move(upload.image);
+	textureImageMemory = std::move(upload.memory);
+	textureImageView   = UniqueImageView(logicalDevice, createImageView(logicalDevice, textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels));
+}
+
+void VulkanApp::reloadTexture()
+{
+	// The loader's staging buffer and the mip generator's views are reused
+	// by the new upload, so an earlier reload has to be done with them.
+	retireTextureReloads(true);
+
+	TextureUpload               upload;
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool        = commandPool;
+	allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandBufferCount = 1;
+	VkResult result              = vkAllocateCommandBuffers(logicalDevice, &allocInfo, &upload.commandBuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	vkBeginCommandBuffer(upload.commandBuffer, &beginInfo);
+	bool recorded = recordTextureUpload(upload.commandBuffer, upload);
+	vkEndCommandBuffer(upload.commandBuffer);
+	if (!recorded)
+	{
+		vkFreeCommandBuffers(logicalDevice, commandPool, 1, &upload.commandBuffer);
+		useTexture(upload);
+		markDirty(DIRTY_SCENE);
+		return;
+	}
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	result          = vkCreateFence(logicalDevice, &fenceInfo, nullptr, upload.fence.put(logicalDevice));
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers    = &upload.commandBuffer;
+	result                        = vkQueueSubmit(graphicsQueue, 1, &submitInfo, upload.fence);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+	textureReloads.push_back(std::move(upload));
+}
+
+// Swaps in the reloaded textures whose uploads have finished, the replaced
+// ones stay alive until the frames using them retire.
+void VulkanApp::retireTextureReloads(bool wait)
+{
+	bool changed = false;
+	for (size_t i = 0; i < textureReloads.size();)
+	{
+		TextureUpload &upload = textureReloads[i];
+		VkFence        fence  = upload.fence;
+		if (wait)
+		{
+			vkWaitForFences(logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX);
+		}
+		else if (vkGetFenceStatus(logicalDevice, fence) != VK_SUCCESS)
+		{
+			++i;
+			continue;
+		}
+		vkFreeCommandBuffers(logicalDevice, commandPool, 1, &upload.commandBuffer);
+		useTexture(upload);
+		textureReloads.erase(textureReloads.begin() + i);
+		changed = true;
+	}
+	if (changed)
+	{
+		markDirty(DIRTY_SCENE);
+	}
+}
+
+bool VulkanApp::canHostCopy(VkFormat format) const
+{
+	if (!hostImageCopySupported)
+	{
+		return false;
+	}
+	VkFormatProperties3 formatProperties3{};
+	formatProperties3.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3;
+	VkFormatProperties2 formatProperties{};
+	formatProperties.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2;
+	formatProperties.pNext = &formatProperties3;
+	vkGetPhysicalDeviceFormatProperties2(physicalDevice, format, &formatProperties);
+
+	const VkFormatFeatureFlags2 required = VK_FORMAT_FEATURE_2_HOST_IMAGE_TRANSFER_BIT_EXT | VK_FORMAT_FEATURE_2_SAMPLED_IMAGE_BIT |
+	                                       VK_FORMAT_FEATURE_2_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (formatProperties3.optimalTilingFeatures & required) == required;
+}
+
+void VulkanApp::hostCopyTextureImage(TextureUpload &upload, uint32_t width, uint32_t height, const std::vector<const void *> &levels)
+{
+	createImage(width, height, upload.mipLevels, VK_SAMPLE_COUNT_1_BIT, physicalDevice,
+	            logicalDevice, *upload.image.put(logicalDevice), *upload.memory.put(logicalDevice),
+	            upload.format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	hostCopyToImage(upload.image, width, height, levels);
+}
+
+void VulkanApp::hostCopyToImage(VkImage image, uint32_t width, uint32_t height, const std::vector<const void *> &levels)
+{
+	uint32_t levelCount = static_cast<uint32_t>(levels.size());
+
+	// The image is new, so the layout change needs no synchronization.
+	VkHostImageLayoutTransitionInfoEXT transition{};
+	transition.sType                       = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT;
+	transition.image                       = image;
+	transition.oldLayout                   = VK_IMAGE_LAYOUT_UNDEFINED;
+	transition.newLayout                   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	transition.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	transition.subresourceRange.levelCount = levelCount;
+	transition.subresourceRange.layerCount = 1;
+	VkResult result                        = pfnTransitionImageLayout(logicalDevice, 1, &transition);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+
+	std::vector<VkMemoryToImageCopyEXT> regions(levelCount);
+	for (uint32_t level = 0; level < levelCount; ++level)
+	{
+		regions[level].sType                       = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT;
+		regions[level].pHostPointer                = levels[level];
+		regions[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[level].imageSubresource.mipLevel   = level;
+		regions[level].imageSubresource.layerCount = 1;
+		regions[level].imageExtent                 = {std::max(width >> level, 1u), std::max(height >> level, 1u), 1};
+	}
+
+	VkCopyMemoryToImageInfoEXT copyInfo{};
+	copyInfo.sType          = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT;
+	copyInfo.dstImage       = image;
+	copyInfo.dstImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	copyInfo.regionCount    = levelCount;
+	copyInfo.pRegions       = regions.data();
+	result                  = pfnCopyMemoryToImage(logicalDevice, &copyInfo);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error(err2msg(result));
+	}
+}
+
+
+VkImageView VulkanApp::currentTextureView() const
+{
+	return streamTextures ? residencyManager.view(modelTexture) : textureImageView.get();
 }
 
 void VulkanApp::createTextureSampler()
@@ -829,32 +1723,166 @@ void VulkanApp::createTextureSampler()
 	samplerCreateInfo.mipmapMode              = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerCreateInfo.mipLodBias              = 0.0f;
 	samplerCreateInfo.minLod                  = 0.0f;
-	samplerCreateInfo.maxLod                  = static_cast<float>(mipLevels);
+	samplerCreateInfo.maxLod                  = VK_LOD_CLAMP_NONE;
 
-	VkResult result = vkCreateSampler(logicalDevice, &samplerCreateInfo, nullptr, &textureSampler);
-	if (result != VK_SUCCESS)
+	textureSampler = objectCache.sampler(samplerCreateInfo);
+}
+
+void VulkanApp::loadModel()
+{
+	auto endsWith = [this](const char *suffix) {
+		size_t length = strlen(suffix);
+		return modelPath.size() >= length && modelPath.compare(modelPath.size() - length, length, suffix) == 0;
+	};
+	std::string cachePath = modelPath + ".meshc";
+	if (!useMeshCache || !loadMeshCache(cachePath))
 	{
-		throw std::runtime_error(err2msg(result));
+		if (endsWith(".glb") || endsWith(".gltf"))
+		{
+			loadGltfModel(modelPath);
+		}
+		else
+		{
+			loadObjModel(modelPath);
+		}
+		if (useMeshCache)
+		{
+			writeMeshCache(cachePath);
+		}
+	}
+
+	// Bounding sphere around the box center, used to estimate screen coverage
+	modelMin = glm::vec3(std::numeric_limits<float>::max());
+	modelMax = glm::vec3(std::numeric_limits<float>::lowest());
+	for (const Vertex &vertex : vertices)
+	{
+		modelMin = glm::min(modelMin, vertex.pos);
+		modelMax = glm::max(modelMax, vertex.pos);
+	}
+	modelCenter = (modelMin + modelMax) * 0.5f;
+	modelRadius = 0.0f;
+	for (const Vertex &vertex : vertices)
+	{
+		modelRadius = std::max(modelRadius, glm::length(vertex.pos - modelCenter));
 	}
 }
 
-void VulkanApp::loadModel()
+// Material libraries of a packed model are parsed from the pack as well.
+class PackedMaterialReader : public tinyobj::MaterialReader
+{
+  public:
+	explicit PackedMaterialReader(const std::string &baseDir) : baseDir(baseDir), fileReader(baseDir) {}
+
+	bool operator()(const std::string &matId, std::vector<tinyobj::material_t> *materials, std::map<std::string, int> *matMap,
+	                std::string *warn, std::string *err) override
+	{
+		AssetView asset;
+		if (!findAsset(baseDir + matId, asset))
+		{
+			return fileReader(matId, materials, matMap, warn, err);
+		}
+		AssetStream stream(asset);
+		tinyobj::LoadMtl(matMap, materials, &stream, warn, err);
+		return true;
+	}
+
+  private:
+	std::string                 baseDir;
+	tinyobj::MaterialFileReader fileReader;
+};
+
+void VulkanApp::loadObjModel(const std::string &path)
 {
 	tinyobj::attrib_t                attrib;
 	std::vector<tinyobj::shape_t>    shapes;
 	std::vector<tinyobj::material_t> materials;
 	std::string                      warn, err;
 
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_OBJ_FILEPATH.c_str()))
+	// Material libraries and textures are looked up next to the model.
+	std::string baseDir = path.substr(0, path.find_last_of('/') + 1);
+	AssetView   asset;
+	bool        loaded;
+	if (findAsset(path, asset))
+	{
+		AssetStream          stream(asset);
+		PackedMaterialReader materialReader(baseDir);
+		loaded = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &stream, &materialReader);
+	}
+	else
+	{
+		loaded = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), baseDir.c_str());
+	}
+	if (!loaded)
 	{
 		throw std::runtime_error(warn + err);
 	}
 
-	std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+	// A textured material takes its color from the texture. Faces without a
+	// material get a white one, appended after the file's.
+	for (const tinyobj::material_t &material : materials)
+	{
+		ModelMaterial modelMaterial;
+		std::string   texturePath = baseDir + material.diffuse_texname;
+		if (material.diffuse_texname.empty())
+		{
+			modelMaterial.diffuse = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+		}
+		else if (findAsset(texturePath, asset) || std::ifstream(texturePath).good())
+		{
+			auto texture = std::find_if(materialTextures.begin(), materialTextures.end(),
+			                            [&texturePath](const MaterialTexture &texture) { return texture.path == texturePath; });
+			if (texture == materialTextures.end())
+			{
+				texture       = materialTextures.emplace(materialTextures.end());
+				texture->path = texturePath;
+			}
+			modelMaterial.texture = static_cast<uint32_t>(texture - materialTextures.begin()) + 1;
+		}
+		modelMaterials.push_back(modelMaterial);
+	}
+	uint32_t defaultMaterial = static_cast<uint32_t>(modelMaterials.size());
+	modelMaterials.push_back(ModelMaterial{});
 
+	// Faces are split by shape and material, and the pieces of one material
+	// laid out next to each other so the draw queue can merge them.
+	struct Piece
+	{
+		uint32_t                      material;
+		std::vector<tinyobj::index_t> corners;
+	};
+	std::vector<Piece> pieces;
 	for (const auto &shape : shapes)
 	{
-		for (const auto &index : shape.mesh.indices)
+		std::unordered_map<uint32_t, size_t> shapePieces;
+		for (size_t face = 0; face < shape.mesh.material_ids.size(); ++face)
+		{
+			int      id       = shape.mesh.material_ids[face];
+			uint32_t material = id >= 0 && id < static_cast<int>(materials.size()) ? static_cast<uint32_t>(id) : defaultMaterial;
+			auto     piece    = shapePieces.try_emplace(material, pieces.size()).first;
+			if (piece->second == pieces.size())
+			{
+				pieces.push_back({material, {}});
+			}
+			// Faces are triangulated by the loader.
+			for (size_t corner = 3 * face; corner < 3 * face + 3; ++corner)
+			{
+				pieces[piece->second].corners.push_back(shape.mesh.indices[corner]);
+			}
+		}
+	}
+	std::stable_sort(pieces.begin(), pieces.end(), [](const Piece &a, const Piece &b) { return a.material < b.material; });
+
+	std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+
+	for (const Piece &piece : pieces)
+	{
+		Submesh submesh{};
+		submesh.firstIndex = static_cast<uint32_t>(indices.size());
+		submesh.material   = piece.material;
+
+		glm::vec3 pieceMin(std::numeric_limits<float>::max());
+		glm::vec3 pieceMax(std::numeric_limits<float>::lowest());
+		for (const auto &index : piece.corners)
 		{
 			Vertex vertex{};
 
@@ -863,11 +1891,14 @@ void VulkanApp::loadModel()
 			    attrib.vertices[3 * index.vertex_index + 1],
 			    attrib.vertices[3 * index.vertex_index + 2]};
 
-			vertex.texCoord = {
-			    attrib.texcoords[2 * index.texcoord_index + 0],
-			    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+			if (index.texcoord_index >= 0)
+			{
+				vertex.texCoord = {
+				    attrib.texcoords[2 * index.texcoord_index + 0],
+				    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]};
+			}
 
-			vertex.color = {1.0f, 1.0f, 1.0f};
+			vertex.color = modelMaterials[piece.material].diffuse;
 
 			if (uniqueVertices.count(vertex) == 0)
 			{
@@ -876,23 +1907,353 @@ void VulkanApp::loadModel()
 			}
 
 			indices.push_back(uniqueVertices[vertex]);
+			pieceMin = glm::min(pieceMin, vertex.pos);
+			pieceMax = glm::max(pieceMax, vertex.pos);
+		}
+
+		submesh.indexCount = static_cast<uint32_t>(indices.size()) - submesh.firstIndex;
+		submesh.center     = (pieceMin + pieceMax) * 0.5f;
+		submeshes.push_back(submesh);
+	}
+}
+
+void VulkanApp::loadGltfModel(const std::string &path)
+{
+	// Textures are 1 + an image index in both, and the images stay mapped
+	// until createMaterialTextures has uploaded them.
+	GltfModel model = loadGltf(path);
+	vertices        = std::move(model.vertices);
+	indices         = std::move(model.indices);
+	submeshes       = std::move(model.submeshes);
+	modelMaterials  = std::move(model.materials);
+	for (const GltfImage &image : model.images)
+	{
+		MaterialTexture &texture = materialTextures.emplace_back();
+		texture.path             = image.path;
+		texture.encoded          = image.data;
+		texture.encodedSize      = image.size;
+	}
+	for (MappedFile &file : model.files)
+	{
+		modelFiles.push_back(std::move(file));
+	}
+}
+
+// The cache holds the submeshes and materials as they are in memory, the
+// texture paths, and the vertices and indices as GeometryCodec streams. It
+// is stale once the size or modification time of the model file, one of
+// its material libraries or one of its textures changes; these files are
+// listed after the header with the stamps they had when it was written.
+static const uint32_t MESH_CACHE_MAGIC   = 0x4348534D;    // "MSHC"
+static const uint32_t MESH_CACHE_VERSION = 2;
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t  sourceTime;
+	uint32_t dependencyCount;
+	uint32_t dependencyBytes;
+	uint32_t submeshCount;
+	uint32_t materialCount;
+	uint32_t textureCount;
+	uint32_t pathBytes;
+	uint64_t vertexBytes;
+	uint64_t indexBytes;
+};
+
+static bool sourceStamp(const std::string &path, uint64_t &size, int64_t &time)
+{
+	std::error_code error;
+	size = std::filesystem::file_size(path, error);
+	if (error)
+	{
+		return false;
+	}
+	time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+	return !error;
+}
+
+// The mtllib statements of an OBJ file, resolved the way tinyobjloader does.
+static std::vector<std::string> materialLibraries(const std::string &path)
+{
+	std::string              baseDir = path.substr(0, path.find_last_of('/') + 1);
+	std::vector<std::string> libraries;
+	std::ifstream            file(path);
+	std::string              line;
+	while (std::getline(file, line))
+	{
+		std::istringstream words(line);
+		std::string        word;
+		if (words >> word && word == "mtllib")
+		{
+			while (words >> word)
+			{
+				libraries.push_back(baseDir + word);
+			}
 		}
 	}
+	return libraries;
+}
+
+// Length prefixed strings of the dependency and texture tables.
+static std::string readCachePath(const uint8_t *&cursor, const uint8_t *end)
+{
+	uint32_t length;
+	if (end - cursor < static_cast<ptrdiff_t>(sizeof(length)))
+	{
+		throw std::runtime_error("truncated path");
+	}
+	memcpy(&length, cursor, sizeof(length));
+	cursor += sizeof(length);
+	if (static_cast<size_t>(end - cursor) < length)
+	{
+		throw std::runtime_error("truncated path");
+	}
+	std::string path(reinterpret_cast<const char *>(cursor), length);
+	cursor += length;
+	return path;
+}
+
+static void writeCachePath(std::ofstream &file, const std::string &path)
+{
+	uint32_t length = static_cast<uint32_t>(path.size());
+	file.write(reinterpret_cast<const char *>(&length), sizeof(length));
+	file.write(path.data(), length);
+}
+
+static void reportMeshCache(const char *action, size_t rawBytes, size_t cacheBytes, double ms)
+{
+	std::cout << "Mesh cache: " << action << " " << std::fixed << std::setprecision(1) << rawBytes / (1024.0 * 1024.0)
+	          << " MiB of vertices and indices as " << cacheBytes / (1024.0 * 1024.0) << " MiB ("
+	          << static_cast<double>(rawBytes) / cacheBytes << ":1) in " << std::setprecision(2) << ms << " ms, "
+	          << rawBytes / (ms * 1e6) << " GB/s\n";
+	std::cout.unsetf(std::ios::floatfield);
+}
+
+bool VulkanApp::loadMeshCache(const std::string &path)
+{
+	MeshCacheHeader header;
+	uint64_t        sourceSize;
+	int64_t         sourceTime;
+	std::error_code error;
+	if (!std::filesystem::exists(path, error) || !sourceStamp(modelPath, sourceSize, sourceTime))
+	{
+		return false;
+	}
+
+	MappedFile file;
+	file.open(path);
+	if (file.size() < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	uint64_t expected = sizeof(header) + static_cast<uint64_t>(header.dependencyBytes) + header.submeshCount * sizeof(Submesh) +
+	                    header.materialCount * sizeof(ModelMaterial) + header.pathBytes;
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION || header.sourceSize != sourceSize ||
+	    header.sourceTime != sourceTime || header.vertexBytes > file.size() || header.indexBytes > file.size() ||
+	    file.size() != expected + header.vertexBytes + header.indexBytes)
+	{
+		return false;
+	}
+
+	// A stale or corrupt cache falls back to parsing the model, so nothing
+	// decoded from it may be left behind.
+	try
+	{
+		const uint8_t *cursor          = file.data() + sizeof(header);
+		const uint8_t *dependenciesEnd = cursor + header.dependencyBytes;
+		for (uint32_t i = 0; i < header.dependencyCount; ++i)
+		{
+			std::string dependency = readCachePath(cursor, dependenciesEnd);
+			uint64_t    stamp[2];
+			if (static_cast<size_t>(dependenciesEnd - cursor) < sizeof(stamp))
+			{
+				throw std::runtime_error("truncated stamp");
+			}
+			memcpy(stamp, cursor, sizeof(stamp));
+			cursor += sizeof(stamp);
+			if (!sourceStamp(dependency, sourceSize, sourceTime) || stamp[0] != sourceSize ||
+			    static_cast<int64_t>(stamp[1]) != sourceTime)
+			{
+				return false;
+			}
+		}
+		cursor = dependenciesEnd;
+
+		submeshes.resize(header.submeshCount);
+		memcpy(submeshes.data(), cursor, header.submeshCount * sizeof(Submesh));
+		cursor += header.submeshCount * sizeof(Submesh);
+		modelMaterials.resize(header.materialCount);
+		memcpy(modelMaterials.data(), cursor, header.materialCount * sizeof(ModelMaterial));
+		cursor += header.materialCount * sizeof(ModelMaterial);
+
+		const uint8_t *pathsEnd = cursor + header.pathBytes;
+		for (uint32_t i = 0; i < header.textureCount; ++i)
+		{
+			materialTextures.emplace_back().path = readCachePath(cursor, pathsEnd);
+		}
+		cursor = pathsEnd;
+
+		// Both streams are decoded straight into the arrays the vertex and
+		// index buffers are filled from.
+		uint32_t vertexCount, vertexStride, indexCount, indexStride;
+		GeometryCodec::readHeader(cursor, header.vertexBytes, vertexCount, vertexStride);
+		GeometryCodec::readHeader(cursor + header.vertexBytes, header.indexBytes, indexCount, indexStride);
+		if (vertexStride != sizeof(Vertex) || indexStride != sizeof(uint32_t))
+		{
+			throw std::runtime_error("unexpected element size");
+		}
+		vertices.resize(vertexCount);
+		indices.resize(indexCount);
+
+		auto start = std::chrono::steady_clock::now();
+		GeometryCodec::decode(cursor, header.vertexBytes, vertices.data());
+		GeometryCodec::decode(cursor + header.vertexBytes, header.indexBytes, indices.data());
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// Everything the draws index has to stay in range.
+		for (const Submesh &submesh : submeshes)
+		{
+			if (static_cast<uint64_t>(submesh.firstIndex) + submesh.indexCount > indices.size() || submesh.material >= modelMaterials.size())
+			{
+				throw std::runtime_error("submesh out of range");
+			}
+		}
+		for (const ModelMaterial &material : modelMaterials)
+		{
+			if (material.texture > materialTextures.size())
+			{
+				throw std::runtime_error("material texture out of range");
+			}
+		}
+		if (std::any_of(indices.begin(), indices.end(), [this](uint32_t index) { return index >= vertices.size(); }))
+		{
+			throw std::runtime_error("index out of range");
+		}
+
+		reportMeshCache("decoded", vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t),
+		                header.vertexBytes + header.indexBytes, ms);
+		return true;
+	}
+	catch (const std::runtime_error &exception)
+	{
+		std::cout << "Mesh cache: \"" << path << "\" is malformed (" << exception.what() << "), parsing the model\n";
+		submeshes.clear();
+		modelMaterials.clear();
+		materialTextures.clear();
+		vertices.clear();
+		indices.clear();
+		return false;
+	}
+}
+
+void VulkanApp::writeMeshCache(const std::string &path)
+{
+	// Embedded images would have to be copied out of the model file.
+	for (const MaterialTexture &texture : materialTextures)
+	{
+		if (texture.encoded != nullptr)
+		{
+			std::cout << "Mesh cache: not written, the model embeds its textures\n";
+			return;
+		}
+	}
+
+	MeshCacheHeader header{};
+	if (!sourceStamp(modelPath, header.sourceSize, header.sourceTime))
+	{
+		return;
+	}
+	header.magic         = MESH_CACHE_MAGIC;
+	header.version       = MESH_CACHE_VERSION;
+	header.submeshCount  = static_cast<uint32_t>(submeshes.size());
+	header.materialCount = static_cast<uint32_t>(modelMaterials.size());
+	header.textureCount  = static_cast<uint32_t>(materialTextures.size());
+	for (const MaterialTexture &texture : materialTextures)
+	{
+		header.pathBytes += static_cast<uint32_t>(sizeof(uint32_t) + texture.path.size());
+	}
+
+	// A missing material library could appear later without touching the
+	// model, so such a model is not cached.
+	std::string              extension = std::filesystem::path(modelPath).extension().string();
+	std::vector<std::string> dependencies;
+	if (extension != ".glb" && extension != ".gltf")
+	{
+		dependencies = materialLibraries(modelPath);
+	}
+	for (const MaterialTexture &texture : materialTextures)
+	{
+		dependencies.push_back(texture.path);
+	}
+	std::vector<std::array<uint64_t, 2>> stamps(dependencies.size());
+	for (size_t i = 0; i < dependencies.size(); ++i)
+	{
+		int64_t time;
+		if (!sourceStamp(dependencies[i], stamps[i][0], time))
+		{
+			std::cout << "Mesh cache: not written, \"" << dependencies[i] << "\" is missing\n";
+			return;
+		}
+		stamps[i][1] = static_cast<uint64_t>(time);
+		header.dependencyBytes += static_cast<uint32_t>(sizeof(uint32_t) + dependencies[i].size() + sizeof(stamps[i]));
+	}
+	header.dependencyCount = static_cast<uint32_t>(dependencies.size());
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<uint8_t> vertexStream =
+	    GeometryCodec::encode(vertices.data(), static_cast<uint32_t>(vertices.size()), sizeof(Vertex), true);
+	std::vector<uint8_t> indexStream =
+	    GeometryCodec::encode(indices.data(), static_cast<uint32_t>(indices.size()), sizeof(uint32_t), true);
+	double ms          = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	header.vertexBytes = vertexStream.size();
+	header.indexBytes  = indexStream.size();
+
+	std::ofstream file(path, std::ios::binary);
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	for (size_t i = 0; i < dependencies.size(); ++i)
+	{
+		writeCachePath(file, dependencies[i]);
+		file.write(reinterpret_cast<const char *>(stamps[i].data()), sizeof(stamps[i]));
+	}
+	file.write(reinterpret_cast<const char *>(submeshes.data()), submeshes.size() * sizeof(Submesh));
+	file.write(reinterpret_cast<const char *>(modelMaterials.data()), modelMaterials.size() * sizeof(ModelMaterial));
+	for (const MaterialTexture &texture : materialTextures)
+	{
+		writeCachePath(file, texture.path);
+	}
+	file.write(reinterpret_cast<const char *>(vertexStream.data()), vertexStream.size());
+	file.write(reinterpret_cast<const char *>(indexStream.data()), indexStream.size());
+	file.close();
+	if (!file)
+	{
+		// A read-only model directory only costs the cache.
+		std::error_code error;
+		std::filesystem::remove(path, error);
+		std::cout << "Mesh cache: couldn't write \"" << path << "\"\n";
+		return;
+	}
+
+	reportMeshCache("encoded", vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint32_t),
+	                vertexStream.size() + indexStream.size(), ms);
 }
 
 void VulkanApp::createVertexBuffer()
 {
     VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    UniqueBuffer       stagingBuffer;
+    UniqueDeviceMemory stagingBufferMemory;
     createMemoryBuffer(logicalDevice,
                        physicalDevice,
                        bufferSize,
                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                       stagingBuffer,
-                       stagingBufferMemory);
+                       *stagingBuffer.put(logicalDevice),
+                       *stagingBufferMemory.put(logicalDevice));
 
     void *data;
 	vkMapMemory(logicalDevice, stagingBufferMemory, 0, bufferSize, 0, &data);
@@ -901,23 +2262,20 @@ void VulkanApp::createVertexBuffer()
 
 	createMemoryBuffer(logicalDevice, physicalDevice, bufferSize,
 	                   VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-	                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+	                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *vertexBuffer.put(logicalDevice), *vertexBufferMemory.put(logicalDevice));
 
 	copyBuffer(stagingBuffer, vertexBuffer, bufferSize, commandPool, logicalDevice, graphicsQueue);
-
-	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
 }
 
 void VulkanApp::createIndexBuffer()
 {
-	VkDeviceSize   size = sizeof(indices[0]) * indices.size();
-	VkBuffer       stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	VkDeviceSize       size = sizeof(indices[0]) * indices.size();
+	UniqueBuffer       stagingBuffer;
+	UniqueDeviceMemory stagingBufferMemory;
 	createMemoryBuffer(logicalDevice, physicalDevice, size,
 	                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 	                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-	                   stagingBuffer, stagingBufferMemory);
+	                   *stagingBuffer.put(logicalDevice), *stagingBufferMemory.put(logicalDevice));
 
 	void *data;
 	vkMapMemory(logicalDevice, stagingBufferMemory, 0, size, 0, &data);
@@ -926,12 +2284,88 @@ void VulkanApp::createIndexBuffer()
 
 	createMemoryBuffer(logicalDevice, physicalDevice, size,
 	                   VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-	                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+	                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *indexBuffer.put(logicalDevice), *indexBufferMemory.put(logicalDevice));
 
 	copyBuffer(stagingBuffer, indexBuffer, size, commandPool, logicalDevice, graphicsQueue);
+}
+
+void VulkanApp::createMaterialTextures()
+{
+	// Uploaded once through a staging buffer with blitted mips, the model
+	// texture keeps its own compressed, streamed or host copy paths. A
+	// texture with neither a file nor encoded data is a white pixel.
+	for (MaterialTexture &texture : materialTextures)
+	{
+		uint32_t             width = 1, height = 1;
+		std::vector<uint8_t> pixels(4, 255);
+		if (texture.encoded != nullptr)
+		{
+			pixels = TextureLoader::decodeToHost(texture.encoded, texture.encodedSize, width, height);
+		}
+		else if (!texture.path.empty())
+		{
+			pixels = TextureLoader::decodeToHost(texture.path, width, height);
+		}
+		uint32_t     levels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+		VkDeviceSize size   = pixels.size();
+
+		UniqueBuffer       stagingBuffer;
+		UniqueDeviceMemory stagingBufferMemory;
+		createMemoryBuffer(logicalDevice, physicalDevice, size,
+		                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+		                   *stagingBuffer.put(logicalDevice), *stagingBufferMemory.put(logicalDevice));
+
+		void *data;
+		vkMapMemory(logicalDevice, stagingBufferMemory, 0, size, 0, &data);
+		memcpy(data, pixels.data(), (size_t) size);
+		vkUnmapMemory(logicalDevice, stagingBufferMemory);
+
+		createImage(static_cast<int32_t>(width), static_cast<int32_t>(height), levels, VK_SAMPLE_COUNT_1_BIT, physicalDevice,
+		            logicalDevice, *texture.image.put(logicalDevice), *texture.memory.put(logicalDevice), VK_FORMAT_R8G8B8A8_SRGB,
+		            VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+		transitionImageLayout(logicalDevice, commandPool, graphicsQueue, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture.image, VK_FORMAT_R8G8B8A8_SRGB, levels);
+		copyBufferToImage(logicalDevice, commandPool, graphicsQueue, stagingBuffer, texture.image, width, height);
+		generateMipmaps(texture.image, VK_FORMAT_R8G8B8A8_SRGB, static_cast<int32_t>(width), static_cast<int32_t>(height), levels,
+		                commandPool, logicalDevice, graphicsQueue, physicalDevice);
+
+		texture.view        = UniqueImageView(logicalDevice, createImageView(logicalDevice, texture.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, levels));
+		texture.encoded     = nullptr;
+		texture.encodedSize = 0;
+	}
+	modelFiles.clear();
+}
+
+void VulkanApp::createPositionBuffer()
+{
+	// Split out of the interleaved vertices so the depth pre-pass fetches
+	// 12 bytes per vertex instead of sizeof(Vertex).
+	std::vector<glm::vec3> positions(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		positions[i] = vertices[i].pos;
+	}
+
+	VkDeviceSize       size = sizeof(positions[0]) * positions.size();
+	UniqueBuffer       stagingBuffer;
+	UniqueDeviceMemory stagingBufferMemory;
+	createMemoryBuffer(logicalDevice, physicalDevice, size,
+	                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	                   VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+	                   *stagingBuffer.put(logicalDevice), *stagingBufferMemory.put(logicalDevice));
+
+	void *data;
+	vkMapMemory(logicalDevice, stagingBufferMemory, 0, size, 0, &data);
+	memcpy(data, positions.data(), (size_t) size);
+	vkUnmapMemory(logicalDevice, stagingBufferMemory);
+
+	createMemoryBuffer(logicalDevice, physicalDevice, size,
+	                   VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+	                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *positionBuffer.put(logicalDevice), *positionBufferMemory.put(logicalDevice));
 
-	vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+	copyBuffer(stagingBuffer, positionBuffer, size, commandPool, logicalDevice, graphicsQueue);
 }
 
 void VulkanApp::createUniformBuffers()
@@ -946,80 +2380,182 @@ void VulkanApp::createUniformBuffers()
 		createMemoryBuffer(logicalDevice, physicalDevice, bufferSize,
 		                   VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 		                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		                   uniformBuffers[i], uniformBuffersMemory[i]);
+		                   *uniformBuffers[i].put(logicalDevice), *uniformBuffersMemory[i].put(logicalDevice));
 	}
 }
 
 void VulkanApp::createDescriptorPool()
 {
-	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	std::vector<VkDescriptorPoolSize> sizesPerSet(2);
+	sizesPerSet[0].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	sizesPerSet[0].descriptorCount = 1;
+	sizesPerSet[1].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	sizesPerSet[1].descriptorCount = 1;
 
-	poolSizes[0].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-
-	poolSizes[1].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+	descriptorAllocator.create(logicalDevice, static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT), sizesPerSet);
+	descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+	materialDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+}
 
-	VkDescriptorPoolCreateInfo descriptorPoolInfo{};
-	descriptorPoolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptorPoolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-	descriptorPoolInfo.pPoolSizes    = poolSizes.data();
-	descriptorPoolInfo.maxSets       = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+void VulkanApp::writeFrameDescriptors(uint32_t frame)
+{
+	// Allocated fresh every frame, so texture swaps need no bookkeeping.
+	descriptorAllocator.beginFrame(frame);
+	descriptorSets[frame] = descriptorAllocator.allocate(descriptorSetLayout);
+
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = uniformBuffers[frame];
+	bufferInfo.offset = 0;
+	bufferInfo.range  = sizeof(UniformBufferObject);
+
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.sampler     = textureSampler;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView   = currentTextureView();
+
+	descriptorAllocator.writeBuffer(descriptorSets[frame], 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfo);
+	descriptorAllocator.writeImage(descriptorSets[frame], 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfo);
+
+	// Without bindless every material texture needs a set of its own.
+	materialDescriptorSets[frame].clear();
+	for (size_t i = 0; i < materialTextures.size() && !useBindless; ++i)
+	{
+		VkDescriptorSet set = descriptorAllocator.allocate(descriptorSetLayout);
+		imageInfo.imageView = materialTextures[i].view;
+		descriptorAllocator.writeBuffer(set, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, bufferInfo);
+		descriptorAllocator.writeImage(set, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, imageInfo);
+		materialDescriptorSets[frame].push_back(set);
+	}
+	descriptorAllocator.flush();
 
-	VkResult result = vkCreateDescriptorPool(logicalDevice, &descriptorPoolInfo, nullptr, &descriptorPool);
-	if (result != VK_SUCCESS)
+	if (useBindless)
 	{
-		throw std::runtime_error(err2msg(result));
+		// A new view gets a new slot, the old one may still be sampled by frames in flight.
+		VkImageView view = currentTextureView();
+		if (view != bindlessTextureView)
+		{
+			uint32_t previousSlot = bindlessTextureSlot;
+			bindlessTextureSlot   = bindlessTable.addTexture(view, textureSampler);
+			bindlessTextureView   = view;
+
+			BindlessTable::Material material = bindlessTable.material(modelMaterial);
+			material.textureIndex            = bindlessTextureSlot;
+			bindlessTable.setMaterial(modelMaterial, material);
+			if (previousSlot != UINT32_MAX)
+			{
+				deletionQueue.push([this, previousSlot]() { bindlessTable.releaseTexture(previousSlot); });
+			}
+		}
+		materialBase = bindlessTable.beginFrame(frame);
 	}
 }
 
-void VulkanApp::createDescriptorSets()
+void VulkanApp::replaceGraphicsPipeline(UniquePipeline &&pipeline)
 {
-	std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+	deletionQueue.defer(std::move(graphicsPipeline));
+	graphicsPipeline = std::move(pipeline);
+}
 
-	VkDescriptorSetAllocateInfo allocInfo{};
-	allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool     = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-	allocInfo.pSetLayouts        = layouts.data();
+void VulkanApp::updateShaderReload()
+{
+	// Frames in flight keep the old pipelines until they retire.
+	if (pipelineRebuild.valid() && pipelineRebuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		PipelineRebuild rebuild = pipelineRebuild.get();
+		if (!rebuild.error.empty())
+		{
+			std::cout << "Shader reload failed, keeping the previous pipelines: " << rebuild.error << "\n";
+		}
+		else
+		{
+			std::cout << "Shader reload: rebuilt" << (rebuild.graphics.get() != VK_NULL_HANDLE ? " the main pipeline" : "")
+			          << (rebuild.depth.get() != VK_NULL_HANDLE ? " the depth pipeline" : "") << " in " << rebuild.ms << " ms\n";
+			if (rebuild.graphics.get() != VK_NULL_HANDLE)
+			{
+				replaceGraphicsPipeline(std::move(rebuild.graphics));
+			}
+			if (rebuild.depth.get() != VK_NULL_HANDLE)
+			{
+				deletionQueue.defer(std::move(depthPipeline));
+				depthPipeline = std::move(rebuild.depth);
+			}
+			markDirty(DIRTY_SCENE);
+		}
+	}
 
-	descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-	VkResult result = vkAllocateDescriptorSets(logicalDevice, &allocInfo, descriptorSets.data());
-	if (result != VK_SUCCESS)
+	for (std::string &shader : shaderWatcher.takeCompiled())
 	{
-		throw std::runtime_error(err2msg(result));
+		changedShaders.insert(std::move(shader));
 	}
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+	if (pipelineRebuild.valid() || changedShaders.empty())
+	{
+		return;
+	}
+
+	// Only the pipelines made from a changed module are rebuilt.
+	bool graphics = changedShaders.count(vertexShaderFile(false)) > 0 || changedShaders.count(fragmentShaderFile()) > 0;
+	bool depth    = useDepthPrepass && changedShaders.count(vertexShaderFile(true)) > 0;
+	changedShaders.clear();
+	if (!graphics && !depth)
 	{
-		VkDescriptorBufferInfo bufferInfo{};
-		bufferInfo.buffer = uniformBuffers[i];
-		bufferInfo.offset = 0;
-		bufferInfo.range  = sizeof(UniformBufferObject);
+		return;
+	}
+	pipelineRebuild = std::async(std::launch::async, [this, graphics, depth]() {
+		PipelineRebuild rebuild;
+		auto            start = std::chrono::steady_clock::now();
+		try
+		{
+			if (graphics)
+			{
+				rebuild.graphics = buildGraphicsPipeline();
+			}
+			if (depth)
+			{
+				rebuild.depth = buildGraphicsPipeline(true);
+			}
+		}
+		catch (const std::exception &e)
+		{
+			rebuild       = PipelineRebuild{};
+			rebuild.error = e.what();
+		}
+		rebuild.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return rebuild;
+	});
+}
 
-		VkDescriptorImageInfo imageInfo{};
-		imageInfo.sampler     = textureSampler;
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView   = textureImageView;
+void VulkanApp::cancelPipelineRebuild()
+{
+	// The rebuild reads the state the caller is about to change, and the
+	// caller builds every pipeline again anyway.
+	if (pipelineRebuild.valid())
+	{
+		pipelineRebuild.get();
+	}
+}
 
-		std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-		descriptorWrites[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[0].dstSet          = descriptorSets[i];
-		descriptorWrites[0].dstBinding      = 0;
-		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[0].descriptorCount = 1;
-		descriptorWrites[0].pBufferInfo     = &bufferInfo;
+void VulkanApp::reloadAssets()
+{
+	cancelPipelineRebuild();
 
-		descriptorWrites[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[1].dstSet          = descriptorSets[i];
-		descriptorWrites[1].dstBinding      = 1;
-		descriptorWrites[1].dstArrayElement = 0;
-		descriptorWrites[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWrites[1].descriptorCount = 1;
-		descriptorWrites[1].pImageInfo      = &imageInfo;
+	// Frames in flight keep using the old objects until they retire.
+	replaceGraphicsPipeline(buildGraphicsPipeline());
+	if (useDepthPrepass)
+	{
+		deletionQueue.defer(std::move(depthPipeline));
+		depthPipeline = buildGraphicsPipeline(true);
+	}
 
-		vkUpdateDescriptorSets(logicalDevice, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	if (streamTextures)
+	{
+		residencyManager.reload(modelTexture);
 	}
+	else
+	{
+		reloadTexture();
+	}
+
+	markDirty(DIRTY_SCENE);
 }
 
 void VulkanApp::createCommandBuffers()
@@ -1044,6 +2580,7 @@ void VulkanApp::createSyncObjects()
 	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+	inFlightPresentIds.assign(MAX_FRAMES_IN_FLIGHT, 0);
 
 	VkSemaphoreCreateInfo semaphoreCreateInfo{};
 	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1076,28 +2613,74 @@ void VulkanApp::mainLoop()
 {
 	while (!glfwWindowShouldClose(window))
 	{
-		glfwPollEvents();
-		drawFrame();
+		if (onDemandRendering && !isRedrawNeeded())
+		{
+			glfwWaitEventsTimeout(IDLE_WAIT_TIMEOUT);
+		}
+		else
+		{
+			glfwPollEvents();
+		}
+
+		if (watchShaders)
+		{
+			updateShaderReload();
+		}
+		advanceAnimation();
+		if (!onDemandRendering || isRedrawNeeded())
+		{
+			drawFrame();
+		}
 	}
 
 	vkDeviceWaitIdle(logicalDevice);
 }
 void VulkanApp::cleanup()
 {
+	shaderWatcher.stop();
+	cancelPipelineRebuild();
+	deletionQueue.flush();
+	renderGraph.reset();
 	cleanupSwapChain();
 
-	vkDestroySampler(logicalDevice, textureSampler, nullptr);
-	vkDestroyImageView(logicalDevice, textureImageView, nullptr);
-	vkDestroyImage(logicalDevice, textureImage, nullptr);
-	vkFreeMemory(logicalDevice, textureImageMemory, nullptr);
+	uniformBuffers.clear();
+	uniformBuffersMemory.clear();
+	descriptorAllocator.destroy();
+	bindlessTable.destroy();
+	instanceManager.destroy();
+	gpuCuller.destroy();
+	depthPyramid.destroy();
+	threadPool.destroy();
+	graphicsPipeline.reset();
+	depthPipeline.reset();
+	if (!useDynamicRendering)
+	{
+		vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+		vkDestroyRenderPass(logicalDevice, occlusionRenderPass, nullptr);
+	}
+
+	mipGenerator.destroy();
+	textureLoader.destroy();
+	residencyManager.destroy();
+	mountAssetPack(nullptr);
+	assetPack.close();
+	textureReloads.clear();
+	textureImageView.reset();
+	textureImage.reset();
+	textureImageMemory.reset();
+	materialTextures.clear();
+
+	objectCache.printStats();
+	objectCache.destroy();
 
-	vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
+	indexBuffer.reset();
+	indexBufferMemory.reset();
 
-	vkDestroyBuffer(logicalDevice, indexBuffer, nullptr);
-	vkFreeMemory(logicalDevice, indexBufferMemory, nullptr);
+	vertexBuffer.reset();
+	vertexBufferMemory.reset();
 
-	vkDestroyBuffer(logicalDevice, vertexBuffer, nullptr);
-	vkFreeMemory(logicalDevice, vertexBufferMemory, nullptr);
+	positionBuffer.reset();
+	positionBufferMemory.reset();
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
 	{
@@ -1158,6 +2741,8 @@ VkBool32 VulkanApp::debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT message
 
 void VulkanApp::recordCommandBuffer(VkCommandBuffer buffer, uint32_t imageIndex)
 {
+	frameDrawStats = {};
+
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags            = 0;
@@ -1169,54 +2754,546 @@ void VulkanApp::recordCommandBuffer(VkCommandBuffer buffer, uint32_t imageIndex)
 		throw std::runtime_error(err2msg(result));
 	}
 
-	VkRenderPassBeginInfo renderPassBeginInfo{};
-	renderPassBeginInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBeginInfo.renderPass        = renderPass;
-	renderPassBeginInfo.framebuffer       = swapChainFramebuffers[imageIndex];
-	renderPassBeginInfo.renderArea.extent = swapChainExtent;
-	renderPassBeginInfo.renderArea.offset = {0, 0};
-
-	std::array<VkClearValue, 2> clearValues{};
-	clearValues[0].color                = {{0.0f, 0.0f, 0.0f, 1.0f}};
-	clearValues[1].depthStencil         = {1.0f, 0};
-	renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-	renderPassBeginInfo.pClearValues    = clearValues.data();
+	// Instance uploads have to be recorded outside of the render pass.
+	if (useInstancing)
+	{
+		instanceManager.record(buffer, currentFrame, deletionQueue);
+	}
+	if (useGpuCulling)
+	{
+		gpuCuller.record(buffer, currentFrame, instanceManager.buffer(), instanceManager.count(), instanceManager.meshInstanceCounts(),
+		                 viewProjection * modelMatrix, deletionQueue, useOcclusionCulling ? GpuCuller::Phase::Early : GpuCuller::Phase::All);
+	}
 
-	vkCmdBeginRenderPass(commandBuffers[currentFrame], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-	vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	if (useDynamicRendering)
+	{
+		renderGraph.setImportedImage(swapChainResource, swapChainImages[imageIndex], swapChainImageViews[imageIndex]);
+		renderGraph.execute(buffer);
+	}
+	else
+	{
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color        = {{0.0f, 0.0f, 0.0f, 1.0f}};
+		clearValues[1].depthStencil = {1.0f, 0};
+
+		VkRenderPassBeginInfo renderPassBeginInfo{};
+		renderPassBeginInfo.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass        = renderPass;
+		renderPassBeginInfo.framebuffer       = swapChainFramebuffers[imageIndex];
+		renderPassBeginInfo.renderArea.extent = swapChainExtent;
+		renderPassBeginInfo.renderArea.offset = {0, 0};
+		renderPassBeginInfo.clearValueCount   = static_cast<uint32_t>(clearValues.size());
+		renderPassBeginInfo.pClearValues      = clearValues.data();
+
+		vkCmdBeginRenderPass(buffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		if (useDepthPrepass)
+		{
+			drawScene(buffer, true);
+			vkCmdNextSubpass(buffer, VK_SUBPASS_CONTENTS_INLINE);
+		}
+		drawScene(buffer);
+		vkCmdEndRenderPass(buffer);
 
-	VkBuffer     vertexBuffers[] = {vertexBuffer};
-	VkDeviceSize offsets[]       = {0};
-	vkCmdBindVertexBuffers(commandBuffers[currentFrame], 0, 1, vertexBuffers, offsets);
-	vkCmdBindIndexBuffer(commandBuffers[currentFrame], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-	vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
-	vkCmdDrawIndexed(commandBuffers[currentFrame], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+		if (useOcclusionCulling)
+		{
+			depthPyramid.record(buffer);
+			gpuCuller.record(buffer, currentFrame, instanceManager.buffer(), instanceManager.count(), instanceManager.meshInstanceCounts(),
+			                 viewProjection * modelMatrix, deletionQueue, GpuCuller::Phase::Late);
 
-	vkCmdEndRenderPass(commandBuffers[currentFrame]);
+			renderPassBeginInfo.renderPass = occlusionRenderPass;
+			vkCmdBeginRenderPass(buffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			if (useDepthPrepass)
+			{
+				drawScene(buffer, true);
+				vkCmdNextSubpass(buffer, VK_SUBPASS_CONTENTS_INLINE);
+			}
+			drawScene(buffer);
+			vkCmdEndRenderPass(buffer);
+		}
+	}
 
-	result = vkEndCommandBuffer(commandBuffers[currentFrame]);
+	result = vkEndCommandBuffer(buffer);
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error(err2msg(result));
 	}
 }
 
-void VulkanApp::updateUniformBuffer(uint32_t currentImage)
+void VulkanApp::drawScene(VkCommandBuffer buffer, bool depthOnly)
+{
+	VkViewport viewport{};
+	viewport.x        = 0.0f;
+	viewport.y        = 0.0f;
+	viewport.width    = static_cast<float>(swapChainExtent.width);
+	viewport.height   = static_cast<float>(swapChainExtent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(buffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = {0, 0};
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(buffer, 0, 1, &scissor);
+
+	// The pre-pass draws exactly the same instances, only from the position stream.
+	VkBuffer vertexStream = depthOnly ? positionBuffer : vertexBuffer;
+
+	if (useInstancing)
+	{
+		// Culled draws read the visible instances the pass grouped by mesh.
+		VkBuffer                    instances     = useGpuCulling ? gpuCuller.visibleInstances() : instanceManager.buffer();
+		std::array<VkBuffer, 2>     vertexBuffers = {vertexStream, instances};
+		std::array<VkDeviceSize, 2> offsets       = {0, 0};
+		vkCmdBindVertexBuffers(buffer, 0, static_cast<uint32_t>(vertexBuffers.size()), vertexBuffers.data(), offsets.data());
+	}
+	else
+	{
+		VkBuffer     vertexBuffers[] = {vertexStream};
+		VkDeviceSize offsets[]       = {0};
+		vkCmdBindVertexBuffers(buffer, 0, 1, vertexBuffers, offsets);
+	}
+	vkCmdBindIndexBuffer(buffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+	if (useBindless)
+	{
+		std::array<VkDescriptorSet, 2> sets = {descriptorSets[currentFrame], bindlessTable.set()};
+		vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, static_cast<uint32_t>(sets.size()), sets.data(), 0, nullptr);
+	}
+
+	// The matrix product is done once per draw here instead of per vertex.
+	DrawConstants constants{};
+	constants.mvp           = viewProjection * modelMatrix;
+	constants.materialIndex = materialBase + modelMaterial;
+	vkCmdPushConstants(buffer, pipelineLayout, DRAW_CONSTANT_STAGES, 0, sizeof(constants), &constants);
+
+	if (useGpuCulling)
+	{
+		// The culler's commands draw the whole model with the model texture.
+		vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthOnly ? depthPipeline : graphicsPipeline);
+		bindMaterial(buffer, 0);
+		gpuCuller.draw(buffer);
+		return;
+	}
+
+	// Pipelines and materials are only bound when the sorted draws change them.
+	queueDraws(depthOnly);
+	std::array<VkPipeline, 2> pipelines     = {graphicsPipeline, depthPipeline};
+	uint32_t                  boundPipeline = UINT32_MAX;
+	uint32_t                  boundMaterial = UINT32_MAX;
+	for (const DrawQueue::Draw &draw : drawQueue.draws())
+	{
+		if (draw.pipeline != boundPipeline)
+		{
+			vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[draw.pipeline]);
+			boundPipeline = draw.pipeline;
+		}
+		if (draw.material != boundMaterial)
+		{
+			bindMaterial(buffer, draw.material);
+			boundMaterial = draw.material;
+		}
+		vkCmdDrawIndexed(buffer, draw.indexCount, draw.instanceCount, draw.firstIndex, 0, draw.firstInstance);
+	}
+	frameDrawStats += drawQueue.stats();
+}
+
+void VulkanApp::queueDraws(bool depthOnly)
+{
+	// Materials are keyed by texture, the only state they bind. The depth
+	// pre-pass binds none, so its draws only differ by mesh.
+	glm::mat4 mvp      = viewProjection * modelMatrix;
+	uint32_t  pipeline = depthOnly ? 1 : 0;
+
+	drawQueue.clear();
+	for (uint32_t mesh = 0; mesh < submeshes.size(); ++mesh)
+	{
+		const Submesh &submesh  = submeshes[mesh];
+		uint32_t       material = depthOnly ? 0 : modelMaterials[submesh.material].texture;
+		glm::vec4      clip     = mvp * glm::vec4(submesh.center, 1.0f);
+		float          depth    = clip.w > 0.0f ? clip.z / clip.w : 0.0f;
+		auto           push     = [&](uint32_t firstInstance, uint32_t instanceCount) {
+			drawQueue.push(pipeline, material, mesh, depth, submesh.firstIndex, submesh.indexCount, firstInstance, instanceCount);
+		};
+
+		if (!useInstancing)
+		{
+			push(0, 1);
+		}
+		else if (useCpuCulling)
+		{
+			// Neighbouring visible slots share one draw.
+			for (size_t first = 0; first < visibleInstances.size();)
+			{
+				size_t last = first + 1;
+				while (last < visibleInstances.size() && visibleInstances[last] == visibleInstances[last - 1] + 1)
+				{
+					++last;
+				}
+				push(visibleInstances[first], static_cast<uint32_t>(last - first));
+				first = last;
+			}
+		}
+		else if (drawInstancesSeparately)
+		{
+			for (uint32_t instance = 0; instance < instanceManager.count(); ++instance)
+			{
+				push(instance, 1);
+			}
+		}
+		else
+		{
+			push(0, instanceManager.count());
+		}
+	}
+
+	// Merging would turn the benchmark's separate draws back into one.
+	drawQueue.sort(!drawInstancesSeparately);
+}
+
+void VulkanApp::bindMaterial(VkCommandBuffer buffer, uint32_t material)
+{
+	if (useBindless)
+	{
+		uint32_t materialIndex = materialBase + bindlessMaterials[material];
+		vkCmdPushConstants(buffer, pipelineLayout, DRAW_CONSTANT_STAGES, offsetof(DrawConstants, materialIndex), sizeof(materialIndex), &materialIndex);
+	}
+	else
+	{
+		VkDescriptorSet set = material == 0 ? descriptorSets[currentFrame] : materialDescriptorSets[currentFrame][material - 1];
+		vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &set, 0, nullptr);
+	}
+}
+
+void VulkanApp::populateInstances(uint32_t count)
+{
+	// Square grid around the model in its ground plane, tints cycling through hues.
+	uint32_t side    = std::max(1u, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count)))));
+	float    spacing = 2.0f * modelRadius;
+	float    center  = 0.5f * static_cast<float>(side - 1);
+
+	instanceManager.clear();
+	objectStore.clear();
+	transforms.clear();
+	rowNodes.clear();
+	instanceNodes.clear();
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		glm::vec3 offset((static_cast<float>(i % side) - center) * spacing, (static_cast<float>(i / side) - center) * spacing, 0.0f);
+		float     hue = static_cast<float>(i) * 2.4f;
+
+		InstanceManager::Instance instance;
+		instance.model = glm::translate(glm::mat4(1.0f), offset);
+		instance.tint  = glm::vec4(0.6f + 0.4f * glm::cos(glm::vec3(hue, hue + 2.1f, hue + 4.2f)), 1.0f);
+		instanceManager.add(instance);
+		objectStore.add(instance.model, modelMin, modelMax, 0);
+
+		// Rows sit on the grid's center line, instances are placed along them.
+		if (i % side == 0)
+		{
+			rowNodes.push_back(transforms.add(TransformHierarchy::NO_PARENT, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, offset.y, 0.0f))));
+		}
+		instanceNodes.push_back(transforms.add(rowNodes.back(), glm::translate(glm::mat4(1.0f), glm::vec3(offset.x, 0.0f, 0.0f))));
+	}
+	markDirty(DIRTY_SCENE);
+}
+
+void VulkanApp::animateInstanceTransforms()
+{
+	for (uint32_t row = 0; row < rowNodes.size(); ++row)
+	{
+		glm::mat4 local = glm::translate(glm::mat4(1.0f), glm::vec3(transforms.local(rowNodes[row])[3]));
+		float     swing = 0.2f * std::sin(animationTime + 0.5f * static_cast<float>(row));
+		transforms.setLocal(rowNodes[row], glm::rotate(local, swing, glm::vec3(0.0f, 0.0f, 1.0f)));
+	}
+	for (uint32_t slot = 0; slot < instanceNodes.size(); ++slot)
+	{
+		glm::mat4 local = glm::translate(glm::mat4(1.0f), glm::vec3(transforms.local(instanceNodes[slot])[3]));
+		float     spin  = animationTime * (1.0f + static_cast<float>(slot % 3));
+		transforms.setLocal(instanceNodes[slot], glm::rotate(local, spin, glm::vec3(0.0f, 0.0f, 1.0f)));
+	}
+	transforms.update(threadPool);
+
+	// Nothing is removed from the grid, so instance ids are the slots.
+	for (uint32_t slot = 0; slot < instanceNodes.size(); ++slot)
+	{
+		InstanceManager::Instance instance = instanceManager.get(slot);
+		instance.model                     = transforms.world(instanceNodes[slot]);
+		instanceManager.update(slot, instance);
+		objectStore.setTransform(slot, instance.model);
+	}
+}
+
+void VulkanApp::buildRenderGraph()
+{
+	renderGraph.reset();
+
+	// The acquire semaphore is waited on at the color output stage.
+	swapChainResource = renderGraph.importImage("swapchain", VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+	                                            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, 0);
+
+	TransientImageDesc depthDesc{};
+	depthDesc.format  = depthFormat;
+	depthDesc.extent  = swapChainExtent;
+	depthDesc.samples = msaaSamples;
+	depthDesc.usage   = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	depthDesc.aspect  = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (useDepthPrepass)
+	{
+		// Stored by the pre-pass for the main pass, so not lazily allocated.
+		depthDesc.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	}
+	depthResource = renderGraph.createImage("depth", depthDesc);
+
+	std::vector<ResourceUse> uses = {{swapChainResource, ResourceUsage::ColorAttachment},
+	                                 {depthResource, ResourceUsage::DepthAttachment}};
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT)
+	{
+		TransientImageDesc colorDesc{};
+		colorDesc.format  = swapChainImageFormat;
+		colorDesc.extent  = swapChainExtent;
+		colorDesc.samples = msaaSamples;
+		colorDesc.usage   = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		colorResource     = renderGraph.createImage("color", colorDesc);
+		uses.push_back({colorResource, ResourceUsage::ColorAttachment});
+	}
+
+	if (useDepthPrepass)
+	{
+		renderGraph.addPass("depth prepass", {{depthResource, ResourceUsage::DepthAttachment}},
+		                    [this](VkCommandBuffer buffer) { recordDepthPrepass(buffer); });
+	}
+	renderGraph.addPass("main", std::move(uses), [this](VkCommandBuffer buffer) { recordMainPass(buffer); });
+	renderGraph.setOutput(swapChainResource, ResourceUsage::Present);
+	renderGraph.compile(logicalDevice, physicalDevice);
+
+	if (dumpRenderGraph)
+	{
+		renderGraph.printSchedule(std::cout);
+	}
+}
+
+void VulkanApp::recordMainPass(VkCommandBuffer buffer)
+{
+	// With MSAA the multisampled image is resolved into the swap chain image,
+	// otherwise the swap chain image is rendered to directly.
+	VkRenderingAttachmentInfo colorAttachment{};
+	colorAttachment.sType                  = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	colorAttachment.imageLayout            = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.loadOp                 = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.clearValue.color       = {{0.0f, 0.0f, 0.0f, 1.0f}};
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT)
+	{
+		colorAttachment.imageView          = renderGraph.getView(colorResource);
+		colorAttachment.storeOp            = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.resolveMode        = VK_RESOLVE_MODE_AVERAGE_BIT;
+		colorAttachment.resolveImageView   = renderGraph.getView(swapChainResource);
+		colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	}
+	else
+	{
+		colorAttachment.imageView   = renderGraph.getView(swapChainResource);
+		colorAttachment.storeOp     = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.resolveMode = VK_RESOLVE_MODE_NONE;
+	}
+
+	VkRenderingAttachmentInfo depthAttachment{};
+	depthAttachment.sType                   = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depthAttachment.imageView               = renderGraph.getView(depthResource);
+	depthAttachment.imageLayout             = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.loadOp                  = useDepthPrepass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp                 = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.clearValue.depthStencil = {1.0f, 0};
+
+	VkRenderingInfo renderingInfo{};
+	renderingInfo.sType                = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	renderingInfo.renderArea.offset    = {0, 0};
+	renderingInfo.renderArea.extent    = swapChainExtent;
+	renderingInfo.layerCount           = 1;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachments    = &colorAttachment;
+	renderingInfo.pDepthAttachment     = &depthAttachment;
+
+	vkCmdBeginRendering(buffer, &renderingInfo);
+	drawScene(buffer);
+	vkCmdEndRendering(buffer);
+}
+
+void VulkanApp::recordDepthPrepass(VkCommandBuffer buffer)
+{
+	VkRenderingAttachmentInfo depthAttachment{};
+	depthAttachment.sType                   = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depthAttachment.imageView               = renderGraph.getView(depthResource);
+	depthAttachment.imageLayout             = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.loadOp                  = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp                 = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachment.clearValue.depthStencil = {1.0f, 0};
+
+	VkRenderingInfo renderingInfo{};
+	renderingInfo.sType                = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	renderingInfo.renderArea.offset    = {0, 0};
+	renderingInfo.renderArea.extent    = swapChainExtent;
+	renderingInfo.layerCount           = 1;
+	renderingInfo.colorAttachmentCount = 0;
+	renderingInfo.pDepthAttachment     = &depthAttachment;
+
+	vkCmdBeginRendering(buffer, &renderingInfo);
+	drawScene(buffer, true);
+	vkCmdEndRendering(buffer);
+}
+
+void VulkanApp::setDepthPrepass(bool enabled)
 {
-	static auto startTime = std::chrono::high_resolution_clock::now();
+	// The render pass layout and the main pipeline's depth test depend on
+	// it, so both are rebuilt with everything made from them.
+	cancelPipelineRebuild();
+	vkDeviceWaitIdle(logicalDevice);
+	useDepthPrepass = enabled;
+
+	graphicsPipeline.reset();
+	depthPipeline.reset();
+	if (useDynamicRendering)
+	{
+		buildRenderGraph();
+	}
+	else
+	{
+		for (auto framebuffer : swapChainFramebuffers)
+		{
+			vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+		}
+		vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+		vkDestroyRenderPass(logicalDevice, occlusionRenderPass, nullptr);
+		createRenderPass();
+		createFramebuffers();
+	}
+	graphicsPipeline = buildGraphicsPipeline();
+	if (useDepthPrepass)
+	{
+		depthPipeline = buildGraphicsPipeline(true);
+	}
+	markDirty(DIRTY_SCENE);
+}
 
+void VulkanApp::advanceAnimation()
+{
 	auto currentTime = std::chrono::high_resolution_clock::now();
+	if (hasUpdated && !animationPaused)
+	{
+		animationTime += std::chrono::duration<float, std::chrono::seconds::period>(currentTime - lastUpdateTime).count();
+		markDirty(DIRTY_UNIFORMS);
+	}
+	lastUpdateTime = currentTime;
+	hasUpdated     = true;
+}
+
+glm::vec3 VulkanApp::cameraEye() const
+{
+	return cameraTarget + cameraDistance * glm::vec3(std::cos(cameraPitch) * std::cos(cameraYaw),
+	                                                 std::cos(cameraPitch) * std::sin(cameraYaw),
+	                                                 std::sin(cameraPitch));
+}
+
+void VulkanApp::requestTextureDetail()
+{
+	// The texture is wrapped around the model, so its width is taken to span
+	// about the projected diameter of the bounding sphere.
+	glm::mat4 model    = glm::rotate(glm::mat4(1.0f), animationTime * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::vec3 center   = glm::vec3(model * glm::vec4(modelCenter, 1.0f));
+	float     distance = std::max(glm::length(cameraEye() - center) - modelRadius, 0.1f);
+	float     pixels   = modelRadius * swapChainExtent.height / (distance * std::tan(glm::radians(45.0f) / 2.0f));
+	residencyManager.request(modelTexture, pixels);
+}
 
-	float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+void VulkanApp::updateUniformBuffer(uint32_t currentImage)
+{
+	glm::vec3 eye = cameraEye();
 
 	UniformBufferObject ubo{};
-	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-	ubo.view  = glm::lookAt(glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(0.0f, 0.0f, 0.25f), glm::vec3(0.0f, 0.0f, 1.0f));
+	ubo.view  = glm::lookAt(eye, cameraTarget, glm::vec3(0.0f, 0.0f, 1.0f));
 	ubo.proj  = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float) swapChainExtent.height, 0.1f, 10.0f);
 	ubo.proj[1][1] *= -1;
+	ubo.viewProj = ubo.proj * ubo.view;
+
+	viewProjection = ubo.viewProj;
+	modelMatrix    = glm::rotate(glm::mat4(1.0f), animationTime * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 
 	void *data;
 	vkMapMemory(logicalDevice, uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
 	memcpy(data, &ubo, sizeof(ubo));
 	vkUnmapMemory(logicalDevice, uniformBuffersMemory[currentImage]);
 }
+
+void VulkanApp::reportCulling()
+{
+	if (!useGpuCulling)
+	{
+		return;
+	}
+
+	// The fence we just waited on retired this frame's counters.
+	cullStats = gpuCuller.stats(currentFrame);
+	auto now  = std::chrono::steady_clock::now();
+	if (useOcclusionCulling && now - lastCullReport >= std::chrono::seconds(1))
+	{
+		lastCullReport = now;
+		std::cout << "Culling: " << cullStats.drawn << " drawn, " << cullStats.frustumCulled << " outside the frustum, "
+		          << cullStats.occluded << " occluded\n";
+	}
+}
+
+void VulkanApp::reportDraws()
+{
+	auto now = std::chrono::steady_clock::now();
+	if (reportDrawStats && now - lastDrawReport >= std::chrono::seconds(1))
+	{
+		lastDrawReport = now;
+		std::cout << "Draws: " << frameDrawStats.submitted << " submitted, " << frameDrawStats.draws << " issued, "
+		          << frameDrawStats.pipelineChanges << " pipeline, " << frameDrawStats.materialChanges << " material, "
+		          << frameDrawStats.meshChanges << " mesh changes\n";
+	}
+}
+
+void VulkanApp::reportStreaming()
+{
+	auto now = std::chrono::steady_clock::now();
+	if (reportStreamingStats && now - lastStreamingReport >= std::chrono::seconds(1))
+	{
+		lastStreamingReport           = now;
+		ResidencyManager::Stats stats = residencyManager.stats();
+		std::cout << "Streaming: " << stats.residentBytes / (1024 * 1024) << " of " << stats.budget / (1024 * 1024) << " MiB resident, "
+		          << stats.pendingLoads << " loading, " << stats.pendingUploads << " uploading, " << stats.uploads << " swapped in, "
+		          << stats.evictions << " evicted, " << stats.failures << " failed";
+		if (!stats.lastError.empty())
+		{
+			std::cout << " (last: " << stats.lastError << ")";
+		}
+		std::cout << "\n";
+	}
+}
+
+void VulkanApp::pollFrameLatency()
+{
+	if (!reportLatency)
+	{
+		return;
+	}
+
+	// Presents are waited for by presentWaiter. Without it a frame is done
+	// once its fence reads signaled, fences are read without blocking.
+	if (!presentWaitSupported)
+	{
+		for (uint32_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; ++frame)
+		{
+			if (inFlightPresentIds[frame] != 0 && vkGetFenceStatus(logicalDevice, inFlightFences[frame]) == VK_SUCCESS)
+			{
+				latencyTracker.frameCompleted(inFlightPresentIds[frame]);
+				inFlightPresentIds[frame] = 0;
+			}
+		}
+	}
+
+	if (latencyTracker.shouldReport())
+	{
+		latencyTracker.report(std::cout, presentWaitSupported ? "present_wait" : "cpu estimate",
+		                      presentModeName(swapChainPresentMode), static_cast<uint32_t>(swapChainImages.size()));
+	}
+}
@@ -5,13 +5,51 @@
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.hpp>
 
+#include <chrono>
 #include <cstdlib>
+#include <future>
 #include <iostream>
+#include <set>
 #include <stdexcept>
 #include <vector>
 
+#include "AssetPack.hpp"
+#include "BindlessTable.hpp"
+#include "DeletionQueue.hpp"
+#include "DepthPyramid.hpp"
+#include "DescriptorAllocator.hpp"
+#include "Downsample.hpp"
+#include "DrawQueue.hpp"
+#include "GeometryCodec.hpp"
+#include "Gltf.hpp"
+#include "GpuCuller.hpp"
+#include "InstanceManager.hpp"
+#include "Ktx2.hpp"
+#include "LatencyTracker.hpp"
+#include "MipGenerator.hpp"
+#include "ObjectCache.hpp"
+#include "ObjectStore.hpp"
+#include "PresentWaiter.hpp"
+#include "RenderGraph.hpp"
+#include "ResidencyManager.hpp"
+#include "ShaderWatcher.hpp"
+#include "TextureLoader.hpp"
+#include "ThreadPool.hpp"
+#include "TransformHierarchy.hpp"
+#include "VulkanHandles.hpp"
 #include "VulkanUtils.hpp"
 
+// State that invalidates the last presented image in on-demand mode
+enum DirtyFlags : uint32_t
+{
+	DIRTY_NONE      = 0,
+	DIRTY_CAMERA    = 1 << 0,
+	DIRTY_UNIFORMS  = 1 << 1,
+	DIRTY_SCENE     = 1 << 2,
+	DIRTY_SWAPCHAIN = 1 << 3,
+	DIRTY_ALL       = DIRTY_CAMERA | DIRTY_UNIFORMS | DIRTY_SCENE | DIRTY_SWAPCHAIN
+};
+
 class VulkanApp
 {
   public:
@@ -23,8 +61,83 @@ class VulkanApp
 	const std::string               MODEL_TEX_FILEPATH   = "./textures/nefertiti.png";
 	const std::vector<const char *> validationLayers     = {"VK_LAYER_KHRONOS_validation"};
 	const size_t                    MAX_FRAMES_IN_FLIGHT = 2;
+	const double                    IDLE_WAIT_TIMEOUT    = 0.5;
 	void                            run();
 	bool                            framebufferResized = false;
+	void                            markDirty(uint32_t flags);
+	void                            handleKey(int key, int action);
+	void                            handleScroll(double yOffset);
+
+	// Presentation settings, 0 images means minImageCount + 1
+	PresentPolicy presentPolicy       = PresentPolicy::Mailbox;
+	uint32_t      swapChainImageCount = 0;
+	bool          reportLatency       = false;
+
+	// Render only when something changed instead of continuously
+	bool onDemandRendering = false;
+	bool animationPaused   = false;
+
+	// Use VK_KHR_dynamic_rendering instead of VkRenderPass/VkFramebuffer objects
+	bool useDynamicRendering = false;
+	bool dumpRenderGraph     = false;
+
+	// Upload through staging buffers even if VK_EXT_host_image_copy is available
+	bool disableHostImageCopy = false;
+
+	// Sample textures from one descriptor-indexed array through a material table
+	bool useBindless = false;
+
+	// Draw this many tinted copies of the model with one instanced draw, 0
+	// draws the model alone without per-instance data
+	uint32_t instanceCount = 0;
+
+	// Cull the instances in a compute pass and draw them with an indirect count
+	bool useGpuCulling = false;
+
+	// Also cull the instances hidden behind others against a depth pyramid,
+	// implies GPU culling and needs the render pass path
+	bool useOcclusionCulling = false;
+
+	// Cull the instances on the CPU with SIMD over all cores and draw the
+	// visible ones, GPU culling wins when both are asked for
+	bool useCpuCulling = false;
+
+	// Lay down depth in a pre-pass reading only positions, then shade with
+	// an EQUAL depth test and no depth writes so each sample is shaded once
+	bool useDepthPrepass = false;
+
+	// Spin every instance and swing each row of the grid, the instances
+	// being children of their row in a transform hierarchy
+	bool animateInstances = false;
+
+	// Print the draws and state changes of a frame once a second
+	bool reportDrawStats = false;
+
+	// An OBJ file, or a glTF 2.0 one when it ends in .glb or .gltf
+	std::string modelPath = MODEL_OBJ_FILEPATH;
+
+	// Keep the parsed model next to it as compressed vertex and index
+	// streams and load those while the model file is unchanged
+	bool useMeshCache = false;
+
+	// Read shaders, textures and models from one mapped pack built by the
+	// packer tool, falling back to loose files for anything it lacks
+	std::string assetPackPath;
+
+	// Recompile shaders/*.vert and *.frag whenever one is saved, rebuild the
+	// pipelines using it in the background and swap them in between frames
+	bool watchShaders = false;
+
+	// Stream texture levels in the background within a memory budget, 0 MiB
+	// derives the budget from VK_EXT_memory_budget
+	bool         streamTextures = false;
+	VkDeviceSize textureBudget  = 0;
+
+	// Print the streaming budget, residency and events once a second
+	bool reportStreamingStats = false;
+
+	// Run the named benchmark instead of the render loop
+	std::string benchmark;
 
   private:
 	// Device setup
@@ -38,29 +151,34 @@ class VulkanApp
 	VkQueue                  presentQueue;
 
 	// Swap chain
-	VkSwapchainKHR             swapChain;
-	std::vector<VkImage>       swapChainImages;
-	VkFormat                   swapChainImageFormat;
-	VkExtent2D                 swapChainExtent;
-	std::vector<VkImageView>   swapChainImageViews;
-	VkRenderPass               renderPass;
-	VkDescriptorSetLayout      descriptorSetLayout;
-	VkPipelineLayout           pipelineLayout;
-	VkPipeline                 graphicsPipeline;
+	VkSwapchainKHR               swapChain;
+	std::vector<VkImage>         swapChainImages;
+	VkFormat                     swapChainImageFormat;
+	VkExtent2D                   swapChainExtent;
+	VkPresentModeKHR             swapChainPresentMode;
+	std::vector<UniqueImageView> swapChainImageViews;
+	VkRenderPass                 renderPass;
+	VkDescriptorSetLayout        descriptorSetLayout;
+	VkPipelineLayout             pipelineLayout;
+	UniquePipeline               graphicsPipeline;
     std::vector<VkFramebuffer> swapChainFramebuffers;
     VkCommandPool commandPool;
 
     // Vertex/Index buffers -> UBO
-	std::vector<Vertex>   vertices;
-	std::vector<uint32_t> indices;
-
-	VkBuffer                     vertexBuffer;
-	VkDeviceMemory               vertexBufferMemory;
-	VkBuffer                     indexBuffer;
-	VkDeviceMemory               indexBufferMemory;
-	std::vector<VkBuffer>        uniformBuffers;
-	std::vector<VkDeviceMemory>  uniformBuffersMemory;
-	VkDescriptorPool             descriptorPool;
+	std::vector<Vertex>        vertices;
+	std::vector<uint32_t>      indices;
+	std::vector<Submesh>       submeshes;
+	std::vector<ModelMaterial> modelMaterials;
+
+	UniqueBuffer                    vertexBuffer;
+	UniqueDeviceMemory              vertexBufferMemory;
+	UniqueBuffer                    indexBuffer;
+	UniqueDeviceMemory              indexBufferMemory;
+	UniqueBuffer                    positionBuffer;
+	UniqueDeviceMemory              positionBufferMemory;
+	std::vector<UniqueBuffer>       uniformBuffers;
+	std::vector<UniqueDeviceMemory> uniformBuffersMemory;
+	DescriptorAllocator          descriptorAllocator;
 	std::vector<VkDescriptorSet> descriptorSets;
 	std::vector<VkCommandBuffer> commandBuffers;
 
@@ -69,23 +187,147 @@ class VulkanApp
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
 
+	// Samplers and layouts shared between identical create infos
+	ObjectCache objectCache;
+
+	// Objects released while frames may still use them
+	DeletionQueue deletionQueue;
+	uint64_t      frameNumber = 0;
+
+	// Latency measurement
+	bool                    presentWaitSupported = false;
+	PFN_vkWaitForPresentKHR pfnWaitForPresent    = nullptr;
+	uint64_t                presentId            = 0;
+	std::vector<uint64_t>   inFlightPresentIds;
+	LatencyTracker          latencyTracker;
+	PresentWaiter           presentWaiter;
+
 	// Textures
-	uint32_t       mipLevels;
-	VkImage        textureImage;
-	VkDeviceMemory textureImageMemory;
-	VkImageView    textureImageView;
-	VkSampler      textureSampler;
+	uint32_t           mipLevels;
+	VkFormat           textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+	UniqueImage        textureImage;
+	UniqueDeviceMemory textureImageMemory;
+	UniqueImageView    textureImageView;
+	VkSampler          textureSampler;
+	MipGenerator       mipGenerator;
+	TextureLoader      textureLoader;
+
+	// A model texture recorded into a command buffer. Reloads keep the
+	// current texture bound and swap once the fence has signaled, so F5
+	// never waits for the queue. PNG uploads copy from the loader's staging
+	// buffer and own no staging of their own.
+	struct TextureUpload
+	{
+		VkFormat           format    = VK_FORMAT_R8G8B8A8_SRGB;
+		uint32_t           mipLevels = 1;
+		UniqueImage        image;
+		UniqueDeviceMemory memory;
+		UniqueBuffer       stagingBuffer;
+		UniqueDeviceMemory stagingMemory;
+		VkCommandBuffer    commandBuffer = VK_NULL_HANDLE;
+		UniqueFence        fence;
+	};
+	std::vector<TextureUpload> textureReloads;
+
+	// VK_EXT_host_image_copy uploads
+	bool                           hostImageCopySupported   = false;
+	PFN_vkTransitionImageLayoutEXT pfnTransitionImageLayout = nullptr;
+	PFN_vkCopyMemoryToImageEXT     pfnCopyMemoryToImage     = nullptr;
+
+	// Textures of the model's materials, bound through a descriptor set
+	// per frame each or through their bindless material
+	struct MaterialTexture
+	{
+		std::string        path;
+		const uint8_t     *encoded     = nullptr;    // embedded in a model file, else path or plain white
+		size_t             encodedSize = 0;
+		UniqueImage        image;
+		UniqueDeviceMemory memory;
+		UniqueImageView    view;
+	};
+	std::vector<MaterialTexture>              materialTextures;
+	std::vector<std::vector<VkDescriptorSet>> materialDescriptorSets;
+	std::vector<MappedFile>                   modelFiles;    // mapped until the embedded textures are uploaded
+	AssetPack                                 assetPack;
+
+	// Shader hot reload. A rebuild in flight holds the new pipelines of the
+	// shaders changed when it started, later changes wait for the next one.
+	struct PipelineRebuild
+	{
+		UniquePipeline graphics;
+		UniquePipeline depth;
+		std::string    error;
+		double         ms = 0.0;
+	};
+	ShaderWatcher                shaderWatcher;
+	std::future<PipelineRebuild> pipelineRebuild;
+	std::set<std::string>        changedShaders;
+
+	// Bindless materials, materialBase selects this frame's copy of the
+	// table. bindlessMaterials maps the texture of a model material to its
+	// table entry, the model texture's being modelMaterial.
+	BindlessTable         bindlessTable;
+	uint32_t              modelMaterial       = 0;
+	uint32_t              materialBase        = 0;
+	uint32_t              bindlessTextureSlot = UINT32_MAX;
+	VkImageView           bindlessTextureView = VK_NULL_HANDLE;
+	std::vector<uint32_t> bindlessMaterials;
+
+	// Instanced drawing, the benchmark compares against one draw per instance
+	bool            useInstancing           = false;
+	bool            drawInstancesSeparately = false;
+	InstanceManager instanceManager;
+	GpuCuller       gpuCuller;
+
+	// Occlusion culling, the second render pass draws what the late phase found
+	DepthPyramid                          depthPyramid;
+	VkRenderPass                          occlusionRenderPass = VK_NULL_HANDLE;
+	GpuCuller::Stats                      cullStats;
+	std::chrono::steady_clock::time_point lastCullReport;
+
+	// CPU culling, slots match the instance slots and are kept even when
+	// culling is off so the benchmark can switch it on
+	ObjectStore           objectStore;
+	ThreadPool            threadPool;
+	std::vector<uint32_t> visibleInstances;
+
+	// Instance transforms as rows of the grid parenting their instances,
+	// instance nodes in instance slot order
+	TransformHierarchy         transforms;
+	std::vector<TransformNode> rowNodes;
+	std::vector<TransformNode> instanceNodes;
+
+	// Depth pre-pass, drawn in a subpass of its own on the render pass path
+	UniquePipeline depthPipeline;
+
+	// Draws sorted by state, the stats of the last recorded frame
+	DrawQueue                             drawQueue;
+	DrawQueue::Stats                      frameDrawStats;
+	std::chrono::steady_clock::time_point lastDrawReport;
+
+	// Streamed textures
+	bool             memoryBudgetSupported = false;
+	ResidencyManager                      residencyManager;
+	StreamedTexture                       modelTexture = 0;
+	std::chrono::steady_clock::time_point lastStreamingReport;
 
 	// Depth
-	VkImage        depthImage;
-    VkDeviceMemory depthImageMemory;
-    VkImageView depthImageView;
+	UniqueImage        depthImage;
+	UniqueDeviceMemory depthImageMemory;
+	UniqueImageView    depthImageView;
+
+	// MSAA
+	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	VkFormat              depthFormat;
+	UniqueImage           colorImage;
+	UniqueDeviceMemory    colorImageMemory;
+	UniqueImageView       colorImageView;
 
-    // MSAA
-    VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
-    VkImage colorImage;
-    VkDeviceMemory colorImageMemory;
-    VkImageView colorImageView;
+	// Render graph driving the dynamic rendering path
+	RenderGraph         renderGraph;
+	RenderGraphResource swapChainResource = 0;
+	RenderGraphResource colorResource     = 0;
+	RenderGraphResource depthResource     = 0;
 
     // Main phase
     void initWindow();
@@ -107,24 +349,59 @@ class VulkanApp
 	void createRenderPass();
 	void createDescriptorSetLayout();
 	void createGraphicsPipeline();
+	UniquePipeline buildGraphicsPipeline(bool depthOnly = false);
+	const char *vertexShaderFile(bool depthOnly) const;
+	const char *fragmentShaderFile() const;
 	void createFramebuffers();
 	void createCommandPool();
     void createColorResources();
     void createDepthResources();
+	std::string findTextureFile() const;
+	bool recordCompressedTextureUpload(VkCommandBuffer commandBuffer, const std::string &path, TextureUpload &upload);
+	bool recordTextureUpload(VkCommandBuffer commandBuffer, TextureUpload &upload);
+	bool canHostCopy(VkFormat format) const;
+	void hostCopyTextureImage(TextureUpload &upload, uint32_t width, uint32_t height, const std::vector<const void *> &levels);
+	void hostCopyToImage(VkImage image, uint32_t width, uint32_t height, const std::vector<const void *> &levels);
 	void createTextureImage();
-	void createTextureImageView();
+	void useTexture(TextureUpload &upload);
+	void reloadTexture();
+	void retireTextureReloads(bool wait);
+	VkImageView currentTextureView() const;
 	void createTextureSampler();
 	void loadModel();
+	void loadObjModel(const std::string &path);
+	void loadGltfModel(const std::string &path);
+	bool loadMeshCache(const std::string &path);
+	void writeMeshCache(const std::string &path);
+	void createMaterialTextures();
 	void createVertexBuffer();
 	void createIndexBuffer();
+	void createPositionBuffer();
 	void createUniformBuffers();
 	void createDescriptorPool();
-	void createDescriptorSets();
+	void writeFrameDescriptors(uint32_t frame);
 	void createCommandBuffers();
 	void createSyncObjects();
 
 	// Helpful variables
-	uint32_t currentFrame = 0;
+	uint32_t                            currentFrame   = 0;
+	uint32_t                            dirtyFlags     = DIRTY_ALL;
+	std::chrono::steady_clock::duration lastRecordTime = {};
+
+	// Animation and camera
+	float                                          animationTime = 0.0f;
+	std::chrono::high_resolution_clock::time_point lastUpdateTime;
+	bool                                           hasUpdated     = false;
+	glm::vec3                                      cameraTarget   = glm::vec3(0.0f, 0.0f, 0.25f);
+	float                                          cameraYaw      = glm::radians(45.0f);
+	float                                          cameraPitch    = std::asin(0.25f / 0.75f);
+	float                                          cameraDistance = 0.75f;
+	glm::mat4                                      viewProjection = glm::mat4(1.0f);
+	glm::mat4                                      modelMatrix    = glm::mat4(1.0f);
+	glm::vec3                                      modelMin       = glm::vec3(0.0f);
+	glm::vec3                                      modelMax       = glm::vec3(0.0f);
+	glm::vec3                                      modelCenter    = glm::vec3(0.0f);
+	float                                          modelRadius    = 0.0f;
 
 	// Support functions
 	bool checkValidationLayerSupport();
@@ -134,9 +411,45 @@ class VulkanApp
 	                   const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
 	                   void	                                   *pUserData);
 	void recordCommandBuffer(VkCommandBuffer buffer, uint32_t imageIndex);
+	void drawScene(VkCommandBuffer buffer, bool depthOnly = false);
+	void queueDraws(bool depthOnly);
+	void bindMaterial(VkCommandBuffer buffer, uint32_t material);
+	void populateInstances(uint32_t count);
+	void animateInstanceTransforms();
+	void buildRenderGraph();
+	void recordMainPass(VkCommandBuffer buffer);
+	void recordDepthPrepass(VkCommandBuffer buffer);
+	void setDepthPrepass(bool enabled);
 	void updateUniformBuffer(uint32_t currentImage);
+	glm::vec3 cameraEye() const;
+	void requestTextureDetail();
+	void pollFrameLatency();
+	void reportCulling();
+	void reportDraws();
+	void reportStreaming();
+	void reloadAssets();
+	void replaceGraphicsPipeline(UniquePipeline &&pipeline);
+	void updateShaderReload();
+	void cancelPipelineRebuild();
+
+	// Benchmarks
+	void runBenchmark();
+	void benchmarkMipGeneration();
+	void benchmarkTextureUpload();
+	void benchmarkDescriptorAllocation();
+	void benchmarkInstancing();
+	void benchmarkCulling();
+	void benchmarkDepthPrepass();
+	void benchmarkTransforms();
+	void benchmarkModelLoading();
+	void benchmarkGeometryCodec();
+	bool isRedrawNeeded() const;
+	void advanceAnimation();
 };
 
 static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
+static void windowRefreshCallback(GLFWwindow *window);
+static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods);
+static void scrollCallback(GLFWwindow *window, double xOffset, double yOffset);
 
 #endif
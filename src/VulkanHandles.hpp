@@ -0,0 +1,99 @@
+#ifndef VULKANHANDLES_H
+#define VULKANHANDLES_H
+
+#include <vulkan/vulkan.h>
+
+// Move-only owner of a device-level Vulkan handle, destroyed with the given
+// vkDestroy*/vkFree* function when it goes out of scope or is reset.
+template <typename Handle, void(VKAPI_PTR *Destroy)(VkDevice, Handle, const VkAllocationCallbacks *)>
+class UniqueHandle
+{
+  public:
+	UniqueHandle() = default;
+	UniqueHandle(VkDevice device, Handle handle) :
+	    device(device), handle(handle)
+	{
+	}
+	~UniqueHandle()
+	{
+		reset();
+	}
+
+	UniqueHandle(const UniqueHandle &)            = delete;
+	UniqueHandle &operator=(const UniqueHandle &) = delete;
+
+	UniqueHandle(UniqueHandle &&other) noexcept :
+	    device(other.device), handle(other.release())
+	{
+	}
+	UniqueHandle &operator=(UniqueHandle &&other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			device = other.device;
+			handle = other.release();
+		}
+		return *this;
+	}
+
+	operator Handle() const
+	{
+		return handle;
+	}
+	Handle get() const
+	{
+		return handle;
+	}
+	VkDevice getDevice() const
+	{
+		return device;
+	}
+
+	// Destroys the current handle and exposes the storage to a vkCreate* call.
+	Handle *put(VkDevice owner)
+	{
+		reset();
+		device = owner;
+		return &handle;
+	}
+	Handle release()
+	{
+		Handle released = handle;
+		handle          = VK_NULL_HANDLE;
+		return released;
+	}
+	void reset()
+	{
+		if (handle != VK_NULL_HANDLE)
+		{
+			Destroy(device, handle, nullptr);
+			handle = VK_NULL_HANDLE;
+		}
+	}
+
+	static void destroy(VkDevice device, Handle handle)
+	{
+		Destroy(device, handle, nullptr);
+	}
+
+  private:
+	VkDevice device = VK_NULL_HANDLE;
+	Handle   handle = VK_NULL_HANDLE;
+};
+
+using UniqueBuffer              = UniqueHandle<VkBuffer, vkDestroyBuffer>;
+using UniqueCommandPool         = UniqueHandle<VkCommandPool, vkDestroyCommandPool>;
+using UniqueDescriptorPool      = UniqueHandle<VkDescriptorPool, vkDestroyDescriptorPool>;
+using UniqueDescriptorSetLayout = UniqueHandle<VkDescriptorSetLayout, vkDestroyDescriptorSetLayout>;
+using UniqueDeviceMemory        = UniqueHandle<VkDeviceMemory, vkFreeMemory>;
+using UniqueFence               = UniqueHandle<VkFence, vkDestroyFence>;
+using UniqueImage               = UniqueHandle<VkImage, vkDestroyImage>;
+using UniqueImageView           = UniqueHandle<VkImageView, vkDestroyImageView>;
+using UniquePipeline            = UniqueHandle<VkPipeline, vkDestroyPipeline>;
+using UniquePipelineLayout      = UniqueHandle<VkPipelineLayout, vkDestroyPipelineLayout>;
+using UniqueQueryPool           = UniqueHandle<VkQueryPool, vkDestroyQueryPool>;
+using UniqueSampler             = UniqueHandle<VkSampler, vkDestroySampler>;
+using UniqueShaderModule        = UniqueHandle<VkShaderModule, vkDestroyShaderModule>;
+
+#endif
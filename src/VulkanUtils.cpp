@@ -1,5 +1,7 @@
 #include "VulkanUtils.hpp"
-#include <fstream>
+#include "AssetPack.hpp"
+#include <algorithm>
+#include <cstring>
 #include <limits>
 #include <set>
 
@@ -96,12 +98,10 @@ void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT  &creat
 
 bool isDeviceSuitable(const VkPhysicalDevice device, const VkSurfaceKHR surface)
 {
-	QueueFamiliyIndices        indices = findQueueFamilies(device, surface);
-	VkPhysicalDeviceProperties deviceProperties;
-	VkPhysicalDeviceFeatures   deviceFeatures;
+	QueueFamiliyIndices      indices = findQueueFamilies(device, surface);
+	VkPhysicalDeviceFeatures deviceFeatures;
 
 	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-	vkGetPhysicalDeviceProperties(device, &deviceProperties);
 
 	bool isSwapChainSupported = checkDeviceExtensionSupport(device);
 	bool isSwapChainAdequate  = false;
@@ -112,9 +112,25 @@ bool isDeviceSuitable(const VkPhysicalDevice device, const VkSurfaceKHR surface)
 		isSwapChainAdequate                      = !swapChainDetails.formats.empty() && !swapChainDetails.presentModes.empty();
 	}
 
-	return (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
-	        deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) &&
-	       deviceFeatures.geometryShader && indices.isComplete() && isSwapChainSupported && isSwapChainAdequate && deviceFeatures.samplerAnisotropy;
+	return deviceFeatures.geometryShader && indices.isComplete() && isSwapChainSupported && isSwapChainAdequate && deviceFeatures.samplerAnisotropy;
+}
+
+int rankPhysicalDevice(const VkPhysicalDevice device)
+{
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+	switch (deviceProperties.deviceType)
+	{
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+			return 4;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+			return 3;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+			return 2;
+		default:
+			return 1;
+	}
 }
 
 QueueFamiliyIndices findQueueFamilies(const VkPhysicalDevice &device, const VkSurfaceKHR &surface)
@@ -165,6 +181,23 @@ bool checkDeviceExtensionSupport(const VkPhysicalDevice device)
 	return requiredExtensions.empty();
 }
 
+bool isDeviceExtensionSupported(const VkPhysicalDevice device, const char *extensionName)
+{
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto &extension : availableExtensions)
+	{
+		if (strcmp(extension.extensionName, extensionName) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
 SwapChainSupportDetails querySwapChainSupport(const VkPhysicalDevice &device, const VkSurfaceKHR surface)
 {
 	SwapChainSupportDetails details;
@@ -201,18 +234,67 @@ VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>
 	return availableFormats[0];
 }
 
-VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes)
+VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes, PresentPolicy policy)
 {
-	for (const auto &presentMode : availablePresentModes)
+	// Every policy degrades towards FIFO, the only mode the spec guarantees.
+	std::vector<VkPresentModeKHR> preferred;
+	switch (policy)
 	{
-		if (presentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+		case PresentPolicy::Immediate:
+			preferred = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+			break;
+		case PresentPolicy::Mailbox:
+			preferred = {VK_PRESENT_MODE_MAILBOX_KHR};
+			break;
+		case PresentPolicy::FifoRelaxed:
+			preferred = {VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+			break;
+		case PresentPolicy::Fifo:
+			break;
+	}
+
+	for (VkPresentModeKHR mode : preferred)
+	{
+		for (const auto &presentMode : availablePresentModes)
 		{
-			return presentMode;
+			if (presentMode == mode)
+			{
+				return presentMode;
+			}
 		}
 	}
 	return VK_PRESENT_MODE_FIFO_KHR;
 }
 
+const char *presentModeName(VkPresentModeKHR presentMode)
+{
+	switch (presentMode)
+	{
+		case VK_PRESENT_MODE_IMMEDIATE_KHR:
+			return "IMMEDIATE";
+		case VK_PRESENT_MODE_MAILBOX_KHR:
+			return "MAILBOX";
+		case VK_PRESENT_MODE_FIFO_KHR:
+			return "FIFO";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+			return "FIFO_RELAXED";
+		default:
+			return "UNKNOWN";
+	}
+}
+
+uint32_t chooseSwapImageCount(const VkSurfaceCapabilitiesKHR &surfaceCapabilities, uint32_t requestedCount)
+{
+	uint32_t imageCount = requestedCount == 0 ? surfaceCapabilities.minImageCount + 1 : requestedCount;
+
+	imageCount = std::max(imageCount, surfaceCapabilities.minImageCount);
+	if (surfaceCapabilities.maxImageCount > 0 && imageCount > surfaceCapabilities.maxImageCount)
+	{
+		imageCount = surfaceCapabilities.maxImageCount;
+	}
+	return imageCount;
+}
+
 VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &surfaceCapabilities, GLFWwindow *window)
 {
 	if (surfaceCapabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
@@ -230,28 +312,38 @@ VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &surfaceCapabilities,
 	return actualExtent;
 }
 
-std::vector<char> readFile(const std::string &filename)
+SpirvBinary loadSpirv(const std::string &filename)
 {
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	const uint32_t SPIRV_MAGIC = 0x07230203;
+
+	SpirvBinary binary;
+	AssetView   asset;
+	if (!findAsset(filename, asset))
+	{
+		binary.file.open(filename);
+		asset = {binary.file.data(), binary.file.size()};
+	}
 
-    if (!file.is_open())
-    {
-        throw std::runtime_error("Failed to open a file \"" + filename + "\"");
-    }
-    size_t            fileSize = file.tellg();
-    std::vector<char> buffer(fileSize);
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
-    file.close();
-    return buffer;
+	uint32_t magic = 0;
+	if (asset.size >= sizeof(magic))
+	{
+		memcpy(&magic, asset.data, sizeof(magic));
+	}
+	if (magic != SPIRV_MAGIC || asset.size % 4 != 0 || reinterpret_cast<uintptr_t>(asset.data) % 4 != 0)
+	{
+		throw std::runtime_error("\"" + filename + "\" is not a SPIR-V module");
+	}
+	binary.code = reinterpret_cast<const uint32_t *>(asset.data);
+	binary.size = asset.size;
+	return binary;
 }
 
-VkShaderModule createShaderModule(const VkDevice &device, const std::vector<char> &code)
+VkShaderModule createShaderModule(const VkDevice &device, const SpirvBinary &binary)
 {
 	VkShaderModuleCreateInfo createInfo{};
-	createInfo.pCode    = reinterpret_cast<const uint32_t *>(code.data());
+	createInfo.pCode    = binary.code;
 	createInfo.sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
+	createInfo.codeSize = binary.size;
 	VkShaderModule shaderModule;
 	VkResult       result = vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule);
 	if (result != VK_SUCCESS)
@@ -321,7 +413,8 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, const
 
 void createImage(int32_t textureWidth, int32_t textureHeight, int32_t mipLevels, VkSampleCountFlagBits numSamples, const VkPhysicalDevice &physicalDevice,
                  const VkDevice &logicalDevice, VkImage &textureImage, VkDeviceMemory &textureImageMemory,
-                 VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties)
+                 VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+                 VkImageCreateFlags flags)
 {
 	VkImageCreateInfo imageCreateInfo{};
 	imageCreateInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -337,7 +430,7 @@ void createImage(int32_t textureWidth, int32_t textureHeight, int32_t mipLevels,
 	imageCreateInfo.usage         = usage;
 	imageCreateInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
 	imageCreateInfo.samples       = numSamples;
-	imageCreateInfo.flags         = 0;
+	imageCreateInfo.flags         = flags;
 
 	VkResult result = vkCreateImage(logicalDevice, &imageCreateInfo, nullptr, &textureImage);
 	if (result != VK_SUCCESS)
@@ -393,10 +486,72 @@ void endSingleTimeCommands(const VkDevice &device, const VkCommandPool &commandP
 	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
 
-void transitionImageLayout(const VkDevice &device, const VkCommandPool &commandPool, const VkQueue &graphicsQueue, const VkImageLayout &oldLayout, const VkImageLayout &newLayout, VkImage &image, VkFormat format, uint32_t mipLevels)
+// Stages and accesses that may touch an image while it is in the given layout.
+static void getLayoutSyncScope(VkImageLayout layout, VkPipelineStageFlags &stage, VkAccessFlags &access)
+{
+	switch (layout)
+	{
+		case VK_IMAGE_LAYOUT_UNDEFINED:
+		case VK_IMAGE_LAYOUT_PREINITIALIZED:
+			stage  = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			access = 0;
+			break;
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+			stage  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			access = VK_ACCESS_TRANSFER_READ_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+			stage  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			access = VK_ACCESS_TRANSFER_WRITE_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+			stage  = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			access = VK_ACCESS_SHADER_READ_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+			stage  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+			stage  = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+			stage  = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_GENERAL:
+			stage  = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+			break;
+		case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+			stage  = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			access = 0;
+			break;
+		default:
+			throw std::runtime_error("Unsupported image layout!");
+	}
+}
+
+bool hasStencilComponent(VkFormat format)
+{
+	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT;
+}
+
+bool isDepthFormat(VkFormat format)
+{
+	return format == VK_FORMAT_D32_SFLOAT || format == VK_FORMAT_D16_UNORM || format == VK_FORMAT_X8_D24_UNORM_PACK32 || hasStencilComponent(format);
+}
+
+void transitionImageLayout(const VkDevice &device, const VkCommandPool &commandPool, const VkQueue &graphicsQueue, const VkImageLayout &oldLayout, const VkImageLayout &newLayout, VkImage image, VkFormat format, uint32_t mipLevels)
 {
 	VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool, device);
+	recordTransitionImageLayout(commandBuffer, oldLayout, newLayout, image, format, mipLevels);
+	endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
+}
 
+void recordTransitionImageLayout(VkCommandBuffer commandBuffer, VkImageLayout oldLayout, VkImageLayout newLayout, VkImage image, VkFormat format, uint32_t mipLevels)
+{
 	VkImageMemoryBarrier barrier{};
 	barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout                       = oldLayout;
@@ -404,10 +559,10 @@ void transitionImageLayout(const VkDevice &device, const VkCommandPool &commandP
 	barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
 	barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
 	barrier.image                           = image;
-	if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+	if (isDepthFormat(format))
 	{
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-		if (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT)
+		if (hasStencilComponent(format))
 		{
 			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
 		}
@@ -420,44 +575,19 @@ void transitionImageLayout(const VkDevice &device, const VkCommandPool &commandP
 	barrier.subresourceRange.levelCount     = mipLevels;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount     = 1;
-	barrier.srcAccessMask                   = 0;
-	barrier.dstAccessMask                   = 0;
 
+	// Any pair of layouts is allowed: wait for whatever could use the old
+	// layout and block whatever may use the new one.
 	VkPipelineStageFlags sourceStage;
 	VkPipelineStageFlags destinationStage;
-
-	if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-		sourceStage      = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-	{
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		sourceStage      = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	}
-	else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-	{
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-		sourceStage      = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-	}
-	else
-	{
-		throw std::runtime_error("Unsupported layout transition!");
-	}
+	VkAccessFlags        sourceAccess;
+	VkAccessFlags        destinationAccess;
+	getLayoutSyncScope(oldLayout, sourceStage, sourceAccess);
+	getLayoutSyncScope(newLayout, destinationStage, destinationAccess);
+	barrier.srcAccessMask = sourceAccess & (VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT);
+	barrier.dstAccessMask = destinationAccess;
 
 	vkCmdPipelineBarrier(commandBuffer, sourceStage, destinationStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-	endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
 }
 
 void copyBufferToImage(const VkDevice &device, const VkCommandPool &commandPool, const VkQueue &graphicsQueue, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
@@ -482,6 +612,13 @@ void copyBufferToImage(const VkDevice &device, const VkCommandPool &commandPool,
 	endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
 }
 
+void copyBufferToImage(const VkDevice &device, const VkCommandPool &commandPool, const VkQueue &graphicsQueue, VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy> &regions)
+{
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool, device);
+	vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+	endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
+}
+
 VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags flags, uint32_t mipLevels)
 {
 	VkImageViewCreateInfo createInfo{};
@@ -507,6 +644,29 @@ VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkI
 	return imageView;
 }
 
+VkImageMemoryBarrier2 imageBarrier2(VkImage image, VkImageAspectFlags aspectMask, VkImageLayout oldLayout, VkImageLayout newLayout,
+                                    VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+                                    VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess)
+{
+	VkImageMemoryBarrier2 barrier{};
+	barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barrier.srcStageMask                    = srcStage;
+	barrier.srcAccessMask                   = srcAccess;
+	barrier.dstStageMask                    = dstStage;
+	barrier.dstAccessMask                   = dstAccess;
+	barrier.oldLayout                       = oldLayout;
+	barrier.newLayout                       = newLayout;
+	barrier.srcQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex             = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image                           = image;
+	barrier.subresourceRange.aspectMask     = aspectMask;
+	barrier.subresourceRange.baseMipLevel   = 0;
+	barrier.subresourceRange.levelCount     = VK_REMAINING_MIP_LEVELS;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount     = VK_REMAINING_ARRAY_LAYERS;
+	return barrier;
+}
+
 VkFormat findSuitableFormat(const VkPhysicalDevice &physicalDevice, const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
 {
 	for (VkFormat format : candidates)
@@ -525,18 +685,52 @@ VkFormat findSuitableFormat(const VkPhysicalDevice &physicalDevice, const std::v
 	throw std::runtime_error("Failed to find supported format!");
 }
 
-void generateMipmaps(VkImage image, VkFormat format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels, VkCommandPool commandPool, VkDevice device, VkQueue graphicsQueue, VkPhysicalDevice physicalDevice)
+bool supportsLinearBlit(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+	return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+}
+
+bool isSampledFormatSupported(VkPhysicalDevice physicalDevice, VkFormat format)
 {
+	const VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
 	VkFormatProperties formatProperties;
 	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+	return (formatProperties.optimalTilingFeatures & required) == required;
+}
 
-	if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+// Layouts VK_EXT_host_image_copy can write to.
+bool isHostCopyDstLayout(VkPhysicalDevice physicalDevice, VkImageLayout layout)
+{
+	VkPhysicalDeviceHostImageCopyPropertiesEXT hostImageCopyProperties{};
+	hostImageCopyProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2 properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &hostImageCopyProperties;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+	std::vector<VkImageLayout> layouts(hostImageCopyProperties.copyDstLayoutCount);
+	hostImageCopyProperties.pCopyDstLayouts = layouts.data();
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+	return std::find(layouts.begin(), layouts.end(), layout) != layouts.end();
+}
+
+void generateMipmaps(VkImage image, VkFormat format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels, VkCommandPool commandPool, VkDevice device, VkQueue graphicsQueue, VkPhysicalDevice physicalDevice)
+{
+	if (!supportsLinearBlit(physicalDevice, format))
 	{
 		throw std::runtime_error("texture format doesn't support linear blitting!");
 	}
 
 	VkCommandBuffer commandBuffer = beginSingleTimeCommands(commandPool, device);
+	recordBlitMipmaps(commandBuffer, image, texWidth, texHeight, mipLevels);
+	endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
+}
 
+void recordBlitMipmaps(VkCommandBuffer commandBuffer, VkImage image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels)
+{
 	VkImageMemoryBarrier barrier{};
 	barrier.sType                           = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.image                           = image;
@@ -603,8 +797,6 @@ void generateMipmaps(VkImage image, VkFormat format, int32_t texWidth, int32_t t
 	barrier.dstAccessMask                 = VK_ACCESS_SHADER_READ_BIT;
 
 	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-	endSingleTimeCommands(device, commandPool, commandBuffer, graphicsQueue);
 }
 
 VkSampleCountFlagBits getMaxUsableSampleCount(VkPhysicalDevice physicalDevice)
@@ -640,3 +832,17 @@ VkSampleCountFlagBits getMaxUsableSampleCount(VkPhysicalDevice physicalDevice)
 	}
 	return VK_SAMPLE_COUNT_1_BIT;
 }
+
+std::array<glm::vec4, 6> frustumPlanes(const glm::mat4 &viewProjection)
+{
+	// glm is column major, so row i is viewProjection[column][i].
+	glm::mat4                transposed = glm::transpose(viewProjection);
+	std::array<glm::vec4, 6> planes     = {transposed[3] + transposed[0], transposed[3] - transposed[0],
+	                                       transposed[3] + transposed[1], transposed[3] - transposed[1],
+	                                       transposed[3] + transposed[2], transposed[3] - transposed[2]};
+	for (glm::vec4 &plane : planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return planes;
+}
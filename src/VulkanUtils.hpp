@@ -13,6 +13,8 @@
 
 #include <vulkan/vulkan.hpp>
 
+#include "MappedFile.hpp"
+
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
 #else
@@ -69,6 +71,24 @@ struct Vertex
 		description[2].offset   = offsetof(Vertex, texCoord);
 		return description;
 	}
+	// The depth pre-pass reads positions from a tightly packed stream of their own.
+	static VkVertexInputBindingDescription getPositionBindingDescription()
+	{
+		VkVertexInputBindingDescription description{};
+		description.binding   = 0;
+		description.stride    = sizeof(glm::vec3);
+		description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		return description;
+	}
+	static VkVertexInputAttributeDescription getPositionAttributeDescription()
+	{
+		VkVertexInputAttributeDescription description{};
+		description.binding  = 0;
+		description.location = 0;
+		description.format   = VK_FORMAT_R32G32B32_SFLOAT;
+		description.offset   = 0;
+		return description;
+	}
 	bool operator==(const Vertex &other) const
 	{
 		return pos == other.pos && color == other.color && texCoord == other.texCoord;
@@ -87,17 +107,52 @@ struct hash<Vertex>
 };
 }        // namespace std
 
+// Range of the model's index buffer drawn with one material.
+struct Submesh
+{
+	uint32_t  firstIndex;
+	uint32_t  indexCount;
+	uint32_t  material;
+	glm::vec3 center;    // of the bounding box, for depth sorting
+};
+
+// The diffuse color is baked into the vertex colors, so only the texture
+// is bound per draw.
+struct ModelMaterial
+{
+	glm::vec3 diffuse = glm::vec3(1.0f);
+	uint32_t  texture = 0;    // 0 the model texture, otherwise 1 + a material texture
+};
+
+// Per-frame camera data. Per-draw transforms are pushed as DrawConstants.
 struct UniformBufferObject
 {
-	alignas(16) glm::mat4 model;
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
+	alignas(16) glm::mat4 viewProj;
+};
+
+// Push constants of the main pipeline, visible to both stages.
+struct DrawConstants
+{
+	glm::mat4 mvp;
+	uint32_t  materialIndex;    // into the bindless material table
 };
 
+const VkShaderStageFlags DRAW_CONSTANT_STAGES = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
 // SWAP CHAIN SUPPORT CHECK
 
 const std::vector<const char*> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
+enum class PresentPolicy
+{
+	Fifo,
+	FifoRelaxed,
+	Mailbox,
+	Immediate
+};
+
 struct SwapChainSupportDetails
 {
     VkSurfaceCapabilitiesKHR capabilities;
@@ -119,21 +174,47 @@ void                     populateDebugMessengerCreateInfo(VkDebugUtilsMessengerC
 
 bool isDeviceSuitable(const VkPhysicalDevice device, const VkSurfaceKHR surface);
 
+int rankPhysicalDevice(const VkPhysicalDevice device);
+
+// Links a Vk*Features structure into the pNext chain behind head.
+template <typename Head, typename Feature>
+void chainFeature(Head &head, Feature &feature)
+{
+	feature.pNext = head.pNext;
+	head.pNext    = &feature;
+}
+
 QueueFamiliyIndices findQueueFamilies(const VkPhysicalDevice &device, const VkSurfaceKHR &surface);
 
 bool checkDeviceExtensionSupport(const VkPhysicalDevice device);
 
+bool isDeviceExtensionSupported(const VkPhysicalDevice device, const char *extensionName);
+
 SwapChainSupportDetails querySwapChainSupport(const VkPhysicalDevice &device,
                                               const VkSurfaceKHR      surface);
 VkSurfaceFormatKHR      chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &availableFormats);
 
-VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes);
+VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes, PresentPolicy policy);
+
+const char *presentModeName(VkPresentModeKHR presentMode);
+
+uint32_t chooseSwapImageCount(const VkSurfaceCapabilitiesKHR &surfaceCapabilities, uint32_t requestedCount);
 
 VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR &surfaceCapabilities, GLFWwindow *window);
 
-std::vector<char> readFile(const std::string &filename);
+// SPIR-V words read in place, from the mounted asset pack or a mapping of
+// the file. Both start at least word aligned, so the code is never copied
+// and is valid as long as the binary lives.
+struct SpirvBinary
+{
+	MappedFile      file;    // closed when the code is in the asset pack
+	const uint32_t *code = nullptr;
+	size_t          size = 0;    // in bytes
+};
+
+SpirvBinary loadSpirv(const std::string &filename);
 
-VkShaderModule createShaderModule(const VkDevice &device, const std::vector<char> &code);
+VkShaderModule createShaderModule(const VkDevice &device, const SpirvBinary &binary);
 
 uint32_t findMemoryType(const VkPhysicalDevice physicalDevice,
                         uint32_t typeFilter,
@@ -165,21 +246,41 @@ void createImage(int32_t textureWidth,
                  VkFormat format,
                  VkImageTiling tiling,
                  VkImageUsageFlags usage,
-                 VkMemoryPropertyFlags properties);
+                 VkMemoryPropertyFlags properties,
+                 VkImageCreateFlags flags = 0);
 
 VkCommandBuffer beginSingleTimeCommands(const VkCommandPool &commandPool, const VkDevice &device);
 void            endSingleTimeCommands(const VkDevice &device, const VkCommandPool &commandPool, const VkCommandBuffer &commandBuffer, const VkQueue &graphicsQueue);
 
-void transitionImageLayout(const VkDevice &device, const VkCommandPool &commandPool, const VkQueue &graphicsQueue, const VkImageLayout &oldLayout, const VkImageLayout &newLayout, VkImage &image, VkFormat format, uint32_t mipLevels);
+bool hasStencilComponent(VkFormat format);
+bool isDepthFormat(VkFormat format);
+
+void transitionImageLayout(const VkDevice &device, const VkCommandPool &commandPool, const VkQueue &graphicsQueue, const VkImageLayout &oldLayout, const VkImageLayout &newLayout, VkImage image, VkFormat format, uint32_t mipLevels);
+void recordTransitionImageLayout(VkCommandBuffer commandBuffer, VkImageLayout oldLayout, VkImageLayout newLayout, VkImage image, VkFormat format, uint32_t mipLevels);
 
 void copyBufferToImage(const VkDevice &device, const VkCommandPool &commandPool, const VkQueue &graphicsQueue, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+void copyBufferToImage(const VkDevice &device, const VkCommandPool &commandPool, const VkQueue &graphicsQueue, VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy> &regions);
 
 VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags flags, uint32_t mipLevels);
 
+VkImageMemoryBarrier2 imageBarrier2(VkImage image, VkImageAspectFlags aspectMask, VkImageLayout oldLayout, VkImageLayout newLayout,
+                                    VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+                                    VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess);
+
 VkFormat findSuitableFormat(const VkPhysicalDevice &physicalDevice, const std::vector<VkFormat> &candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
+bool supportsLinearBlit(VkPhysicalDevice physicalDevice, VkFormat format);
+bool isSampledFormatSupported(VkPhysicalDevice physicalDevice, VkFormat format);
+bool isHostCopyDstLayout(VkPhysicalDevice physicalDevice, VkImageLayout layout);
+
 void generateMipmaps(VkImage image, VkFormat format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels, VkCommandPool commandPool, VkDevice device, VkQueue graphicsQueue, VkPhysicalDevice physicalDevice);
+void recordBlitMipmaps(VkCommandBuffer commandBuffer, VkImage image, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 
 VkSampleCountFlagBits getMaxUsableSampleCount(VkPhysicalDevice physicalDevice);
 
+// Left, right, bottom, top, near and far planes of a view projection
+// matrix, normalized and facing inwards. The near plane allows the whole
+// -w..w depth range, so it holds for either depth convention.
+std::array<glm::vec4, 6> frustumPlanes(const glm::mat4 &viewProjection);
+
 #endif
@@ -1,17 +1,156 @@
 #include "VulkanApp.hpp"
 
-int main()
+#include <cstring>
+#include <string>
+
+static PresentPolicy parsePresentPolicy(const std::string &name)
+{
+	if (name == "fifo")
+	{
+		return PresentPolicy::Fifo;
+	}
+	if (name == "fifo_relaxed")
+	{
+		return PresentPolicy::FifoRelaxed;
+	}
+	if (name == "mailbox")
+	{
+		return PresentPolicy::Mailbox;
+	}
+	if (name == "immediate")
+	{
+		return PresentPolicy::Immediate;
+	}
+	throw std::runtime_error("Unknown present mode \"" + name + "\"");
+}
+
+static void parseArguments(VulkanApp &app, int argc, char **argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg.rfind("--present-mode=", 0) == 0)
+		{
+			app.presentPolicy = parsePresentPolicy(arg.substr(strlen("--present-mode=")));
+		}
+		else if (arg.rfind("--swapchain-images=", 0) == 0)
+		{
+			app.swapChainImageCount = static_cast<uint32_t>(std::stoul(arg.substr(strlen("--swapchain-images="))));
+		}
+		else if (arg == "--latency")
+		{
+			app.reportLatency = true;
+		}
+		else if (arg == "--on-demand")
+		{
+			app.onDemandRendering = true;
+		}
+		else if (arg == "--paused")
+		{
+			app.animationPaused = true;
+		}
+		else if (arg == "--dynamic-rendering")
+		{
+			app.useDynamicRendering = true;
+		}
+		else if (arg.rfind("--benchmark=", 0) == 0)
+		{
+			app.benchmark = arg.substr(strlen("--benchmark="));
+		}
+		else if (arg == "--no-host-copy")
+		{
+			app.disableHostImageCopy = true;
+		}
+		else if (arg == "--bindless")
+		{
+			app.useBindless = true;
+		}
+		else if (arg.rfind("--instances=", 0) == 0)
+		{
+			app.instanceCount = static_cast<uint32_t>(std::stoul(arg.substr(strlen("--instances="))));
+		}
+		else if (arg == "--gpu-culling")
+		{
+			app.useGpuCulling = true;
+		}
+		else if (arg == "--occlusion-culling")
+		{
+			app.useOcclusionCulling = true;
+		}
+		else if (arg == "--cpu-culling")
+		{
+			app.useCpuCulling = true;
+		}
+		else if (arg == "--depth-prepass")
+		{
+			app.useDepthPrepass = true;
+		}
+		else if (arg == "--animate-instances")
+		{
+			app.animateInstances = true;
+		}
+		else if (arg == "--draw-stats")
+		{
+			app.reportDrawStats = true;
+		}
+		else if (arg.rfind("--model=", 0) == 0)
+		{
+			app.modelPath = arg.substr(strlen("--model="));
+		}
+		else if (arg == "--mesh-cache")
+		{
+			app.useMeshCache = true;
+		}
+		else if (arg == "--asset-pack")
+		{
+			app.assetPackPath = "assets.pack";
+		}
+		else if (arg.rfind("--asset-pack=", 0) == 0)
+		{
+			app.assetPackPath = arg.substr(strlen("--asset-pack="));
+		}
+		else if (arg == "--watch-shaders")
+		{
+			app.watchShaders = true;
+		}
+		else if (arg == "--stream-textures")
+		{
+			app.streamTextures = true;
+		}
+		else if (arg == "--stream-stats")
+		{
+			app.streamTextures       = true;
+			app.reportStreamingStats = true;
+		}
+		else if (arg.rfind("--texture-budget=", 0) == 0)
+		{
+			app.streamTextures = true;
+			app.textureBudget  = static_cast<VkDeviceSize>(std::stoull(arg.substr(strlen("--texture-budget=")))) << 20;
+		}
+		else if (arg == "--dump-graph")
+		{
+			app.dumpRenderGraph = true;
+		}
+		else
+		{
+			throw std::runtime_error("Unknown argument \"" + arg + "\"");
+		}
+	}
+}
+
+int main(int argc, char **argv)
 {
 	VulkanApp app;
 
 	try
 	{
-        app.run();
-    }
-    catch (const std::exception &e)
-    {
-        std::cout << e.what() << std::endl;
-        return EXIT_FAILURE;
-    }
-    return EXIT_SUCCESS;
+		parseArguments(app, argc, argv);
+		app.run();
+	}
+	catch (const std::exception &e)
+	{
+		std::cout << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
 }
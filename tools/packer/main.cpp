@@ -0,0 +1,84 @@
+#include "AssetPack.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static void printUsage()
+{
+	std::cout << "Usage: packer <output.pack> <prefix>=<directory>...\n";
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+	std::string output = argv[1];
+
+	try
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		// Every file below a directory is packed under the prefix, so
+		// "shaders=build/shaders" makes build/shaders/a.spv "shaders/a.spv".
+		// Later directories win when two provide the same name.
+		std::vector<AssetPack::Input> inputs;
+		for (int i = 2; i < argc; ++i)
+		{
+			std::string arg       = argv[i];
+			size_t      separator = arg.find('=');
+			if (separator == std::string::npos)
+			{
+				printUsage();
+				return EXIT_FAILURE;
+			}
+			std::string           prefix = arg.substr(0, separator);
+			std::filesystem::path root   = arg.substr(separator + 1);
+			for (const auto &file : std::filesystem::recursive_directory_iterator(root))
+			{
+				if (!file.is_regular_file())
+				{
+					continue;
+				}
+				std::string name = prefix + "/" + file.path().lexically_relative(root).generic_string();
+				auto        same = std::find_if(inputs.begin(), inputs.end(), [&name](const AssetPack::Input &input) { return input.name == name; });
+				if (same != inputs.end())
+				{
+					same->path = file.path().string();
+				}
+				else
+				{
+					inputs.push_back({name, file.path().string()});
+				}
+			}
+		}
+
+		ThreadPool pool;
+		pool.create();
+		AssetPack::write(output, inputs, pool);
+
+		// Read back, which also checks the pack.
+		AssetPack pack;
+		pack.open(output, pool);
+		pool.destroy();
+		AssetPack::Stats stats   = pack.stats();
+		double           seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << output << ": " << stats.entries << " files, " << stats.compressed << " compressed, " << stats.bytes / 1024
+		          << " KiB packed into " << stats.fileBytes / 1024 << " KiB in " << seconds << " s" << std::endl;
+	}
+	catch (const std::exception &e)
+	{
+		std::cout << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,487 @@
+#include "BcEncoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BC_USE_SSE2
+#endif
+
+namespace
+{
+// Block texels split by channel so four texels fit one SSE register.
+struct Block
+{
+	alignas(16) float channels[4][16];
+};
+
+struct Endpoints
+{
+	float a[4];
+	float b[4];
+};
+
+void loadBlock(const uint8_t *texels, Block &block)
+{
+	for (int i = 0; i < 16; ++i)
+	{
+		for (int c = 0; c < 4; ++c)
+		{
+			block.channels[c][i] = texels[i * 4 + c];
+		}
+	}
+}
+
+// Nearest palette entry for every texel, returns the summed squared error.
+float findIndices(const Block &block, const float (*palette)[4], int paletteSize, int channelCount, uint8_t *indices)
+{
+#ifdef BC_USE_SSE2
+	__m128 total = _mm_setzero_ps();
+	for (int group = 0; group < 16; group += 4)
+	{
+		__m128 texel[4];
+		for (int c = 0; c < channelCount; ++c)
+		{
+			texel[c] = _mm_load_ps(&block.channels[c][group]);
+		}
+		__m128 best      = _mm_set1_ps(std::numeric_limits<float>::max());
+		__m128 bestIndex = _mm_setzero_ps();
+		for (int k = 0; k < paletteSize; ++k)
+		{
+			__m128 distance = _mm_setzero_ps();
+			for (int c = 0; c < channelCount; ++c)
+			{
+				__m128 delta = _mm_sub_ps(texel[c], _mm_set1_ps(palette[k][c]));
+				distance     = _mm_add_ps(distance, _mm_mul_ps(delta, delta));
+			}
+			__m128 closer = _mm_cmplt_ps(distance, best);
+			best          = _mm_min_ps(distance, best);
+			bestIndex     = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps(static_cast<float>(k))), _mm_andnot_ps(closer, bestIndex));
+		}
+		total = _mm_add_ps(total, best);
+
+		alignas(16) int32_t packed[4];
+		_mm_store_si128(reinterpret_cast<__m128i *>(packed), _mm_cvttps_epi32(bestIndex));
+		for (int i = 0; i < 4; ++i)
+		{
+			indices[group + i] = static_cast<uint8_t>(packed[i]);
+		}
+	}
+	alignas(16) float sums[4];
+	_mm_store_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+	float total = 0.0f;
+	for (int i = 0; i < 16; ++i)
+	{
+		float best = std::numeric_limits<float>::max();
+		for (int k = 0; k < paletteSize; ++k)
+		{
+			float distance = 0.0f;
+			for (int c = 0; c < channelCount; ++c)
+			{
+				float delta = block.channels[c][i] - palette[k][c];
+				distance += delta * delta;
+			}
+			if (distance < best)
+			{
+				best       = distance;
+				indices[i] = static_cast<uint8_t>(k);
+			}
+		}
+		total += best;
+	}
+	return total;
+#endif
+}
+
+// Endpoints at the extremes of the block's principal axis.
+Endpoints principalEndpoints(const Block &block, int channelCount)
+{
+	float mean[4] = {};
+	for (int c = 0; c < channelCount; ++c)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			mean[c] += block.channels[c][i];
+		}
+		mean[c] /= 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; ++i)
+	{
+		for (int x = 0; x < channelCount; ++x)
+		{
+			for (int y = 0; y < channelCount; ++y)
+			{
+				covariance[x][y] += (block.channels[x][i] - mean[x]) * (block.channels[y][i] - mean[y]);
+			}
+		}
+	}
+
+	float axis[4] = {1.0f, 1.0f, 1.0f, channelCount == 4 ? 1.0f : 0.0f};
+	for (int iteration = 0; iteration < 8; ++iteration)
+	{
+		float next[4] = {};
+		float length  = 0.0f;
+		for (int x = 0; x < channelCount; ++x)
+		{
+			for (int y = 0; y < channelCount; ++y)
+			{
+				next[x] += covariance[x][y] * axis[y];
+			}
+			length = std::max(length, std::fabs(next[x]));
+		}
+		if (length < 1e-6f)
+		{
+			break;
+		}
+		for (int c = 0; c < channelCount; ++c)
+		{
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float minProjection = std::numeric_limits<float>::max();
+	float maxProjection = -std::numeric_limits<float>::max();
+	float lengthSquared = 0.0f;
+	for (int c = 0; c < channelCount; ++c)
+	{
+		lengthSquared += axis[c] * axis[c];
+	}
+	for (int i = 0; i < 16; ++i)
+	{
+		float projection = 0.0f;
+		for (int c = 0; c < channelCount; ++c)
+		{
+			projection += (block.channels[c][i] - mean[c]) * axis[c];
+		}
+		minProjection = std::min(minProjection, projection);
+		maxProjection = std::max(maxProjection, projection);
+	}
+
+	Endpoints endpoints{};
+	for (int c = 0; c < 4; ++c)
+	{
+		float direction = lengthSquared > 0.0f && c < channelCount ? axis[c] / lengthSquared : 0.0f;
+		endpoints.a[c]  = std::clamp(mean[c] + minProjection * direction, 0.0f, 255.0f);
+		endpoints.b[c]  = std::clamp(mean[c] + maxProjection * direction, 0.0f, 255.0f);
+	}
+	if (channelCount < 4)
+	{
+		endpoints.a[3] = endpoints.b[3] = 255.0f;
+	}
+	return endpoints;
+}
+
+// Least squares endpoints for fixed interpolation weights per texel.
+bool refineEndpoints(const Block &block, const uint8_t *indices, const float *weights, int channelCount, Endpoints &endpoints)
+{
+	float alpha2 = 0.0f, beta2 = 0.0f, alphaBeta = 0.0f;
+	float alphaX[4] = {}, betaX[4] = {};
+	for (int i = 0; i < 16; ++i)
+	{
+		float beta  = weights[indices[i]];
+		float alpha = 1.0f - beta;
+		alpha2 += alpha * alpha;
+		beta2 += beta * beta;
+		alphaBeta += alpha * beta;
+		for (int c = 0; c < channelCount; ++c)
+		{
+			alphaX[c] += alpha * block.channels[c][i];
+			betaX[c] += beta * block.channels[c][i];
+		}
+	}
+	float determinant = alpha2 * beta2 - alphaBeta * alphaBeta;
+	if (std::fabs(determinant) < 1e-6f)
+	{
+		return false;
+	}
+	for (int c = 0; c < channelCount; ++c)
+	{
+		endpoints.a[c] = std::clamp((alphaX[c] * beta2 - betaX[c] * alphaBeta) / determinant, 0.0f, 255.0f);
+		endpoints.b[c] = std::clamp((betaX[c] * alpha2 - alphaX[c] * alphaBeta) / determinant, 0.0f, 255.0f);
+	}
+	return true;
+}
+
+// BC1
+
+uint16_t packRGB565(const float *color)
+{
+	uint32_t r = static_cast<uint32_t>(std::lround(color[0] * 31.0f / 255.0f));
+	uint32_t g = static_cast<uint32_t>(std::lround(color[1] * 63.0f / 255.0f));
+	uint32_t b = static_cast<uint32_t>(std::lround(color[2] * 31.0f / 255.0f));
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t packed, float *color)
+{
+	uint32_t r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0]   = static_cast<float>((r << 3) | (r >> 2));
+	color[1]   = static_cast<float>((g << 2) | (g >> 4));
+	color[2]   = static_cast<float>((b << 3) | (b >> 2));
+	color[3]   = 255.0f;
+}
+
+struct BC1Candidate
+{
+	uint16_t color0, color1;
+	uint8_t  indices[16];
+	float    error;
+};
+
+BC1Candidate evaluateBC1(const Block &block, const Endpoints &endpoints)
+{
+	BC1Candidate candidate{};
+	candidate.color0 = packRGB565(endpoints.b);
+	candidate.color1 = packRGB565(endpoints.a);
+	if (candidate.color0 < candidate.color1)
+	{
+		std::swap(candidate.color0, candidate.color1);
+	}
+
+	float palette[4][4];
+	unpackRGB565(candidate.color0, palette[0]);
+	unpackRGB565(candidate.color1, palette[1]);
+	for (int c = 0; c < 4; ++c)
+	{
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+	// Equal endpoints select the three color mode, only index 0 is safe.
+	int paletteSize = candidate.color0 == candidate.color1 ? 1 : 4;
+	candidate.error = findIndices(block, palette, paletteSize, 3, candidate.indices);
+	return candidate;
+}
+
+// BC7 mode 6
+
+const float BC7_WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+struct BC7Endpoint
+{
+	uint8_t  value[4];    // 7 bit
+	uint32_t pBit;
+};
+
+BC7Endpoint quantizeBC7(const float *color)
+{
+	BC7Endpoint best{};
+	float       bestError = std::numeric_limits<float>::max();
+	for (uint32_t p = 0; p < 2; ++p)
+	{
+		BC7Endpoint endpoint{};
+		endpoint.pBit = p;
+		float error   = 0.0f;
+		for (int c = 0; c < 4; ++c)
+		{
+			int   q           = std::clamp(static_cast<int>(std::lround((color[c] - p) / 2.0f)), 0, 127);
+			float delta       = static_cast<float>((q << 1) | p) - color[c];
+			endpoint.value[c] = static_cast<uint8_t>(q);
+			error += delta * delta;
+		}
+		if (error < bestError)
+		{
+			bestError = error;
+			best      = endpoint;
+		}
+	}
+	return best;
+}
+
+struct BC7Candidate
+{
+	BC7Endpoint endpoint0, endpoint1;
+	uint8_t     indices[16];
+	float       error;
+};
+
+BC7Candidate evaluateBC7(const Block &block, const Endpoints &endpoints)
+{
+	BC7Candidate candidate{};
+	candidate.endpoint0 = quantizeBC7(endpoints.a);
+	candidate.endpoint1 = quantizeBC7(endpoints.b);
+
+	float palette[16][4];
+	for (int k = 0; k < 16; ++k)
+	{
+		int weight = static_cast<int>(BC7_WEIGHTS[k]);
+		for (int c = 0; c < 4; ++c)
+		{
+			int e0        = (candidate.endpoint0.value[c] << 1) | candidate.endpoint0.pBit;
+			int e1        = (candidate.endpoint1.value[c] << 1) | candidate.endpoint1.pBit;
+			palette[k][c] = static_cast<float>(((64 - weight) * e0 + weight * e1 + 32) >> 6);
+		}
+	}
+	candidate.error = findIndices(block, palette, 16, 4, candidate.indices);
+	return candidate;
+}
+
+struct BitWriter
+{
+	uint8_t *bytes;
+	uint32_t position = 0;
+
+	void write(uint32_t value, uint32_t bitCount)
+	{
+		for (uint32_t i = 0; i < bitCount; ++i, ++position)
+		{
+			bytes[position >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (position & 7));
+		}
+	}
+};
+}    // namespace
+
+uint32_t bcBlockSize(BcFormat format)
+{
+	return format == BcFormat::BC1 ? 8 : 16;
+}
+
+void encodeBC1Block(const uint8_t *texels, uint8_t *block)
+{
+	Block source;
+	loadBlock(texels, source);
+
+	Endpoints    endpoints = principalEndpoints(source, 3);
+	BC1Candidate best      = evaluateBC1(source, endpoints);
+
+	// Index order is color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1.
+	const float weights[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+	for (int iteration = 0; iteration < 2 && best.error > 0.0f; ++iteration)
+	{
+		Endpoints refined{};
+		unpackRGB565(best.color0, refined.a);
+		unpackRGB565(best.color1, refined.b);
+		if (!refineEndpoints(source, best.indices, weights, 3, refined))
+		{
+			break;
+		}
+		BC1Candidate candidate = evaluateBC1(source, refined);
+		if (candidate.error >= best.error)
+		{
+			break;
+		}
+		best = candidate;
+	}
+
+	uint32_t indexBits = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		indexBits |= static_cast<uint32_t>(best.indices[i]) << (2 * i);
+	}
+	block[0] = static_cast<uint8_t>(best.color0);
+	block[1] = static_cast<uint8_t>(best.color0 >> 8);
+	block[2] = static_cast<uint8_t>(best.color1);
+	block[3] = static_cast<uint8_t>(best.color1 >> 8);
+	memcpy(block + 4, &indexBits, sizeof(indexBits));
+}
+
+void encodeBC7Block(const uint8_t *texels, uint8_t *block)
+{
+	Block source;
+	loadBlock(texels, source);
+
+	Endpoints    endpoints = principalEndpoints(source, 4);
+	BC7Candidate best      = evaluateBC7(source, endpoints);
+
+	float weights[16];
+	for (int k = 0; k < 16; ++k)
+	{
+		weights[k] = BC7_WEIGHTS[k] / 64.0f;
+	}
+	for (int iteration = 0; iteration < 2 && best.error > 0.0f; ++iteration)
+	{
+		Endpoints refined{};
+		if (!refineEndpoints(source, best.indices, weights, 4, refined))
+		{
+			break;
+		}
+		BC7Candidate candidate = evaluateBC7(source, refined);
+		if (candidate.error >= best.error)
+		{
+			break;
+		}
+		best = candidate;
+	}
+
+	// The anchor texel stores only three index bits, so its MSB must be 0.
+	if (best.indices[0] & 8)
+	{
+		std::swap(best.endpoint0, best.endpoint1);
+		for (auto &index : best.indices)
+		{
+			index = static_cast<uint8_t>(15 - index);
+		}
+	}
+
+	memset(block, 0, 16);
+	BitWriter writer{block};
+	writer.write(1 << 6, 7);
+	for (int c = 0; c < 4; ++c)
+	{
+		writer.write(best.endpoint0.value[c], 7);
+		writer.write(best.endpoint1.value[c], 7);
+	}
+	writer.write(best.endpoint0.pBit, 1);
+	writer.write(best.endpoint1.pBit, 1);
+	writer.write(best.indices[0], 3);
+	for (int i = 1; i < 16; ++i)
+	{
+		writer.write(best.indices[i], 4);
+	}
+}
+
+std::vector<uint8_t> encodeImage(const uint8_t *pixels, uint32_t width, uint32_t height, BcFormat format, unsigned threadCount)
+{
+	uint32_t             blocksX   = (width + 3) / 4;
+	uint32_t             blocksY   = (height + 3) / 4;
+	uint32_t             blockSize = bcBlockSize(format);
+	std::vector<uint8_t> encoded(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+	auto encodeRows = [&](uint32_t firstRow, uint32_t rowStep) {
+		uint8_t texels[16 * 4];
+		for (uint32_t by = firstRow; by < blocksY; by += rowStep)
+		{
+			for (uint32_t bx = 0; bx < blocksX; ++bx)
+			{
+				for (uint32_t y = 0; y < 4; ++y)
+				{
+					for (uint32_t x = 0; x < 4; ++x)
+					{
+						uint32_t px = std::min(bx * 4 + x, width - 1);
+						uint32_t py = std::min(by * 4 + y, height - 1);
+						memcpy(&texels[(y * 4 + x) * 4], &pixels[(static_cast<size_t>(py) * width + px) * 4], 4);
+					}
+				}
+				uint8_t *block = &encoded[(static_cast<size_t>(by) * blocksX + bx) * blockSize];
+				if (format == BcFormat::BC1)
+				{
+					encodeBC1Block(texels, block);
+				}
+				else
+				{
+					encodeBC7Block(texels, block);
+				}
+			}
+		}
+	};
+
+	threadCount = std::max(1u, std::min(threadCount, blocksY));
+	std::vector<std::thread> workers;
+	for (unsigned i = 1; i < threadCount; ++i)
+	{
+		workers.emplace_back(encodeRows, i, threadCount);
+	}
+	encodeRows(0, threadCount);
+	for (auto &worker : workers)
+	{
+		worker.join();
+	}
+	return encoded;
+}
@@ -0,0 +1,25 @@
+#ifndef BCENCODER_H
+#define BCENCODER_H
+
+#include <cstdint>
+#include <vector>
+
+enum class BcFormat
+{
+	BC1,
+	BC7
+};
+
+// Block sizes in bytes for a 4x4 texel block.
+uint32_t bcBlockSize(BcFormat format);
+
+// Encodes 16 RGBA8 texels in row-major order. BC1 ignores alpha, BC7 uses
+// mode 6 (one subset, RGBA endpoints with p-bits and 4-bit indices).
+void encodeBC1Block(const uint8_t *texels, uint8_t *block);
+void encodeBC7Block(const uint8_t *texels, uint8_t *block);
+
+// Encodes a whole RGBA8 image, clamping edge blocks, across the given
+// number of threads.
+std::vector<uint8_t> encodeImage(const uint8_t *pixels, uint32_t width, uint32_t height, BcFormat format, unsigned threadCount);
+
+#endif
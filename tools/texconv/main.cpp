@@ -0,0 +1,120 @@
+#include "BcEncoder.hpp"
+#include "Downsample.hpp"
+#include "Ktx2.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+static void printUsage()
+{
+	std::cout << "Usage: texconv [--format=bc7|bc1] [--linear] <input.png> <output.ktx2>\n";
+}
+
+int main(int argc, char **argv)
+{
+	BcFormat    format = BcFormat::BC7;
+	bool        srgb   = true;
+	std::string input, output;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--format=bc7")
+		{
+			format = BcFormat::BC7;
+		}
+		else if (arg == "--format=bc1")
+		{
+			format = BcFormat::BC1;
+		}
+		else if (arg == "--linear")
+		{
+			srgb = false;
+		}
+		else if (input.empty())
+		{
+			input = arg;
+		}
+		else if (output.empty())
+		{
+			output = arg;
+		}
+		else
+		{
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (input.empty() || output.empty())
+	{
+		printUsage();
+		return EXIT_FAILURE;
+	}
+
+	try
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		int      width, height, channels;
+		stbi_uc *decoded = stbi_load(input.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		if (decoded == nullptr)
+		{
+			throw std::runtime_error("Couldn't load \"" + input + "\"");
+		}
+		std::vector<uint8_t> pixels(decoded, decoded + static_cast<size_t>(width) * height * 4);
+		stbi_image_free(decoded);
+
+		unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		std::vector<std::vector<uint8_t>> levels;
+		uint32_t                          levelWidth  = static_cast<uint32_t>(width);
+		uint32_t                          levelHeight = static_cast<uint32_t>(height);
+		size_t                            rawSize     = 0;
+		size_t                            encodedSize = 0;
+		while (true)
+		{
+			levels.push_back(encodeImage(pixels.data(), levelWidth, levelHeight, format, threadCount));
+			rawSize += pixels.size();
+			encodedSize += levels.back().size();
+			if (levelWidth == 1 && levelHeight == 1)
+			{
+				break;
+			}
+			pixels      = downsampleRgba8(pixels.data(), levelWidth, levelHeight, srgb);
+			levelWidth  = std::max(levelWidth / 2, 1u);
+			levelHeight = std::max(levelHeight / 2, 1u);
+		}
+
+		VkFormat vkFormat;
+		if (format == BcFormat::BC7)
+		{
+			vkFormat = srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+		}
+		else
+		{
+			vkFormat = srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+		}
+		writeKtx2(output, vkFormat, static_cast<uint32_t>(width), static_cast<uint32_t>(height), levels);
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cout << input << " -> " << output << ": " << width << "x" << height << ", " << levels.size() << " levels, "
+		          << ktx2FormatName(vkFormat) << " " << encodedSize / 1024 << " KiB (RGBA8 " << rawSize / 1024 << " KiB) in "
+		          << seconds << " s" << std::endl;
+	}
+	catch (const std::exception &e)
+	{
+		std::cout << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}